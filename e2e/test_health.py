@@ -7,6 +7,11 @@ KNOWN_MODES = {
     "FloorList", "RoomList", "RoomControls", "Standby", "SettingsMenu", "WifiSettings", "WifiPassword",
 }
 
+RX_RING_LEN = 128 * 1024  # HASS_RX_RING_LEN
+# One slow message stalls the websocket task once the ring fills, and it gives
+# up after HASS_RX_RING_FULL_WAIT_MS (3 s); stay well clear of that
+RX_DISPATCH_MAX_MS = 1000
+
 
 def test_health(device):
     health = device.health()
@@ -14,6 +19,10 @@ def test_health(device):
     assert health["heap_free"] > 0
     assert health["psram_free"] > 0
     assert health["wifi"] == "up"
+    assert health["rx_messages"] > 0
+    assert health["rx_ring_peak"] <= RX_RING_LEN
+    assert health["rx_ring_overflows"] == 0
+    assert health["rx_dispatch_max_ms"] < RX_DISPATCH_MAX_MS
 
 
 def test_state_parses(device):
@@ -24,6 +24,8 @@ def test_tap_light_toggles_ha(at_home, ha, cfg, light_restored):
     state = goto_room(at_home, cfg)
     widget = find_widget(state, cfg.light_entity)
     assert widget is not None, f"{cfg.light_entity} not found in widgets"
+    # With scoped subscriptions the room's states arrive once it is opened
+    at_home.wait_for(lambda s: (find_widget(s, cfg.light_entity) or {}).get("value", 1) == 0)
 
     before = at_home.screenshot()
 
@@ -56,3 +58,12 @@ def test_ha_change_reflected_on_device(at_home, ha, cfg, light_restored):
     ha.turn_on(cfg.light_entity)
     # HASS_IGNORE_UPDATE_DELAY_MS plus websocket latency
     at_home.wait_for(lambda s: (find_widget(s, cfg.light_entity) or {}).get("value", 0) > 0, timeout=15)
+
+
+def test_change_while_away_shown_on_open(at_home, ha, cfg, light_restored):
+    # The room is not subscribed while off screen; opening it must catch up
+    ha.turn_on(cfg.light_entity)
+    ha.wait_for_state(cfg.light_entity, "on")
+
+    goto_room(at_home, cfg)
+    at_home.wait_for(lambda s: (find_widget(s, cfg.light_entity) or {}).get("value", 0) > 0, timeout=15)
@@ -7,6 +7,7 @@
 #include <stdio.h>
 
 #include "esp_websocket_client.h"
+#include "esp_websocket_tls.h"
 #include "esp_transport.h"
 #include "esp_transport_tcp.h"
 #include "esp_transport_ssl.h"
@@ -160,6 +161,7 @@ struct esp_websocket_client {
     int                         close_status_code;  /*!< Status code from the last received CLOSE frame (0 = none / client-initiated) */
     esp_transport_keep_alive_t  keep_alive_cfg;
     struct ifreq                *if_name;
+    esp_websocket_tls_session_t tls_session;            /*!< data is NULL unless resumption is enabled and usable */
 };
 
 static uint64_t _tick_get_ms(void)
@@ -503,6 +505,8 @@ static void destroy_and_free_resources(esp_websocket_client_handle_t client)
         free(client->if_name);
         client->if_name = NULL;
     }
+    free(client->tls_session.data);
+    client->tls_session.data = NULL;
     esp_websocket_client_destroy_config(client);
     if (client->transport_list) {
         esp_transport_list_destroy(client->transport_list);
@@ -617,6 +621,23 @@ static esp_err_t esp_websocket_client_create_transport(esp_websocket_client_hand
         esp_transport_set_default_port(ws, WEBSOCKET_TCP_DEFAULT_PORT);
         esp_transport_list_add(client->transport_list, ws, WS_OVER_TCP_SCHEME);
         ESP_WS_CLIENT_ERR_OK_CHECK(TAG, set_websocket_transport_optional_settings(client, WS_OVER_TCP_SCHEME), return ESP_FAIL;)
+    } else if (strcasecmp(client->config->scheme, WS_OVER_TLS_SCHEME) == 0 && client->tls_session.data) {
+        esp_transport_handle_t ssl = esp_websocket_tls_init(&client->tls_session, client->config->cert, client->config->cert_len);
+        ESP_WS_CLIENT_MEM_CHECK(TAG, ssl, return ESP_ERR_NO_MEM);
+
+        esp_transport_set_default_port(ssl, WEBSOCKET_SSL_DEFAULT_PORT);
+        esp_transport_list_add(client->transport_list, ssl, "_ssl"); // need to save to transport list, for cleanup
+        if (client->keep_alive_cfg.keep_alive_enable || client->if_name) {
+            ESP_LOGW(TAG, "Keep-alive and interface options are not applied with TLS session resumption");
+        }
+
+        esp_transport_handle_t wss = esp_transport_ws_init(ssl);
+        ESP_WS_CLIENT_MEM_CHECK(TAG, wss, return ESP_ERR_NO_MEM);
+
+        esp_transport_set_default_port(wss, WEBSOCKET_SSL_DEFAULT_PORT);
+
+        esp_transport_list_add(client->transport_list, wss, WS_OVER_TLS_SCHEME);
+        ESP_WS_CLIENT_ERR_OK_CHECK(TAG, set_websocket_transport_optional_settings(client, WS_OVER_TLS_SCHEME), return ESP_FAIL;)
     } else if (strcasecmp(client->config->scheme, WS_OVER_TLS_SCHEME) == 0) {
         esp_transport_handle_t ssl = esp_transport_ssl_init();
         ESP_WS_CLIENT_MEM_CHECK(TAG, ssl, return ESP_ERR_NO_MEM);
@@ -875,6 +896,16 @@ esp_websocket_client_handle_t esp_websocket_client_init(const esp_websocket_clie
         goto _websocket_init_fail;
     }
 
+    if (config->enable_tls_session_resumption) {
+        if (config->cert_pem && !config->use_global_ca_store && !config->client_cert && !config->crt_bundle_attach &&
+                !config->skip_cert_common_name_check && !config->cert_common_name && !config->ext_transport) {
+            client->tls_session.data = malloc(ESP_WEBSOCKET_TLS_SESSION_MAX_LEN);
+            ESP_WS_CLIENT_MEM_CHECK(TAG, client->tls_session.data, goto _websocket_init_fail);
+        } else {
+            ESP_LOGW(TAG, "TLS session resumption needs a plain cert_pem setup, doing full handshakes");
+        }
+    }
+
     if (client->config->scheme == NULL) {
         if (asprintf(&client->config->scheme, WS_OVER_TCP_SCHEME) < 0) {
             client->config->scheme = NULL;
@@ -941,6 +972,41 @@ esp_err_t esp_websocket_client_destroy_on_exit(esp_websocket_client_handle_t cli
     return ESP_OK;
 }
 
+esp_err_t esp_websocket_client_set_tls_session(esp_websocket_client_handle_t client, const uint8_t *data, size_t len)
+{
+    if (client == NULL || (data == NULL && len > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (client->tls_session.data == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (len > ESP_WEBSOCKET_TLS_SESSION_MAX_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (len > 0) {
+        memcpy(client->tls_session.data, data, len);
+    }
+    client->tls_session.len = len;
+    client->tls_session.resumed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_websocket_client_get_tls_session(esp_websocket_client_handle_t client, uint8_t *out, size_t cap, size_t *len, bool *resumed)
+{
+    if (client == NULL || out == NULL || len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (client->tls_session.data == NULL || client->tls_session.len == 0 || client->tls_session.len > cap) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    memcpy(out, client->tls_session.data, client->tls_session.len);
+    *len = client->tls_session.len;
+    if (resumed) {
+        *resumed = client->tls_session.resumed;
+    }
+    return ESP_OK;
+}
+
 esp_err_t esp_websocket_client_set_uri(esp_websocket_client_handle_t client, const char *uri)
 {
     if (client == NULL || uri == NULL) {
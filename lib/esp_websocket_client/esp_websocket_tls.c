@@ -0,0 +1,410 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_websocket_client.h"
+#include "esp_websocket_tls.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/version.h"
+#include "mbedtls/x509_crt.h"
+
+/* TLS 1.3 hands out its ticket after the handshake; mbedTLS only passes it to
+ * the application (MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET) when asked to
+ * since 3.6.1, and always did before */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+#define WS_TLS13_TICKETS                1
+#else
+#define WS_TLS13_TICKETS                0
+#endif
+
+static const char *TAG = "websocket_tls";
+
+typedef struct {
+    esp_websocket_tls_session_t *session;
+    const char                  *cert;
+    size_t                      cert_len;
+    int                         sock;
+    bool                        ssl_ready;      /*!< The mbedTLS contexts below are initialised */
+    mbedtls_ssl_context         ssl;
+    mbedtls_ssl_config          conf;
+    mbedtls_ctr_drbg_context    ctr_drbg;
+    mbedtls_entropy_context     entropy;
+    mbedtls_x509_crt            ca;
+} transport_ws_tls_t;
+
+static struct timeval ws_tls_timeval(int timeout_ms)
+{
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+    return tv;
+}
+
+static int ws_tls_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    int sock = *(int *)ctx;
+    int ret = send(sock, buf, len, 0);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+    return ret;
+}
+
+static int ws_tls_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    int sock = *(int *)ctx;
+    int ret = recv(sock, buf, len, 0);
+    if (ret < 0) {
+        /* SO_RCVTIMEO expired */
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? MBEDTLS_ERR_SSL_TIMEOUT : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+    return ret;
+}
+
+static int ws_tls_open_socket(const char *host, int port, int timeout_ms)
+{
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(host, port_str, &hints, &res) != 0 || res == NULL) {
+        ESP_LOGE(TAG, "Cannot resolve %s", host);
+        return -1;
+    }
+
+    int sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sock >= 0) {
+        int flags = fcntl(sock, F_GETFL, 0);
+        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+        int ret = connect(sock, res->ai_addr, res->ai_addrlen);
+        if (ret < 0 && errno == EINPROGRESS) {
+            fd_set writable;
+            FD_ZERO(&writable);
+            FD_SET(sock, &writable);
+            struct timeval tv = ws_tls_timeval(timeout_ms);
+            int error = 0;
+            socklen_t error_len = sizeof(error);
+            if (select(sock + 1, NULL, &writable, NULL, &tv) == 1 &&
+                    getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &error_len) == 0 && error == 0) {
+                ret = 0;
+            }
+        }
+        fcntl(sock, F_SETFL, flags);
+        if (ret == 0) {
+            struct timeval tv = ws_tls_timeval(timeout_ms);
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        } else {
+            ESP_LOGE(TAG, "Cannot connect to %s:%d", host, port);
+            close(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return sock;
+}
+
+static void ws_tls_cleanup(transport_ws_tls_t *tls)
+{
+    if (tls->ssl_ready) {
+        mbedtls_ssl_free(&tls->ssl);
+        mbedtls_ssl_config_free(&tls->conf);
+        mbedtls_ctr_drbg_free(&tls->ctr_drbg);
+        mbedtls_entropy_free(&tls->entropy);
+        mbedtls_x509_crt_free(&tls->ca);
+        tls->ssl_ready = false;
+    }
+    if (tls->sock >= 0) {
+        close(tls->sock);
+        tls->sock = -1;
+    }
+}
+
+static int ws_tls_setup(transport_ws_tls_t *tls, const char *host)
+{
+    mbedtls_ssl_init(&tls->ssl);
+    mbedtls_ssl_config_init(&tls->conf);
+    mbedtls_ctr_drbg_init(&tls->ctr_drbg);
+    mbedtls_entropy_init(&tls->entropy);
+    mbedtls_x509_crt_init(&tls->ca);
+    tls->ssl_ready = true;
+
+    int ret = mbedtls_ctr_drbg_seed(&tls->ctr_drbg, mbedtls_entropy_func, &tls->entropy, NULL, 0);
+    if (ret != 0) {
+        return ret;
+    }
+    /* PEM input must include the terminating NUL */
+    size_t cert_len = tls->cert_len ? tls->cert_len : strlen(tls->cert) + 1;
+    ret = mbedtls_x509_crt_parse(&tls->ca, (const unsigned char *)tls->cert, cert_len);
+    if (ret != 0) {
+        return ret;
+    }
+    ret = mbedtls_ssl_config_defaults(&tls->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) {
+        return ret;
+    }
+    mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&tls->conf, &tls->ca, NULL);
+    mbedtls_ssl_conf_rng(&tls->conf, mbedtls_ctr_drbg_random, &tls->ctr_drbg);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&tls->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+#if WS_TLS13_TICKETS && MBEDTLS_VERSION_NUMBER >= 0x03060100
+    mbedtls_ssl_conf_tls13_enable_signal_new_session_tickets(&tls->conf, MBEDTLS_SSL_TLS1_3_SIGNAL_NEW_SESSION_TICKETS_ENABLED);
+#endif
+    ret = mbedtls_ssl_setup(&tls->ssl, &tls->conf);
+    if (ret != 0) {
+        return ret;
+    }
+    ret = mbedtls_ssl_set_hostname(&tls->ssl, host);
+    if (ret != 0) {
+        return ret;
+    }
+    mbedtls_ssl_set_bio(&tls->ssl, &tls->sock, ws_tls_send, ws_tls_recv, NULL);
+    return 0;
+}
+
+/* Returns the id of the offered session, so a resumption can be told apart */
+static size_t ws_tls_offer_session(transport_ws_tls_t *tls, unsigned char *id, size_t id_cap)
+{
+    esp_websocket_tls_session_t *session = tls->session;
+    if (session->len == 0) {
+        return 0;
+    }
+    size_t id_len = 0;
+    mbedtls_ssl_session saved;
+    mbedtls_ssl_session_init(&saved);
+    if (mbedtls_ssl_session_load(&saved, session->data, session->len) == 0 && mbedtls_ssl_set_session(&tls->ssl, &saved) == 0) {
+        id_len = mbedtls_ssl_session_get_id_len(&saved);
+        if (id_len > id_cap) {
+            id_len = 0;
+        }
+        memcpy(id, mbedtls_ssl_session_get_id(&saved), id_len);
+    } else {
+        ESP_LOGW(TAG, "Stored TLS session is unusable, doing a full handshake");
+        session->len = 0;
+    }
+    mbedtls_ssl_session_free(&saved);
+    return id_len;
+}
+
+static void ws_tls_keep_session(transport_ws_tls_t *tls, const unsigned char *offered_id, size_t offered_id_len)
+{
+    esp_websocket_tls_session_t *session = tls->session;
+    mbedtls_ssl_session negotiated;
+    mbedtls_ssl_session_init(&negotiated);
+    session->resumed = false;
+    if (mbedtls_ssl_get_session(&tls->ssl, &negotiated) == 0) {
+        /* A resuming TLS 1.2 server echoes the session id the client offered.
+         * TLS 1.3 echoes it either way and does not say, so it reads as not resumed. */
+        session->resumed = offered_id_len > 0 && mbedtls_ssl_get_version_number(&tls->ssl) == MBEDTLS_SSL_VERSION_TLS1_2 &&
+                           mbedtls_ssl_session_get_id_len(&negotiated) == offered_id_len &&
+                           memcmp(mbedtls_ssl_session_get_id(&negotiated), offered_id, offered_id_len) == 0;
+        size_t len = 0;
+        if (mbedtls_ssl_session_save(&negotiated, session->data, ESP_WEBSOCKET_TLS_SESSION_MAX_LEN, &len) == 0) {
+            session->len = len;
+        } else {
+            ESP_LOGW(TAG, "TLS session does not fit %d bytes, the next connect is a full handshake", ESP_WEBSOCKET_TLS_SESSION_MAX_LEN);
+            session->len = 0;
+        }
+    }
+    mbedtls_ssl_session_free(&negotiated);
+}
+
+static int ws_tls_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    transport_ws_tls_t *tls = esp_transport_get_context_data(t);
+    ws_tls_cleanup(tls);
+    int64_t started_us = esp_timer_get_time();
+
+    tls->sock = ws_tls_open_socket(host, port, timeout_ms);
+    if (tls->sock < 0) {
+        return -1;
+    }
+    int ret = ws_tls_setup(tls, host);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "TLS setup failed: -0x%04x", -ret);
+        ws_tls_cleanup(tls);
+        return -1;
+    }
+
+    unsigned char offered_id[32];
+    size_t offered_id_len = ws_tls_offer_session(tls, offered_id, sizeof(offered_id));
+    bool offered = tls->session->len > 0;
+    int64_t handshake_started_us = esp_timer_get_time();
+    while ((ret = mbedtls_ssl_handshake(&tls->ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            ESP_LOGE(TAG, "TLS handshake failed: -0x%04x", -ret);
+            if (offered) {
+                tls->session->len = 0; /* the next attempt starts clean */
+            }
+            ws_tls_cleanup(tls);
+            return -1;
+        }
+    }
+    /* TLS 1.3: the ticket to keep comes later, see ws_tls_read */
+    bool tls13 = mbedtls_ssl_get_version_number(&tls->ssl) == MBEDTLS_SSL_VERSION_TLS1_3;
+    if (tls13) {
+        tls->session->resumed = false;
+    } else {
+        ws_tls_keep_session(tls, offered_id, offered_id_len);
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "%s handshake %d ms (%s), connect %d ms", tls13 ? "TLS 1.3" : "TLS 1.2", (int)((now_us - handshake_started_us) / 1000),
+             tls->session->resumed ? "resumed" : (offered ? (tls13 ? "ticket offered" : "session refused") : "full"),
+             (int)((now_us - started_us) / 1000));
+    return 0;
+}
+
+static int ws_tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    transport_ws_tls_t *tls = esp_transport_get_context_data(t);
+    if (tls->sock < 0) {
+        return -1;
+    }
+    if (tls->ssl_ready && mbedtls_ssl_get_bytes_avail(&tls->ssl) > 0) {
+        return 1;
+    }
+    fd_set readable;
+    fd_set errors;
+    FD_ZERO(&readable);
+    FD_ZERO(&errors);
+    FD_SET(tls->sock, &readable);
+    FD_SET(tls->sock, &errors);
+    struct timeval tv = ws_tls_timeval(timeout_ms);
+    int ret = select(tls->sock + 1, &readable, NULL, &errors, timeout_ms < 0 ? NULL : &tv);
+    if (ret > 0 && FD_ISSET(tls->sock, &errors)) {
+        return -1;
+    }
+    return ret;
+}
+
+static int ws_tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    transport_ws_tls_t *tls = esp_transport_get_context_data(t);
+    if (tls->sock < 0) {
+        return -1;
+    }
+    fd_set writable;
+    fd_set errors;
+    FD_ZERO(&writable);
+    FD_ZERO(&errors);
+    FD_SET(tls->sock, &writable);
+    FD_SET(tls->sock, &errors);
+    struct timeval tv = ws_tls_timeval(timeout_ms);
+    int ret = select(tls->sock + 1, NULL, &writable, &errors, timeout_ms < 0 ? NULL : &tv);
+    if (ret > 0 && FD_ISSET(tls->sock, &errors)) {
+        return -1;
+    }
+    return ret;
+}
+
+static int ws_tls_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    transport_ws_tls_t *tls = esp_transport_get_context_data(t);
+    int poll = ws_tls_poll_read(t, timeout_ms);
+    if (poll == 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (poll < 0 || !tls->ssl_ready) {
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    int ret = mbedtls_ssl_read(&tls->ssl, (unsigned char *)buffer, len);
+#if WS_TLS13_TICKETS
+    while (ret == MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET) {
+        bool resumed = tls->session->resumed;
+        ws_tls_keep_session(tls, NULL, 0);
+        tls->session->resumed = resumed;
+        ret = mbedtls_ssl_read(&tls->ssl, (unsigned char *)buffer, len);
+    }
+#endif
+    if (ret > 0) {
+        return ret;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_TIMEOUT) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    ESP_LOGE(TAG, "TLS read failed: -0x%04x", -ret);
+    return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+}
+
+static int ws_tls_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    transport_ws_tls_t *tls = esp_transport_get_context_data(t);
+    int poll = ws_tls_poll_write(t, timeout_ms);
+    if (poll <= 0) {
+        return poll;
+    }
+    if (!tls->ssl_ready) {
+        return -1;
+    }
+    int ret = mbedtls_ssl_write(&tls->ssl, (const unsigned char *)buffer, len);
+    if (ret >= 0) {
+        return ret;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return 0;
+    }
+    ESP_LOGE(TAG, "TLS write failed: -0x%04x", -ret);
+    return -1;
+}
+
+static int ws_tls_close(esp_transport_handle_t t)
+{
+    transport_ws_tls_t *tls = esp_transport_get_context_data(t);
+    if (tls->ssl_ready && tls->sock >= 0) {
+        mbedtls_ssl_close_notify(&tls->ssl);
+    }
+    ws_tls_cleanup(tls);
+    return 0;
+}
+
+static int ws_tls_destroy(esp_transport_handle_t t)
+{
+    transport_ws_tls_t *tls = esp_transport_get_context_data(t);
+    ws_tls_cleanup(tls);
+    free(tls);
+    return 0;
+}
+
+esp_transport_handle_t esp_websocket_tls_init(esp_websocket_tls_session_t *session, const char *cert, size_t cert_len)
+{
+    esp_transport_handle_t t = esp_transport_init();
+    if (t == NULL) {
+        return NULL;
+    }
+    transport_ws_tls_t *tls = calloc(1, sizeof(transport_ws_tls_t));
+    if (tls == NULL) {
+        esp_transport_destroy(t);
+        return NULL;
+    }
+    tls->session = session;
+    tls->cert = cert;
+    tls->cert_len = cert_len;
+    tls->sock = -1;
+    esp_transport_set_context_data(t, tls);
+    esp_transport_set_func(t, ws_tls_connect, ws_tls_read, ws_tls_write, ws_tls_close, ws_tls_poll_read, ws_tls_poll_write, ws_tls_destroy);
+    return t;
+}
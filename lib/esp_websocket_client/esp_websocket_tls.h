@@ -0,0 +1,39 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_transport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* TLS session kept by the client between connects, in mbedtls_ssl_session_save() form */
+typedef struct {
+    uint8_t *data;      /*!< ESP_WEBSOCKET_TLS_SESSION_MAX_LEN bytes, allocated with the client */
+    size_t  len;        /*!< 0: nothing to offer, the next connect does a full handshake */
+    bool    resumed;    /*!< The last handshake reused the offered session (TLS 1.2; TLS 1.3 does not tell) */
+} esp_websocket_tls_session_t;
+
+/**
+ * @brief      TLS transport on mbedTLS that offers `session` on connect and
+ *             stores the negotiated one back into it after every handshake.
+ *             esp_transport_ssl has no session API, hence this transport.
+ *
+ * @param      session   Owned by the client, must outlive the transport
+ * @param      cert      CA certificate, PEM when cert_len is 0
+ *
+ * @return     The transport handle, or NULL when out of memory
+ */
+esp_transport_handle_t esp_websocket_tls_init(esp_websocket_tls_session_t *session, const char *cert, size_t cert_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -160,8 +160,14 @@ typedef struct {
     size_t                      ping_interval_sec;          /*!< Websocket ping interval, defaults to 10 seconds if not set */
     struct ifreq                *if_name;                   /*!< The name of interface for data to go through. Use the default interface without setting */
     esp_transport_handle_t      ext_transport;              /*!< External WebSocket tcp_transport handle to the client; or if null, the client will create its own transport handle. */
+    bool                        enable_tls_session_resumption; /*!< wss with `cert_pem` only (no client certificate, bundle, global CA store or common name options):
+                                                                 connect through the client's own mbedTLS transport, which resumes the previous TLS session
+                                                                 (ticket or session id, TLS 1.2) and falls back to a full handshake. See esp_websocket_client_set_tls_session(). */
 } esp_websocket_client_config_t;
 
+/* Largest serialized TLS session kept by the client (it carries the server certificate) */
+#define ESP_WEBSOCKET_TLS_SESSION_MAX_LEN   (2048)
+
 /**
  * @brief      Start a Websocket session
  *             This function must be the first function to call,
@@ -187,6 +193,32 @@ esp_websocket_client_handle_t esp_websocket_client_init(const esp_websocket_clie
  */
 esp_err_t esp_websocket_client_set_uri(esp_websocket_client_handle_t client, const char *uri);
 
+/**
+ * @brief      Set the TLS session offered on the next connect, e.g. one saved across deep sleep.
+ *             The client keeps the session of every handshake by itself, so this is only needed
+ *             for a fresh client. Must be called while the client is stopped.
+ *
+ * @param[in]  client  The client, created with enable_tls_session_resumption
+ * @param[in]  data    Session as returned by esp_websocket_client_get_tls_session()
+ * @param[in]  len     Its length, 0 to forget the session
+ *
+ * @return     ESP_OK, ESP_ERR_NOT_SUPPORTED when resumption is off, ESP_ERR_INVALID_SIZE when too long
+ */
+esp_err_t esp_websocket_client_set_tls_session(esp_websocket_client_handle_t client, const uint8_t *data, size_t len);
+
+/**
+ * @brief      Copy out the TLS session of the last handshake. Call it from the WEBSOCKET_EVENT_CONNECTED handler.
+ *
+ * @param[in]  client   The client
+ * @param[out] out      ESP_WEBSOCKET_TLS_SESSION_MAX_LEN bytes are enough
+ * @param[in]  cap      Size of out
+ * @param[out] len      Session length
+ * @param[out] resumed  Whether the last handshake resumed the offered session (may be NULL)
+ *
+ * @return     ESP_OK, ESP_ERR_NOT_FOUND when there is no session to keep
+ */
+esp_err_t esp_websocket_client_get_tls_session(esp_websocket_client_handle_t client, uint8_t *out, size_t cap, size_t *len, bool *resumed);
+
 /**
  * @brief      Set additional websocket headers for the client, when performing this behavior, the headers will replace the old ones
  * @pre        Must stop the WebSocket client before set headers if the client has been connected
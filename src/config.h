@@ -1,10 +1,15 @@
 #pragma once
 
+constexpr int MAX_HOME_ASSISTANT_FALLBACK_URLS = 3;
+
 struct Configuration {
     const char* wifi_ssid;
     const char* wifi_password;
 
     const char* home_assistant_url;
+    // Other addresses of the same server, e.g. a reverse proxy next to the LAN
+    // address (optional). Each connect goes to the fastest one that answers.
+    const char* home_assistant_fallback_urls[MAX_HOME_ASSISTANT_FALLBACK_URLS];
     const char* home_assistant_token;
     const char* root_ca;
 
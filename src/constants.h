@@ -12,25 +12,82 @@ constexpr uint8_t SLIDER_OFFSET = 100;    // The zero is a bit on the right
 constexpr uint8_t TOUCH_AREA_MARGIN = 20; // Larger touch target for easier tapping
 
 // Home assistant configuration
-constexpr uint32_t HASS_MAX_JSON_BUFFER = 1024 * 512; // 512k, area/entity registries can be large
+constexpr uint32_t HASS_MAX_JSON_BUFFER = 1024 * 256;    // whole messages: the initial state sync is the largest
+constexpr uint32_t HASS_MAX_REGISTRY_ITEM_LEN = 1024 * 16; // registry listings are streamed one row at a time
+constexpr uint32_t HASS_SEND_BUFFER_LEN = 1024 * 20;       // largest outgoing message: subscribe_entities with every entity id
+constexpr size_t HASS_DISPATCH_INDEX_SIZE = 256;              // power of two, about twice the ids subscribed to
 constexpr uint32_t HASS_RECONNECT_DELAY_MS = 10000;
+// With fallback URLs configured, every reconnect times a TCP handshake to each
+// endpoint and connects to the fastest one whose last connect did not fail.
+constexpr uint32_t HASS_ENDPOINT_PROBE_TIMEOUT_MS = 1500;
+// Scoped subscriptions: the always-on subscribe_entities only carries the
+// device area sensor and standby sources; each room opened gets its own
+// subscription, dropped once the room has been left for the linger time.
+// Off subscribes every discovered entity for the whole session.
+constexpr bool HASS_SCOPED_SUBSCRIPTIONS = true;
+constexpr uint32_t HASS_ROOM_SUBSCRIPTION_LINGER_MS = 30000;
+constexpr uint8_t HASS_MAX_ROOM_SUBSCRIPTIONS = 3;
+// Received frames are queued in PSRAM for a separate parser task, so a long
+// registry parse never stalls the websocket task (pings, next frames,
+// disconnect detection). The websocket task only blocks when the ring is full,
+// and at most HASS_RX_RING_FULL_WAIT_MS: then it drops the connection to resync.
+constexpr size_t HASS_RX_RING_LEN = 1024 * 128;
+constexpr uint32_t HASS_RX_RING_FULL_WAIT_MS = 3000;
+constexpr uint32_t HASS_PARSER_TASK_STACK = 8192;
+constexpr uint8_t HASS_PARSER_TASK_PRIORITY = 3; // below the websocket task (5), above ui and hass (1)
+constexpr int8_t HASS_PARSER_TASK_CORE = 1;
+// Let HA batch queued messages into one array frame (supported_features),
+// so bursts of state changes cost one frame and one wakeup instead of many.
+constexpr bool HASS_COALESCE_MESSAGES = true;
+// Hourly silent refresh wakes skip discovery, registry and room traffic: they
+// only ask for the energy sources, the weather forecast, the standby entity
+// states and today's energy statistics, then signal the sleep path.
+constexpr bool HASS_SILENT_REFRESH_MINIMAL = true;
+// Resume the previous TLS session (wss with root_ca only) on reconnects and
+// on wakes from deep sleep, skipping the certificate exchange and key
+// agreement. Falls back to a full handshake whenever HA refuses the session.
+constexpr bool HASS_TLS_SESSION_RESUMPTION = true;
+constexpr size_t HASS_TLS_SESSION_MAX_LEN = 2048; // kept in RTC memory, carries the server certificate
 
-// When sending commands too fast (on a slider), this can flood
-// the zigbee network and make the commands fail. Increase this delay
-// if you see errors when using sliders.
-constexpr uint32_t HASS_TASK_SEND_DELAY_MS = 500;
+// Commands go out through a token bucket per domain whose rate adapts to
+// call_service results: +1/s per success, halved on an error or a missing
+// result. Each entity has at most one command in flight and newer values
+// replace queued ones, so slider drags cannot flood the zigbee network.
+constexpr float HASS_COMMAND_RATE_INITIAL = 4.0f; // commands per second per domain
+constexpr float HASS_COMMAND_RATE_MIN = 0.5f;
+constexpr float HASS_COMMAND_RATE_MAX = 20.0f;
+constexpr float HASS_COMMAND_BURST = 4.0f; // back-to-back commands allowed per domain
+constexpr uint32_t HASS_COMMAND_RESULT_TIMEOUT_MS = 5000;
+constexpr uint32_t HASS_TASK_IDLE_WAIT_MS = 1000;
 
-// When sending commands, we'll receive the updates from the server
-// with a delay. This causes jittering in the slider and unnecessary
-// commands sent to the server. We ignore updates from the server
-// during this delay after a command was sent on an entity.
-// FIXME: We can lose updates, we should have an authoritative value
-// and a target value in the store at some point.
-constexpr uint32_t HASS_IGNORE_UPDATE_DELAY_MS = 1000;
+// A sent command stays on screen as the entity's target until the state
+// change carrying its context id (from the call_service result) comes back.
+// Other updates only move the reported value meanwhile. Targets whose echo
+// never arrives (value unchanged, lost event) fall back after this delay.
+constexpr uint32_t HASS_COMMAND_ECHO_TIMEOUT_MS = 3000;
+constexpr size_t HASS_MAX_COMMAND_ECHOES = 32;
+constexpr size_t HASS_CONTEXT_ID_LEN = 40; // ULIDs are 26 chars, older installs use 32-char uuids
+
+// Discovery cache (NVS). The default partition table gives NVS 20 KB: five
+// 4 KB pages, one kept free for compaction, shared with the Wi-Fi profiles and
+// settings, and blob chunks carry their own entry overhead. 8 KB leaves real
+// headroom; larger houses simply fall back to full discovery.
+constexpr size_t DISCOVERY_CACHE_MAX_LEN = 1024 * 8;
+// After a restore the floor and area listings are fetched again and compared,
+// so room edits made while the device was off trigger a rediscovery. Entity
+// and device edits (renames, moves between rooms, removals) are only caught
+// by registry events while connected, so an offline one shows until this age.
+constexpr uint32_t DISCOVERY_CACHE_MAX_AGE_S = 24 * 3600;  // re-download the registries at least daily
+constexpr uint32_t HASS_REGISTRY_CHANGE_SETTLE_MS = 5000; // registry edits arrive in bursts
+constexpr size_t HASS_MAX_REGISTRY_DELTAS = 8;            // registry lookups in flight for in-place updates
+
+// Discovery requests are sent together. A listing that is still streaming in
+// keeps pushing its deadline out, so the timeout only covers silence.
+constexpr uint32_t HASS_DISCOVERY_REQUEST_TIMEOUT_MS = 10000;
+constexpr uint8_t HASS_DISCOVERY_MAX_ATTEMPTS = 3;
 
 // Other constants
 constexpr size_t MAX_ENTITIES = 128;
-constexpr size_t MAX_DEVICE_MAPPINGS = 512;
 constexpr size_t MAX_WIDGETS_PER_SCREEN = 16;
 constexpr size_t MAX_FLOORS = 16;
 constexpr size_t MAX_ROOMS = 32;
@@ -50,11 +107,22 @@ constexpr size_t MAX_STANDBY_CONDITION_LEN = 32;
 constexpr size_t MAX_STANDBY_FORECAST_DAYS = 5;
 constexpr size_t MAX_STANDBY_DAY_LABEL_LEN = 8;
 constexpr uint32_t TOUCH_RELEASE_TIMEOUT_MS = 25;
+// Sliders follow the finger while dragged: every interval the value under it is
+// redrawn and queued as a command. The store keeps only the latest value and
+// the command scheduler sends one call per entity at a time, so intermediate
+// values collapse; the value on release is always the last one queued.
+constexpr bool SLIDER_LIVE_DRAG = true;
+constexpr uint32_t SLIDER_LIVE_DRAG_INTERVAL_MS = 150; // about one partial refresh
+constexpr uint8_t SLIDER_LIVE_DRAG_MIN_STEP = 2;       // percent, ignores touch jitter
 constexpr uint32_t DISPLAY_FULL_REDRAW_TIMEOUT_MS = 15000;
 constexpr uint8_t DISPLAY_PARTIAL_UPDATE_PASSES = 2;
 constexpr uint8_t DISPLAY_FULL_UPDATE_PASSES = 4;
 constexpr uint32_t STANDBY_IDLE_TIMEOUT_MS = 120000;
 constexpr uint32_t STANDBY_REFRESH_INTERVAL_MS = 3600000; // 1 hour
+// Standby energy as today's totals from the recorder, fetched once per
+// standby refresh, instead of subscribing to every energy sensor (busy ones
+// report every few seconds)
+constexpr bool HASS_STANDBY_ENERGY_FROM_STATISTICS = true;
 
 // Deep-sleep standby (battery only; e-ink keeps the standby image at ~0 cost)
 constexpr uint32_t STANDBY_SLEEP_SETTLE_MS = 60000;      // standby must be on screen this long before sleeping
@@ -121,6 +189,11 @@ constexpr uint16_t ROOM_CONTROLS_BACK_X = 20;
 constexpr uint16_t ROOM_CONTROLS_BACK_Y = 25;
 constexpr uint16_t ROOM_CONTROLS_BACK_W = 120;
 constexpr uint16_t ROOM_CONTROLS_BACK_H = 60;
+// All off / All on, right of the room name; shown when the room has lights or switches
+constexpr uint16_t ROOM_CONTROLS_BULK_W = 96;
+constexpr uint16_t ROOM_CONTROLS_BULK_GAP = 12;
+constexpr uint16_t ROOM_CONTROLS_BULK_ON_X = DISPLAY_WIDTH - ROOM_CONTROLS_ITEM_X - ROOM_CONTROLS_BULK_W;
+constexpr uint16_t ROOM_CONTROLS_BULK_OFF_X = ROOM_CONTROLS_BULK_ON_X - ROOM_CONTROLS_BULK_GAP - ROOM_CONTROLS_BULK_W;
 
 // Settings / Wi-Fi UI geometry
 constexpr uint16_t SETTINGS_HEADER_HEIGHT = 100;
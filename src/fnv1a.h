@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 32-bit FNV-1a: cheap fingerprints and id digests, nothing adversarial
+constexpr uint32_t FNV1A_OFFSET = 2166136261u;
+constexpr uint32_t FNV1A_PRIME = 16777619u;
+
+inline uint32_t fnv1a_update(uint32_t hash, const void* data, size_t len) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * FNV1A_PRIME;
+    }
+    return hash;
+}
+
+// Hashes the terminating NUL too, so consecutive strings cannot run together
+inline uint32_t fnv1a_update_str(uint32_t hash, const char* text) {
+    if (text) {
+        while (*text != '\0') {
+            hash = (hash ^ static_cast<uint8_t>(*text++)) * FNV1A_PRIME;
+        }
+    }
+    return (hash ^ 0) * FNV1A_PRIME;
+}
+
+inline uint32_t fnv1a_str(const char* text) {
+    return fnv1a_update_str(FNV1A_OFFSET, text);
+}
@@ -0,0 +1,143 @@
+#include "id_table.h"
+
+#include "esp_heap_caps.h"
+#include "fnv1a.h"
+#include <cstdlib>
+#include <cstring>
+
+static constexpr size_t ID_ARENA_BLOCK_SIZE = 2048;
+static constexpr uint16_t ID_MAP_MIN_CAP = 16;
+static constexpr uint16_t ID_MAP_MAX_CAP = 32768;
+
+struct IdArenaBlock {
+    IdArenaBlock* next;
+    size_t used;
+    size_t cap;
+};
+
+static void* id_table_alloc(size_t len) {
+    void* ptr = heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    return ptr ? ptr : malloc(len);
+}
+
+static char* id_arena_block_data(IdArenaBlock* block) {
+    return reinterpret_cast<char*>(block + 1);
+}
+
+const char* id_arena_intern(IdArena* arena, const char* text) {
+    if (!text) {
+        return nullptr;
+    }
+    const size_t len = strlen(text) + 1;
+    IdArenaBlock* block = arena->blocks;
+    if (!block || block->cap - block->used < len) {
+        const size_t cap = len > ID_ARENA_BLOCK_SIZE ? len : ID_ARENA_BLOCK_SIZE;
+        block = static_cast<IdArenaBlock*>(id_table_alloc(sizeof(IdArenaBlock) + cap));
+        if (!block) {
+            return nullptr;
+        }
+        block->next = arena->blocks;
+        block->used = 0;
+        block->cap = cap;
+        arena->blocks = block;
+    }
+
+    char* copy = id_arena_block_data(block) + block->used;
+    memcpy(copy, text, len);
+    block->used += len;
+    arena->bytes += len;
+    return copy;
+}
+
+void id_arena_reset(IdArena* arena) {
+    IdArenaBlock* block = arena->blocks;
+    while (block) {
+        IdArenaBlock* next = block->next;
+        heap_caps_free(block);
+        block = next;
+    }
+    arena->blocks = nullptr;
+    arena->bytes = 0;
+}
+
+static uint32_t id_map_hash(const char* id) {
+    const uint32_t hash = fnv1a_str(id);
+    return hash != 0 ? hash : 1;
+}
+
+static IdMapSlot* id_map_find(const IdMap* map, const char* id, uint32_t hash) {
+    const uint16_t mask = map->cap - 1;
+    for (uint16_t probe = 0; probe < map->cap; probe++) {
+        IdMapSlot* slot = &map->slots[(hash + probe) & mask];
+        if (slot->hash == 0 || (slot->hash == hash && strcmp(slot->id, id) == 0)) {
+            return slot;
+        }
+    }
+    return nullptr;
+}
+
+static bool id_map_grow(IdMap* map) {
+    if (map->cap >= ID_MAP_MAX_CAP) {
+        return false;
+    }
+    const uint16_t cap = map->cap ? map->cap * 2 : ID_MAP_MIN_CAP;
+    IdMapSlot* slots = static_cast<IdMapSlot*>(id_table_alloc(sizeof(IdMapSlot) * cap));
+    if (!slots) {
+        return false;
+    }
+    memset(slots, 0, sizeof(IdMapSlot) * cap);
+
+    IdMap grown = {.slots = slots, .cap = cap, .count = map->count};
+    for (uint16_t idx = 0; idx < map->cap; idx++) {
+        const IdMapSlot& slot = map->slots[idx];
+        if (slot.hash != 0) {
+            *id_map_find(&grown, slot.id, slot.hash) = slot;
+        }
+    }
+    heap_caps_free(map->slots);
+    *map = grown;
+    return true;
+}
+
+bool id_map_put(IdMap* map, IdArena* arena, const char* id, int16_t value) {
+    if (!id) {
+        return false;
+    }
+    // Keep the load factor under 3/4 so probes stay short
+    if ((map->count + 1) * 4 > map->cap * 3 && !id_map_grow(map)) {
+        return false;
+    }
+
+    const uint32_t hash = id_map_hash(id);
+    IdMapSlot* slot = id_map_find(map, id, hash);
+    if (slot->hash == 0) {
+        const char* interned = id_arena_intern(arena, id);
+        if (!interned) {
+            return false;
+        }
+        slot->hash = hash;
+        slot->id = interned;
+        map->count++;
+    }
+    slot->value = value;
+    return true;
+}
+
+bool id_map_get(const IdMap* map, const char* id, int16_t* value) {
+    if (!id || map->cap == 0) {
+        return false;
+    }
+    const IdMapSlot* slot = id_map_find(map, id, id_map_hash(id));
+    if (!slot || slot->hash == 0) {
+        return false;
+    }
+    *value = slot->value;
+    return true;
+}
+
+void id_map_clear(IdMap* map) {
+    if (map->slots) {
+        memset(map->slots, 0, sizeof(IdMapSlot) * map->cap);
+    }
+    map->count = 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Interned id strings (floor, area, device and statistic ids) plus
+// open-addressing maps from an id to a small index. Both grow on demand, so
+// the number of ids is bounded by free memory rather than by fixed arrays
+// sized for the worst case.
+
+struct IdArenaBlock;
+
+struct IdArena {
+    IdArenaBlock* blocks;
+    size_t bytes; // interned bytes, for logging
+};
+
+// Stable copy of `text` valid until the next reset, nullptr when out of memory
+const char* id_arena_intern(IdArena* arena, const char* text);
+void id_arena_reset(IdArena* arena);
+
+struct IdMapSlot {
+    uint32_t hash; // 0 marks an empty slot
+    const char* id;
+    int16_t value;
+};
+
+struct IdMap {
+    IdMapSlot* slots;
+    uint16_t cap; // power of two, 0 until the first insert
+    uint16_t count;
+};
+
+// Inserts or overwrites; the id is interned on first insert
+bool id_map_put(IdMap* map, IdArena* arena, const char* id, int16_t value);
+bool id_map_get(const IdMap* map, const char* id, int16_t* value);
+// Forgets all entries but keeps the slot storage for the next discovery
+void id_map_clear(IdMap* map);
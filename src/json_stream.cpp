@@ -0,0 +1,260 @@
+#include "json_stream.h"
+
+#include <cstring>
+
+void json_stream_init(JsonStream* stream, const JsonStreamHandlers* handlers, char* item_buffer, size_t item_cap,
+                      char* message_buffer, size_t message_cap) {
+    *stream = {};
+    stream->handlers = *handlers;
+    stream->item_buffer = item_buffer;
+    stream->item_cap = item_buffer ? item_cap : 0;
+    stream->message_buffer = message_buffer;
+    stream->message_cap = message_buffer ? message_cap : 0;
+    json_stream_reset(stream);
+}
+
+void json_stream_reset(JsonStream* stream) {
+    stream->depth = 0;
+    stream->expect_key = false;
+    stream->in_string = false;
+    stream->string_is_key = false;
+    stream->escape = false;
+    stream->in_scalar = false;
+    stream->text_len = 0;
+    stream->split_depth = 0;
+    stream->item_active = false;
+    stream->item_overflow = false;
+    stream->item_len = 0;
+    stream->error = false;
+    stream->base = 0;
+    stream->message_active = false;
+    stream->message_captured = false;
+    stream->message_len = 0;
+    stream->message_start = 0;
+    stream->pos = 0;
+    stream->items = 0;
+    stream->dropped_items = 0;
+    stream->largest_item = 0;
+    memset(stream->keys, 0, sizeof(stream->keys));
+}
+
+static bool json_stream_is_delimiter(char c) {
+    return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void json_stream_text_append(JsonStream* stream, char c) {
+    if (stream->text_len + 1 < sizeof(stream->text)) {
+        stream->text[stream->text_len++] = c;
+    }
+}
+
+static void json_stream_item_append(JsonStream* stream, char c) {
+    if (stream->item_overflow) {
+        return;
+    }
+    if (stream->item_len >= stream->item_cap) {
+        stream->item_overflow = true;
+        return;
+    }
+    stream->item_buffer[stream->item_len++] = c;
+}
+
+static void json_stream_item_finish(JsonStream* stream) {
+    stream->item_active = false;
+    if (stream->item_overflow) {
+        stream->dropped_items++;
+    } else {
+        stream->items++;
+        if (stream->item_len > stream->largest_item) {
+            stream->largest_item = stream->item_len;
+        }
+        if (stream->handlers.on_item) {
+            stream->handlers.on_item(stream->handlers.ctx, stream->item_buffer, stream->item_len);
+        }
+    }
+    stream->item_len = 0;
+    stream->item_overflow = false;
+}
+
+static void json_stream_message_append(JsonStream* stream, char c) {
+    if (!stream->message_captured) {
+        return;
+    }
+    if (stream->message_len >= stream->message_cap) {
+        stream->message_captured = false;
+        return;
+    }
+    stream->message_buffer[stream->message_len++] = c;
+}
+
+static void json_stream_message_start(JsonStream* stream) {
+    stream->message_active = true;
+    stream->message_captured = stream->message_buffer != nullptr;
+    stream->message_len = 0;
+    stream->message_start = stream->pos - 1;
+    stream->items = 0;
+    stream->dropped_items = 0;
+    stream->largest_item = 0;
+    if (stream->handlers.on_message_start) {
+        stream->handlers.on_message_start(stream->handlers.ctx);
+    }
+}
+
+static void json_stream_message_finish(JsonStream* stream) {
+    stream->message_active = false;
+    if (stream->handlers.on_message_end) {
+        stream->handlers.on_message_end(stream->handlers.ctx, stream->message_captured ? stream->message_buffer : nullptr,
+                                        stream->pos - stream->message_start);
+    }
+    stream->message_captured = false;
+    stream->message_len = 0;
+}
+
+static bool json_stream_in_top_object(const JsonStream* stream) {
+    return stream->depth == stream->base + 1 && stream->containers[stream->base] == '{';
+}
+
+static void json_stream_text_done(JsonStream* stream, bool is_string) {
+    stream->text[stream->text_len] = '\0';
+    if (is_string && stream->string_is_key) {
+        if (stream->depth > 0 && stream->depth < JSON_STREAM_KEY_DEPTH) {
+            strncpy(stream->keys[stream->depth], stream->text, JSON_STREAM_MAX_KEY_LEN - 1);
+            stream->keys[stream->depth][JSON_STREAM_MAX_KEY_LEN - 1] = '\0';
+        }
+        return;
+    }
+    if (json_stream_in_top_object(stream) && stream->handlers.on_field) {
+        stream->handlers.on_field(stream->handlers.ctx, stream->keys[stream->base + 1], stream->text, is_string);
+    }
+}
+
+bool json_stream_feed(JsonStream* stream, const char* data, size_t len) {
+    for (size_t idx = 0; idx < len; idx++) {
+        if (stream->error) {
+            return false;
+        }
+        const char c = data[idx];
+        stream->pos++;
+        if (stream->message_active) {
+            json_stream_message_append(stream, c);
+        }
+
+        if (stream->in_string) {
+            if (stream->item_active) {
+                json_stream_item_append(stream, c);
+            } else if (c != '"' || stream->escape) {
+                json_stream_text_append(stream, c);
+            }
+            if (stream->escape) {
+                stream->escape = false;
+            } else if (c == '\\') {
+                stream->escape = true;
+            } else if (c == '"') {
+                stream->in_string = false;
+                if (!stream->item_active) {
+                    json_stream_text_done(stream, true);
+                }
+            }
+            continue;
+        }
+
+        if (stream->in_scalar) {
+            if (!json_stream_is_delimiter(c)) {
+                if (stream->item_active) {
+                    json_stream_item_append(stream, c);
+                } else {
+                    json_stream_text_append(stream, c);
+                }
+                continue;
+            }
+            stream->in_scalar = false;
+            if (!stream->item_active) {
+                json_stream_text_done(stream, false);
+            }
+            // the delimiter itself is handled below
+        }
+
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            if (stream->item_active) {
+                json_stream_item_append(stream, c);
+            }
+            continue;
+        }
+
+        // Containers directly inside the array being split become items
+        if (stream->split_depth != 0 && stream->depth == stream->split_depth && !stream->item_active && (c == '{' || c == '[')) {
+            stream->item_active = true;
+            stream->item_len = 0;
+            stream->item_overflow = false;
+        }
+        if (stream->item_active) {
+            json_stream_item_append(stream, c);
+        }
+
+        switch (c) {
+        case '{':
+        case '[':
+            if (stream->depth >= JSON_STREAM_MAX_DEPTH) {
+                stream->error = true;
+                return false;
+            }
+            if (stream->depth == 0) {
+                stream->base = c == '[' ? 1 : 0;
+            } else if (stream->base != 0 && stream->depth == 1 && c == '{') {
+                json_stream_message_start(stream);
+                json_stream_message_append(stream, c);
+            }
+            // The batch array itself is not reported
+            if (c == '[' && stream->split_depth == 0 && stream->depth >= stream->base && stream->handlers.on_array) {
+                const bool keyed = stream->depth > 0 && stream->depth < JSON_STREAM_KEY_DEPTH && stream->containers[stream->depth - 1] == '{';
+                if (stream->handlers.on_array(stream->handlers.ctx, stream->depth - stream->base, keyed ? stream->keys[stream->depth] : "")) {
+                    stream->split_depth = stream->depth + 1;
+                    stream->message_captured = false; // its items are handed over instead
+                }
+            }
+            stream->containers[stream->depth++] = c;
+            if (stream->depth < JSON_STREAM_KEY_DEPTH) {
+                stream->keys[stream->depth][0] = '\0';
+            }
+            stream->expect_key = c == '{';
+            break;
+        case '}':
+        case ']':
+            if (stream->depth == 0) {
+                stream->error = true;
+                return false;
+            }
+            stream->depth--;
+            if (stream->item_active && stream->depth == stream->split_depth) {
+                json_stream_item_finish(stream);
+            } else if (stream->split_depth != 0 && stream->depth + 1 == stream->split_depth) {
+                stream->split_depth = 0; // the split array itself closed
+            }
+            if (stream->message_active && stream->depth == 1) {
+                json_stream_message_finish(stream);
+            }
+            stream->expect_key = false;
+            break;
+        case ',':
+            stream->expect_key = stream->depth > 0 && stream->containers[stream->depth - 1] == '{';
+            break;
+        case ':':
+            break;
+        case '"':
+            stream->in_string = true;
+            stream->escape = false;
+            stream->string_is_key = stream->expect_key;
+            stream->expect_key = false;
+            stream->text_len = 0;
+            break;
+        default:
+            stream->in_scalar = true;
+            stream->text_len = 0;
+            if (!stream->item_active) {
+                json_stream_text_append(stream, c);
+            }
+            break;
+        }
+    }
+    return !stream->error;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Incremental scanner for JSON messages that arrive in websocket fragments and
+// are too large to buffer whole (registry listings grow with the house). It
+// never builds a tree: it tracks nesting, reports the scalar fields of the
+// top-level object and can cut the elements of selected arrays out as
+// standalone JSON texts, so each one is parsed on its own while only a single
+// element is ever held in memory.
+//
+// A frame whose top level is an array is taken as a batch of coalesced
+// messages: each element is then scanned as if it were a message of its own
+// and, unless it was split, handed over whole once it closes.
+
+constexpr uint8_t JSON_STREAM_MAX_DEPTH = 32;
+constexpr uint8_t JSON_STREAM_KEY_DEPTH = 4; // keys are only remembered this close to the root
+constexpr size_t JSON_STREAM_MAX_KEY_LEN = 32;
+constexpr size_t JSON_STREAM_MAX_SCALAR_LEN = 40;
+
+struct JsonStreamHandlers {
+    // Scalar directly inside the top-level object. Strings arrive unquoted with escapes left as-is.
+    void (*on_field)(void* ctx, const char* key, const char* value, bool is_string);
+    // Array opened under `key` at `depth` containers deep, counted from the message (1 = a member of
+    // its top-level object). Return true to have its elements cut out.
+    bool (*on_array)(void* ctx, uint8_t depth, const char* key);
+    // One complete element of a split array (not NUL-terminated)
+    void (*on_item)(void* ctx, const char* json, size_t len);
+    // Around each message of a coalesced batch. `json` is the whole message (not NUL-terminated),
+    // or nullptr when it was split or did not fit the message buffer; `len` is its size either way.
+    void (*on_message_start)(void* ctx);
+    void (*on_message_end)(void* ctx, const char* json, size_t len);
+    void* ctx;
+};
+
+struct JsonStream {
+    JsonStreamHandlers handlers;
+    char* item_buffer;
+    size_t item_cap;
+    char* message_buffer;
+    size_t message_cap;
+
+    uint8_t depth;
+    char containers[JSON_STREAM_MAX_DEPTH];
+    char keys[JSON_STREAM_KEY_DEPTH][JSON_STREAM_MAX_KEY_LEN];
+    bool expect_key;
+    bool in_string;
+    bool string_is_key;
+    bool escape;
+    bool in_scalar;
+    size_t text_len; // key or top-level scalar being collected
+    char text[JSON_STREAM_MAX_SCALAR_LEN];
+
+    uint8_t split_depth; // depth of the elements being cut out, 0 when not splitting
+    bool item_active;
+    bool item_overflow;
+    size_t item_len;
+    bool error;
+
+    uint8_t base; // 1 inside a coalesced batch, where each message sits one level down
+    bool message_active;
+    bool message_captured; // false once the message was split or overflowed
+    size_t message_len;
+    size_t message_start;
+    size_t pos; // bytes fed since the reset
+
+    // Stats for the current message
+    uint16_t items;
+    uint16_t dropped_items;
+    size_t largest_item;
+};
+
+void json_stream_init(JsonStream* stream, const JsonStreamHandlers* handlers, char* item_buffer, size_t item_cap,
+                      char* message_buffer, size_t message_cap);
+void json_stream_reset(JsonStream* stream);
+// Returns false once the input is malformed; the rest of the message is ignored
+bool json_stream_feed(JsonStream* stream, const char* data, size_t len);
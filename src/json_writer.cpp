@@ -0,0 +1,101 @@
+#include "json_writer.h"
+
+#include <cmath>
+#include <cstdio>
+
+void json_writer_init(JsonWriter* writer, char* buffer, size_t cap) {
+    writer->data = buffer;
+    writer->cap = cap;
+    writer->len = 0;
+    writer->overflow = cap == 0;
+    writer->depth = 0;
+    writer->has_members = 0;
+}
+
+void json_writer_raw(JsonWriter* writer, const char* text, size_t len) {
+    // Keep one byte for the terminator
+    if (writer->overflow || writer->len + len >= writer->cap) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->data + writer->len, text, len);
+    writer->len += len;
+}
+
+void json_writer_separator(JsonWriter* writer) {
+    const uint8_t bit = static_cast<uint8_t>(1u << writer->depth);
+    if (writer->has_members & bit) {
+        json_writer_raw(writer, ",", 1);
+    }
+    writer->has_members |= bit;
+}
+
+void json_writer_open(JsonWriter* writer, char bracket) {
+    json_writer_raw(writer, &bracket, 1);
+    if (writer->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        writer->overflow = true;
+        return;
+    }
+    writer->depth++;
+    writer->has_members &= static_cast<uint8_t>(~(1u << writer->depth));
+}
+
+void json_writer_close(JsonWriter* writer, char bracket) {
+    if (writer->depth > 0) {
+        writer->depth--;
+    }
+    json_writer_raw(writer, &bracket, 1);
+}
+
+void json_writer_escaped(JsonWriter* writer, const char* text) {
+    static const char kHex[] = "0123456789abcdef";
+    json_writer_raw(writer, "\"", 1);
+    if (text) {
+        // Copy runs of plain characters in one go
+        const char* run = text;
+        for (const char* c = text;; c++) {
+            const unsigned char ch = static_cast<unsigned char>(*c);
+            if (ch != '\0' && ch != '"' && ch != '\\' && ch >= 0x20) {
+                continue;
+            }
+            json_writer_raw(writer, run, c - run);
+            if (ch == '\0') {
+                break;
+            }
+            if (ch == '"' || ch == '\\') {
+                const char escaped[2] = {'\\', static_cast<char>(ch)};
+                json_writer_raw(writer, escaped, 2);
+            } else {
+                const char escaped[6] = {'\\', 'u', '0', '0', kHex[ch >> 4], kHex[ch & 0xf]};
+                json_writer_raw(writer, escaped, 6);
+            }
+            run = c + 1;
+        }
+    }
+    json_writer_raw(writer, "\"", 1);
+}
+
+void json_writer_number_value(JsonWriter* writer, double value) {
+    if (!std::isfinite(value)) {
+        json_writer_raw(writer, "null", 4);
+        return;
+    }
+    char text[24];
+    int len;
+    if (value == std::floor(value) && std::fabs(value) < 1e15) {
+        len = snprintf(text, sizeof(text), "%lld", static_cast<long long>(value));
+    } else {
+        len = snprintf(text, sizeof(text), "%.6g", value);
+    }
+    if (len > 0) {
+        json_writer_raw(writer, text, static_cast<size_t>(len) < sizeof(text) ? static_cast<size_t>(len) : sizeof(text) - 1);
+    }
+}
+
+const char* json_writer_finish(JsonWriter* writer) {
+    if (writer->overflow || writer->depth != 0) {
+        return nullptr;
+    }
+    writer->data[writer->len] = '\0';
+    return writer->data;
+}
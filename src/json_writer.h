@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Minimal JSON emitter for outgoing websocket messages. Writes straight into a
+// caller-owned buffer with no allocations. Keys can only be string literals:
+// their length comes from the array type and they are copied verbatim, so
+// only values go through the escaper. Running out of room sets `overflow`
+// and json_writer_finish returns nullptr.
+
+constexpr uint8_t JSON_WRITER_MAX_DEPTH = 8;
+
+struct JsonWriter {
+    char* data;
+    size_t cap;
+    size_t len;
+    bool overflow;
+    uint8_t depth;
+    uint8_t has_members; // bit per depth: a separator is needed before the next member
+};
+
+void json_writer_init(JsonWriter* writer, char* buffer, size_t cap);
+void json_writer_raw(JsonWriter* writer, const char* text, size_t len);
+void json_writer_open(JsonWriter* writer, char bracket);
+void json_writer_close(JsonWriter* writer, char bracket);
+void json_writer_separator(JsonWriter* writer);
+void json_writer_escaped(JsonWriter* writer, const char* text);
+void json_writer_number_value(JsonWriter* writer, double value);
+// NUL-terminated message, or nullptr when it did not fit
+const char* json_writer_finish(JsonWriter* writer);
+
+template <size_t N>
+inline void json_writer_key(JsonWriter* writer, const char (&key)[N]) {
+    json_writer_separator(writer);
+    json_writer_raw(writer, "\"", 1);
+    json_writer_raw(writer, key, N - 1);
+    json_writer_raw(writer, "\":", 2);
+}
+
+// For literal keys chosen at runtime (e.g. from a table); copied verbatim like the above
+inline void json_writer_literal_key(JsonWriter* writer, const char* key) {
+    json_writer_separator(writer);
+    json_writer_raw(writer, "\"", 1);
+    json_writer_raw(writer, key, strlen(key));
+    json_writer_raw(writer, "\":", 2);
+}
+
+template <size_t N>
+inline void json_writer_string(JsonWriter* writer, const char (&key)[N], const char* value) {
+    json_writer_key(writer, key);
+    json_writer_escaped(writer, value);
+}
+
+template <size_t N>
+inline void json_writer_number(JsonWriter* writer, const char (&key)[N], double value) {
+    json_writer_key(writer, key);
+    json_writer_number_value(writer, value);
+}
+
+template <size_t N>
+inline void json_writer_bool(JsonWriter* writer, const char (&key)[N], bool value) {
+    json_writer_key(writer, key);
+    json_writer_raw(writer, value ? "true" : "false", value ? 4 : 5);
+}
+
+template <size_t N>
+inline void json_writer_begin_object(JsonWriter* writer, const char (&key)[N]) {
+    json_writer_key(writer, key);
+    json_writer_open(writer, '{');
+}
+
+template <size_t N>
+inline void json_writer_begin_array(JsonWriter* writer, const char (&key)[N]) {
+    json_writer_key(writer, key);
+    json_writer_open(writer, '[');
+}
+
+inline void json_writer_array_string(JsonWriter* writer, const char* value) {
+    json_writer_separator(writer);
+    json_writer_escaped(writer, value);
+}
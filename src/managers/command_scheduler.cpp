@@ -0,0 +1,147 @@
+#include "managers/command_scheduler.h"
+#include "constants.h"
+#include "esp_log.h"
+
+static const char* TAG = "command_scheduler";
+
+static void command_bucket_refill(CommandBucket* bucket, uint32_t now_ms) {
+    const uint32_t elapsed_ms = now_ms - bucket->updated_ms;
+    bucket->updated_ms = now_ms;
+    bucket->tokens += bucket->rate * static_cast<float>(elapsed_ms) / 1000.0f;
+    if (bucket->tokens > HASS_COMMAND_BURST) {
+        bucket->tokens = HASS_COMMAND_BURST;
+    }
+}
+
+static void command_bucket_adapt(CommandBucket* bucket, bool success) {
+    if (success) {
+        bucket->rate += 1.0f;
+        if (bucket->rate > HASS_COMMAND_RATE_MAX) {
+            bucket->rate = HASS_COMMAND_RATE_MAX;
+        }
+        return;
+    }
+    bucket->rate /= 2.0f;
+    if (bucket->rate < HASS_COMMAND_RATE_MIN) {
+        bucket->rate = HASS_COMMAND_RATE_MIN;
+    }
+}
+
+// Time until the result is considered lost; at least 1 so callers keep waiting
+static uint32_t command_in_flight_remaining_ms(const CommandInFlight* command, uint32_t now_ms) {
+    const uint32_t age_ms = now_ms - command->sent_ms;
+    return age_ms < HASS_COMMAND_RESULT_TIMEOUT_MS ? HASS_COMMAND_RESULT_TIMEOUT_MS - age_ms : 1;
+}
+
+static void command_scheduler_remove(CommandScheduler* scheduler, uint8_t idx) {
+    scheduler->in_flight[idx] = scheduler->in_flight[--scheduler->in_flight_count];
+}
+
+// A group call is tracked once per entity but adapts its bucket only once
+static bool command_scheduler_last_of_message(const CommandScheduler* scheduler, uint8_t idx) {
+    for (uint8_t other = 0; other < scheduler->in_flight_count; other++) {
+        if (other != idx && scheduler->in_flight[other].message_id == scheduler->in_flight[idx].message_id) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void command_scheduler_init(CommandScheduler* scheduler, uint32_t now_ms) {
+    for (uint8_t idx = 0; idx < COMMAND_SCHEDULER_BUCKETS; idx++) {
+        scheduler->buckets[idx] = {.tokens = HASS_COMMAND_BURST, .rate = HASS_COMMAND_RATE_INITIAL, .updated_ms = now_ms};
+    }
+    scheduler->in_flight_count = 0;
+}
+
+void command_scheduler_clear_in_flight(CommandScheduler* scheduler) {
+    scheduler->in_flight_count = 0;
+}
+
+uint32_t command_scheduler_wait_ms(CommandScheduler* scheduler, uint8_t bucket_idx, uint8_t entity_idx, uint32_t now_ms) {
+    if (bucket_idx >= COMMAND_SCHEDULER_BUCKETS) {
+        return 0;
+    }
+    if (scheduler->in_flight_count >= COMMAND_SCHEDULER_MAX_IN_FLIGHT) {
+        return command_in_flight_remaining_ms(&scheduler->in_flight[0], now_ms);
+    }
+    if (entity_idx != COMMAND_SCHEDULER_NO_ENTITY) {
+        for (uint8_t idx = 0; idx < scheduler->in_flight_count; idx++) {
+            if (scheduler->in_flight[idx].entity_idx == entity_idx) {
+                return command_in_flight_remaining_ms(&scheduler->in_flight[idx], now_ms);
+            }
+        }
+    }
+
+    CommandBucket* bucket = &scheduler->buckets[bucket_idx];
+    command_bucket_refill(bucket, now_ms);
+    if (bucket->tokens >= 1.0f) {
+        return 0;
+    }
+    return static_cast<uint32_t>((1.0f - bucket->tokens) * 1000.0f / bucket->rate) + 1;
+}
+
+void command_scheduler_on_sent(CommandScheduler* scheduler, uint8_t bucket_idx, uint8_t entity_idx, uint16_t message_id, uint32_t now_ms) {
+    command_scheduler_on_sent_group(scheduler, bucket_idx, &entity_idx, 1, message_id, now_ms);
+}
+
+void command_scheduler_on_sent_group(CommandScheduler* scheduler, uint8_t bucket_idx, const uint8_t* entity_idxs, uint8_t count,
+                                     uint16_t message_id, uint32_t now_ms) {
+    if (bucket_idx >= COMMAND_SCHEDULER_BUCKETS) {
+        return;
+    }
+    CommandBucket* bucket = &scheduler->buckets[bucket_idx];
+    command_bucket_refill(bucket, now_ms);
+    bucket->tokens -= 1.0f; // multi-call commands (climate) may briefly go into debt
+
+    for (uint8_t idx = 0; idx < count && scheduler->in_flight_count < COMMAND_SCHEDULER_MAX_IN_FLIGHT; idx++) {
+        scheduler->in_flight[scheduler->in_flight_count++] = {
+            .message_id = message_id,
+            .entity_idx = entity_idxs[idx],
+            .bucket = bucket_idx,
+            .sent_ms = now_ms,
+        };
+    }
+}
+
+bool command_scheduler_on_result(CommandScheduler* scheduler, uint16_t message_id, bool success) {
+    bool matched = false;
+    uint8_t idx = 0;
+    while (idx < scheduler->in_flight_count) {
+        const CommandInFlight& command = scheduler->in_flight[idx];
+        if (command.message_id != message_id) {
+            idx++;
+            continue;
+        }
+        matched = true;
+        if (command_scheduler_last_of_message(scheduler, idx)) {
+            CommandBucket* bucket = &scheduler->buckets[command.bucket];
+            command_bucket_adapt(bucket, success);
+            if (!success) {
+                ESP_LOGW(TAG, "Command %u failed, domain %u slowed to %.1f/s", message_id, command.bucket, bucket->rate);
+            }
+        }
+        command_scheduler_remove(scheduler, idx);
+    }
+    return matched;
+}
+
+uint8_t command_scheduler_expire(CommandScheduler* scheduler, uint32_t now_ms) {
+    uint8_t expired = 0;
+    uint8_t idx = 0;
+    while (idx < scheduler->in_flight_count) {
+        const CommandInFlight& command = scheduler->in_flight[idx];
+        if (now_ms - command.sent_ms < HASS_COMMAND_RESULT_TIMEOUT_MS) {
+            idx++;
+            continue;
+        }
+        if (command_scheduler_last_of_message(scheduler, idx)) {
+            CommandBucket* bucket = &scheduler->buckets[command.bucket];
+            command_bucket_adapt(bucket, false);
+            ESP_LOGW(TAG, "No result for command %u, domain %u slowed to %.1f/s", command.message_id, command.bucket, bucket->rate);
+        }
+        command_scheduler_remove(scheduler, idx);
+        expired++;
+    }
+    return expired;
+}
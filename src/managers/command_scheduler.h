@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+
+// Paces outgoing call_service commands. Every domain (one per CommandType)
+// has a token bucket whose refill rate grows additively while Home Assistant
+// acknowledges commands and halves when one fails or never gets a result.
+// An entity never has more than one command awaiting its result; the store
+// keeps only the latest value meanwhile, so drags collapse into a few calls.
+
+constexpr uint8_t COMMAND_SCHEDULER_BUCKETS = 8;
+constexpr uint8_t COMMAND_SCHEDULER_MAX_IN_FLIGHT = 16;
+constexpr uint8_t COMMAND_SCHEDULER_NO_ENTITY = UINT8_MAX;
+
+struct CommandBucket {
+    float tokens;
+    float rate; // tokens per second
+    uint32_t updated_ms;
+};
+
+struct CommandInFlight {
+    uint16_t message_id;
+    uint8_t entity_idx;
+    uint8_t bucket;
+    uint32_t sent_ms;
+};
+
+struct CommandScheduler {
+    CommandBucket buckets[COMMAND_SCHEDULER_BUCKETS];
+    CommandInFlight in_flight[COMMAND_SCHEDULER_MAX_IN_FLIGHT];
+    uint8_t in_flight_count;
+};
+
+void command_scheduler_init(CommandScheduler* scheduler, uint32_t now_ms);
+// Forgets commands awaiting results (the connection they were sent on is gone)
+void command_scheduler_clear_in_flight(CommandScheduler* scheduler);
+// 0 when a command for this bucket and entity may be sent now, otherwise how
+// long until it could be
+uint32_t command_scheduler_wait_ms(CommandScheduler* scheduler, uint8_t bucket, uint8_t entity_idx, uint32_t now_ms);
+void command_scheduler_on_sent(CommandScheduler* scheduler, uint8_t bucket, uint8_t entity_idx, uint16_t message_id, uint32_t now_ms);
+// One call for several entities (room-wide on/off): a single token, every
+// entity waits for the shared result
+void command_scheduler_on_sent_group(CommandScheduler* scheduler, uint8_t bucket, const uint8_t* entity_idxs, uint8_t count,
+                                     uint16_t message_id, uint32_t now_ms);
+// False when message_id is not a command this scheduler sent
+bool command_scheduler_on_result(CommandScheduler* scheduler, uint16_t message_id, bool success);
+// Counts results overdue by HASS_COMMAND_RESULT_TIMEOUT_MS as failures; returns how many expired
+uint8_t command_scheduler_expire(CommandScheduler* scheduler, uint32_t now_ms);
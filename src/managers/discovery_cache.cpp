@@ -0,0 +1,162 @@
+#include "managers/discovery_cache.h"
+#include "constants.h"
+#include "esp_log.h"
+#include "fnv1a.h"
+#include "uptime.h"
+#include <Preferences.h>
+#include <cstring>
+#include <ctime>
+
+static const char* TAG = "discovery_cache";
+
+static constexpr const char* CACHE_PREFS_NS = "hass_cache";
+static constexpr const char* CACHE_HEADER_KEY = "hdr";
+static constexpr const char* CACHE_PAYLOAD_KEY = "data";
+static constexpr uint32_t CACHE_MAGIC = 0x48444331; // "HDC1"
+static constexpr time_t CACHE_MIN_WALL_CLOCK = 1735689600; // 2025-01-01: anything earlier means SNTP has not synced
+
+struct DiscoveryCacheHeader {
+    uint32_t magic;
+    uint32_t fingerprint;
+    uint32_t checksum;
+    uint32_t payload_len;
+    uint32_t saved_at;       // wall clock seconds, 0 when the clock was not set yet
+    uint32_t saved_uptime_s; // survives deep sleep, restarts at zero on power loss
+};
+
+void discovery_cache_put_u8(DiscoveryCacheWriter* writer, uint8_t value) {
+    if (writer->len >= writer->cap) {
+        writer->overflow = true;
+        return;
+    }
+    writer->data[writer->len++] = value;
+}
+
+void discovery_cache_put_str(DiscoveryCacheWriter* writer, const char* value) {
+    const size_t len = value ? strnlen(value, UINT8_MAX) : 0;
+    discovery_cache_put_u8(writer, static_cast<uint8_t>(len));
+    if (writer->len + len > writer->cap) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->data + writer->len, value, len);
+    writer->len += len;
+}
+
+uint8_t discovery_cache_get_u8(DiscoveryCacheReader* reader) {
+    if (reader->pos >= reader->len) {
+        reader->error = true;
+        return 0;
+    }
+    return reader->data[reader->pos++];
+}
+
+void discovery_cache_get_str(DiscoveryCacheReader* reader, char* out, size_t out_len) {
+    const size_t len = discovery_cache_get_u8(reader);
+    if (reader->error || reader->pos + len > reader->len || out_len == 0) {
+        reader->error = true;
+        if (out_len > 0) {
+            out[0] = '\0';
+        }
+        return;
+    }
+    const size_t copy_len = len < out_len - 1 ? len : out_len - 1;
+    memcpy(out, reader->data + reader->pos, copy_len);
+    out[copy_len] = '\0';
+    reader->pos += len;
+}
+
+static uint32_t discovery_cache_wall_clock() {
+    const time_t now = time(nullptr);
+    return now >= CACHE_MIN_WALL_CLOCK ? static_cast<uint32_t>(now) : 0;
+}
+
+static bool discovery_cache_age_s(const DiscoveryCacheHeader* header, uint32_t* age_s) {
+    const uint32_t now = discovery_cache_wall_clock();
+    if (now != 0 && header->saved_at != 0 && now >= header->saved_at) {
+        *age_s = now - header->saved_at;
+        return true;
+    }
+    // No usable wall clock: fall back to the sleep-surviving uptime, which
+    // only goes backwards after a power loss of unknown length
+    const uint32_t uptime_s = uptime_ms() / 1000;
+    if (uptime_s >= header->saved_uptime_s) {
+        *age_s = uptime_s - header->saved_uptime_s;
+        return true;
+    }
+    return false;
+}
+
+bool discovery_cache_save(uint32_t fingerprint, const uint8_t* payload, size_t len) {
+    if (!payload || len == 0 || len > DISCOVERY_CACHE_MAX_LEN) {
+        ESP_LOGW(TAG, "Not caching discovery: %u bytes (limit %u)", static_cast<unsigned>(len),
+                 static_cast<unsigned>(DISCOVERY_CACHE_MAX_LEN));
+        return false;
+    }
+
+    DiscoveryCacheHeader header = {
+        .magic = CACHE_MAGIC,
+        .fingerprint = fingerprint,
+        .checksum = fnv1a_update(FNV1A_OFFSET, payload, len),
+        .payload_len = static_cast<uint32_t>(len),
+        .saved_at = discovery_cache_wall_clock(),
+        .saved_uptime_s = uptime_ms() / 1000,
+    };
+
+    Preferences prefs;
+    if (!prefs.begin(CACHE_PREFS_NS, false)) {
+        ESP_LOGW(TAG, "Failed to open cache namespace");
+        return false;
+    }
+    // Header last: a save torn by a reset leaves no header. The old payload
+    // goes first too, otherwise NVS needs room for both copies while writing.
+    prefs.remove(CACHE_HEADER_KEY);
+    prefs.remove(CACHE_PAYLOAD_KEY);
+    const bool saved = prefs.putBytes(CACHE_PAYLOAD_KEY, payload, len) == len &&
+                       prefs.putBytes(CACHE_HEADER_KEY, &header, sizeof(header)) == sizeof(header);
+    prefs.end();
+
+    if (saved) {
+        ESP_LOGI(TAG, "Saved discovery cache: %u bytes, fingerprint %08lx", static_cast<unsigned>(len),
+                 static_cast<unsigned long>(fingerprint));
+    } else {
+        ESP_LOGW(TAG, "Failed to write discovery cache (%u bytes)", static_cast<unsigned>(len));
+    }
+    return saved;
+}
+
+size_t discovery_cache_load(uint32_t fingerprint, uint8_t* payload, size_t cap) {
+    Preferences prefs;
+    if (!payload || !prefs.begin(CACHE_PREFS_NS, true)) {
+        return 0;
+    }
+
+    DiscoveryCacheHeader header = {};
+    size_t len = 0;
+    uint32_t age_s = 0;
+    if (prefs.getBytes(CACHE_HEADER_KEY, &header, sizeof(header)) != sizeof(header) || header.magic != CACHE_MAGIC) {
+        ESP_LOGI(TAG, "No discovery cache");
+    } else if (header.fingerprint != fingerprint) {
+        ESP_LOGI(TAG, "Discovery cache fingerprint changed (%08lx != %08lx)", static_cast<unsigned long>(header.fingerprint),
+                 static_cast<unsigned long>(fingerprint));
+    } else if (!discovery_cache_age_s(&header, &age_s) || age_s > DISCOVERY_CACHE_MAX_AGE_S) {
+        ESP_LOGI(TAG, "Discovery cache expired");
+    } else if (header.payload_len == 0 || header.payload_len > cap ||
+               prefs.getBytes(CACHE_PAYLOAD_KEY, payload, header.payload_len) != header.payload_len ||
+               fnv1a_update(FNV1A_OFFSET, payload, header.payload_len) != header.checksum) {
+        ESP_LOGW(TAG, "Discovery cache is corrupt");
+    } else {
+        len = header.payload_len;
+        ESP_LOGI(TAG, "Loaded discovery cache: %u bytes, %lu s old", static_cast<unsigned>(len), static_cast<unsigned long>(age_s));
+    }
+    prefs.end();
+    return len;
+}
+
+void discovery_cache_invalidate() {
+    Preferences prefs;
+    if (prefs.begin(CACHE_PREFS_NS, false)) {
+        prefs.remove(CACHE_HEADER_KEY);
+        prefs.end();
+    }
+}
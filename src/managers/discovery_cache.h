@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Flash copy of the last completed discovery (rooms, entities, id maps and
+// standby sources), so later boots can skip the registry downloads. The
+// payload format belongs to the caller; this module only stores it behind a
+// header carrying the caller's fingerprint, a checksum and the save time.
+
+struct DiscoveryCacheWriter {
+    uint8_t* data;
+    size_t cap;
+    size_t len;
+    bool overflow;
+};
+
+struct DiscoveryCacheReader {
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+    bool error;
+};
+
+void discovery_cache_put_u8(DiscoveryCacheWriter* writer, uint8_t value);
+void discovery_cache_put_str(DiscoveryCacheWriter* writer, const char* value);
+uint8_t discovery_cache_get_u8(DiscoveryCacheReader* reader);
+void discovery_cache_get_str(DiscoveryCacheReader* reader, char* out, size_t out_len);
+
+bool discovery_cache_save(uint32_t fingerprint, const uint8_t* payload, size_t len);
+// Payload length, or 0 when the cache is missing, corrupt, from another
+// fingerprint or older than DISCOVERY_CACHE_MAX_AGE_S
+size_t discovery_cache_load(uint32_t fingerprint, uint8_t* payload, size_t cap);
+void discovery_cache_invalidate();
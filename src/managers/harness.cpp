@@ -1,5 +1,6 @@
 #include "managers/harness.h"
 #include "managers/beacon.h"
+#include "managers/home_assistant.h"
 #include "managers/mqtt.h"
 #include "managers/power.h"
 #include "boards.h"
@@ -206,6 +207,16 @@ static esp_err_t health_get_handler(httpd_req_t* req) {
     cJSON_AddBoolToObject(root, "standby_sleep", power_standby_sleep_enabled());
     cJSON_AddStringToObject(root, "sleep_inhibit", power_sleep_inhibit());
 
+    HassRxStats rx;
+    home_assistant_rx_stats(&rx);
+    cJSON_AddNumberToObject(root, "rx_ring_used", rx.ring_used);
+    cJSON_AddNumberToObject(root, "rx_ring_peak", rx.ring_peak);
+    cJSON_AddNumberToObject(root, "rx_ring_full", rx.ring_full);
+    cJSON_AddNumberToObject(root, "rx_ring_overflows", rx.ring_overflows);
+    cJSON_AddNumberToObject(root, "rx_messages", rx.messages);
+    cJSON_AddNumberToObject(root, "rx_dispatch_last_ms", rx.dispatch_last_ms);
+    cJSON_AddNumberToObject(root, "rx_dispatch_max_ms", rx.dispatch_max_ms);
+
     BatteryStatus battery;
     store_get_battery(harness_ctx->store, &battery);
     if (battery.valid) {
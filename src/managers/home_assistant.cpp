@@ -7,16 +7,94 @@
 #include "esp_websocket_client.h"
 #include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/ringbuf.h"
 #include "freertos/semphr.h"
+#include "fnv1a.h"
+#include "id_table.h"
+#include "json_stream.h"
+#include "json_writer.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include "state_decoder.h"
+#include "managers/command_scheduler.h"
+#include "managers/discovery_cache.h"
 #include "managers/home_assistant.h"
 #include "managers/power.h"
+#include "managers/tls_session_cache.h"
 #include "store.h"
+#include "uptime.h"
+#include "esp_attr.h"
 #include <cJSON.h>
 #include <cctype>
+#include <cerrno>
 #include <ctime>
 #include <cstdlib>
 #include <cstring>
 
+// What an entity id in a subscribe_entities event feeds
+enum DispatchRole : uint16_t {
+    DispatchRoleDeviceArea = 1 << 0,
+    DispatchRoleWeather = 1 << 1,
+    DispatchRoleBatterySoc = 1 << 2,
+    DispatchRoleHouse = 1 << 3,
+    DispatchRoleSolar = 1 << 4,
+    DispatchRoleGridIn = 1 << 5,
+    DispatchRoleGridOut = 1 << 6,
+    DispatchRoleBatteryOut = 1 << 7,
+    DispatchRoleBatteryIn = 1 << 8,
+};
+
+constexpr uint8_t DISPATCH_SERIES_COUNT = 5; // solar, grid in, grid out, battery out, battery in
+
+struct EntityDispatch {
+    uint32_t hash;         // 0 marks an empty slot
+    const char* entity_id; // owned by the store or the standby fields below
+    int16_t widget_idx;    // -1 when not shown in a room
+    uint16_t roles;        // DispatchRole bits
+    int8_t series_slots[DISPATCH_SERIES_COUNT];
+};
+
+// Discovery requests. The device registry is only fetched, after the entity
+// registry, when some entities have no area of their own.
+enum DiscoveryRequestKind : uint8_t {
+    DiscoveryFloorRegistry = 0,
+    DiscoveryAreaRegistry = 1,
+    DiscoveryDeviceRegistry = 2,
+    DiscoveryEntityRegistry = 3,
+    DiscoveryEnergyPrefs = 4,
+    DiscoveryRequestKinds = 5,
+};
+
+enum DiscoveryRequestState : uint8_t {
+    DiscoveryRequestIdle = 0,
+    DiscoveryRequestQueued = 1,   // sent on the task's next pass
+    DiscoveryRequestDeferred = 2, // answered before its inputs landed; resent once they have
+    DiscoveryRequestInFlight = 3,
+    DiscoveryRequestDone = 4,
+    DiscoveryRequestHeld = 5, // not sent unless an earlier result asks for it
+};
+
+struct DiscoveryRequest {
+    uint16_t id; // message id while in flight, 0 otherwise
+    uint8_t state;
+    uint8_t attempts;
+    bool success;
+    uint32_t deadline_ms;
+};
+
+// A call_service whose state change we expect back for an entity
+struct CommandEcho {
+    bool active;
+    uint8_t entity_idx;
+    uint16_t message_id;                   // awaiting the result, 0 once answered
+    char context_id[HASS_CONTEXT_ID_LEN];  // from the result
+    TickType_t deadline;
+    // A state change can overtake the result; keep the latest one to compare
+    bool early_seen;
+    uint8_t early_value;
+    char early_context_id[HASS_CONTEXT_ID_LEN];
+};
+
 typedef struct home_assistant_context {
     EntityStore* store;
     Configuration* config;
@@ -25,18 +103,93 @@ typedef struct home_assistant_context {
     SemaphoreHandle_t mutex;
     TaskHandle_t task;
 
+    // home_assistant_url and the fallback URLs; hass task only
+    const char* endpoints[1 + MAX_HOME_ASSISTANT_FALLBACK_URLS];
+    uint8_t endpoint_count;
+    uint8_t endpoint_idx; // the one the client is set up for
+    bool endpoint_failed[1 + MAX_HOME_ASSISTANT_FALLBACK_URLS]; // last connect through it never came up
+
+    // Outgoing messages are serialised into one reusable buffer
+    SemaphoreHandle_t send_mutex;
+    char* send_buffer;
+
     uint16_t event_id;         // counter to send events
     char* json_buffer;         // buffer for accumulating JSON data
     size_t json_buffer_len;    // current buffer length
     size_t json_buffer_cap;    // max buffer size
-    uint8_t pending_discovery_command;
-    bool dropping_oversized_payload;
-
-    // Request IDs for discovery flow
-    uint16_t floor_registry_request_id;
-    uint16_t area_registry_request_id;
-    uint16_t device_registry_request_id;
-    uint16_t entity_registry_request_id;
+    bool dropping_oversized_payload; // json_buffer* and this are parser task only
+
+    // Text frames go from the websocket task to the parser task through this
+    // ring; entries of an older connection are dropped
+    RingbufHandle_t rx_ring;
+    volatile uint32_t rx_generation;
+    volatile bool rx_overflowed; // a chunk was dropped: skip the rest of this connection
+
+    // Registry listings are cut into items while they stream in instead of
+    // being buffered whole; only touched from the parser task
+    JsonStream registry_stream;
+    char* registry_item_buffer;
+    bool registry_stream_candidate; // current message may still be a registry result
+    uint8_t registry_stream_request; // RegistryRequest being split, RegistryRequestNone otherwise
+    uint16_t registry_stream_response_id;
+    bool registry_stream_early; // its inputs have not landed yet; items are skipped
+    TickType_t registry_stream_started_at;
+    bool rx_coalesced; // current frame is an array of coalesced messages
+
+    // Discovery cache and registry change tracking
+    uint32_t discovery_cache_fingerprint;
+    bool discovery_cache_dirty; // discovery finished or a registry delta landed; persist it
+    // Floor and area listings as the last discovery parsed them, saved with the
+    // cache. A restored cache is checked against fresh listings of both, the
+    // cheap registries, before it is trusted for the rest of the session.
+    uint32_t registry_hashes[2];
+    uint16_t registry_check_ids[2]; // 0 once answered
+    bool registry_check_answered[2];
+    uint32_t registry_check_hashes[2];
+    bool registry_check_pending;
+    uint16_t entities_subscription_id;
+    // HASS_SCOPED_SUBSCRIPTIONS: rooms opened recently, each with its own
+    // subscribe_entities; left_ms is 0 while the room is on screen
+    struct RoomSubscription {
+        uint16_t id; // 0 when free
+        int8_t room_idx;
+        uint32_t left_ms;
+    } room_subscriptions[HASS_MAX_ROOM_SUBSCRIPTIONS];
+    bool registry_events_subscribed; // per connection
+    bool registry_changed; // an edit that deltas cannot express, rediscover once it settles
+    TickType_t registry_changed_at;
+
+    // Registry edits are patched into the store in place: the changed rows
+    // are looked up and applied, without a room sync or UI reset
+    struct RegistryDelta {
+        uint16_t id;   // request id, 0 when free
+        uint8_t kind;  // RegistryRequest: floor/area listing, device lookup, entity row
+        bool answered; // device lookups are template subscriptions: waiting for the event
+        char target[MAX_ENTITY_ID_LEN]; // entity or device id
+    } registry_deltas[HASS_MAX_REGISTRY_DELTAS];
+    TickType_t registry_delta_at;
+    bool entities_resubscribe_pending; // a delta added entities that need their states
+    TickType_t connect_started_at;
+
+    // Discovery requests go out together and are tracked until their result
+    // has been applied; the task resends the ones that time out
+    DiscoveryRequest discovery_requests[DiscoveryRequestKinds];
+    bool discovery_subscribe_pending;
+    TickType_t discovery_started_at;
+    uint32_t discovery_rx_start; // rx_bytes when discovery started
+    volatile uint32_t rx_bytes;  // text received, counted by the parser task
+
+    // Widget entities from the first one without an area of their own on,
+    // waiting for the device listing so they are placed in registry order;
+    // strings are interned in discovery_ids
+    struct HeldEntity {
+        const char* entity_id;
+        const char* display_name;
+        const char* device_id; // null when the entity has a room of its own
+        int16_t room_idx;      // -1 until the device listing gives one
+        CommandType command_type;
+    } held_entities[MAX_ENTITIES];
+    uint8_t held_entity_count;
 
     // Home Assistant sends updates by attribute only. We keep a local cache to
     // reconstruct a coherent value (on/off + brightness/percentage).
@@ -44,11 +197,25 @@ typedef struct home_assistant_context {
     const char* entity_ids[MAX_ENTITIES];
     uint8_t entity_modes[MAX_ENTITIES]; // 0/1 for lights, ClimateMode value for climate
     int8_t entity_values[MAX_ENTITIES]; // brightness percentage or climate temp steps (-1 unknown)
-    TickType_t last_command_sent_at_ms[MAX_ENTITIES];
+    CommandScheduler commands;
+    CommandEcho echoes[HASS_MAX_COMMAND_ECHOES];
+
+    // entity id -> widget / standby role, rebuilt before each subscribe_entities
+    EntityDispatch dispatch_index[HASS_DISPATCH_INDEX_SIZE];
+    EntityDispatch decoding_dispatch; // entity being decoded, parser task only
+
+    // Widget states of the event being decoded, applied to the store in one
+    // go once it has been walked; parser task only
+    StoreEntityKind state_batch_kinds[MAX_ENTITIES];
+    uint8_t state_batch_kind_count;
+    bool state_batch_kinds_loaded;
+    StoreValueUpdate state_batch[MAX_ENTITIES];
+    uint8_t state_batch_count;
 
     // Bermuda device location
     char device_area_entity_id[MAX_ENTITY_ID_LEN];
     char device_area_id[MAX_ICON_NAME_LEN]; // last reported HA area_id for the device
+    bool wake_room_pending; // wake boot: the device room opens once its own state sync lands
 
     // Standby data entity IDs
     char standby_weather_entity_id[MAX_ENTITY_ID_LEN];
@@ -62,48 +229,59 @@ typedef struct home_assistant_context {
     uint16_t weather_forecast_request_id;
     bool weather_forecast_requested;
     uint32_t last_weather_forecast_request_ms;
-    uint16_t energy_prefs_request_id;
+    // Forecasts are pushed through weather/subscribe_forecast; servers
+    // without it are polled with get_forecasts instead (per connection)
+    uint16_t weather_forecast_subscription_id;
+    bool weather_forecast_polling;
     bool standby_energy_house_computed;
 
-    // Mapping floor_id -> floor index in store
-    uint8_t floor_count;
-    char floor_ids[MAX_FLOORS][MAX_ENTITY_ID_LEN];
-    int8_t floor_store_indices[MAX_FLOORS];
+    // Registry ids seen during discovery, interned in discovery_ids and
+    // released together when discovery restarts
+    IdArena discovery_ids;
+    IdMap floor_map;  // floor_id -> floor index in store
+    IdMap area_map;   // area_id -> room index in store
+    IdMap device_map; // device_id -> room index in store
     int8_t other_floor_idx;
 
-    // Mapping area_id -> room index in store
-    uint8_t area_count;
-    char area_ids[MAX_ROOMS][MAX_ENTITY_ID_LEN];
-    int8_t area_room_indices[MAX_ROOMS];
-
-    // Mapping device_id -> room index in store
-    uint16_t device_count;
-    char device_ids[MAX_DEVICE_MAPPINGS][MAX_ENTITY_ID_LEN];
-    int8_t device_room_indices[MAX_DEVICE_MAPPINGS];
-
     struct StandbyEnergySeries {
         uint8_t count;
-        char entity_ids[8][MAX_ENTITY_ID_LEN];
+        const char* entity_ids[8]; // interned in discovery_ids, or borrowed from cJSON while parsing
         bool values_valid[8];
         float values[8];
     } standby_solar_series, standby_grid_in_series, standby_grid_out_series, standby_battery_out_series, standby_battery_in_series;
+
+    // recorder/statistic_during_period requests for the series above, see
+    // HASS_STANDBY_ENERGY_FROM_STATISTICS; answered ones have id 0
+    struct EnergyStatRequest {
+        uint16_t id;
+        uint8_t series; // DISPATCH_SERIES_COUNT order
+        uint8_t slot;
+    } energy_stat_requests[DISPATCH_SERIES_COUNT * 8];
+    uint8_t energy_stat_pending;
+    uint32_t last_energy_stats_request_ms;
+
+    // Silent refresh session (HASS_SILENT_REFRESH_MINIMAL): standby data only,
+    // upgraded to a full session if the user wakes the panel meanwhile
+    bool silent_refresh;
+    uint16_t silent_prefs_request_id;
+    bool silent_requests_sent;
+    bool silent_refresh_signalled;
 } home_assistant_context_t;
 
 static const char* TAG = "home_assistant";
 
-enum DiscoveryCommand : uint8_t {
-    DiscoveryCommandNone = 0,
-    DiscoveryCommandRequestFloorRegistry = 1,
-    DiscoveryCommandRequestAreaRegistry = 2,
-    DiscoveryCommandRequestDeviceRegistry = 3,
-    DiscoveryCommandRequestEntityRegistry = 4,
-    DiscoveryCommandRequestEnergyPrefs = 5,
-    DiscoveryCommandSubscribeEntities = 6,
+// Registry listings that are streamed; each value is its DiscoveryRequestKind + 1
+enum RegistryRequest : uint8_t {
+    RegistryRequestNone = 0,
+    RegistryRequestFloor = 1,
+    RegistryRequestArea = 2,
+    RegistryRequestDevice = 3,
+    RegistryRequestEntity = 4,
 };
 
-static void hass_dispatch_discovery_command(home_assistant_context_t* hass);
-void hass_cmd_request_energy_prefs(home_assistant_context_t* hass);
+static void hass_save_discovery_cache(home_assistant_context_t* hass);
 void hass_cmd_subscribe(home_assistant_context_t* hass);
+static void hass_rebuild_dispatch_index(home_assistant_context_t* hass);
 
 static void copy_string(char* dst, size_t dst_len, const char* src) {
     if (dst_len == 0) {
@@ -148,8 +326,14 @@ static bool has_entity_id(const char* entity_id) {
     return entity_id && entity_id[0] != '\0';
 }
 
+// Entity statistics are "sensor.x"; external ones (integrations importing
+// history, e.g. "tibber:energy_...") use a colon and have no entity state to
+// subscribe to, so they only count when fetched from the statistics
 static bool has_statistic_like_id(const char* statistic_id) {
-    return has_entity_id(statistic_id) && strchr(statistic_id, '.') != nullptr;
+    if (!has_entity_id(statistic_id)) {
+        return false;
+    }
+    return strchr(statistic_id, '.') != nullptr || (HASS_STANDBY_ENERGY_FROM_STATISTICS && strchr(statistic_id, ':') != nullptr);
 }
 
 static void copy_optional_entity_id(char* dst, size_t dst_len, const char* src) {
@@ -160,16 +344,7 @@ static void copy_optional_entity_id(char* dst, size_t dst_len, const char* src)
     }
 }
 
-static bool parse_state_float(cJSON* state_item, float* out_value) {
-    if (cJSON_IsNumber(state_item)) {
-        *out_value = static_cast<float>(state_item->valuedouble);
-        return true;
-    }
-    if (!cJSON_IsString(state_item) || !state_item->valuestring) {
-        return false;
-    }
-
-    const char* value = state_item->valuestring;
+static bool parse_state_text(const char* value, float* out_value) {
     while (*value != '\0' && isspace(static_cast<unsigned char>(*value))) {
         value++;
     }
@@ -201,6 +376,17 @@ static bool parse_state_float(cJSON* state_item, float* out_value) {
     return true;
 }
 
+static bool parse_state_float(cJSON* state_item, float* out_value) {
+    if (cJSON_IsNumber(state_item)) {
+        *out_value = static_cast<float>(state_item->valuedouble);
+        return true;
+    }
+    if (!cJSON_IsString(state_item) || !state_item->valuestring) {
+        return false;
+    }
+    return parse_state_text(state_item->valuestring, out_value);
+}
+
 static bool parse_standby_soc_attribute(cJSON* attributes, const char* key, float* out_value) {
     if (!cJSON_IsObject(attributes) || !key || !out_value) {
         return false;
@@ -242,7 +428,9 @@ static void standby_energy_series_reset(home_assistant_context_t::StandbyEnergyS
     memset(series->values, 0, sizeof(series->values));
 }
 
-static bool standby_energy_series_add_entity(home_assistant_context_t::StandbyEnergySeries* series, const char* entity_id) {
+// With an arena the id is interned; without one the caller keeps it alive
+static bool standby_energy_series_add_entity(home_assistant_context_t::StandbyEnergySeries* series, IdArena* arena,
+                                             const char* entity_id) {
     if (!series || !has_statistic_like_id(entity_id)) {
         return false;
     }
@@ -258,24 +446,23 @@ static bool standby_energy_series_add_entity(home_assistant_context_t::StandbyEn
         return false;
     }
 
-    copy_string(series->entity_ids[series->count], sizeof(series->entity_ids[series->count]), entity_id);
+    const char* stored_id = arena ? id_arena_intern(arena, entity_id) : entity_id;
+    if (!stored_id) {
+        return false;
+    }
+    series->entity_ids[series->count] = stored_id;
     series->values_valid[series->count] = false;
     series->values[series->count] = 0.0f;
     series->count++;
     return true;
 }
 
-static int8_t standby_energy_series_find(const home_assistant_context_t::StandbyEnergySeries* series, const char* entity_id) {
-    if (!series || !entity_id) {
-        return -1;
-    }
-
-    for (uint8_t idx = 0; idx < series->count; idx++) {
-        if (strcmp(series->entity_ids[idx], entity_id) == 0) {
-            return static_cast<int8_t>(idx);
-        }
+static void standby_energy_series_assign(home_assistant_context_t::StandbyEnergySeries* series, IdArena* arena,
+                                         const home_assistant_context_t::StandbyEnergySeries* source) {
+    standby_energy_series_reset(series);
+    for (uint8_t idx = 0; idx < source->count; idx++) {
+        standby_energy_series_add_entity(series, arena, source->entity_ids[idx]);
     }
-    return -1;
 }
 
 static bool standby_energy_series_set_value(home_assistant_context_t::StandbyEnergySeries* series, int8_t idx, bool valid, float value) {
@@ -463,27 +650,25 @@ static bool cover_entity_should_be_included(cJSON* item, const char* entity_id,
 static void hass_reset_discovery_state(home_assistant_context_t* hass) {
     power_wifi_sleep_hold(false); // don't leak the hold if the connection dies mid-discovery
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    hass->floor_registry_request_id = 0;
-    hass->area_registry_request_id = 0;
-    hass->device_registry_request_id = 0;
-    hass->entity_registry_request_id = 0;
-    hass->pending_discovery_command = DiscoveryCommandNone;
-    hass->dropping_oversized_payload = false;
-    hass->floor_count = 0;
-    hass->area_count = 0;
-    hass->device_count = 0;
+    memset(hass->discovery_requests, 0, sizeof(hass->discovery_requests));
+    hass->discovery_subscribe_pending = false;
+    memset(hass->registry_deltas, 0, sizeof(hass->registry_deltas));
+    memset(hass->registry_check_ids, 0, sizeof(hass->registry_check_ids));
+    hass->registry_check_pending = false;
+    memset(hass->room_subscriptions, 0, sizeof(hass->room_subscriptions));
+    hass->entities_resubscribe_pending = false;
     hass->entity_count = 0;
     hass->other_floor_idx = -1;
-    memset(hass->floor_ids, 0, sizeof(hass->floor_ids));
-    memset(hass->floor_store_indices, -1, sizeof(hass->floor_store_indices));
-    memset(hass->area_ids, 0, sizeof(hass->area_ids));
-    memset(hass->area_room_indices, -1, sizeof(hass->area_room_indices));
-    memset(hass->device_ids, 0, sizeof(hass->device_ids));
-    memset(hass->device_room_indices, -1, sizeof(hass->device_room_indices));
+    id_map_clear(&hass->floor_map);
+    id_map_clear(&hass->area_map);
+    id_map_clear(&hass->device_map);
+    id_arena_reset(&hass->discovery_ids);
+    hass->held_entity_count = 0;
     memset(hass->entity_ids, 0, sizeof(hass->entity_ids));
     memset(hass->entity_modes, 0, sizeof(hass->entity_modes));
     memset(hass->entity_values, -1, sizeof(hass->entity_values));
-    memset(hass->last_command_sent_at_ms, 0, sizeof(hass->last_command_sent_at_ms));
+    memset(hass->echoes, 0, sizeof(hass->echoes));
+    memset(hass->dispatch_index, 0, sizeof(hass->dispatch_index));
     copy_optional_entity_id(hass->device_area_entity_id, sizeof(hass->device_area_entity_id), hass->config->bermuda_area_entity_id);
     copy_optional_entity_id(hass->standby_weather_entity_id, sizeof(hass->standby_weather_entity_id), hass->config->weather_entity_id);
     copy_optional_entity_id(hass->standby_energy_solar_entity_id, sizeof(hass->standby_energy_solar_entity_id),
@@ -499,21 +684,23 @@ static void hass_reset_discovery_state(home_assistant_context_t* hass) {
                             hass->config->energy_battery_soc_entity_id);
     copy_optional_entity_id(hass->standby_energy_house_entity_id, sizeof(hass->standby_energy_house_entity_id),
                             hass->config->energy_house_entity_id);
-    hass->energy_prefs_request_id = 0;
     hass->standby_energy_house_computed = false;
     standby_energy_series_reset(&hass->standby_solar_series);
     standby_energy_series_reset(&hass->standby_grid_in_series);
     standby_energy_series_reset(&hass->standby_grid_out_series);
     standby_energy_series_reset(&hass->standby_battery_out_series);
     standby_energy_series_reset(&hass->standby_battery_in_series);
-    standby_energy_series_add_entity(&hass->standby_solar_series, hass->standby_energy_solar_entity_id);
-    standby_energy_series_add_entity(&hass->standby_grid_in_series, hass->standby_energy_grid_entity_id);
-    standby_energy_series_add_entity(&hass->standby_grid_out_series, hass->standby_energy_grid_export_entity_id);
-    standby_energy_series_add_entity(&hass->standby_battery_out_series, hass->standby_energy_battery_usage_entity_id);
-    standby_energy_series_add_entity(&hass->standby_battery_in_series, hass->standby_energy_battery_charge_entity_id);
+    standby_energy_series_add_entity(&hass->standby_solar_series, &hass->discovery_ids, hass->standby_energy_solar_entity_id);
+    standby_energy_series_add_entity(&hass->standby_grid_in_series, &hass->discovery_ids, hass->standby_energy_grid_entity_id);
+    standby_energy_series_add_entity(&hass->standby_grid_out_series, &hass->discovery_ids, hass->standby_energy_grid_export_entity_id);
+    standby_energy_series_add_entity(&hass->standby_battery_out_series, &hass->discovery_ids, hass->standby_energy_battery_usage_entity_id);
+    standby_energy_series_add_entity(&hass->standby_battery_in_series, &hass->discovery_ids, hass->standby_energy_battery_charge_entity_id);
     hass->weather_forecast_request_id = 0;
     hass->weather_forecast_requested = false;
     hass->last_weather_forecast_request_ms = 0;
+    memset(hass->energy_stat_requests, 0, sizeof(hass->energy_stat_requests));
+    hass->energy_stat_pending = 0;
+    hass->last_energy_stats_request_ms = 0;
     xSemaphoreGive(hass->mutex);
 }
 
@@ -526,7 +713,6 @@ static void hass_refresh_entities_from_store(home_assistant_context_t* hass) {
         hass->entity_ids[entity_idx] = hass->store->entities[entity_idx].entity_id;
         hass->entity_modes[entity_idx] = 0;
         hass->entity_values[entity_idx] = -1;
-        hass->last_command_sent_at_ms[entity_idx] = 0;
     }
 
     xSemaphoreGive(hass->store->mutex);
@@ -543,6 +729,12 @@ void hass_update_state(home_assistant_context_t* hass, ConnState state) {
         return;
     }
 
+    if (state == ConnState::Up) {
+        ESP_LOGI(TAG, "Home Assistant up %lu ms after connect, %lu ms after boot",
+                 static_cast<unsigned long>((xTaskGetTickCount() - hass->connect_started_at) * portTICK_PERIOD_MS),
+                 static_cast<unsigned long>(since_boot_ms()));
+    }
+
     // Update the UI state
     if (state == ConnState::Initializing) {
         // initial state at boot time, do nothing
@@ -555,128 +747,99 @@ void hass_update_state(home_assistant_context_t* hass, ConnState state) {
     xTaskNotifyGive(hass->task);
 }
 
-uint16_t hass_generate_event_id(home_assistant_context_t* hass) {
-    xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    uint16_t event_id = hass->event_id++;
-    xSemaphoreGive(hass->mutex);
-    return event_id;
+static uint32_t hass_now_ms() {
+    return static_cast<uint32_t>(xTaskGetTickCount() * portTICK_PERIOD_MS);
 }
 
-void hass_cmd_authenticate(home_assistant_context_t* hass) {
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "auth");
-    cJSON_AddStringToObject(root, "access_token", hass->config->home_assistant_token);
-    char* request = cJSON_PrintUnformatted(root);
-    esp_websocket_client_send_text(hass->client, request, strlen(request), portMAX_DELAY);
-    cJSON_free(request);
-    cJSON_Delete(root);
+// Holds send_mutex until hass_send_message; take it before hass->mutex
+static void hass_begin_message(home_assistant_context_t* hass, JsonWriter* writer) {
+    xSemaphoreTake(hass->send_mutex, portMAX_DELAY);
+    json_writer_init(writer, hass->send_buffer, hass->send_buffer ? HASS_SEND_BUFFER_LEN : 0);
+    json_writer_open(writer, '{');
 }
 
-void hass_cmd_request_floor_registry(home_assistant_context_t* hass) {
-    cJSON* root = cJSON_CreateObject();
-    uint16_t request_id = hass_generate_event_id(hass);
+// hass_begin_message plus the "id" member. The id is drawn under send_mutex so
+// ids go out in the order they were drawn; HA rejects one lower than the last.
+// Record it for tracking before hass_send_message, the answer can follow at once.
+static uint16_t hass_begin_request(home_assistant_context_t* hass, JsonWriter* writer) {
+    hass_begin_message(hass, writer);
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    hass->floor_registry_request_id = request_id;
+    const uint16_t request_id = hass->event_id++;
     xSemaphoreGive(hass->mutex);
-
-    cJSON_AddNumberToObject(root, "id", request_id);
-    cJSON_AddStringToObject(root, "type", "config/floor_registry/list");
-
-    char* request = cJSON_PrintUnformatted(root);
-    ESP_LOGI(TAG, "Sending %s", request);
-    esp_websocket_client_send_text(hass->client, request, strlen(request), portMAX_DELAY);
-    cJSON_free(request);
-    cJSON_Delete(root);
+    json_writer_number(writer, "id", request_id);
+    return request_id;
 }
 
-void hass_cmd_request_area_registry(home_assistant_context_t* hass) {
-    cJSON* root = cJSON_CreateObject();
-    uint16_t request_id = hass_generate_event_id(hass);
-    xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    hass->area_registry_request_id = request_id;
-    xSemaphoreGive(hass->mutex);
-
-    cJSON_AddNumberToObject(root, "id", request_id);
-    cJSON_AddStringToObject(root, "type", "config/area_registry/list");
-
-    char* request = cJSON_PrintUnformatted(root);
-    ESP_LOGI(TAG, "Sending %s", request);
-    esp_websocket_client_send_text(hass->client, request, strlen(request), portMAX_DELAY);
-    cJSON_free(request);
-    cJSON_Delete(root);
+static void hass_send_message(home_assistant_context_t* hass, JsonWriter* writer, const char* description, bool log_payload = true) {
+    json_writer_close(writer, '}');
+    const char* message = json_writer_finish(writer);
+    if (!message) {
+        ESP_LOGE(TAG, "Dropping %s: message does not fit in %u bytes", description, static_cast<unsigned>(HASS_SEND_BUFFER_LEN));
+    } else {
+        ESP_LOGI(TAG, "Sending %s (%u bytes)", description, static_cast<unsigned>(writer->len));
+        if (log_payload) {
+            ESP_LOGD(TAG, "Sending %s", message);
+        }
+        esp_websocket_client_send_text(hass->client, message, writer->len, portMAX_DELAY);
+    }
+    xSemaphoreGive(hass->send_mutex);
 }
 
-void hass_cmd_request_entity_registry(home_assistant_context_t* hass) {
-    cJSON* root = cJSON_CreateObject();
-    uint16_t request_id = hass_generate_event_id(hass);
+// {"id":N,"type":...} requests without parameters; the id lands in
+// *tracked_id (under hass->mutex) before the request goes out
+static void hass_send_simple_request(home_assistant_context_t* hass, const char* type, uint16_t* tracked_id) {
+    JsonWriter writer;
+    const uint16_t request_id = hass_begin_request(hass, &writer);
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    hass->entity_registry_request_id = request_id;
+    *tracked_id = request_id;
     xSemaphoreGive(hass->mutex);
-
-    cJSON_AddNumberToObject(root, "id", request_id);
-    cJSON_AddStringToObject(root, "type", "config/entity_registry/list_for_display");
-
-    char* request = cJSON_PrintUnformatted(root);
-    ESP_LOGI(TAG, "Sending %s", request);
-    esp_websocket_client_send_text(hass->client, request, strlen(request), portMAX_DELAY);
-    cJSON_free(request);
-    cJSON_Delete(root);
+    json_writer_string(&writer, "type", type);
+    hass_send_message(hass, &writer, type);
 }
 
-void hass_cmd_request_device_registry(home_assistant_context_t* hass) {
-    cJSON* root = cJSON_CreateObject();
-    uint16_t request_id = hass_generate_event_id(hass);
-    xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    hass->device_registry_request_id = request_id;
-    xSemaphoreGive(hass->mutex);
-
-    cJSON_AddNumberToObject(root, "id", request_id);
-    cJSON_AddStringToObject(root, "type", "config/device_registry/list");
-
-    char* request = cJSON_PrintUnformatted(root);
-    ESP_LOGI(TAG, "Sending %s", request);
-    esp_websocket_client_send_text(hass->client, request, strlen(request), portMAX_DELAY);
-    cJSON_free(request);
-    cJSON_Delete(root);
+void hass_cmd_authenticate(home_assistant_context_t* hass) {
+    JsonWriter writer;
+    hass_begin_message(hass, &writer);
+    json_writer_string(&writer, "type", "auth");
+    json_writer_string(&writer, "access_token", hass->config->home_assistant_token);
+    hass_send_message(hass, &writer, "auth", false);
 }
 
-void hass_set_pending_discovery_command(home_assistant_context_t* hass, DiscoveryCommand command) {
-    xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    hass->pending_discovery_command = command;
-    xSemaphoreGive(hass->mutex);
-    xTaskNotifyGive(hass->task);
+// HA then batches whatever it has queued into one array frame
+static void hass_cmd_supported_features(home_assistant_context_t* hass) {
+    JsonWriter writer;
+    hass_begin_request(hass, &writer);
+    json_writer_string(&writer, "type", "supported_features");
+    json_writer_begin_object(&writer, "features");
+    json_writer_number(&writer, "coalesce_messages", 1);
+    json_writer_close(&writer, '}');
+    hass_send_message(hass, &writer, "supported_features");
 }
 
-static void hass_dispatch_discovery_command(home_assistant_context_t* hass) {
-    DiscoveryCommand command = DiscoveryCommandNone;
+static const char* const kDiscoveryRequestTypes[DiscoveryRequestKinds] = {
+    "config/floor_registry/list",
+    "config/area_registry/list",
+    "config/device_registry/list",
+    "config/entity_registry/list_for_display",
+    "energy/get_prefs",
+};
+
+static void hass_send_discovery_request(home_assistant_context_t* hass, DiscoveryRequestKind kind) {
+    JsonWriter writer;
+    const uint16_t request_id = hass_begin_request(hass, &writer);
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    command = static_cast<DiscoveryCommand>(hass->pending_discovery_command);
-    hass->pending_discovery_command = DiscoveryCommandNone;
+    DiscoveryRequest* request = &hass->discovery_requests[kind];
+    request->id = request_id;
+    request->state = DiscoveryRequestInFlight;
+    request->attempts++;
+    request->deadline_ms = hass_now_ms() + HASS_DISCOVERY_REQUEST_TIMEOUT_MS;
+    if (kind == DiscoveryFloorRegistry || kind == DiscoveryAreaRegistry) {
+        hass->registry_hashes[kind - DiscoveryFloorRegistry] = FNV1A_OFFSET; // a retry starts over
+    }
     xSemaphoreGive(hass->mutex);
 
-    switch (command) {
-    case DiscoveryCommandRequestFloorRegistry:
-        hass_cmd_request_floor_registry(hass);
-        break;
-    case DiscoveryCommandRequestAreaRegistry:
-        hass_cmd_request_area_registry(hass);
-        break;
-    case DiscoveryCommandRequestDeviceRegistry:
-        hass_cmd_request_device_registry(hass);
-        break;
-    case DiscoveryCommandRequestEntityRegistry:
-        hass_cmd_request_entity_registry(hass);
-        break;
-    case DiscoveryCommandRequestEnergyPrefs:
-        hass_cmd_request_energy_prefs(hass);
-        break;
-    case DiscoveryCommandSubscribeEntities:
-        hass_cmd_subscribe(hass);
-        break;
-    case DiscoveryCommandNone:
-    default:
-        break;
-    }
+    json_writer_string(&writer, "type", kDiscoveryRequestTypes[kind]);
+    hass_send_message(hass, &writer, kDiscoveryRequestTypes[kind]);
 }
 
 static bool entity_id_already_added(const char* entity_id, const char* const* list, uint8_t list_count) {
@@ -690,7 +853,6 @@ static bool entity_id_already_added(const char* entity_id, const char* const* li
 
 static void hass_cmd_request_weather_forecast(home_assistant_context_t* hass) {
     char weather_entity_id[MAX_ENTITY_ID_LEN] = {};
-    uint16_t request_id = 0;
 
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
     if (!has_entity_id(hass->standby_weather_entity_id)) {
@@ -703,53 +865,60 @@ static void hass_cmd_request_weather_forecast(home_assistant_context_t* hass) {
     }
 
     copy_string(weather_entity_id, sizeof(weather_entity_id), hass->standby_weather_entity_id);
-    request_id = hass->event_id++;
-    hass->weather_forecast_request_id = request_id;
     hass->weather_forecast_requested = true;
     hass->last_weather_forecast_request_ms = static_cast<uint32_t>(xTaskGetTickCount() * portTICK_PERIOD_MS);
     xSemaphoreGive(hass->mutex);
 
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "id", request_id);
-    cJSON_AddStringToObject(root, "type", "call_service");
-    cJSON_AddStringToObject(root, "domain", "weather");
-    cJSON_AddStringToObject(root, "service", "get_forecasts");
-    cJSON_AddBoolToObject(root, "return_response", true);
-
-    cJSON* service_data = cJSON_CreateObject();
-    cJSON_AddStringToObject(service_data, "type", "daily");
-    cJSON_AddStringToObject(service_data, "entity_id", weather_entity_id);
-    cJSON_AddItemToObject(root, "service_data", service_data);
-
-    cJSON* target = cJSON_CreateObject();
-    cJSON_AddStringToObject(target, "entity_id", weather_entity_id);
-    cJSON_AddItemToObject(root, "target", target);
-
-    char* request = cJSON_PrintUnformatted(root);
     ESP_LOGI(TAG, "Requesting weather forecast for %s", weather_entity_id);
-    esp_websocket_client_send_text(hass->client, request, strlen(request), portMAX_DELAY);
-    cJSON_free(request);
-    cJSON_Delete(root);
+    JsonWriter writer;
+    const uint16_t request_id = hass_begin_request(hass, &writer);
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass->weather_forecast_request_id = request_id;
+    xSemaphoreGive(hass->mutex);
+    json_writer_string(&writer, "type", "call_service");
+    json_writer_string(&writer, "domain", "weather");
+    json_writer_string(&writer, "service", "get_forecasts");
+    json_writer_bool(&writer, "return_response", true);
+    json_writer_begin_object(&writer, "service_data");
+    json_writer_string(&writer, "type", "daily");
+    json_writer_string(&writer, "entity_id", weather_entity_id);
+    json_writer_close(&writer, '}');
+    json_writer_begin_object(&writer, "target");
+    json_writer_string(&writer, "entity_id", weather_entity_id);
+    json_writer_close(&writer, '}');
+    hass_send_message(hass, &writer, "weather/get_forecasts");
 }
 
-void hass_cmd_request_energy_prefs(home_assistant_context_t* hass) {
-    cJSON* root = cJSON_CreateObject();
-    uint16_t request_id = hass_generate_event_id(hass);
+// Pushes a new forecast whenever the weather integration refreshes
+static void hass_cmd_subscribe_weather_forecast(home_assistant_context_t* hass) {
+    char weather_entity_id[MAX_ENTITY_ID_LEN] = {};
+
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    hass->energy_prefs_request_id = request_id;
+    const bool polling = hass->weather_forecast_polling;
+    const bool subscribed = hass->weather_forecast_subscription_id != 0;
+    copy_string(weather_entity_id, sizeof(weather_entity_id), hass->standby_weather_entity_id);
     xSemaphoreGive(hass->mutex);
+    if (!has_entity_id(weather_entity_id) || subscribed) {
+        return;
+    }
+    if (polling) {
+        hass_cmd_request_weather_forecast(hass);
+        return;
+    }
 
-    cJSON_AddNumberToObject(root, "id", request_id);
-    cJSON_AddStringToObject(root, "type", "energy/get_prefs");
-
-    char* request = cJSON_PrintUnformatted(root);
-    ESP_LOGI(TAG, "Requesting energy preferences from Home Assistant");
-    esp_websocket_client_send_text(hass->client, request, strlen(request), portMAX_DELAY);
-    cJSON_free(request);
-    cJSON_Delete(root);
+    ESP_LOGI(TAG, "Subscribing to the weather forecast of %s", weather_entity_id);
+    JsonWriter writer;
+    const uint16_t request_id = hass_begin_request(hass, &writer);
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass->weather_forecast_subscription_id = request_id;
+    xSemaphoreGive(hass->mutex);
+    json_writer_string(&writer, "type", "weather/subscribe_forecast");
+    json_writer_string(&writer, "forecast_type", "daily");
+    json_writer_string(&writer, "entity_id", weather_entity_id);
+    hass_send_message(hass, &writer, "weather/subscribe_forecast");
 }
 
-static void hass_add_standby_entity_id(cJSON* entity_ids,
+static void hass_add_standby_entity_id(JsonWriter* entity_ids,
                                        const char* entity_id,
                                        const char** added_ids,
                                        size_t max_added_ids,
@@ -764,13 +933,15 @@ static void hass_add_standby_entity_id(cJSON* entity_ids,
         return;
     }
 
-    cJSON_AddItemToArray(entity_ids, cJSON_CreateString(entity_id));
-    ESP_LOGI(TAG, "Subscribing standby entity %s", entity_id);
+    if (entity_ids) {
+        json_writer_array_string(entity_ids, entity_id);
+        ESP_LOGD(TAG, "Subscribing %s", entity_id);
+    }
     added_ids[*added_id_count] = entity_id;
     (*added_id_count)++;
 }
 
-static void hass_add_standby_series_ids(cJSON* entity_ids,
+static void hass_add_standby_series_ids(JsonWriter* entity_ids,
                                         const home_assistant_context_t::StandbyEnergySeries* series,
                                         const char** added_ids,
                                         size_t max_added_ids,
@@ -839,65 +1010,398 @@ static void hass_update_standby_energy_metrics(home_assistant_context_t* hass) {
     }
 }
 
-void hass_cmd_subscribe(home_assistant_context_t* hass) {
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "id", hass_generate_event_id(hass));
-    cJSON_AddStringToObject(root, "type", "subscribe_entities");
+static home_assistant_context_t::StandbyEnergySeries* hass_energy_series(home_assistant_context_t* hass, uint8_t series) {
+    switch (series) {
+    case 0:
+        return &hass->standby_solar_series;
+    case 1:
+        return &hass->standby_grid_in_series;
+    case 2:
+        return &hass->standby_grid_out_series;
+    case 3:
+        return &hass->standby_battery_out_series;
+    default:
+        return &hass->standby_battery_in_series;
+    }
+}
+
+// Today's change of every energy statistic, one request each. HA works out
+// the day in its own timezone and converts to kWh.
+static void hass_cmd_request_energy_statistics(home_assistant_context_t* hass) {
+    if (!HASS_STANDBY_ENERGY_FROM_STATISTICS) {
+        return;
+    }
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    memset(hass->energy_stat_requests, 0, sizeof(hass->energy_stat_requests));
+    hass->energy_stat_pending = 0;
+    hass->last_energy_stats_request_ms = hass_now_ms();
+    xSemaphoreGive(hass->mutex);
+
+    uint8_t sent = 0;
+    for (uint8_t series = 0; series < DISPATCH_SERIES_COUNT; series++) {
+        for (uint8_t slot = 0;; slot++) {
+            char statistic_id[MAX_ENTITY_ID_LEN];
+            xSemaphoreTake(hass->mutex, portMAX_DELAY);
+            const home_assistant_context_t::StandbyEnergySeries* source = hass_energy_series(hass, series);
+            const bool more = slot < source->count;
+            if (more) {
+                copy_string(statistic_id, sizeof(statistic_id), source->entity_ids[slot]);
+            }
+            xSemaphoreGive(hass->mutex);
+            if (!more) {
+                break;
+            }
+
+            JsonWriter writer;
+            const uint16_t request_id = hass_begin_request(hass, &writer);
+            xSemaphoreTake(hass->mutex, portMAX_DELAY);
+            hass->energy_stat_requests[sent] = {.id = request_id, .series = series, .slot = slot};
+            hass->energy_stat_pending++;
+            xSemaphoreGive(hass->mutex);
+            sent++;
+            json_writer_string(&writer, "type", "recorder/statistic_during_period");
+            json_writer_string(&writer, "statistic_id", statistic_id);
+            json_writer_begin_object(&writer, "calendar");
+            json_writer_string(&writer, "period", "day");
+            json_writer_close(&writer, '}');
+            json_writer_begin_array(&writer, "types");
+            json_writer_array_string(&writer, "change");
+            json_writer_close(&writer, ']');
+            json_writer_begin_object(&writer, "units");
+            json_writer_string(&writer, "energy", "kWh");
+            json_writer_close(&writer, '}');
+            hass_send_message(hass, &writer, statistic_id, false);
+        }
+    }
+    if (sent > 0) {
+        ESP_LOGI(TAG, "Requested today's energy statistics for %u ids", sent);
+    }
+}
+
+// {"change": kWh}, {"change": null} when nothing was recorded today, or {}
+// when HA has no such statistic
+static bool hass_handle_energy_statistic_result(home_assistant_context_t* hass, uint16_t response_id, bool success, cJSON* result_item) {
+    cJSON* change = success && cJSON_IsObject(result_item) ? cJSON_GetObjectItem(result_item, "change") : nullptr;
+    const bool valid = cJSON_IsNumber(change) || cJSON_IsNull(change);
+    const float value = cJSON_IsNumber(change) ? static_cast<float>(change->valuedouble) : 0.0f;
+
+    bool matched = false;
+    bool done = false;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    for (auto& request : hass->energy_stat_requests) {
+        if (request.id == 0 || request.id != response_id) {
+            continue;
+        }
+        request.id = 0;
+        matched = true;
+        standby_energy_series_set_value(hass_energy_series(hass, request.series), static_cast<int8_t>(request.slot), valid, value);
+        done = --hass->energy_stat_pending == 0;
+        break;
+    }
+    xSemaphoreGive(hass->mutex);
+
+    if (matched && success && !valid) {
+        ESP_LOGW(TAG, "Energy statistic request %u: HA has no such statistic", response_id);
+    }
+    if (done) {
+        hass_update_standby_energy_metrics(hass);
+        xTaskNotifyGive(hass->task); // a silent refresh may be waiting for the last answer
+    }
+    return matched;
+}
+
+static void hass_cmd_unsubscribe(home_assistant_context_t* hass, uint16_t subscription_id) {
+    JsonWriter writer;
+    hass_begin_request(hass, &writer);
+    json_writer_string(&writer, "type", "unsubscribe_events");
+    json_writer_number(&writer, "subscription", subscription_id);
+    hass_send_message(hass, &writer, "unsubscribe_events");
+}
+
+// Registry edits make the discovery cache stale; listen once per connection
+static void hass_cmd_subscribe_registry_events(home_assistant_context_t* hass) {
+    static const char* kRegistryEvents[] = {"floor_registry_updated", "area_registry_updated", "device_registry_updated",
+                                            "entity_registry_updated"};
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool already_subscribed = hass->registry_events_subscribed;
+    hass->registry_events_subscribed = true;
+    xSemaphoreGive(hass->mutex);
+    if (already_subscribed) {
+        return;
+    }
+
+    for (size_t idx = 0; idx < sizeof(kRegistryEvents) / sizeof(kRegistryEvents[0]); idx++) {
+        JsonWriter writer;
+        hass_begin_request(hass, &writer);
+        json_writer_string(&writer, "type", "subscribe_events");
+        json_writer_string(&writer, "event_type", kRegistryEvents[idx]);
+        hass_send_message(hass, &writer, kRegistryEvents[idx]);
+    }
+}
 
-    cJSON* entity_ids = cJSON_CreateArray();
+// Writes the ids of the long-lived subscription, or only counts them when
+// `entity_ids` is null; caller holds hass->mutex
+static uint16_t hass_add_subscribed_ids(home_assistant_context_t* hass, JsonWriter* entity_ids) {
     constexpr size_t max_added_ids = MAX_ENTITIES + 48;
     const char* added_ids[max_added_ids] = {};
     uint16_t added_id_count = 0;
-    xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    for (uint8_t idx = 0; idx < hass->entity_count; idx++) {
-        hass_add_standby_entity_id(entity_ids, hass->entity_ids[idx], added_ids, max_added_ids, &added_id_count);
+    if (!HASS_SCOPED_SUBSCRIPTIONS) {
+        for (uint8_t idx = 0; idx < hass->entity_count; idx++) {
+            hass_add_standby_entity_id(entity_ids, hass->entity_ids[idx], added_ids, max_added_ids, &added_id_count);
+        }
     }
     hass_add_standby_entity_id(entity_ids, hass->device_area_entity_id, added_ids, max_added_ids, &added_id_count);
     hass_add_standby_entity_id(entity_ids, hass->standby_weather_entity_id, added_ids, max_added_ids, &added_id_count);
-    hass_add_standby_series_ids(entity_ids, &hass->standby_solar_series, added_ids, max_added_ids, &added_id_count);
-    hass_add_standby_series_ids(entity_ids, &hass->standby_grid_in_series, added_ids, max_added_ids, &added_id_count);
-    hass_add_standby_series_ids(entity_ids, &hass->standby_grid_out_series, added_ids, max_added_ids, &added_id_count);
-    hass_add_standby_series_ids(entity_ids, &hass->standby_battery_out_series, added_ids, max_added_ids, &added_id_count);
-    hass_add_standby_series_ids(entity_ids, &hass->standby_battery_in_series, added_ids, max_added_ids, &added_id_count);
+    if (!HASS_STANDBY_ENERGY_FROM_STATISTICS) {
+        hass_add_standby_series_ids(entity_ids, &hass->standby_solar_series, added_ids, max_added_ids, &added_id_count);
+        hass_add_standby_series_ids(entity_ids, &hass->standby_grid_in_series, added_ids, max_added_ids, &added_id_count);
+        hass_add_standby_series_ids(entity_ids, &hass->standby_grid_out_series, added_ids, max_added_ids, &added_id_count);
+        hass_add_standby_series_ids(entity_ids, &hass->standby_battery_out_series, added_ids, max_added_ids, &added_id_count);
+        hass_add_standby_series_ids(entity_ids, &hass->standby_battery_in_series, added_ids, max_added_ids, &added_id_count);
+    }
     hass_add_standby_entity_id(entity_ids, hass->standby_energy_battery_soc_entity_id, added_ids, max_added_ids, &added_id_count);
     if (!hass->standby_energy_house_computed) {
         hass_add_standby_entity_id(entity_ids, hass->standby_energy_house_entity_id, added_ids, max_added_ids, &added_id_count);
     }
+    return added_id_count;
+}
+
+static void hass_cmd_subscribe_entities(home_assistant_context_t* hass) {
+    hass_rebuild_dispatch_index(hass);
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const uint16_t id_count = hass_add_subscribed_ids(hass, nullptr);
+    hass->entities_subscription_id = 0;
     xSemaphoreGive(hass->mutex);
-    cJSON_AddItemToObject(root, "entity_ids", entity_ids);
+    if (id_count == 0) {
+        // HA reads an empty entity_ids as every entity in the house. No state
+        // sync will mark the session up either, so do it here.
+        ESP_LOGW(TAG, "No entities to subscribe to");
+        hass_update_state(hass, ConnState::Up);
+        power_wifi_sleep_hold(false);
+        return;
+    }
 
-    char* request = cJSON_PrintUnformatted(root);
-    ESP_LOGI(TAG, "Sending %s", request);
-    esp_websocket_client_send_text(hass->client, request, strlen(request), portMAX_DELAY);
-    cJSON_free(request);
-    cJSON_Delete(root);
+    JsonWriter writer;
+    const uint16_t subscription_id = hass_begin_request(hass, &writer);
+    json_writer_string(&writer, "type", "subscribe_entities");
+    json_writer_begin_array(&writer, "entity_ids");
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass->entities_subscription_id = subscription_id;
+    hass_add_subscribed_ids(hass, &writer);
+    xSemaphoreGive(hass->mutex);
+    json_writer_close(&writer, ']');
+    hass_send_message(hass, &writer, "subscribe_entities");
+}
 
-    hass_cmd_request_weather_forecast(hass);
+// Scoped mode: the room's widgets get a subscription of their own, tracked in
+// room_subscriptions[slot_idx]
+static void hass_cmd_subscribe_room(home_assistant_context_t* hass, uint8_t slot_idx, const uint8_t* entity_idxs, uint8_t count) {
+    JsonWriter writer;
+    const uint16_t subscription_id = hass_begin_request(hass, &writer);
+    json_writer_string(&writer, "type", "subscribe_entities");
+    json_writer_begin_array(&writer, "entity_ids");
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass->room_subscriptions[slot_idx].id = subscription_id;
+    for (uint8_t idx = 0; idx < count; idx++) {
+        if (entity_idxs[idx] < hass->entity_count) {
+            json_writer_array_string(&writer, hass->entity_ids[entity_idxs[idx]]);
+        }
+    }
+    xSemaphoreGive(hass->mutex);
+    json_writer_close(&writer, ']');
+    hass_send_message(hass, &writer, "subscribe_entities (room)");
 }
 
-int16_t hass_match_entity(home_assistant_context_t* hass, const char* key) {
-    int16_t result = -1;
+// Subscribes the open room and drops rooms that were left more than the
+// linger time ago; going back and forth keeps the existing subscription
+static void hass_sync_room_subscriptions(home_assistant_context_t* hass) {
+    if (!HASS_SCOPED_SUBSCRIPTIONS) {
+        return;
+    }
+    const int8_t open_room = store_get_open_room(hass->store);
+    const uint32_t now_ms = hass_now_ms();
+    uint16_t dropped[HASS_MAX_ROOM_SUBSCRIPTIONS];
+    uint8_t dropped_count = 0;
+    bool subscribed = open_room < 0;
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    for (auto& room : hass->room_subscriptions) {
+        if (room.id == 0) {
+            continue;
+        }
+        if (room.room_idx == open_room) {
+            room.left_ms = 0;
+            subscribed = true;
+        } else if (room.left_ms == 0) {
+            room.left_ms = now_ms | 1; // 0 means open
+        } else if (now_ms - room.left_ms >= HASS_ROOM_SUBSCRIPTION_LINGER_MS) {
+            dropped[dropped_count++] = room.id;
+            room.id = 0;
+        }
+    }
+    xSemaphoreGive(hass->mutex);
+    for (uint8_t idx = 0; idx < dropped_count; idx++) {
+        hass_cmd_unsubscribe(hass, dropped[idx]);
+    }
+    if (subscribed) {
+        return;
+    }
+
+    uint8_t entity_idxs[MAX_ENTITIES];
+    const uint8_t count = store_get_room_entities(hass->store, open_room, entity_idxs, MAX_ENTITIES);
+    if (count == 0) {
+        return; // an empty list would mean every entity
+    }
+
+    uint16_t evicted = 0;
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    for (uint8_t i = 0; i < hass->entity_count; i++) {
-        if (strcmp(key, hass->entity_ids[i]) == 0) {
-            result = i;
+    home_assistant_context_t::RoomSubscription* slot = nullptr;
+    for (auto& room : hass->room_subscriptions) {
+        if (room.id == 0) {
+            slot = &room;
             break;
         }
+        // Otherwise the room left longest ago makes way
+        if (!slot || now_ms - room.left_ms > now_ms - slot->left_ms) {
+            slot = &room;
+        }
     }
+    evicted = slot->id;
+    slot->id = 0; // hass_cmd_subscribe_room records the new one
+    slot->room_idx = open_room;
+    slot->left_ms = 0;
+    const uint8_t slot_idx = static_cast<uint8_t>(slot - hass->room_subscriptions);
     xSemaphoreGive(hass->mutex);
-    return result;
+    if (evicted != 0) {
+        hass_cmd_unsubscribe(hass, evicted);
+    }
+    hass_cmd_subscribe_room(hass, slot_idx, entity_idxs, count);
 }
 
-int16_t hass_find_floor_for_floor_id(home_assistant_context_t* hass, const char* floor_id) {
-    int16_t floor_idx = -1;
+static void hass_drop_room_subscriptions(home_assistant_context_t* hass) {
+    uint16_t dropped[HASS_MAX_ROOM_SUBSCRIPTIONS];
+    uint8_t dropped_count = 0;
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    for (uint8_t idx = 0; idx < hass->floor_count; idx++) {
-        if (strcmp(hass->floor_ids[idx], floor_id) == 0) {
-            floor_idx = hass->floor_store_indices[idx];
-            break;
+    for (auto& room : hass->room_subscriptions) {
+        if (room.id != 0) {
+            dropped[dropped_count++] = room.id;
+            room.id = 0;
+        }
+    }
+    xSemaphoreGive(hass->mutex);
+    for (uint8_t idx = 0; idx < dropped_count; idx++) {
+        hass_cmd_unsubscribe(hass, dropped[idx]);
+    }
+}
+
+void hass_cmd_subscribe(home_assistant_context_t* hass) {
+    hass_cmd_subscribe_entities(hass);
+    hass_cmd_subscribe_weather_forecast(hass);
+    hass_cmd_request_energy_statistics(hass);
+    hass_cmd_subscribe_registry_events(hass);
+}
+
+static uint32_t hass_dispatch_hash(const char* entity_id) {
+    const uint32_t hash = fnv1a_str(entity_id);
+    return hash != 0 ? hash : 1; // 0 marks empty slots
+}
+
+// Open addressing with linear probing; caller holds hass->mutex
+static EntityDispatch* hass_dispatch_slot(home_assistant_context_t* hass, const char* entity_id, bool create) {
+    const uint32_t hash = hass_dispatch_hash(entity_id);
+    const size_t mask = HASS_DISPATCH_INDEX_SIZE - 1;
+    for (size_t probe = 0; probe < HASS_DISPATCH_INDEX_SIZE; probe++) {
+        EntityDispatch* slot = &hass->dispatch_index[(hash + probe) & mask];
+        if (slot->hash == 0) {
+            if (!create) {
+                return nullptr;
+            }
+            slot->hash = hash;
+            slot->entity_id = entity_id;
+            slot->widget_idx = -1;
+            slot->roles = 0;
+            memset(slot->series_slots, -1, sizeof(slot->series_slots));
+            return slot;
+        }
+        if (slot->hash == hash && strcmp(slot->entity_id, entity_id) == 0) {
+            return slot;
+        }
+    }
+    return nullptr;
+}
+
+static void hass_dispatch_add_role(home_assistant_context_t* hass, const char* entity_id, uint16_t role) {
+    if (!has_entity_id(entity_id)) {
+        return;
+    }
+    EntityDispatch* slot = hass_dispatch_slot(hass, entity_id, true);
+    if (!slot) {
+        ESP_LOGW(TAG, "Dispatch index full, ignoring %s", entity_id);
+        return;
+    }
+    slot->roles |= role;
+}
+
+static void hass_dispatch_add_series(home_assistant_context_t* hass, const home_assistant_context_t::StandbyEnergySeries* series,
+                                     uint8_t series_idx, uint16_t role) {
+    for (uint8_t idx = 0; idx < series->count; idx++) {
+        EntityDispatch* slot = hass_dispatch_slot(hass, series->entity_ids[idx], true);
+        if (!slot) {
+            ESP_LOGW(TAG, "Dispatch index full, ignoring %s", series->entity_ids[idx]);
+            continue;
+        }
+        slot->roles |= role;
+        slot->series_slots[series_idx] = static_cast<int8_t>(idx);
+    }
+}
+
+// Resolves every subscribed id once so state events need a single lookup per entity
+static void hass_rebuild_dispatch_index(home_assistant_context_t* hass) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    memset(hass->dispatch_index, 0, sizeof(hass->dispatch_index));
+    for (uint8_t idx = 0; idx < hass->entity_count; idx++) {
+        EntityDispatch* slot = hass_dispatch_slot(hass, hass->entity_ids[idx], true);
+        if (!slot) {
+            ESP_LOGW(TAG, "Dispatch index full, ignoring %s", hass->entity_ids[idx]);
+            continue;
         }
+        if (slot->widget_idx < 0) {
+            slot->widget_idx = idx;
+        }
+    }
+    hass_dispatch_add_role(hass, hass->device_area_entity_id, DispatchRoleDeviceArea);
+    hass_dispatch_add_role(hass, hass->standby_weather_entity_id, DispatchRoleWeather);
+    hass_dispatch_add_role(hass, hass->standby_energy_battery_soc_entity_id, DispatchRoleBatterySoc);
+    hass_dispatch_add_role(hass, hass->standby_energy_house_entity_id, DispatchRoleHouse);
+    hass_dispatch_add_series(hass, &hass->standby_solar_series, 0, DispatchRoleSolar);
+    hass_dispatch_add_series(hass, &hass->standby_grid_in_series, 1, DispatchRoleGridIn);
+    hass_dispatch_add_series(hass, &hass->standby_grid_out_series, 2, DispatchRoleGridOut);
+    hass_dispatch_add_series(hass, &hass->standby_battery_out_series, 3, DispatchRoleBatteryOut);
+    hass_dispatch_add_series(hass, &hass->standby_battery_in_series, 4, DispatchRoleBatteryIn);
+    xSemaphoreGive(hass->mutex);
+}
+
+static bool hass_dispatch_lookup(home_assistant_context_t* hass, const char* entity_id, EntityDispatch* out) {
+    if (!entity_id) {
+        return false;
+    }
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const EntityDispatch* slot = hass_dispatch_slot(hass, entity_id, false);
+    if (slot) {
+        *out = *slot;
     }
     xSemaphoreGive(hass->mutex);
+    return slot != nullptr;
+}
+
+int16_t hass_find_floor_for_floor_id(home_assistant_context_t* hass, const char* floor_id) {
+    int16_t floor_idx = -1;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    id_map_get(&hass->floor_map, floor_id, &floor_idx);
+    xSemaphoreGive(hass->mutex);
     return floor_idx;
 }
 
@@ -928,12 +1432,7 @@ int16_t hass_ensure_other_floor(home_assistant_context_t* hass) {
 int16_t hass_find_room_for_area(home_assistant_context_t* hass, const char* area_id) {
     int16_t room_idx = -1;
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    for (uint8_t idx = 0; idx < hass->area_count; idx++) {
-        if (strcmp(hass->area_ids[idx], area_id) == 0) {
-            room_idx = hass->area_room_indices[idx];
-            break;
-        }
-    }
+    id_map_get(&hass->area_map, area_id, &room_idx);
     xSemaphoreGive(hass->mutex);
     return room_idx;
 }
@@ -941,12 +1440,7 @@ int16_t hass_find_room_for_area(home_assistant_context_t* hass, const char* area
 int16_t hass_find_room_for_device(home_assistant_context_t* hass, const char* device_id) {
     int16_t room_idx = -1;
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    for (uint16_t idx = 0; idx < hass->device_count; idx++) {
-        if (strcmp(hass->device_ids[idx], device_id) == 0) {
-            room_idx = hass->device_room_indices[idx];
-            break;
-        }
-    }
+    id_map_get(&hass->device_map, device_id, &room_idx);
     xSemaphoreGive(hass->mutex);
     return room_idx;
 }
@@ -980,10 +1474,25 @@ static void hass_parse_weather_entity_update(home_assistant_context_t* hass, cJS
     store_set_standby_weather(hass->store, condition, has_temperature, temperature_c);
 }
 
-// Map the Bermuda area sensor's reported area onto a known room. Called on
-// sensor updates and again after discovery rebuilds the room list.
-static void hass_update_device_room(home_assistant_context_t* hass) {
-    char area_id[MAX_ICON_NAME_LEN];
+// Last reported area, so a wake boot can head for the device room before
+// Bermuda reports again
+static constexpr uint32_t DEVICE_AREA_MAGIC = 0x41524541; // "AREA"
+RTC_NOINIT_ATTR static uint32_t g_rtc_device_area_magic;
+RTC_NOINIT_ATTR static char g_rtc_device_area_id[MAX_ICON_NAME_LEN];
+
+static bool hass_cached_device_area(char* out, size_t out_len) {
+    if (g_rtc_device_area_magic != DEVICE_AREA_MAGIC) {
+        return false;
+    }
+    g_rtc_device_area_id[sizeof(g_rtc_device_area_id) - 1] = '\0';
+    copy_string(out, out_len, g_rtc_device_area_id);
+    return out[0] != '\0';
+}
+
+// Map the Bermuda area sensor's reported area onto a known room. Called on
+// sensor updates and again after discovery rebuilds the room list.
+static void hass_update_device_room(home_assistant_context_t* hass) {
+    char area_id[MAX_ICON_NAME_LEN];
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
     copy_string(area_id, sizeof(area_id), hass->device_area_id);
     xSemaphoreGive(hass->mutex);
@@ -1004,41 +1513,24 @@ static void hass_parse_device_area_update(home_assistant_context_t* hass, cJSON*
 
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
     copy_string(hass->device_area_id, sizeof(hass->device_area_id), area_id_item ? area_id_item->valuestring : "");
+    copy_string(g_rtc_device_area_id, sizeof(g_rtc_device_area_id), hass->device_area_id);
+    g_rtc_device_area_magic = DEVICE_AREA_MAGIC;
     xSemaphoreGive(hass->mutex);
 
     ESP_LOGI(TAG, "Device area update: '%s'", area_id_item ? area_id_item->valuestring : "(none)");
     hass_update_device_room(hass);
 }
 
-static void hass_parse_standby_entity_update(home_assistant_context_t* hass, const char* entity_id, cJSON* item) {
-    if (!entity_id || !item || !cJSON_IsObject(item)) {
+static void hass_apply_standby_value(home_assistant_context_t* hass, const EntityDispatch* dispatch, bool valid, float value);
+
+static void hass_parse_standby_entity_update(home_assistant_context_t* hass, const EntityDispatch* dispatch, cJSON* item) {
+    if (!dispatch || dispatch->roles == 0 || !item || !cJSON_IsObject(item)) {
         return;
     }
 
-    bool is_device_area = false;
-    bool is_weather = false;
-    bool is_battery_soc = false;
-    bool is_house_direct = false;
-    bool house_computed = false;
-    bool series_changed = false;
-    int8_t solar_idx = -1;
-    int8_t grid_in_idx = -1;
-    int8_t grid_out_idx = -1;
-    int8_t battery_out_idx = -1;
-    int8_t battery_in_idx = -1;
-
-    xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    is_device_area = has_entity_id(hass->device_area_entity_id) && strcmp(entity_id, hass->device_area_entity_id) == 0;
-    is_weather = has_entity_id(hass->standby_weather_entity_id) && strcmp(entity_id, hass->standby_weather_entity_id) == 0;
-    is_battery_soc = has_entity_id(hass->standby_energy_battery_soc_entity_id) && strcmp(entity_id, hass->standby_energy_battery_soc_entity_id) == 0;
-    is_house_direct = has_entity_id(hass->standby_energy_house_entity_id) && strcmp(entity_id, hass->standby_energy_house_entity_id) == 0;
-    house_computed = hass->standby_energy_house_computed;
-    solar_idx = standby_energy_series_find(&hass->standby_solar_series, entity_id);
-    grid_in_idx = standby_energy_series_find(&hass->standby_grid_in_series, entity_id);
-    grid_out_idx = standby_energy_series_find(&hass->standby_grid_out_series, entity_id);
-    battery_out_idx = standby_energy_series_find(&hass->standby_battery_out_series, entity_id);
-    battery_in_idx = standby_energy_series_find(&hass->standby_battery_in_series, entity_id);
-    xSemaphoreGive(hass->mutex);
+    const bool is_device_area = (dispatch->roles & DispatchRoleDeviceArea) != 0;
+    const bool is_weather = (dispatch->roles & DispatchRoleWeather) != 0;
+    const bool is_battery_soc = (dispatch->roles & DispatchRoleBatterySoc) != 0;
 
     if (is_device_area) {
         hass_parse_device_area_update(hass, item);
@@ -1063,7 +1555,21 @@ static void hass_parse_standby_entity_update(home_assistant_context_t* hass, con
     if (!has_state_update && !(is_battery_soc && valid)) {
         return;
     }
+    hass_apply_standby_value(hass, dispatch, valid, value);
+}
+
+static void hass_apply_standby_value(home_assistant_context_t* hass, const EntityDispatch* dispatch, bool valid, float value) {
+    const bool is_battery_soc = (dispatch->roles & DispatchRoleBatterySoc) != 0;
+    const bool is_house_direct = (dispatch->roles & DispatchRoleHouse) != 0;
+    const int8_t solar_idx = dispatch->series_slots[0];
+    const int8_t grid_in_idx = dispatch->series_slots[1];
+    const int8_t grid_out_idx = dispatch->series_slots[2];
+    const int8_t battery_out_idx = dispatch->series_slots[3];
+    const int8_t battery_in_idx = dispatch->series_slots[4];
+    bool series_changed = false;
+
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool house_computed = hass->standby_energy_house_computed;
     if (solar_idx >= 0) {
         series_changed = standby_energy_series_set_value(&hass->standby_solar_series, solar_idx, valid, value) || series_changed;
     }
@@ -1143,13 +1649,32 @@ static void hass_parse_weather_forecast_result(home_assistant_context_t* hass, c
     }
 }
 
+// weather/subscribe_forecast events: {"type": "daily", "forecast": [...]}.
+// The store only redraws standby when the days actually differ.
+static bool hass_handle_forecast_event(home_assistant_context_t* hass, int subscription_id, cJSON* event) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool ours = hass->weather_forecast_subscription_id != 0 && subscription_id == hass->weather_forecast_subscription_id;
+    xSemaphoreGive(hass->mutex);
+    if (!ours) {
+        return false;
+    }
+
+    StandbyForecastDay forecast_days[MAX_STANDBY_FORECAST_DAYS] = {};
+    const uint8_t day_count = parse_forecast_days(cJSON_GetObjectItem(event, "forecast"), forecast_days, MAX_STANDBY_FORECAST_DAYS);
+    ESP_LOGI(TAG, "Weather forecast pushed: %u days", day_count);
+    if (day_count > 0) {
+        store_set_standby_forecast(hass->store, forecast_days, day_count);
+    }
+    return true;
+}
+
 static void hass_energy_add_stat_from_key(home_assistant_context_t::StandbyEnergySeries* series, cJSON* object, const char* key) {
     if (!series || !cJSON_IsObject(object)) {
         return;
     }
     cJSON* item = cJSON_GetObjectItem(object, key);
     if (cJSON_IsString(item) && item->valuestring) {
-        standby_energy_series_add_entity(series, item->valuestring);
+        standby_energy_series_add_entity(series, nullptr, item->valuestring);
     }
 }
 
@@ -1180,19 +1705,19 @@ static void hass_apply_energy_preferences(home_assistant_context_t* hass,
 
     xSemaphoreTake(hass->mutex, portMAX_DELAY);
     if (!solar_configured) {
-        hass->standby_solar_series = *solar_series;
+        standby_energy_series_assign(&hass->standby_solar_series, &hass->discovery_ids, solar_series);
     }
     if (!grid_in_configured) {
-        hass->standby_grid_in_series = *grid_in_series;
+        standby_energy_series_assign(&hass->standby_grid_in_series, &hass->discovery_ids, grid_in_series);
     }
     if (!grid_out_configured) {
-        hass->standby_grid_out_series = *grid_out_series;
+        standby_energy_series_assign(&hass->standby_grid_out_series, &hass->discovery_ids, grid_out_series);
     }
     if (!battery_out_configured) {
-        hass->standby_battery_out_series = *battery_out_series;
+        standby_energy_series_assign(&hass->standby_battery_out_series, &hass->discovery_ids, battery_out_series);
     }
     if (!battery_in_configured) {
-        hass->standby_battery_in_series = *battery_in_series;
+        standby_energy_series_assign(&hass->standby_battery_in_series, &hass->discovery_ids, battery_in_series);
     }
 
     const bool has_discovered_sources = hass->standby_solar_series.count > 0 || hass->standby_grid_in_series.count > 0 ||
@@ -1276,24 +1801,13 @@ static void hass_parse_energy_preferences_result(home_assistant_context_t* hass,
         return;
     }
 
-    auto* solar_series = static_cast<home_assistant_context_t::StandbyEnergySeries*>(malloc(sizeof(home_assistant_context_t::StandbyEnergySeries)));
-    auto* grid_in_series =
-        static_cast<home_assistant_context_t::StandbyEnergySeries*>(malloc(sizeof(home_assistant_context_t::StandbyEnergySeries)));
-    auto* grid_out_series =
-        static_cast<home_assistant_context_t::StandbyEnergySeries*>(malloc(sizeof(home_assistant_context_t::StandbyEnergySeries)));
-    auto* battery_out_series =
-        static_cast<home_assistant_context_t::StandbyEnergySeries*>(malloc(sizeof(home_assistant_context_t::StandbyEnergySeries)));
-    auto* battery_in_series =
-        static_cast<home_assistant_context_t::StandbyEnergySeries*>(malloc(sizeof(home_assistant_context_t::StandbyEnergySeries)));
-    if (!solar_series || !grid_in_series || !grid_out_series || !battery_out_series || !battery_in_series) {
-        free(solar_series);
-        free(grid_in_series);
-        free(grid_out_series);
-        free(battery_out_series);
-        free(battery_in_series);
-        ESP_LOGW(TAG, "Insufficient memory to parse energy preferences");
-        return;
-    }
+    // Ids are borrowed from result_item until hass_apply_energy_preferences interns them
+    home_assistant_context_t::StandbyEnergySeries solar = {}, grid_in = {}, grid_out = {}, battery_out = {}, battery_in = {};
+    auto* solar_series = &solar;
+    auto* grid_in_series = &grid_in;
+    auto* grid_out_series = &grid_out;
+    auto* battery_out_series = &battery_out;
+    auto* battery_in_series = &battery_in;
 
     standby_energy_series_reset(solar_series);
     standby_energy_series_reset(grid_in_series);
@@ -1334,50 +1848,185 @@ static void hass_parse_energy_preferences_result(home_assistant_context_t* hass,
     if (solar_series->count == 0 && grid_in_series->count == 0 && grid_out_series->count == 0 && battery_out_series->count == 0 &&
         battery_in_series->count == 0) {
         ESP_LOGW(TAG, "No usable energy entities discovered from energy/get_prefs");
-        free(solar_series);
-        free(grid_in_series);
-        free(grid_out_series);
-        free(battery_out_series);
-        free(battery_in_series);
         return;
     }
 
     hass_apply_energy_preferences(hass, solar_series, grid_in_series, grid_out_series, battery_out_series, battery_in_series);
-    free(solar_series);
-    free(grid_in_series);
-    free(grid_out_series);
-    free(battery_out_series);
-    free(battery_in_series);
-}
-
-void hass_parse_entity_update(home_assistant_context_t* hass, uint8_t widget_idx, cJSON* item) {
-    uint8_t entity_mode = 0;
-    int8_t entity_value = -1;
-    CommandType command_type = CommandType::SetLightBrightnessPercentage;
-    uint8_t climate_mode_mask = CLIMATE_MODE_MASK_DEFAULT;
-    uint8_t previous_climate_mode_mask = CLIMATE_MODE_MASK_DEFAULT;
-    bool climate_hvac_modes_known = false;
-    bool climate_is_ac = false;
-    bool previous_climate_hvac_modes_known = false;
-    bool previous_climate_is_ac = false;
-
-    xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    entity_mode = hass->entity_modes[widget_idx];
-    entity_value = hass->entity_values[widget_idx];
-    xSemaphoreTake(hass->store->mutex, portMAX_DELAY);
-    command_type = hass->store->entities[widget_idx].command_type;
-    if (command_type == CommandType::SetClimateModeAndTemperature) {
-        previous_climate_mode_mask = climate_normalize_mode_mask(hass->store->entities[widget_idx].climate_mode_mask);
-        climate_mode_mask = previous_climate_mode_mask;
-        previous_climate_hvac_modes_known = hass->store->entities[widget_idx].climate_hvac_modes_known;
-        previous_climate_is_ac = hass->store->entities[widget_idx].climate_is_ac;
-        climate_hvac_modes_known = previous_climate_hvac_modes_known;
-        climate_is_ac = previous_climate_is_ac;
+}
+
+// Caller holds hass->mutex
+static bool hass_entity_has_echo(const home_assistant_context_t* hass, uint8_t entity_idx) {
+    for (size_t idx = 0; idx < HASS_MAX_COMMAND_ECHOES; idx++) {
+        if (hass->echoes[idx].active && hass->echoes[idx].entity_idx == entity_idx) {
+            return true;
+        }
     }
-    xSemaphoreGive(hass->store->mutex);
+    return false;
+}
 
-    cJSON* state = cJSON_GetObjectItem(item, "s");
-    cJSON* attributes = cJSON_GetObjectItem(item, "a");
+enum class EchoMatch : uint8_t {
+    Foreign,    // someone else's change, or nothing of ours outstanding
+    Own,        // one of our calls, others still outstanding
+    OwnSettled, // our last outstanding call
+};
+
+// Caller holds hass->mutex
+static EchoMatch hass_match_echo(home_assistant_context_t* hass, uint8_t entity_idx, const char* context_id, uint8_t value) {
+    if (!context_id) {
+        return EchoMatch::Foreign;
+    }
+
+    CommandEcho* awaiting_result = nullptr;
+    for (size_t idx = 0; idx < HASS_MAX_COMMAND_ECHOES; idx++) {
+        CommandEcho& echo = hass->echoes[idx];
+        if (!echo.active || echo.entity_idx != entity_idx) {
+            continue;
+        }
+        if (echo.message_id == 0 && strcmp(echo.context_id, context_id) == 0) {
+            echo.active = false;
+            return hass_entity_has_echo(hass, entity_idx) ? EchoMatch::Own : EchoMatch::OwnSettled;
+        }
+        if (echo.message_id != 0) {
+            awaiting_result = &echo;
+        }
+    }
+
+    if (awaiting_result) {
+        awaiting_result->early_seen = true;
+        awaiting_result->early_value = value;
+        copy_string(awaiting_result->early_context_id, sizeof(awaiting_result->early_context_id), context_id);
+    }
+    return EchoMatch::Foreign;
+}
+
+// Caller holds hass->mutex. Returns an entity whose echo had to be evicted, -1 otherwise.
+static int16_t hass_track_command_echo(home_assistant_context_t* hass, uint8_t entity_idx, uint16_t message_id) {
+    CommandEcho* slot = nullptr;
+    for (size_t idx = 0; idx < HASS_MAX_COMMAND_ECHOES && !slot; idx++) {
+        if (!hass->echoes[idx].active) {
+            slot = &hass->echoes[idx];
+        }
+    }
+
+    int16_t evicted_idx = -1;
+    if (!slot) {
+        slot = &hass->echoes[0];
+        for (size_t idx = 1; idx < HASS_MAX_COMMAND_ECHOES; idx++) {
+            if (static_cast<int32_t>(hass->echoes[idx].deadline - slot->deadline) < 0) {
+                slot = &hass->echoes[idx];
+            }
+        }
+        evicted_idx = slot->entity_idx;
+    }
+
+    *slot = {};
+    slot->active = true;
+    slot->entity_idx = entity_idx;
+    slot->message_id = message_id;
+    slot->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(HASS_COMMAND_RESULT_TIMEOUT_MS);
+    if (evicted_idx >= 0 && hass_entity_has_echo(hass, static_cast<uint8_t>(evicted_idx))) {
+        evicted_idx = -1;
+    }
+    return evicted_idx;
+}
+
+// The result carries the context id our state change will be tagged with
+static bool hass_handle_command_echo_result(home_assistant_context_t* hass, uint16_t message_id, bool success, cJSON* result_item) {
+    cJSON* context = cJSON_IsObject(result_item) ? cJSON_GetObjectItem(result_item, "context") : nullptr;
+    const char* context_id = cJSON_IsObject(context) ? get_optional_string(context, "id", nullptr) : nullptr;
+
+    // A room-wide call has an echo per entity
+    bool matched = false;
+    uint8_t release_idxs[HASS_MAX_COMMAND_ECHOES];
+    uint8_t release_count = 0;
+    StoreValueUpdate confirms[HASS_MAX_COMMAND_ECHOES];
+    uint8_t confirm_count = 0;
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    for (size_t idx = 0; idx < HASS_MAX_COMMAND_ECHOES; idx++) {
+        CommandEcho& echo = hass->echoes[idx];
+        if (!echo.active || echo.message_id != message_id) {
+            continue;
+        }
+        matched = true;
+        if (!success) {
+            echo.active = false;
+            if (!hass_entity_has_echo(hass, echo.entity_idx)) {
+                release_idxs[release_count++] = echo.entity_idx;
+            }
+        } else if (context_id && echo.early_seen && strcmp(echo.early_context_id, context_id) == 0) {
+            echo.active = false;
+            const bool settled = !hass_entity_has_echo(hass, echo.entity_idx);
+            confirms[confirm_count++] = {
+                .entity_idx = echo.entity_idx,
+                .value = echo.early_value,
+                .source = settled ? StoreValueSource::ConfirmedSettled : StoreValueSource::Confirmed,
+            };
+        } else {
+            // Without a context id the target simply times out
+            copy_string(echo.context_id, sizeof(echo.context_id), context_id);
+            echo.message_id = 0;
+            echo.early_seen = false;
+            echo.deadline = xTaskGetTickCount() + pdMS_TO_TICKS(HASS_COMMAND_ECHO_TIMEOUT_MS);
+        }
+    }
+    xSemaphoreGive(hass->mutex);
+
+    for (uint8_t idx = 0; idx < release_count; idx++) {
+        store_release_target(hass->store, release_idxs[idx]);
+    }
+    if (confirm_count == 1) {
+        ESP_LOGI(TAG, "Widget %d confirmed at %d", confirms[0].entity_idx, confirms[0].value);
+    }
+    if (confirm_count > 0) {
+        store_update_values_batch(hass->store, confirms, confirm_count);
+    }
+    return matched;
+}
+
+static void hass_expire_command_echoes(home_assistant_context_t* hass) {
+    uint8_t expired[HASS_MAX_COMMAND_ECHOES];
+    size_t expired_count = 0;
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const TickType_t now = xTaskGetTickCount();
+    for (size_t idx = 0; idx < HASS_MAX_COMMAND_ECHOES; idx++) {
+        CommandEcho& echo = hass->echoes[idx];
+        if (echo.active && static_cast<int32_t>(now - echo.deadline) >= 0) {
+            echo.active = false;
+            expired[expired_count++] = echo.entity_idx;
+        }
+    }
+    size_t release_count = 0;
+    for (size_t idx = 0; idx < expired_count; idx++) {
+        if (!hass_entity_has_echo(hass, expired[idx])) {
+            expired[release_count++] = expired[idx];
+        }
+    }
+    xSemaphoreGive(hass->mutex);
+
+    for (size_t idx = 0; idx < release_count; idx++) {
+        ESP_LOGW(TAG, "No echo for widget %u, showing the reported value", expired[idx]);
+        store_release_target(hass->store, expired[idx]);
+    }
+}
+
+static bool decoded_has_number(const DecodedState* state, StateNumber number) {
+    return (state->numbers_valid & (1 << number)) != 0;
+}
+
+// Turns a decoded state into the store update for its widget. Caller holds
+// hass->mutex; `kind` is the entity as the store knew it when the batch began.
+static void hass_parse_entity_update(home_assistant_context_t* hass, uint8_t widget_idx, const StoreEntityKind* kind, const DecodedState* item,
+                                     StoreValueUpdate* update) {
+    uint8_t entity_mode = hass->entity_modes[widget_idx];
+    int8_t entity_value = hass->entity_values[widget_idx];
+    const CommandType command_type = kind->command_type;
+    uint8_t climate_mode_mask = climate_normalize_mode_mask(kind->climate_mode_mask);
+    bool climate_hvac_modes_known = kind->climate_hvac_modes_known;
+    bool climate_is_ac = kind->climate_is_ac;
+
+    const char* state = item->has_state ? item->state : nullptr;
 
     uint8_t value = 0;
     if (command_type == CommandType::SetClimateModeAndTemperature) {
@@ -1386,42 +2035,31 @@ void hass_parse_entity_update(home_assistant_context_t* hass, uint8_t widget_idx
             mode = ClimateMode::Off;
         }
 
-        if (cJSON_IsObject(attributes)) {
-            cJSON* hvac_modes = cJSON_GetObjectItem(attributes, "hvac_modes");
-            if (cJSON_IsArray(hvac_modes)) {
-                climate_hvac_modes_known = true;
-                uint8_t parsed_mode_mask = 0;
-                cJSON* hvac_mode_item = nullptr;
-                cJSON_ArrayForEach(hvac_mode_item, hvac_modes) {
-                    if (!cJSON_IsString(hvac_mode_item)) {
-                        continue;
-                    }
-
-                    const char* hvac_mode = hvac_mode_item->valuestring;
-                    if (strcmp(hvac_mode, "off") == 0) {
-                        parsed_mode_mask |= CLIMATE_MODE_MASK_OFF;
-                    } else if (strcmp(hvac_mode, "heat") == 0 || strcmp(hvac_mode, "heating") == 0) {
-                        parsed_mode_mask |= CLIMATE_MODE_MASK_HEAT;
-                    } else if (strcmp(hvac_mode, "cool") == 0 || strcmp(hvac_mode, "cooling") == 0) {
-                        parsed_mode_mask |= CLIMATE_MODE_MASK_COOL;
-                    } else if (strcmp(hvac_mode, "heat_cool") == 0) {
-                        parsed_mode_mask |= CLIMATE_MODE_MASK_HEAT | CLIMATE_MODE_MASK_COOL;
-                    }
-                }
+        if (item->has_hvac_modes) {
+            climate_hvac_modes_known = true;
+            uint8_t parsed_mode_mask = 0;
+            if (item->hvac_modes & StateHvacOff) {
+                parsed_mode_mask |= CLIMATE_MODE_MASK_OFF;
+            }
+            if (item->hvac_modes & StateHvacHeat) {
+                parsed_mode_mask |= CLIMATE_MODE_MASK_HEAT;
+            }
+            if (item->hvac_modes & StateHvacCool) {
+                parsed_mode_mask |= CLIMATE_MODE_MASK_COOL;
+            }
 
-                climate_is_ac = (parsed_mode_mask & CLIMATE_MODE_MASK_COOL) != 0;
-                if ((parsed_mode_mask & (CLIMATE_MODE_MASK_HEAT | CLIMATE_MODE_MASK_COOL)) != 0) {
-                    climate_mode_mask = climate_normalize_mode_mask(parsed_mode_mask);
-                }
+            climate_is_ac = (parsed_mode_mask & CLIMATE_MODE_MASK_COOL) != 0;
+            if ((parsed_mode_mask & (CLIMATE_MODE_MASK_HEAT | CLIMATE_MODE_MASK_COOL)) != 0) {
+                climate_mode_mask = climate_normalize_mode_mask(parsed_mode_mask);
             }
         }
 
-        if (cJSON_IsString(state)) {
-            if (strcmp(state->valuestring, "off") == 0) {
+        if (state) {
+            if (strcmp(state, "off") == 0) {
                 mode = ClimateMode::Off;
-            } else if (strcmp(state->valuestring, "heat") == 0 || strcmp(state->valuestring, "heating") == 0) {
+            } else if (strcmp(state, "heat") == 0 || strcmp(state, "heating") == 0) {
                 mode = ClimateMode::Heat;
-            } else if (strcmp(state->valuestring, "cool") == 0 || strcmp(state->valuestring, "cooling") == 0) {
+            } else if (strcmp(state, "cool") == 0 || strcmp(state, "cooling") == 0) {
                 mode = ClimateMode::Cool;
             }
         }
@@ -1430,14 +2068,10 @@ void hass_parse_entity_update(home_assistant_context_t* hass, uint8_t widget_idx
         }
 
         uint8_t temp_steps = entity_value >= 0 ? climate_clamp_temp_steps(entity_value) : climate_celsius_to_steps(20.0f);
-        if (cJSON_IsObject(attributes)) {
-            cJSON* target_temp = cJSON_GetObjectItem(attributes, "temperature");
-            if (!cJSON_IsNumber(target_temp)) {
-                target_temp = cJSON_GetObjectItem(attributes, "target_temp_low");
-            }
-            if (cJSON_IsNumber(target_temp)) {
-                temp_steps = climate_celsius_to_steps(static_cast<float>(target_temp->valuedouble));
-            }
+        if (decoded_has_number(item, StateNumberTemperature)) {
+            temp_steps = climate_celsius_to_steps(item->numbers[StateNumberTemperature]);
+        } else if (decoded_has_number(item, StateNumberTargetTempLow)) {
+            temp_steps = climate_celsius_to_steps(item->numbers[StateNumberTargetTempLow]);
         }
 
         entity_mode = static_cast<uint8_t>(mode);
@@ -1445,10 +2079,10 @@ void hass_parse_entity_update(home_assistant_context_t* hass, uint8_t widget_idx
         value = climate_pack_value(mode, temp_steps);
     } else if (command_type == CommandType::SetCoverOpenClose || command_type == CommandType::ValveOpenClose) {
         bool is_open = entity_mode != 0;
-        if (cJSON_IsString(state)) {
-            if (strcmp(state->valuestring, "open") == 0 || strcmp(state->valuestring, "opening") == 0) {
+        if (state) {
+            if (strcmp(state, "open") == 0 || strcmp(state, "opening") == 0) {
                 is_open = true;
-            } else if (strcmp(state->valuestring, "closed") == 0 || strcmp(state->valuestring, "closing") == 0) {
+            } else if (strcmp(state, "closed") == 0 || strcmp(state, "closing") == 0) {
                 is_open = false;
             }
         }
@@ -1457,29 +2091,22 @@ void hass_parse_entity_update(home_assistant_context_t* hass, uint8_t widget_idx
     } else {
         bool is_on = entity_mode != 0;
 
-        if (cJSON_IsString(state)) {
-            if (strcmp(state->valuestring, "on") == 0) {
+        if (state) {
+            if (strcmp(state, "on") == 0) {
                 is_on = true;
-            } else if (strcmp(state->valuestring, "off") == 0) {
+            } else if (strcmp(state, "off") == 0) {
                 is_on = false;
             }
         }
 
-        if (cJSON_IsObject(attributes)) {
-            cJSON* percentage = cJSON_GetObjectItem(attributes, "percentage");
-            if (cJSON_IsNumber(percentage)) {
-                entity_value = percentage->valueint;
-            }
-
-            cJSON* brightness = cJSON_GetObjectItem(attributes, "brightness");
-            if (cJSON_IsNumber(brightness)) {
-                entity_value = brightness->valueint * 100 / 254;
-            }
-
-            cJSON* off_brightness = cJSON_GetObjectItem(attributes, "off_brightness");
-            if (cJSON_IsNumber(off_brightness)) {
-                entity_value = off_brightness->valueint * 100 / 254;
-            }
+        if (decoded_has_number(item, StateNumberPercentage)) {
+            entity_value = static_cast<int>(item->numbers[StateNumberPercentage]);
+        }
+        if (decoded_has_number(item, StateNumberBrightness)) {
+            entity_value = static_cast<int>(item->numbers[StateNumberBrightness]) * 100 / 254;
+        }
+        if (decoded_has_number(item, StateNumberOffBrightness)) {
+            entity_value = static_cast<int>(item->numbers[StateNumberOffBrightness]) * 100 / 254;
         }
 
         entity_mode = is_on ? 1 : 0;
@@ -1490,423 +2117,1998 @@ void hass_parse_entity_update(home_assistant_context_t* hass, uint8_t widget_idx
 
     hass->entity_modes[widget_idx] = entity_mode;
     hass->entity_values[widget_idx] = entity_value;
+
+    const EchoMatch echo = hass_match_echo(hass, widget_idx, item->context_id[0] != '\0' ? item->context_id : nullptr, value);
+    *update = {};
+    update->entity_idx = widget_idx;
+    update->value = value;
+    if (echo == EchoMatch::Foreign) {
+        ESP_LOGD(TAG, "Setting value of widget %d to %d", widget_idx, value);
+        update->source = StoreValueSource::Reported;
+    } else {
+        ESP_LOGI(TAG, "Widget %d confirmed at %d", widget_idx, value);
+        update->source = echo == EchoMatch::OwnSettled ? StoreValueSource::ConfirmedSettled : StoreValueSource::Confirmed;
+    }
     if (command_type == CommandType::SetClimateModeAndTemperature) {
-        xSemaphoreTake(hass->store->mutex, portMAX_DELAY);
-        hass->store->entities[widget_idx].climate_mode_mask = climate_mode_mask;
-        hass->store->entities[widget_idx].climate_hvac_modes_known = climate_hvac_modes_known;
-        hass->store->entities[widget_idx].climate_is_ac = climate_is_ac;
-        xSemaphoreGive(hass->store->mutex);
+        if (climate_hvac_modes_known != kind->climate_hvac_modes_known || climate_is_ac != kind->climate_is_ac) {
+            ESP_LOGI(TAG, "Climate visibility updated for %s: hvac_modes_known=%d, is_ac=%d", hass->entity_ids[widget_idx],
+                     climate_hvac_modes_known ? 1 : 0, climate_is_ac ? 1 : 0);
+        }
+        update->climate_visibility = true;
+        update->climate_mode_mask = climate_mode_mask;
+        update->climate_hvac_modes_known = climate_hvac_modes_known;
+        update->climate_is_ac = climate_is_ac;
+    }
+}
+
+// Widget states of one subscribe_entities event are collected here and applied
+// to the store together, so the initial sync costs one store lock and at most
+// one UI wakeup instead of a few of each per entity
+static void hass_queue_entity_update(home_assistant_context_t* hass, uint8_t widget_idx, const DecodedState* item) {
+    if (!hass->state_batch_kinds_loaded) {
+        hass->state_batch_kind_count = store_get_entity_kinds(hass->store, hass->state_batch_kinds, MAX_ENTITIES);
+        hass->state_batch_kinds_loaded = true;
+    }
+    if (widget_idx >= hass->state_batch_kind_count || hass->state_batch_count >= MAX_ENTITIES) {
+        return;
     }
 
-    TickType_t now = xTaskGetTickCount();
-    bool ignore_update = (now - hass->last_command_sent_at_ms[widget_idx]) < pdMS_TO_TICKS(HASS_IGNORE_UPDATE_DELAY_MS);
-    const char* entity_id = hass->entity_ids[widget_idx];
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass_parse_entity_update(hass, widget_idx, &hass->state_batch_kinds[widget_idx], item,
+                             &hass->state_batch[hass->state_batch_count++]);
     xSemaphoreGive(hass->mutex);
+}
 
-    if (ignore_update) {
-        ESP_LOGI(TAG, "Ignoring update of entity %s", entity_id);
+static void hass_apply_entity_updates(home_assistant_context_t* hass) {
+    const uint8_t count = hass->state_batch_count;
+    hass->state_batch_count = 0;
+    hass->state_batch_kinds_loaded = false;
+    if (count == 0) {
         return;
     }
+    const uint8_t shown_changes = store_update_values_batch(hass->store, hass->state_batch, count);
+    ESP_LOGI(TAG, "Applied %u widget states, %u on screen changed", count, shown_changes);
+}
 
-    ESP_LOGI(TAG, "Setting value of widget %d to %d", widget_idx, value);
-    store_update_value(hass->store, widget_idx, value);
-    if (command_type == CommandType::SetClimateModeAndTemperature &&
-        (climate_mode_mask != previous_climate_mode_mask || climate_hvac_modes_known != previous_climate_hvac_modes_known ||
-         climate_is_ac != previous_climate_is_ac)) {
-        ESP_LOGI(TAG, "Climate visibility updated for %s: hvac_modes_known=%d, is_ac=%d", entity_id, climate_hvac_modes_known ? 1 : 0,
-                 climate_is_ac ? 1 : 0);
-        store_bump_rooms_revision(hass->store);
+// Standby roles beyond a plain numeric state (forecasts, the Bermuda area, SoC
+// attributes) are rare and read from the entity's own slice of the message
+static void hass_parse_standby_state(home_assistant_context_t* hass, const EntityDispatch* dispatch, const DecodedState* state) {
+    float value = 0.0f;
+    const bool valid = state->has_state && parse_state_text(state->state, &value);
+    const bool is_battery_soc = (dispatch->roles & DispatchRoleBatterySoc) != 0;
+    if ((dispatch->roles & (DispatchRoleDeviceArea | DispatchRoleWeather)) != 0 || (is_battery_soc && !valid && state->has_attributes)) {
+        cJSON* item = cJSON_ParseWithLength(state->json, state->json_len);
+        hass_parse_standby_entity_update(hass, dispatch, item);
+        cJSON_Delete(item);
+        return;
     }
-}
 
-void hass_handle_entity_update(home_assistant_context_t* hass, cJSON* event) {
-    cJSON* initial_values = cJSON_GetObjectItem(event, "a");
-    if (cJSON_IsObject(initial_values)) {
-        cJSON* item = NULL;
-        cJSON_ArrayForEach(item, initial_values) {
-            int16_t entity_id = hass_match_entity(hass, item->string);
-            if (entity_id != -1) {
-                ESP_LOGI(TAG, "Found initial value for widget %d (%s)", entity_id, item->string);
-                hass_parse_entity_update(hass, entity_id, item);
-            }
-            hass_parse_standby_entity_update(hass, item->string, item);
-        }
+    // Attribute-only updates leave the previous values alone
+    if (state->has_state) {
+        hass_apply_standby_value(hass, dispatch, valid, value);
     }
+}
 
-    cJSON* changes = cJSON_GetObjectItem(event, "c");
-    if (cJSON_IsObject(changes)) {
-        cJSON* item = NULL;
-        cJSON_ArrayForEach(item, changes) {
-            int16_t entity_id = hass_match_entity(hass, item->string);
-            if (entity_id != -1) {
-                cJSON* plus_value = cJSON_GetObjectItem(item, "+");
-                if (cJSON_IsObject(plus_value)) {
-                    ESP_LOGI(TAG, "Found update for widget %d (%s)", entity_id, item->string);
-                    hass_parse_entity_update(hass, entity_id, plus_value);
-                }
-            }
-            cJSON* plus_value = cJSON_GetObjectItem(item, "+");
-            if (cJSON_IsObject(plus_value)) {
-                hass_parse_standby_entity_update(hass, item->string, plus_value);
-            }
-        }
+static bool hass_state_decoder_want(void* ctx, const char* entity_id) {
+    home_assistant_context_t* hass = static_cast<home_assistant_context_t*>(ctx);
+    return hass_dispatch_lookup(hass, entity_id, &hass->decoding_dispatch);
+}
+
+static void hass_state_decoder_on_state(void* ctx, const char* entity_id, const DecodedState* state) {
+    home_assistant_context_t* hass = static_cast<home_assistant_context_t*>(ctx);
+    const EntityDispatch* dispatch = &hass->decoding_dispatch;
+    if (dispatch->widget_idx != -1) {
+        ESP_LOGD(TAG, "Found state for widget %d (%s)", dispatch->widget_idx, entity_id);
+        hass_queue_entity_update(hass, dispatch->widget_idx, state);
     }
+    if (dispatch->roles != 0) {
+        hass_parse_standby_state(hass, dispatch, state);
+    }
+}
 
+// subscribe_entities events bypass cJSON; returns false for any other message
+static bool hass_decode_entity_event(home_assistant_context_t* hass, const char* json, size_t len) {
+    const StateDecoderHandlers handlers = {
+        .want = hass_state_decoder_want,
+        .on_state = hass_state_decoder_on_state,
+        .ctx = hass,
+    };
+    const StateDecodeResult result = state_decoder_decode(json, len, &handlers);
+    hass_apply_entity_updates(hass);
+    if (result == StateDecodeResult::NotStates) {
+        return false;
+    }
+    if (result == StateDecodeResult::Malformed) {
+        ESP_LOGW(TAG, "Malformed entity state event, applied the states before the error");
+    }
     hass_update_state(hass, ConnState::Up);
-}
+    power_wifi_sleep_hold(false); // the first event is the full state sync — discovery burst is over
 
-void hass_parse_floor_registry(home_assistant_context_t* hass, cJSON* result) {
-    if (!cJSON_IsArray(result)) {
-        return;
+    // Wake boot: the first sync is the device room's, sent ahead of everything else
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool open_wake_room = hass->wake_room_pending;
+    hass->wake_room_pending = false;
+    xSemaphoreGive(hass->mutex);
+    if (open_wake_room) {
+        hass_update_device_room(hass);
+        ESP_LOGI(TAG, "Wake to room: controls ready %lu ms after boot", static_cast<unsigned long>(since_boot_ms()));
     }
+    return true;
+}
 
-    cJSON* item = nullptr;
-    cJSON_ArrayForEach(item, result) {
-        const char* floor_id = get_optional_string(item, "floor_id", nullptr);
-        if (!floor_id) {
-            floor_id = get_optional_string(item, "id", "fi");
-        }
-        const char* floor_name = get_optional_string(item, "name", "n");
-        const char* floor_icon = get_optional_string(item, "icon", "ic");
+static void hass_parse_floor_registry_item(home_assistant_context_t* hass, cJSON* item) {
+    const char* floor_id = get_optional_string(item, "floor_id", nullptr);
+    if (!floor_id) {
+        floor_id = get_optional_string(item, "id", "fi");
+    }
+    const char* floor_name = get_optional_string(item, "name", "n");
+    const char* floor_icon = get_optional_string(item, "icon", "ic");
 
-        if (!floor_id || !floor_name) {
-            continue;
-        }
+    if (!floor_id || !floor_name) {
+        return;
+    }
 
-        ESP_LOGI(TAG, "[ICON] floor '%s' (id=%s) icon=%s", floor_name, floor_id, floor_icon ? floor_icon : "(none)");
+    ESP_LOGI(TAG, "[ICON] floor '%s' (id=%s) icon=%s", floor_name, floor_id, floor_icon ? floor_icon : "(none)");
 
-        int8_t floor_idx = store_add_floor(hass->store, floor_name, floor_icon);
-        if (floor_idx < 0) {
-            ESP_LOGW(TAG, "Skipping floor %s: floor limit reached", floor_id);
-            continue;
-        }
+    int8_t floor_idx = store_add_floor(hass->store, floor_name, floor_icon);
+    if (floor_idx < 0) {
+        ESP_LOGW(TAG, "Skipping floor %s: floor limit reached", floor_id);
+        return;
+    }
 
-        xSemaphoreTake(hass->mutex, portMAX_DELAY);
-        if (hass->floor_count < MAX_FLOORS) {
-            uint8_t idx = hass->floor_count++;
-            copy_string(hass->floor_ids[idx], sizeof(hass->floor_ids[idx]), floor_id);
-            hass->floor_store_indices[idx] = floor_idx;
-        }
-        xSemaphoreGive(hass->mutex);
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool mapped = id_map_put(&hass->floor_map, &hass->discovery_ids, floor_id, floor_idx);
+    xSemaphoreGive(hass->mutex);
+    if (!mapped) {
+        ESP_LOGW(TAG, "No memory to map floor %s", floor_id);
     }
 }
 
-void hass_parse_area_registry(home_assistant_context_t* hass, cJSON* result) {
-    if (!cJSON_IsArray(result)) {
+static void hass_parse_area_registry_item(home_assistant_context_t* hass, cJSON* item) {
+    const char* area_id = get_optional_string(item, "area_id", "ai");
+    const char* area_name = get_optional_string(item, "name", "n");
+    const char* floor_id = get_optional_string(item, "floor_id", "fl");
+    const char* area_icon = get_optional_string(item, "icon", "ic");
+
+    if (!area_id || !area_name) {
         return;
     }
 
-    cJSON* item = nullptr;
-    cJSON_ArrayForEach(item, result) {
-        const char* area_id = get_optional_string(item, "area_id", "ai");
-        const char* area_name = get_optional_string(item, "name", "n");
-        const char* floor_id = get_optional_string(item, "floor_id", "fl");
-        const char* area_icon = get_optional_string(item, "icon", "ic");
-
-        if (!area_id || !area_name) {
-            continue;
-        }
-
-        ESP_LOGI(TAG, "[ICON] room '%s' (area_id=%s, floor_id=%s) icon=%s", area_name, area_id, floor_id ? floor_id : "(none)",
-                 area_icon ? area_icon : "(none)");
+    ESP_LOGI(TAG, "[ICON] room '%s' (area_id=%s, floor_id=%s) icon=%s", area_name, area_id, floor_id ? floor_id : "(none)",
+             area_icon ? area_icon : "(none)");
 
-        int16_t floor_idx = -1;
-        if (floor_id) {
-            floor_idx = hass_find_floor_for_floor_id(hass, floor_id);
-        }
-        if (floor_idx < 0) {
-            floor_idx = hass_ensure_other_floor(hass);
-        }
-        if (floor_idx < 0) {
-            ESP_LOGW(TAG, "Skipping area %s: no floor slot available", area_id);
-            continue;
-        }
+    int16_t floor_idx = -1;
+    if (floor_id) {
+        floor_idx = hass_find_floor_for_floor_id(hass, floor_id);
+    }
+    if (floor_idx < 0) {
+        floor_idx = hass_ensure_other_floor(hass);
+    }
+    if (floor_idx < 0) {
+        ESP_LOGW(TAG, "Skipping area %s: no floor slot available", area_id);
+        return;
+    }
 
-        int8_t room_idx = store_add_room(hass->store, area_name, area_icon, static_cast<int8_t>(floor_idx));
-        if (room_idx < 0) {
-            ESP_LOGW(TAG, "Skipping area %s: room limit reached", area_id);
-            continue;
-        }
+    int8_t room_idx = store_add_room(hass->store, area_name, area_icon, static_cast<int8_t>(floor_idx));
+    if (room_idx < 0) {
+        ESP_LOGW(TAG, "Skipping area %s: room limit reached", area_id);
+        return;
+    }
 
-        xSemaphoreTake(hass->mutex, portMAX_DELAY);
-        if (hass->area_count < MAX_ROOMS) {
-            uint8_t area_idx = hass->area_count++;
-            copy_string(hass->area_ids[area_idx], sizeof(hass->area_ids[area_idx]), area_id);
-            hass->area_room_indices[area_idx] = room_idx;
-        }
-        xSemaphoreGive(hass->mutex);
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool mapped = id_map_put(&hass->area_map, &hass->discovery_ids, area_id, room_idx);
+    xSemaphoreGive(hass->mutex);
+    if (!mapped) {
+        ESP_LOGW(TAG, "No memory to map area %s", area_id);
     }
 }
 
-void hass_parse_device_registry(home_assistant_context_t* hass, cJSON* result) {
-    if (!cJSON_IsArray(result)) {
+static void hass_parse_device_registry_item(home_assistant_context_t* hass, cJSON* item) {
+    cJSON* device_id_item = cJSON_GetObjectItem(item, "id");
+    cJSON* area_id_item = cJSON_GetObjectItem(item, "area_id");
+    if (!cJSON_IsString(device_id_item) || !cJSON_IsString(area_id_item)) {
         return;
     }
 
-    cJSON* item = nullptr;
-    cJSON_ArrayForEach(item, result) {
-        cJSON* device_id_item = cJSON_GetObjectItem(item, "id");
-        cJSON* area_id_item = cJSON_GetObjectItem(item, "area_id");
-        if (!cJSON_IsString(device_id_item) || !cJSON_IsString(area_id_item)) {
-            continue;
-        }
+    // Only devices a held entity waits on are kept (mapped to -1 until now)
+    int16_t held = -1;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool wanted = id_map_get(&hass->device_map, device_id_item->valuestring, &held);
+    xSemaphoreGive(hass->mutex);
+    if (!wanted) {
+        return;
+    }
 
-        int16_t room_idx = hass_find_room_for_area(hass, area_id_item->valuestring);
-        if (room_idx < 0) {
-            continue;
-        }
+    int16_t room_idx = hass_find_room_for_area(hass, area_id_item->valuestring);
+    if (room_idx < 0) {
+        return;
+    }
 
-        xSemaphoreTake(hass->mutex, portMAX_DELAY);
-        if (hass->device_count < MAX_DEVICE_MAPPINGS) {
-            uint16_t device_idx = hass->device_count++;
-            copy_string(hass->device_ids[device_idx], sizeof(hass->device_ids[device_idx]), device_id_item->valuestring);
-            hass->device_room_indices[device_idx] = room_idx;
-        }
-        xSemaphoreGive(hass->mutex);
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool mapped = id_map_put(&hass->device_map, &hass->discovery_ids, device_id_item->valuestring, room_idx);
+    xSemaphoreGive(hass->mutex);
+    if (!mapped) {
+        ESP_LOGW(TAG, "No memory to map device %s", device_id_item->valuestring);
     }
 }
 
-void hass_parse_entity_registry(home_assistant_context_t* hass, cJSON* result) {
-    cJSON* entities = nullptr;
-    if (cJSON_IsArray(result)) {
-        entities = result;
-    } else if (cJSON_IsObject(result)) {
-        // list_for_display response: { entity_categories: {...}, entities: [...] }
-        cJSON* compact_entities = cJSON_GetObjectItem(result, "entities");
-        if (cJSON_IsArray(compact_entities)) {
-            entities = compact_entities;
-        }
+// The fields of an entity registry row that decide where it is shown
+struct EntityRegistryRow {
+    const char* entity_id;
+    const char* display_name;
+    const char* area_id;
+    const char* device_id;
+};
+
+// False for rows that are not shown at all (hidden, disabled)
+static bool hass_read_entity_registry_row(cJSON* item, EntityRegistryRow* row) {
+    cJSON* entity_id_item = cJSON_GetObjectItem(item, "entity_id");
+    if (!cJSON_IsString(entity_id_item)) {
+        entity_id_item = cJSON_GetObjectItem(item, "ei");
     }
 
-    if (!cJSON_IsArray(entities)) {
-        return;
+    cJSON* area_id_item = cJSON_GetObjectItem(item, "area_id");
+    if (!cJSON_IsString(area_id_item)) {
+        area_id_item = cJSON_GetObjectItem(item, "ai");
+    }
+    cJSON* device_id_item = cJSON_GetObjectItem(item, "device_id");
+    if (!cJSON_IsString(device_id_item)) {
+        device_id_item = cJSON_GetObjectItem(item, "di");
     }
 
-    cJSON* item = nullptr;
-    cJSON_ArrayForEach(item, entities) {
-        cJSON* entity_id_item = cJSON_GetObjectItem(item, "entity_id");
-        if (!cJSON_IsString(entity_id_item)) {
-            entity_id_item = cJSON_GetObjectItem(item, "ei");
-        }
+    cJSON* hidden_by_item = cJSON_GetObjectItem(item, "hidden_by");
+    cJSON* hidden_bool_item = cJSON_GetObjectItem(item, "hb");
+    cJSON* disabled_by_item = cJSON_GetObjectItem(item, "disabled_by");
 
-        cJSON* area_id_item = cJSON_GetObjectItem(item, "area_id");
-        if (!cJSON_IsString(area_id_item)) {
-            area_id_item = cJSON_GetObjectItem(item, "ai");
-        }
-        cJSON* device_id_item = cJSON_GetObjectItem(item, "device_id");
-        if (!cJSON_IsString(device_id_item)) {
-            device_id_item = cJSON_GetObjectItem(item, "di");
-        }
+    if (!cJSON_IsString(entity_id_item)) {
+        return false;
+    }
+    if (cJSON_IsString(hidden_by_item) || cJSON_IsString(disabled_by_item) || cJSON_IsTrue(hidden_bool_item)) {
+        return false;
+    }
 
-        cJSON* hidden_by_item = cJSON_GetObjectItem(item, "hidden_by");
-        cJSON* hidden_bool_item = cJSON_GetObjectItem(item, "hb");
-        cJSON* disabled_by_item = cJSON_GetObjectItem(item, "disabled_by");
+    row->entity_id = entity_id_item->valuestring;
+    row->display_name = hass_entity_display_name_from_registry(item);
+    row->area_id = cJSON_IsString(area_id_item) ? area_id_item->valuestring : nullptr;
+    row->device_id = cJSON_IsString(device_id_item) ? device_id_item->valuestring : nullptr;
+    return true;
+}
 
-        if (!cJSON_IsString(entity_id_item)) {
-            continue;
+static bool hass_is_widget_domain(const char* entity_id) {
+    return strncmp(entity_id, "light.", 6) == 0 || strncmp(entity_id, "climate.", 8) == 0 || strncmp(entity_id, "cover.", 6) == 0 ||
+           strncmp(entity_id, "valve.", 6) == 0 || strncmp(entity_id, "switch.", 7) == 0;
+}
+
+// False when the row does not become a widget
+static bool hass_widget_command_type(cJSON* item, const EntityRegistryRow* row, CommandType* command_type) {
+    if (strncmp(row->entity_id, "light.", 6) == 0) {
+        *command_type = CommandType::SetLightBrightnessPercentage;
+    } else if (strncmp(row->entity_id, "climate.", 8) == 0) {
+        *command_type = CommandType::SetClimateModeAndTemperature;
+    } else if (strncmp(row->entity_id, "cover.", 6) == 0) {
+        if (!cover_entity_should_be_included(item, row->entity_id, row->display_name)) {
+            ESP_LOGI(TAG, "Skipping non-group cover %s", row->entity_id);
+            return false;
         }
-        if (cJSON_IsString(hidden_by_item) || cJSON_IsString(disabled_by_item) || cJSON_IsTrue(hidden_bool_item)) {
-            continue;
+        *command_type = CommandType::SetCoverOpenClose;
+    } else if (strncmp(row->entity_id, "valve.", 6) == 0) {
+        *command_type = CommandType::ValveOpenClose;
+    } else if (strncmp(row->entity_id, "switch.", 7) == 0) {
+        // Only plain switches (outlets etc.); config/diagnostic toggles like
+        // "overload protection" carry an entity category
+        cJSON* category_item = cJSON_GetObjectItem(item, "entity_category");
+        if (category_item == nullptr) {
+            category_item = cJSON_GetObjectItem(item, "ec");
         }
-
-        const char* display_name = hass_entity_display_name_from_registry(item);
-        if (strncmp(entity_id_item->valuestring, "weather.", 8) == 0) {
-            xSemaphoreTake(hass->mutex, portMAX_DELAY);
-            if (!has_entity_id(hass->standby_weather_entity_id)) {
-                copy_string(hass->standby_weather_entity_id, sizeof(hass->standby_weather_entity_id), entity_id_item->valuestring);
-                ESP_LOGI(TAG, "Auto-selected weather entity %s for standby screen", hass->standby_weather_entity_id);
-            }
-            xSemaphoreGive(hass->mutex);
+        if (category_item != nullptr && !cJSON_IsNull(category_item)) {
+            return false;
         }
+        ESP_LOGI(TAG, "Including switch %s", row->entity_id);
+        *command_type = CommandType::SwitchOnOff;
+    } else {
+        return false;
+    }
+    return true;
+}
 
-        CommandType command_type;
-        if (strncmp(entity_id_item->valuestring, "light.", 6) == 0) {
-            command_type = CommandType::SetLightBrightnessPercentage;
-        } else if (strncmp(entity_id_item->valuestring, "climate.", 8) == 0) {
-            command_type = CommandType::SetClimateModeAndTemperature;
-        } else if (strncmp(entity_id_item->valuestring, "cover.", 6) == 0) {
-            if (!cover_entity_should_be_included(item, entity_id_item->valuestring, display_name)) {
-                ESP_LOGI(TAG, "Skipping non-group cover %s", entity_id_item->valuestring);
-                continue;
-            }
-            command_type = CommandType::SetCoverOpenClose;
-        } else if (strncmp(entity_id_item->valuestring, "valve.", 6) == 0) {
-            command_type = CommandType::ValveOpenClose;
-        } else if (strncmp(entity_id_item->valuestring, "switch.", 7) == 0) {
-            // Only plain switches (outlets etc.); config/diagnostic toggles like
-            // "overload protection" carry an entity category
-            cJSON* category_item = cJSON_GetObjectItem(item, "entity_category");
-            if (category_item == nullptr) {
-                category_item = cJSON_GetObjectItem(item, "ec");
+// Keeps an entity until the device listing lands: one whose room comes from
+// its device (room_idx -1), or any entity after such a one, so the rooms keep
+// registry order and limits drop the same entities they would without holding
+static void hass_hold_entity(home_assistant_context_t* hass, const EntityRegistryRow* row, CommandType command_type, int16_t room_idx) {
+    bool held = false;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    if (hass->held_entity_count < MAX_ENTITIES) {
+        home_assistant_context_t::HeldEntity* entity = &hass->held_entities[hass->held_entity_count];
+        entity->entity_id = id_arena_intern(&hass->discovery_ids, row->entity_id);
+        entity->display_name = row->display_name ? id_arena_intern(&hass->discovery_ids, row->display_name) : nullptr;
+        entity->device_id = room_idx < 0 ? id_arena_intern(&hass->discovery_ids, row->device_id) : nullptr;
+        entity->room_idx = room_idx;
+        entity->command_type = command_type;
+        held = entity->entity_id && (entity->display_name || !row->display_name) &&
+               (room_idx >= 0 || (entity->device_id && id_map_put(&hass->device_map, &hass->discovery_ids, row->device_id, -1)));
+        if (held) {
+            hass->held_entity_count++;
+        }
+    }
+    xSemaphoreGive(hass->mutex);
+    if (!held) {
+        ESP_LOGW(TAG, "Skipping entity %s: cannot hold it for its device", row->entity_id);
+    }
+}
+
+// Entities held for the device listing; caller holds hass->mutex
+static uint8_t hass_held_for_device_count(const home_assistant_context_t* hass) {
+    uint8_t count = 0;
+    for (uint8_t idx = 0; idx < hass->held_entity_count; idx++) {
+        count += hass->held_entities[idx].room_idx < 0 ? 1 : 0;
+    }
+    return count;
+}
+
+static void hass_place_held_entities(home_assistant_context_t* hass) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const uint8_t count = hass->held_entity_count;
+    const uint8_t via_device = hass_held_for_device_count(hass);
+    hass->held_entity_count = 0;
+    xSemaphoreGive(hass->mutex);
+
+    uint8_t placed = 0;
+    for (uint8_t idx = 0; idx < count; idx++) {
+        const home_assistant_context_t::HeldEntity* held = &hass->held_entities[idx];
+        const int16_t room_idx = held->room_idx >= 0 ? held->room_idx : hass_find_room_for_device(hass, held->device_id);
+        if (room_idx < 0) {
+            continue;
+        }
+        EntityConfig entity = {
+            .entity_id = held->entity_id,
+            .command_type = held->command_type,
+        };
+        if (store_add_entity_to_room(hass->store, room_idx, entity, held->display_name) < 0) {
+            ESP_LOGW(TAG, "Skipping entity %s: limits reached", held->entity_id);
+            continue;
+        }
+        placed++;
+    }
+    ESP_LOGI(TAG, "Placed %u of %u held entities in registry order, %u of them waiting on their device", placed, count, via_device);
+}
+
+static void hass_parse_entity_registry_item(home_assistant_context_t* hass, cJSON* item) {
+    EntityRegistryRow row;
+    if (!hass_read_entity_registry_row(item, &row)) {
+        return;
+    }
+
+    if (strncmp(row.entity_id, "weather.", 8) == 0) {
+        xSemaphoreTake(hass->mutex, portMAX_DELAY);
+        if (!has_entity_id(hass->standby_weather_entity_id)) {
+            copy_string(hass->standby_weather_entity_id, sizeof(hass->standby_weather_entity_id), row.entity_id);
+            ESP_LOGI(TAG, "Auto-selected weather entity %s for standby screen", hass->standby_weather_entity_id);
+        }
+        xSemaphoreGive(hass->mutex);
+    }
+
+    CommandType command_type;
+    if (!hass_widget_command_type(item, &row, &command_type)) {
+        return;
+    }
+
+    int16_t room_idx = -1;
+    if (row.area_id) {
+        room_idx = hass_find_room_for_area(hass, row.area_id);
+    }
+    if (room_idx < 0 && !row.device_id) {
+        return;
+    }
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool holding = hass->held_entity_count > 0;
+    xSemaphoreGive(hass->mutex);
+    if (room_idx < 0 || holding) {
+        hass_hold_entity(hass, &row, command_type, room_idx);
+        return;
+    }
+
+    EntityConfig entity = {
+        .entity_id = row.entity_id,
+        .command_type = command_type,
+    };
+    if (store_add_entity_to_room(hass->store, room_idx, entity, row.display_name) < 0) {
+        ESP_LOGW(TAG, "Skipping entity %s: limits reached", row.entity_id);
+    }
+}
+
+// The floor and area fields rooms are built from
+static uint32_t hass_registry_item_hash(uint32_t hash, RegistryRequest request, cJSON* item) {
+    if (request == RegistryRequestFloor) {
+        const char* floor_id = get_optional_string(item, "floor_id", nullptr);
+        hash = fnv1a_update_str(hash, floor_id ? floor_id : get_optional_string(item, "id", "fi"));
+        hash = fnv1a_update_str(hash, get_optional_string(item, "name", "n"));
+        return fnv1a_update_str(hash, get_optional_string(item, "icon", "ic"));
+    }
+    hash = fnv1a_update_str(hash, get_optional_string(item, "area_id", "ai"));
+    hash = fnv1a_update_str(hash, get_optional_string(item, "name", "n"));
+    hash = fnv1a_update_str(hash, get_optional_string(item, "floor_id", "fl"));
+    return fnv1a_update_str(hash, get_optional_string(item, "icon", "ic"));
+}
+
+static uint32_t hass_registry_fingerprint(const uint32_t* hashes) {
+    return fnv1a_update(hashes[0], &hashes[1], sizeof(hashes[1]));
+}
+
+static void hass_parse_registry_item(home_assistant_context_t* hass, RegistryRequest request, cJSON* item) {
+    if (request == RegistryRequestFloor || request == RegistryRequestArea) {
+        xSemaphoreTake(hass->mutex, portMAX_DELAY);
+        uint32_t* hash = &hass->registry_hashes[request - RegistryRequestFloor];
+        *hash = hass_registry_item_hash(*hash, request, item);
+        xSemaphoreGive(hass->mutex);
+    }
+    switch (request) {
+    case RegistryRequestFloor:
+        hass_parse_floor_registry_item(hass, item);
+        break;
+    case RegistryRequestArea:
+        hass_parse_area_registry_item(hass, item);
+        break;
+    case RegistryRequestDevice:
+        hass_parse_device_registry_item(hass, item);
+        break;
+    case RegistryRequestEntity:
+        hass_parse_entity_registry_item(hass, item);
+        break;
+    case RegistryRequestNone:
+    default:
+        break;
+    }
+}
+
+// Whole-message path, used when a registry result could not be streamed
+static void hass_parse_registry_result(home_assistant_context_t* hass, RegistryRequest request, cJSON* result) {
+    cJSON* items = result;
+    if (request == RegistryRequestEntity && cJSON_IsObject(result)) {
+        // list_for_display response: { entity_categories: {...}, entities: [...] }
+        items = cJSON_GetObjectItem(result, "entities");
+    }
+    if (!cJSON_IsArray(items)) {
+        return;
+    }
+
+    cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, items) {
+        hass_parse_registry_item(hass, request, item);
+    }
+}
+
+// Caller holds hass->mutex. Rooms hang off floors, entities off rooms and
+// devices only place the entities held back for them, so a listing is only
+// applied after the ones it joins on.
+static bool hass_discovery_inputs_ready(const home_assistant_context_t* hass, uint8_t kind) {
+    const DiscoveryRequest* requests = hass->discovery_requests;
+    switch (kind) {
+    case DiscoveryAreaRegistry:
+        return requests[DiscoveryFloorRegistry].state == DiscoveryRequestDone;
+    case DiscoveryDeviceRegistry:
+        return requests[DiscoveryEntityRegistry].state == DiscoveryRequestDone;
+    case DiscoveryEntityRegistry:
+        return requests[DiscoveryAreaRegistry].state == DiscoveryRequestDone;
+    default:
+        return true;
+    }
+}
+
+// DiscoveryRequestKinds when `response_id` is not an outstanding discovery request
+static uint8_t hass_discovery_request_for_id(home_assistant_context_t* hass, uint16_t response_id, bool* inputs_ready = nullptr) {
+    uint8_t kind = DiscoveryRequestKinds;
+    if (response_id == 0) {
+        return kind;
+    }
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    for (uint8_t idx = 0; idx < DiscoveryRequestKinds; idx++) {
+        if (hass->discovery_requests[idx].state == DiscoveryRequestInFlight && hass->discovery_requests[idx].id == response_id) {
+            kind = idx;
+            break;
+        }
+    }
+    if (inputs_ready) {
+        *inputs_ready = kind == DiscoveryRequestKinds || hass_discovery_inputs_ready(hass, kind);
+    }
+    xSemaphoreGive(hass->mutex);
+    return kind;
+}
+
+static RegistryRequest hass_registry_request_for_id(home_assistant_context_t* hass, uint16_t response_id, bool* inputs_ready = nullptr) {
+    const uint8_t kind = hass_discovery_request_for_id(hass, response_id, inputs_ready);
+    return kind <= DiscoveryEntityRegistry ? static_cast<RegistryRequest>(kind + 1) : RegistryRequestNone;
+}
+
+static const char* hass_registry_name(RegistryRequest request) {
+    switch (request) {
+    case RegistryRequestFloor:
+        return "floor";
+    case RegistryRequestArea:
+        return "area";
+    case RegistryRequestDevice:
+        return "device";
+    case RegistryRequestEntity:
+        return "entity";
+    case RegistryRequestNone:
+    default:
+        return "unknown";
+    }
+}
+
+// Streaming keeps a large listing alive: every fragment moves its deadline out
+static void hass_extend_discovery_deadline(home_assistant_context_t* hass, uint16_t response_id) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    for (uint8_t idx = 0; idx < DiscoveryRequestKinds; idx++) {
+        DiscoveryRequest* request = &hass->discovery_requests[idx];
+        if (request->state == DiscoveryRequestInFlight && request->id == response_id) {
+            request->deadline_ms = hass_now_ms() + HASS_DISCOVERY_REQUEST_TIMEOUT_MS;
+        }
+    }
+    xSemaphoreGive(hass->mutex);
+}
+
+// A listing answered before the ones it joins on is dropped and asked for
+// again once they have landed. HA answers these requests in order, so this
+// only happens if it ever stops doing so.
+static void hass_defer_discovery_request(home_assistant_context_t* hass, uint8_t kind, uint16_t response_id) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    DiscoveryRequest* request = &hass->discovery_requests[kind];
+    if (request->state == DiscoveryRequestInFlight && request->id == response_id) {
+        request->state = DiscoveryRequestDeferred;
+        request->id = 0;
+        request->attempts--; // not a failure
+    }
+    xSemaphoreGive(hass->mutex);
+    ESP_LOGW(TAG, "%s arrived before its inputs, requesting it again", kDiscoveryRequestTypes[kind]);
+}
+
+// Every widget entity is in the store now
+static void hass_finish_entity_discovery(home_assistant_context_t* hass) {
+    hass_refresh_entities_from_store(hass);
+    store_finish_room_sync(hass->store);
+    hass_update_device_room(hass); // room indices may have shifted
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const uint8_t entity_count = hass->entity_count;
+    xSemaphoreGive(hass->mutex);
+    if (entity_count == 0) {
+        ESP_LOGW(TAG, "No light/climate/cover entities discovered for mapped rooms");
+    }
+}
+
+// Records the outcome of a discovery request, runs the joins it completes and
+// subscribes once every request has landed
+static void hass_complete_discovery_request(home_assistant_context_t* hass, uint8_t kind, bool success) {
+    bool unblocked = false;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    DiscoveryRequest* request = &hass->discovery_requests[kind];
+    request->state = DiscoveryRequestDone;
+    request->id = 0;
+    request->success = success;
+    for (uint8_t idx = 0; idx < DiscoveryRequestKinds; idx++) {
+        if (hass->discovery_requests[idx].state == DiscoveryRequestDeferred && hass_discovery_inputs_ready(hass, idx)) {
+            unblocked = true;
+        }
+    }
+    xSemaphoreGive(hass->mutex);
+    if (unblocked) {
+        xTaskNotifyGive(hass->task);
+    }
+
+    switch (kind) {
+    case DiscoveryFloorRegistry:
+        if (!success) {
+            ESP_LOGW(TAG, "Floor registry request failed, using only 'Other Areas'");
+        }
+        break;
+    case DiscoveryAreaRegistry:
+        if (!success) {
+            ESP_LOGE(TAG, "Area registry request failed");
+            hass_update_state(hass, ConnState::ConnectionError);
+            return;
+        }
+        break;
+    case DiscoveryDeviceRegistry:
+        if (!success) {
+            ESP_LOGE(TAG, "Device registry request failed");
+            hass_update_state(hass, ConnState::ConnectionError);
+            return;
+        }
+        hass_place_held_entities(hass);
+        hass_finish_entity_discovery(hass);
+        break;
+    case DiscoveryEntityRegistry: {
+        if (!success) {
+            ESP_LOGE(TAG, "Entity registry request failed");
+            hass_update_state(hass, ConnState::ConnectionError);
+            return;
+        }
+        xSemaphoreTake(hass->mutex, portMAX_DELAY);
+        const uint8_t held = hass_held_for_device_count(hass);
+        DiscoveryRequest* devices = &hass->discovery_requests[DiscoveryDeviceRegistry];
+        if (held > 0) {
+            devices->state = DiscoveryRequestQueued;
+        } else {
+            devices->state = DiscoveryRequestDone;
+            devices->success = true;
+        }
+        xSemaphoreGive(hass->mutex);
+        if (held > 0) {
+            ESP_LOGI(TAG, "%u entities take their room from their device, fetching the device registry", held);
+            xTaskNotifyGive(hass->task);
+            break;
+        }
+        ESP_LOGI(TAG, "Every entity has an area of its own, skipping the device registry");
+        hass_finish_entity_discovery(hass);
+        break;
+    }
+    case DiscoveryEnergyPrefs:
+        if (!success) {
+            ESP_LOGW(TAG, "Energy preferences request failed, keeping configured standby entities");
+        }
+        break;
+    default:
+        break;
+    }
+
+    bool finished = true;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    for (uint8_t idx = 0; idx < DiscoveryRequestKinds; idx++) {
+        finished = finished && hass->discovery_requests[idx].state == DiscoveryRequestDone;
+    }
+    if (finished) {
+        // Back to idle so a completion racing in from the other task cannot subscribe twice
+        for (uint8_t idx = 0; idx < DiscoveryRequestKinds; idx++) {
+            hass->discovery_requests[idx].state = DiscoveryRequestIdle;
+        }
+        hass->discovery_cache_dirty = true;
+        hass->discovery_subscribe_pending = true;
+        ESP_LOGI(TAG, "Discovery finished in %lu ms, %lu bytes received",
+                 static_cast<unsigned long>((xTaskGetTickCount() - hass->discovery_started_at) * portTICK_PERIOD_MS),
+                 static_cast<unsigned long>(hass->rx_bytes - hass->discovery_rx_start));
+    }
+    xSemaphoreGive(hass->mutex);
+    if (finished) {
+        xTaskNotifyGive(hass->task);
+    }
+}
+
+// Sends queued discovery requests, retries the ones that went unanswered and
+// returns how long the task may sleep before the next deadline
+static uint32_t hass_run_discovery(home_assistant_context_t* hass) {
+    uint32_t wait_ms = HASS_TASK_IDLE_WAIT_MS;
+    bool send[DiscoveryRequestKinds] = {};
+    bool failed[DiscoveryRequestKinds] = {};
+    const uint32_t now_ms = hass_now_ms();
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    for (uint8_t idx = 0; idx < DiscoveryRequestKinds; idx++) {
+        DiscoveryRequest* request = &hass->discovery_requests[idx];
+        if (request->state == DiscoveryRequestInFlight && static_cast<int32_t>(now_ms - request->deadline_ms) >= 0) {
+            request->id = 0; // a late answer is ignored
+            if (request->attempts < HASS_DISCOVERY_MAX_ATTEMPTS) {
+                ESP_LOGW(TAG, "%s timed out, retrying", kDiscoveryRequestTypes[idx]);
+                request->state = DiscoveryRequestQueued;
+            } else {
+                ESP_LOGE(TAG, "%s timed out %u times, giving up", kDiscoveryRequestTypes[idx], request->attempts);
+                request->state = DiscoveryRequestIdle;
+                failed[idx] = true;
+            }
+        }
+        if (request->state == DiscoveryRequestQueued || (request->state == DiscoveryRequestDeferred && hass_discovery_inputs_ready(hass, idx))) {
+            send[idx] = true;
+        } else if (request->state == DiscoveryRequestInFlight && request->deadline_ms - now_ms < wait_ms) {
+            wait_ms = request->deadline_ms - now_ms;
+        }
+    }
+    const bool subscribe = hass->discovery_subscribe_pending;
+    hass->discovery_subscribe_pending = false;
+    xSemaphoreGive(hass->mutex);
+
+    for (uint8_t idx = 0; idx < DiscoveryRequestKinds; idx++) {
+        if (failed[idx]) {
+            hass_complete_discovery_request(hass, idx, false);
+        }
+    }
+    // All at once: HA answers them back to back instead of one round trip each
+    for (uint8_t idx = 0; idx < DiscoveryRequestKinds; idx++) {
+        if (send[idx]) {
+            hass_send_discovery_request(hass, static_cast<DiscoveryRequestKind>(idx));
+        }
+    }
+    if (subscribe) {
+        hass_cmd_subscribe(hass);
+        hass_save_discovery_cache(hass);
+    }
+    return wait_ms;
+}
+
+static uint32_t hass_discovery_cache_fingerprint(const Configuration* config) {
+    // Anything that changes what discovery produces: the server, the configured
+    // standby sources, the store limits and the parsing code in this build
+    uint32_t hash = fnv1a_update_str(FNV1A_OFFSET, __DATE__ " " __TIME__);
+    hash = fnv1a_update_str(hash, config->home_assistant_url);
+    hash = fnv1a_update_str(hash, config->weather_entity_id);
+    hash = fnv1a_update_str(hash, config->energy_solar_entity_id);
+    hash = fnv1a_update_str(hash, config->energy_grid_entity_id);
+    hash = fnv1a_update_str(hash, config->energy_grid_export_entity_id);
+    hash = fnv1a_update_str(hash, config->energy_battery_usage_entity_id);
+    hash = fnv1a_update_str(hash, config->energy_battery_charge_entity_id);
+    hash = fnv1a_update_str(hash, config->energy_battery_soc_entity_id);
+    hash = fnv1a_update_str(hash, config->energy_house_entity_id);
+    const uint32_t limits[] = {MAX_ENTITIES, MAX_ROOMS, MAX_FLOORS, MAX_ENTITY_ID_LEN, MAX_ENTITY_NAME_LEN, MAX_ICON_NAME_LEN};
+    return fnv1a_update(hash, limits, sizeof(limits));
+}
+
+static void hass_cache_put_series(DiscoveryCacheWriter* writer, const home_assistant_context_t::StandbyEnergySeries* series) {
+    discovery_cache_put_u8(writer, series->count);
+    for (uint8_t idx = 0; idx < series->count; idx++) {
+        discovery_cache_put_str(writer, series->entity_ids[idx]);
+    }
+}
+
+static void hass_cache_put_map(DiscoveryCacheWriter* writer, const IdMap* map) {
+    discovery_cache_put_u8(writer, map->count > UINT8_MAX ? UINT8_MAX : static_cast<uint8_t>(map->count));
+    uint8_t written = 0;
+    for (uint16_t idx = 0; idx < map->cap && written < UINT8_MAX; idx++) {
+        if (map->slots[idx].hash != 0) {
+            discovery_cache_put_str(writer, map->slots[idx].id);
+            discovery_cache_put_u8(writer, static_cast<uint8_t>(map->slots[idx].value));
+            written++;
+        }
+    }
+}
+
+static void hass_cache_get_map(DiscoveryCacheReader* reader, IdMap* map, IdArena* arena) {
+    char id[MAX_ENTITY_ID_LEN];
+    const uint8_t count = discovery_cache_get_u8(reader);
+    for (uint8_t idx = 0; idx < count && !reader->error; idx++) {
+        discovery_cache_get_str(reader, id, sizeof(id));
+        const int8_t value = static_cast<int8_t>(discovery_cache_get_u8(reader));
+        if (!id_map_put(map, arena, id, value)) {
+            reader->error = true;
+        }
+    }
+}
+
+static void hass_cache_get_series(DiscoveryCacheReader* reader, home_assistant_context_t::StandbyEnergySeries* series, IdArena* arena) {
+    standby_energy_series_reset(series);
+    const uint8_t count = discovery_cache_get_u8(reader);
+    for (uint8_t idx = 0; idx < count && !reader->error; idx++) {
+        char entity_id[MAX_ENTITY_ID_LEN];
+        discovery_cache_get_str(reader, entity_id, sizeof(entity_id));
+        standby_energy_series_add_entity(series, arena, entity_id);
+    }
+}
+
+static void hass_cache_put_u32(DiscoveryCacheWriter* writer, uint32_t value) {
+    for (uint8_t shift = 0; shift < 32; shift += 8) {
+        discovery_cache_put_u8(writer, static_cast<uint8_t>(value >> shift));
+    }
+}
+
+static uint32_t hass_cache_get_u32(DiscoveryCacheReader* reader) {
+    uint32_t value = 0;
+    for (uint8_t shift = 0; shift < 32; shift += 8) {
+        value |= static_cast<uint32_t>(discovery_cache_get_u8(reader)) << shift;
+    }
+    return value;
+}
+
+// Payload layout (strings are u8 length + bytes):
+//   floors:   u8 n, n x {name, icon}
+//   rooms:    u8 n, n x {name, icon, u8 floor_idx, u8 m, m x {entity_id, display_name, u8 command_type}}
+//   floor_id map: u8 n, n x {floor_id, u8 floor_idx}, u8 other_floor_idx (0xff none)
+//   area_id map:  u8 n, n x {area_id, u8 room_idx}
+//   standby:  8 entity ids, u8 house_computed, 5 energy series
+//   registries: u32 floor listing hash, u32 area listing hash
+static void hass_save_discovery_cache(home_assistant_context_t* hass) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool dirty = hass->discovery_cache_dirty;
+    hass->discovery_cache_dirty = false;
+    xSemaphoreGive(hass->mutex);
+    if (!dirty) {
+        return;
+    }
+
+    uint8_t* payload = static_cast<uint8_t*>(heap_caps_malloc(DISCOVERY_CACHE_MAX_LEN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (!payload) {
+        ESP_LOGW(TAG, "No memory to save the discovery cache");
+        return;
+    }
+    DiscoveryCacheWriter writer = {.data = payload, .cap = DISCOVERY_CACHE_MAX_LEN, .len = 0, .overflow = false};
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    xSemaphoreTake(hass->store->mutex, portMAX_DELAY);
+    const EntityStore* store = hass->store;
+    discovery_cache_put_u8(&writer, store->floor_count);
+    for (uint8_t floor_idx = 0; floor_idx < store->floor_count; floor_idx++) {
+        discovery_cache_put_str(&writer, store->floors[floor_idx].name);
+        discovery_cache_put_str(&writer, store->floors[floor_idx].icon);
+    }
+    discovery_cache_put_u8(&writer, store->room_count);
+    for (uint8_t room_idx = 0; room_idx < store->room_count; room_idx++) {
+        const Room& room = store->rooms[room_idx];
+        discovery_cache_put_str(&writer, room.name);
+        discovery_cache_put_str(&writer, room.icon);
+        discovery_cache_put_u8(&writer, static_cast<uint8_t>(room.floor_idx));
+        discovery_cache_put_u8(&writer, room.entity_count);
+        for (uint8_t idx = 0; idx < room.entity_count; idx++) {
+            const HomeAssistantEntity& entity = store->entities[room.entity_ids[idx]];
+            discovery_cache_put_str(&writer, entity.entity_id);
+            discovery_cache_put_str(&writer, entity.display_name);
+            discovery_cache_put_u8(&writer, static_cast<uint8_t>(entity.command_type));
+        }
+    }
+    xSemaphoreGive(hass->store->mutex);
+
+    hass_cache_put_map(&writer, &hass->floor_map);
+    discovery_cache_put_u8(&writer, static_cast<uint8_t>(hass->other_floor_idx));
+    hass_cache_put_map(&writer, &hass->area_map);
+
+    discovery_cache_put_str(&writer, hass->standby_weather_entity_id);
+    discovery_cache_put_str(&writer, hass->standby_energy_solar_entity_id);
+    discovery_cache_put_str(&writer, hass->standby_energy_grid_entity_id);
+    discovery_cache_put_str(&writer, hass->standby_energy_grid_export_entity_id);
+    discovery_cache_put_str(&writer, hass->standby_energy_battery_usage_entity_id);
+    discovery_cache_put_str(&writer, hass->standby_energy_battery_charge_entity_id);
+    discovery_cache_put_str(&writer, hass->standby_energy_battery_soc_entity_id);
+    discovery_cache_put_str(&writer, hass->standby_energy_house_entity_id);
+    discovery_cache_put_u8(&writer, hass->standby_energy_house_computed ? 1 : 0);
+    hass_cache_put_series(&writer, &hass->standby_solar_series);
+    hass_cache_put_series(&writer, &hass->standby_grid_in_series);
+    hass_cache_put_series(&writer, &hass->standby_grid_out_series);
+    hass_cache_put_series(&writer, &hass->standby_battery_out_series);
+    hass_cache_put_series(&writer, &hass->standby_battery_in_series);
+    // After an in-place area delta these no longer match the server and the
+    // next boot rediscovers once; the delta itself was already applied
+    hass_cache_put_u32(&writer, hass->registry_hashes[0]);
+    hass_cache_put_u32(&writer, hass->registry_hashes[1]);
+    const uint32_t fingerprint = hass->discovery_cache_fingerprint;
+    xSemaphoreGive(hass->mutex);
+
+    if (writer.overflow) {
+        ESP_LOGW(TAG, "Discovery result exceeds %u bytes, not caching it", static_cast<unsigned>(DISCOVERY_CACHE_MAX_LEN));
+        discovery_cache_invalidate();
+    } else {
+        discovery_cache_save(fingerprint, payload, writer.len);
+    }
+    heap_caps_free(payload);
+}
+
+static bool hass_apply_discovery_cache(home_assistant_context_t* hass, DiscoveryCacheReader* reader) {
+    char name[MAX_ROOM_NAME_LEN];
+    char icon[MAX_ICON_NAME_LEN];
+    char entity_id[MAX_ENTITY_ID_LEN];
+    char display_name[MAX_ENTITY_NAME_LEN];
+
+    const uint8_t floor_count = discovery_cache_get_u8(reader);
+    for (uint8_t floor_idx = 0; floor_idx < floor_count && !reader->error; floor_idx++) {
+        discovery_cache_get_str(reader, name, sizeof(name));
+        discovery_cache_get_str(reader, icon, sizeof(icon));
+        if (store_add_floor(hass->store, name, icon[0] ? icon : nullptr) != floor_idx) {
+            return false;
+        }
+    }
+
+    const uint8_t room_count = discovery_cache_get_u8(reader);
+    for (uint8_t room_idx = 0; room_idx < room_count && !reader->error; room_idx++) {
+        discovery_cache_get_str(reader, name, sizeof(name));
+        discovery_cache_get_str(reader, icon, sizeof(icon));
+        const int8_t floor_idx = static_cast<int8_t>(discovery_cache_get_u8(reader));
+        if (store_add_room(hass->store, name, icon[0] ? icon : nullptr, floor_idx) != room_idx) {
+            return false;
+        }
+        const uint8_t entity_count = discovery_cache_get_u8(reader);
+        for (uint8_t idx = 0; idx < entity_count && !reader->error; idx++) {
+            discovery_cache_get_str(reader, entity_id, sizeof(entity_id));
+            discovery_cache_get_str(reader, display_name, sizeof(display_name));
+            const uint8_t command_type = discovery_cache_get_u8(reader);
+            if (command_type > static_cast<uint8_t>(CommandType::ValveOpenClose)) {
+                return false;
             }
-            if (category_item != nullptr && !cJSON_IsNull(category_item)) {
-                continue;
+            EntityConfig entity = {
+                .entity_id = entity_id,
+                .command_type = static_cast<CommandType>(command_type),
+            };
+            store_restore_entity_to_room(hass->store, room_idx, entity, display_name);
+        }
+    }
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass_cache_get_map(reader, &hass->floor_map, &hass->discovery_ids);
+    hass->other_floor_idx = static_cast<int8_t>(discovery_cache_get_u8(reader));
+    hass_cache_get_map(reader, &hass->area_map, &hass->discovery_ids);
+
+    discovery_cache_get_str(reader, hass->standby_weather_entity_id, sizeof(hass->standby_weather_entity_id));
+    discovery_cache_get_str(reader, hass->standby_energy_solar_entity_id, sizeof(hass->standby_energy_solar_entity_id));
+    discovery_cache_get_str(reader, hass->standby_energy_grid_entity_id, sizeof(hass->standby_energy_grid_entity_id));
+    discovery_cache_get_str(reader, hass->standby_energy_grid_export_entity_id, sizeof(hass->standby_energy_grid_export_entity_id));
+    discovery_cache_get_str(reader, hass->standby_energy_battery_usage_entity_id, sizeof(hass->standby_energy_battery_usage_entity_id));
+    discovery_cache_get_str(reader, hass->standby_energy_battery_charge_entity_id, sizeof(hass->standby_energy_battery_charge_entity_id));
+    discovery_cache_get_str(reader, hass->standby_energy_battery_soc_entity_id, sizeof(hass->standby_energy_battery_soc_entity_id));
+    discovery_cache_get_str(reader, hass->standby_energy_house_entity_id, sizeof(hass->standby_energy_house_entity_id));
+    hass->standby_energy_house_computed = discovery_cache_get_u8(reader) != 0;
+    hass_cache_get_series(reader, &hass->standby_solar_series, &hass->discovery_ids);
+    hass_cache_get_series(reader, &hass->standby_grid_in_series, &hass->discovery_ids);
+    hass_cache_get_series(reader, &hass->standby_grid_out_series, &hass->discovery_ids);
+    hass_cache_get_series(reader, &hass->standby_battery_out_series, &hass->discovery_ids);
+    hass_cache_get_series(reader, &hass->standby_battery_in_series, &hass->discovery_ids);
+    hass->registry_hashes[0] = hass_cache_get_u32(reader);
+    hass->registry_hashes[1] = hass_cache_get_u32(reader);
+    xSemaphoreGive(hass->mutex);
+
+    return !reader->error && reader->pos == reader->len;
+}
+
+// Rebuilds rooms, entities and standby sources from the flash copy of the last
+// discovery; false means a full discovery is needed
+static bool hass_restore_discovery_cache(home_assistant_context_t* hass) {
+    uint8_t* payload = static_cast<uint8_t*>(heap_caps_malloc(DISCOVERY_CACHE_MAX_LEN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (!payload) {
+        return false;
+    }
+    const size_t len = discovery_cache_load(hass->discovery_cache_fingerprint, payload, DISCOVERY_CACHE_MAX_LEN);
+    if (len == 0) {
+        heap_caps_free(payload);
+        return false;
+    }
+
+    hass_reset_discovery_state(hass);
+    power_wifi_sleep_hold(true); // the initial state sync is still a large burst
+    store_begin_room_sync(hass->store);
+    DiscoveryCacheReader reader = {.data = payload, .len = len, .pos = 0, .error = false};
+    const bool restored = hass_apply_discovery_cache(hass, &reader);
+    heap_caps_free(payload);
+    if (!restored) {
+        ESP_LOGW(TAG, "Discovery cache did not replay cleanly, discarding it");
+        discovery_cache_invalidate();
+        return false;
+    }
+
+    hass_refresh_entities_from_store(hass);
+    store_finish_room_sync(hass->store);
+    hass_update_device_room(hass);
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    ESP_LOGI(TAG, "Restored %u entities in %u rooms from the discovery cache", hass->entity_count, hass->area_map.count);
+    xSemaphoreGive(hass->mutex);
+    return true;
+}
+
+void hass_start_discovery(home_assistant_context_t* hass) {
+    ESP_LOGI(TAG, "Starting room entity discovery");
+    hass_reset_discovery_state(hass);
+    power_wifi_sleep_hold(true); // registry payloads drain internal heap; keep the PHY enabled until the first state sync lands
+    store_begin_room_sync(hass->store);
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    for (uint8_t idx = 0; idx < DiscoveryRequestKinds; idx++) {
+        hass->discovery_requests[idx].state = DiscoveryRequestQueued;
+    }
+    hass->discovery_requests[DiscoveryDeviceRegistry].state = DiscoveryRequestHeld; // queued by the entity registry if needed
+    hass->discovery_started_at = xTaskGetTickCount();
+    hass->discovery_rx_start = hass->rx_bytes;
+    xSemaphoreGive(hass->mutex);
+    xTaskNotifyGive(hass->task);
+}
+
+// Wake boot with the rooms restored: subscribe the room the device was last
+// seen in ahead of the rest of the house. It opens once its states are in
+// (hass_decode_entity_event), so its controls draw complete.
+static void hass_subscribe_wake_room(home_assistant_context_t* hass, const char* area_id) {
+    const int16_t room_idx = hass_find_room_for_area(hass, area_id);
+    if (room_idx < 0) {
+        return;
+    }
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    if (hass->device_area_id[0] == '\0') { // Bermuda has not reported yet
+        copy_string(hass->device_area_id, sizeof(hass->device_area_id), area_id);
+    }
+    xSemaphoreGive(hass->mutex);
+
+    uint8_t entity_idxs[MAX_ENTITIES];
+    const uint8_t count = HASS_SCOPED_SUBSCRIPTIONS ? store_get_room_entities(hass->store, static_cast<int8_t>(room_idx), entity_idxs, MAX_ENTITIES) : 0;
+    if (count == 0) {
+        hass_update_device_room(hass); // nothing to wait for
+        return;
+    }
+
+    ESP_LOGI(TAG, "Wake to room: subscribing the %u entities of room %d first", count, room_idx);
+    hass_rebuild_dispatch_index(hass);
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass->room_subscriptions[0] = {.id = 0, .room_idx = static_cast<int8_t>(room_idx), .left_ms = 0};
+    hass->wake_room_pending = true;
+    xSemaphoreGive(hass->mutex);
+    hass_cmd_subscribe_room(hass, 0, entity_idxs, count);
+}
+
+// The cache may predate registry edits made while the device was off: list the
+// floors and areas again (a few KB) and rediscover if they no longer match
+static void hass_check_cached_registries(home_assistant_context_t* hass) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    memset(hass->registry_check_answered, 0, sizeof(hass->registry_check_answered));
+    hass->registry_check_hashes[0] = FNV1A_OFFSET;
+    hass->registry_check_hashes[1] = FNV1A_OFFSET;
+    hass->registry_check_pending = true;
+    xSemaphoreGive(hass->mutex);
+    hass_send_simple_request(hass, kDiscoveryRequestTypes[DiscoveryFloorRegistry], &hass->registry_check_ids[0]);
+    hass_send_simple_request(hass, kDiscoveryRequestTypes[DiscoveryAreaRegistry], &hass->registry_check_ids[1]);
+}
+
+// After auth: reuse the cached discovery when it is still valid
+static void hass_begin_session(home_assistant_context_t* hass) {
+    char wake_area_id[MAX_ICON_NAME_LEN] = {};
+    const bool wake_to_room = store_wake_to_room_pending(hass->store) && hass_cached_device_area(wake_area_id, sizeof(wake_area_id));
+    if (hass_restore_discovery_cache(hass)) {
+        if (wake_to_room) {
+            hass_subscribe_wake_room(hass, wake_area_id);
+        }
+        hass_check_cached_registries(hass);
+        xSemaphoreTake(hass->mutex, portMAX_DELAY);
+        hass->discovery_subscribe_pending = true;
+        xSemaphoreGive(hass->mutex);
+        xTaskNotifyGive(hass->task);
+        return;
+    }
+    if (wake_to_room) {
+        // The room opens as soon as discovery has placed it
+        xSemaphoreTake(hass->mutex, portMAX_DELAY);
+        if (hass->device_area_id[0] == '\0') {
+            copy_string(hass->device_area_id, sizeof(hass->device_area_id), wake_area_id);
+        }
+        xSemaphoreGive(hass->mutex);
+    }
+    hass_start_discovery(hass);
+}
+
+// Silent refresh wake: no registries, rooms or registry events. The energy
+// sources come first since the standby subscription and statistics need them.
+static void hass_begin_silent_refresh(home_assistant_context_t* hass) {
+    ESP_LOGI(TAG, "Silent refresh: fetching standby data only");
+    hass_reset_discovery_state(hass);
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass->silent_refresh = true;
+    hass->silent_requests_sent = false;
+    hass->silent_refresh_signalled = false;
+    hass->weather_forecast_polling = true; // one get_forecasts, nothing to tear down before sleep
+    xSemaphoreGive(hass->mutex);
+    hass_send_simple_request(hass, "energy/get_prefs", &hass->silent_prefs_request_id);
+    hass_cmd_request_weather_forecast(hass);
+}
+
+static bool hass_handle_silent_refresh_result(home_assistant_context_t* hass, uint16_t response_id, bool success, cJSON* result_item) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool matched = hass->silent_prefs_request_id != 0 && response_id == hass->silent_prefs_request_id;
+    if (matched) {
+        hass->silent_prefs_request_id = 0;
+    }
+    xSemaphoreGive(hass->mutex);
+    if (!matched) {
+        return false;
+    }
+
+    if (success) {
+        hass_parse_energy_preferences_result(hass, result_item);
+    } else {
+        ESP_LOGW(TAG, "energy/get_prefs failed, refreshing the configured standby sources only");
+    }
+    hass_cmd_subscribe_entities(hass); // no rooms were discovered: standby entities only
+    hass_cmd_request_energy_statistics(hass);
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass->silent_requests_sent = true;
+    xSemaphoreGive(hass->mutex);
+    xTaskNotifyGive(hass->task);
+    return true;
+}
+
+// Signals the sleep path once every standby answer is in, and switches to a
+// full session when the user took over the panel
+static void hass_poll_silent_refresh(home_assistant_context_t* hass) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool silent = hass->silent_refresh;
+    const bool complete = silent && !hass->silent_refresh_signalled && hass->silent_requests_sent && hass->state == ConnState::Up &&
+                          hass->energy_stat_pending == 0 && !hass->weather_forecast_requested;
+    if (complete) {
+        hass->silent_refresh_signalled = true;
+    }
+    xSemaphoreGive(hass->mutex);
+    if (!silent) {
+        return;
+    }
+    if (complete) {
+        ESP_LOGI(TAG, "Silent refresh: standby data complete %lu ms after connect, %lu bytes received",
+                 static_cast<unsigned long>((xTaskGetTickCount() - hass->connect_started_at) * portTICK_PERIOD_MS),
+                 static_cast<unsigned long>(hass->rx_bytes));
+        power_silent_refresh_data_ready();
+    }
+    if (power_is_silent_boot()) {
+        return;
+    }
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const uint16_t subscription_id = hass->entities_subscription_id;
+    hass->silent_refresh = false;
+    hass->silent_prefs_request_id = 0;
+    hass->entities_subscription_id = 0;
+    hass->weather_forecast_polling = false;
+    xSemaphoreGive(hass->mutex);
+    ESP_LOGI(TAG, "Silent refresh over with the panel awake, loading rooms and entities");
+    if (subscription_id != 0) {
+        hass_cmd_unsubscribe(hass, subscription_id);
+    }
+    hass_begin_session(hass);
+}
+
+// In-session rediscovery after a registry edit; the new subscription replaces the old one
+static void hass_rediscover(home_assistant_context_t* hass) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const uint16_t subscription_id = hass->entities_subscription_id;
+    const uint16_t forecast_subscription_id = hass->weather_forecast_subscription_id;
+    hass->entities_subscription_id = 0;
+    hass->weather_forecast_subscription_id = 0;
+    xSemaphoreGive(hass->mutex);
+    if (subscription_id != 0) {
+        hass_cmd_unsubscribe(hass, subscription_id);
+    }
+    if (forecast_subscription_id != 0) {
+        hass_cmd_unsubscribe(hass, forecast_subscription_id);
+    }
+    hass_drop_room_subscriptions(hass); // room indices are about to change
+    hass_start_discovery(hass);
+}
+
+static bool hass_is_registry_event(const char* event_type) {
+    return strcmp(event_type, "floor_registry_updated") == 0 || strcmp(event_type, "area_registry_updated") == 0 ||
+           strcmp(event_type, "device_registry_updated") == 0 || strcmp(event_type, "entity_registry_updated") == 0;
+}
+
+static void hass_note_registry_change(home_assistant_context_t* hass, const char* event_type) {
+    ESP_LOGI(TAG, "Registry changed (%s), discovery cache is stale", event_type);
+    discovery_cache_invalidate();
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass->registry_changed = true;
+    hass->registry_changed_at = xTaskGetTickCount();
+    xSemaphoreGive(hass->mutex);
+}
+
+// Caller holds hass->mutex. No discovery running or due: the store is whole.
+static bool hass_discovery_idle_locked(const home_assistant_context_t* hass) {
+    bool idle = !hass->registry_changed && !hass->discovery_subscribe_pending;
+    for (uint8_t idx = 0; idx < DiscoveryRequestKinds; idx++) {
+        idle = idle && hass->discovery_requests[idx].state == DiscoveryRequestIdle;
+    }
+    return idle;
+}
+
+static void hass_note_registry_delta(home_assistant_context_t* hass) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass->discovery_cache_dirty = true;
+    hass->registry_delta_at = xTaskGetTickCount();
+    xSemaphoreGive(hass->mutex);
+    xTaskNotifyGive(hass->task);
+}
+
+// Looks up what a registry edit changed. Areas and floors have no single-row
+// getter but their listings are small; a device's area and entities come from
+// a template. False when the lookup cannot be made.
+static bool hass_send_registry_delta(home_assistant_context_t* hass, RegistryRequest kind, const char* target) {
+    char template_text[256];
+    if (kind == RegistryRequestDevice) {
+        if (strpbrk(target, "'\\{}%") != nullptr) {
+            return false;
+        }
+        snprintf(template_text, sizeof(template_text),
+                 "{{ {'area': device_attr('%s', 'area_id'), 'entities': device_entities('%s')} | tojson }}", target, target);
+    }
+
+    // Only this task claims slots, so the one picked stays free until its id is set
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    home_assistant_context_t::RegistryDelta* delta = nullptr;
+    for (auto& slot : hass->registry_deltas) {
+        if (slot.id == 0) {
+            delta = &slot;
+            break;
+        }
+    }
+    if (delta) {
+        delta->kind = kind;
+        delta->answered = false;
+        copy_string(delta->target, sizeof(delta->target), target);
+    }
+    xSemaphoreGive(hass->mutex);
+    if (!delta) {
+        return false;
+    }
+
+    JsonWriter writer;
+    const uint16_t request_id = hass_begin_request(hass, &writer);
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    delta->id = request_id;
+    xSemaphoreGive(hass->mutex);
+    switch (kind) {
+    case RegistryRequestFloor:
+        json_writer_string(&writer, "type", kDiscoveryRequestTypes[DiscoveryFloorRegistry]);
+        break;
+    case RegistryRequestArea:
+        json_writer_string(&writer, "type", kDiscoveryRequestTypes[DiscoveryAreaRegistry]);
+        break;
+    case RegistryRequestDevice:
+        json_writer_string(&writer, "type", "render_template");
+        json_writer_string(&writer, "template", template_text);
+        break;
+    case RegistryRequestEntity:
+    default:
+        json_writer_string(&writer, "type", "config/entity_registry/get");
+        json_writer_string(&writer, "entity_id", target);
+        break;
+    }
+    hass_send_message(hass, &writer, "registry delta");
+    return true;
+}
+
+// A delta added an entity to the store: track it and subscribe again so its
+// state comes in
+static void hass_track_added_entity(home_assistant_context_t* hass, int16_t entity_idx) {
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    if (entity_idx >= hass->entity_count && entity_idx < static_cast<int16_t>(MAX_ENTITIES)) {
+        for (int16_t idx = hass->entity_count; idx <= entity_idx; idx++) {
+            hass->entity_ids[idx] = hass->store->entities[idx].entity_id;
+            hass->entity_modes[idx] = 0;
+            hass->entity_values[idx] = -1;
+        }
+        hass->entity_count = static_cast<uint8_t>(entity_idx + 1);
+        hass->entities_resubscribe_pending = true;
+    }
+    xSemaphoreGive(hass->mutex);
+}
+
+// `row` is the entity's registry entry, nullptr once it was removed
+static void hass_apply_entity_delta(home_assistant_context_t* hass, const char* entity_id, cJSON* row) {
+    EntityRegistryRow fields;
+    CommandType command_type = CommandType::SwitchOnOff;
+    const bool widget = row && hass_read_entity_registry_row(row, &fields) && hass_widget_command_type(row, &fields, &command_type);
+
+    int16_t room_idx = -1;
+    if (widget && fields.area_id) {
+        room_idx = hass_find_room_for_area(hass, fields.area_id);
+    }
+    if (widget && room_idx < 0 && fields.device_id) {
+        xSemaphoreTake(hass->mutex, portMAX_DELAY);
+        const bool known = id_map_get(&hass->device_map, fields.device_id, &room_idx);
+        xSemaphoreGive(hass->mutex);
+        if (!known) {
+            // Devices outside any room, and all of them after a cache restore,
+            // are not mapped; the lookup comes back here for every entity of it
+            if (!hass_send_registry_delta(hass, RegistryRequestDevice, fields.device_id)) {
+                hass_note_registry_change(hass, "device lookup");
             }
-            ESP_LOGI(TAG, "Including switch %s", entity_id_item->valuestring);
-            command_type = CommandType::SwitchOnOff;
-        } else {
+            return;
+        }
+    }
+
+    EntityConfig entity = {
+        .entity_id = entity_id,
+        .command_type = command_type,
+    };
+    bool added = false;
+    const int16_t entity_idx = store_place_entity(hass->store, static_cast<int8_t>(room_idx), entity, widget ? fields.display_name : nullptr, &added);
+    if (room_idx >= 0 && entity_idx < 0) {
+        ESP_LOGW(TAG, "Skipping entity %s: limits reached", entity_id);
+    }
+    if (added) {
+        hass_track_added_entity(hass, entity_idx);
+    }
+    ESP_LOGI(TAG, "Registry delta: %s now in room %d", entity_id, room_idx);
+    hass_note_registry_delta(hass);
+}
+
+// `result` is the rendered {"area": area_id, "entities": [...]}
+static void hass_apply_device_delta(home_assistant_context_t* hass, const char* device_id, cJSON* result) {
+    cJSON* parsed = nullptr;
+    if (cJSON_IsString(result)) {
+        parsed = cJSON_Parse(result->valuestring);
+        result = parsed;
+    }
+    if (!cJSON_IsObject(result)) {
+        cJSON_Delete(parsed);
+        hass_note_registry_change(hass, "device lookup");
+        return;
+    }
+
+    const char* area_id = get_optional_string(result, "area", nullptr);
+    const int16_t room_idx = area_id ? hass_find_room_for_area(hass, area_id) : -1;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool mapped = id_map_put(&hass->device_map, &hass->discovery_ids, device_id, room_idx); // -1: known, in no room
+    xSemaphoreGive(hass->mutex);
+    if (!mapped) {
+        cJSON_Delete(parsed);
+        hass_note_registry_change(hass, "device lookup");
+        return;
+    }
+
+    cJSON* entity_item = nullptr;
+    cJSON_ArrayForEach(entity_item, cJSON_GetObjectItem(result, "entities")) {
+        if (cJSON_IsString(entity_item) && hass_is_widget_domain(entity_item->valuestring) &&
+            !hass_send_registry_delta(hass, RegistryRequestEntity, entity_item->valuestring)) {
+            hass_note_registry_change(hass, "device entities");
+            break;
+        }
+    }
+    cJSON_Delete(parsed);
+}
+
+static void hass_apply_floor_delta(home_assistant_context_t* hass, cJSON* result) {
+    bool added = false;
+    cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, result) {
+        const char* floor_id = get_optional_string(item, "floor_id", nullptr);
+        const char* floor_name = get_optional_string(item, "name", nullptr);
+        const char* floor_icon = get_optional_string(item, "icon", nullptr);
+        if (!floor_id || !floor_name) {
+            continue;
+        }
+
+        int16_t floor_idx = hass_find_floor_for_floor_id(hass, floor_id);
+        if (floor_idx >= 0) {
+            store_update_floor(hass->store, static_cast<uint8_t>(floor_idx), floor_name, floor_icon);
+            continue;
+        }
+        floor_idx = store_add_floor(hass->store, floor_name, floor_icon);
+        if (floor_idx < 0) {
+            ESP_LOGW(TAG, "Skipping floor %s: floor limit reached", floor_id);
+            continue;
+        }
+        xSemaphoreTake(hass->mutex, portMAX_DELAY);
+        id_map_put(&hass->floor_map, &hass->discovery_ids, floor_id, floor_idx);
+        xSemaphoreGive(hass->mutex);
+        added = true;
+    }
+    if (added) {
+        store_bump_rooms_revision(hass->store);
+    }
+    hass_note_registry_delta(hass);
+}
+
+static void hass_apply_area_delta(home_assistant_context_t* hass, cJSON* result) {
+    bool added = false;
+    cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, result) {
+        const char* area_id = get_optional_string(item, "area_id", nullptr);
+        const char* area_name = get_optional_string(item, "name", nullptr);
+        const char* floor_id = get_optional_string(item, "floor_id", nullptr);
+        const char* area_icon = get_optional_string(item, "icon", nullptr);
+        if (!area_id || !area_name) {
             continue;
         }
 
-        int16_t room_idx = -1;
-        if (cJSON_IsString(area_id_item)) {
-            room_idx = hass_find_room_for_area(hass, area_id_item->valuestring);
+        int16_t floor_idx = floor_id ? hass_find_floor_for_floor_id(hass, floor_id) : -1;
+        if (floor_idx < 0) {
+            xSemaphoreTake(hass->mutex, portMAX_DELAY);
+            added = added || hass->other_floor_idx < 0;
+            xSemaphoreGive(hass->mutex);
+            floor_idx = hass_ensure_other_floor(hass);
+        }
+        if (floor_idx < 0) {
+            continue;
         }
-        if (room_idx < 0 && cJSON_IsString(device_id_item)) {
-            room_idx = hass_find_room_for_device(hass, device_id_item->valuestring);
+
+        int16_t room_idx = hass_find_room_for_area(hass, area_id);
+        if (room_idx >= 0) {
+            store_update_room(hass->store, static_cast<uint8_t>(room_idx), area_name, area_icon, static_cast<int8_t>(floor_idx));
+            continue;
         }
+        room_idx = store_add_room(hass->store, area_name, area_icon, static_cast<int8_t>(floor_idx));
         if (room_idx < 0) {
+            ESP_LOGW(TAG, "Skipping area %s: room limit reached", area_id);
             continue;
         }
+        xSemaphoreTake(hass->mutex, portMAX_DELAY);
+        id_map_put(&hass->area_map, &hass->discovery_ids, area_id, room_idx);
+        xSemaphoreGive(hass->mutex);
+        added = true;
+    }
+    if (added) {
+        store_bump_rooms_revision(hass->store);
+    }
+    hass_note_registry_delta(hass);
+}
 
-        EntityConfig entity = {
-            .entity_id = entity_id_item->valuestring,
-            .command_type = command_type,
-        };
-        if (store_add_entity_to_room(hass->store, room_idx, entity, display_name) < 0) {
-            ESP_LOGW(TAG, "Skipping entity %s: limits reached", entity_id_item->valuestring);
+// Takes the delta awaiting `response_id` out of the table; `event` for device
+// lookups, whose data comes in the subscription's first event
+static bool hass_take_registry_delta(home_assistant_context_t* hass, uint16_t response_id, bool event,
+                                     home_assistant_context_t::RegistryDelta* out) {
+    bool found = false;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    for (auto& slot : hass->registry_deltas) {
+        if (slot.id == 0 || slot.id != response_id || slot.answered != event) {
+            continue;
+        }
+        *out = slot;
+        if (slot.kind == RegistryRequestDevice && !event) {
+            slot.answered = true; // keep it for the event
+        } else {
+            slot.id = 0;
+        }
+        found = true;
+        break;
+    }
+    xSemaphoreGive(hass->mutex);
+    return found;
+}
+
+static bool hass_handle_registry_check_result(home_assistant_context_t* hass, uint16_t response_id, bool success, cJSON* result_item) {
+    if (response_id == 0) {
+        return false;
+    }
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    int8_t slot = -1;
+    for (uint8_t idx = 0; idx < 2; idx++) {
+        if (hass->registry_check_ids[idx] == response_id) {
+            slot = static_cast<int8_t>(idx);
+        }
+    }
+    xSemaphoreGive(hass->mutex);
+    if (slot < 0) {
+        return false;
+    }
+
+    const RegistryRequest request = slot == 0 ? RegistryRequestFloor : RegistryRequestArea;
+    uint32_t hash = FNV1A_OFFSET;
+    if (success && cJSON_IsArray(result_item)) {
+        cJSON* item = nullptr;
+        cJSON_ArrayForEach(item, result_item) {
+            hash = hass_registry_item_hash(hash, request, item);
+        }
+    }
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    hass->registry_check_ids[slot] = 0;
+    hass->registry_check_answered[slot] = true;
+    hass->registry_check_hashes[slot] = hash;
+    if (!success) {
+        hass->registry_check_pending = false; // can't tell; keep the cache
+    }
+    const bool complete = hass->registry_check_pending && hass->registry_check_answered[0] && hass->registry_check_answered[1];
+    const bool stale = complete && hass_registry_fingerprint(hass->registry_check_hashes) != hass_registry_fingerprint(hass->registry_hashes);
+    if (complete) {
+        hass->registry_check_pending = false;
+    }
+    xSemaphoreGive(hass->mutex);
+
+    if (!success) {
+        ESP_LOGW(TAG, "Checking the %s registry failed, keeping the cached rooms", hass_registry_name(request));
+    } else if (stale) {
+        hass_note_registry_change(hass, "while offline");
+    } else if (complete) {
+        ESP_LOGI(TAG, "Floors and areas unchanged since the discovery cache was saved");
+    }
+    return true;
+}
+
+static bool hass_handle_registry_delta_result(home_assistant_context_t* hass, uint16_t response_id, bool success, cJSON* result_item) {
+    home_assistant_context_t::RegistryDelta delta;
+    if (response_id == 0 || !hass_take_registry_delta(hass, response_id, false, &delta)) {
+        return false;
+    }
+    if (!success) {
+        if (delta.kind == RegistryRequestDevice) {
+            hass_take_registry_delta(hass, response_id, true, &delta);
+        }
+        if (delta.kind == RegistryRequestEntity) {
+            hass_apply_entity_delta(hass, delta.target, nullptr); // gone again by now
+        } else {
+            hass_note_registry_change(hass, "registry lookup failed");
+        }
+        return true;
+    }
+
+    switch (delta.kind) {
+    case RegistryRequestFloor:
+        hass_apply_floor_delta(hass, result_item);
+        break;
+    case RegistryRequestArea:
+        hass_apply_area_delta(hass, result_item);
+        break;
+    case RegistryRequestEntity:
+        hass_apply_entity_delta(hass, delta.target, result_item);
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+static bool hass_handle_registry_delta_event(home_assistant_context_t* hass, int subscription_id, cJSON* event) {
+    home_assistant_context_t::RegistryDelta delta;
+    if (subscription_id <= 0 || subscription_id > UINT16_MAX ||
+        !hass_take_registry_delta(hass, static_cast<uint16_t>(subscription_id), true, &delta)) {
+        return false;
+    }
+    hass_cmd_unsubscribe(hass, static_cast<uint16_t>(subscription_id));
+    hass_apply_device_delta(hass, delta.target, cJSON_GetObjectItem(event, "result"));
+    return true;
+}
+
+// Registry fields an entity's widget depends on
+static bool hass_entity_changes_matter(cJSON* changes) {
+    static const char* kWidgetFields[] = {"area_id", "device_id", "name", "original_name", "hidden_by", "disabled_by", "entity_category", "platform"};
+    if (!cJSON_IsObject(changes)) {
+        return true;
+    }
+    for (const char* field : kWidgetFields) {
+        if (cJSON_GetObjectItem(changes, field)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Patches the rows an edit touched into the store. Removed floors and areas
+// and renamed entity ids would shift indices, so they rediscover instead.
+static void hass_handle_registry_event(home_assistant_context_t* hass, const char* event_type, cJSON* data) {
+    const char* action = cJSON_IsObject(data) ? get_optional_string(data, "action", nullptr) : nullptr;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool deltas = action != nullptr && hass_discovery_idle_locked(hass);
+    xSemaphoreGive(hass->mutex);
+    if (!deltas) {
+        hass_note_registry_change(hass, event_type);
+        return;
+    }
+
+    discovery_cache_invalidate(); // saved again once the deltas settle
+    const bool remove = strcmp(action, "remove") == 0;
+    const bool create_or_update = strcmp(action, "create") == 0 || strcmp(action, "update") == 0;
+    cJSON* changes = cJSON_GetObjectItem(data, "changes");
+    bool handled = true;
+    if (strcmp(event_type, "entity_registry_updated") == 0) {
+        const char* entity_id = get_optional_string(data, "entity_id", nullptr);
+        if (get_optional_string(data, "old_entity_id", nullptr)) {
+            handled = false;
+        } else if (!entity_id || !hass_is_widget_domain(entity_id)) {
+            // nothing shown
+        } else if (remove) {
+            hass_apply_entity_delta(hass, entity_id, nullptr);
+        } else if (create_or_update && hass_entity_changes_matter(changes)) {
+            handled = hass_send_registry_delta(hass, RegistryRequestEntity, entity_id);
+        }
+    } else if (strcmp(event_type, "device_registry_updated") == 0) {
+        // Removed devices take their entities along, each with its own event
+        const char* device_id = get_optional_string(data, "device_id", nullptr);
+        if (device_id && create_or_update && (!cJSON_IsObject(changes) || cJSON_GetObjectItem(changes, "area_id"))) {
+            handled = hass_send_registry_delta(hass, RegistryRequestDevice, device_id);
+        }
+    } else if (remove) {
+        handled = false;
+    } else if (create_or_update) {
+        const bool floors = strcmp(event_type, "floor_registry_updated") == 0;
+        handled = hass_send_registry_delta(hass, floors ? RegistryRequestFloor : RegistryRequestArea, nullptr);
+    }
+    if (!handled) {
+        hass_note_registry_change(hass, event_type);
+    }
+}
+
+void hass_handle_result(home_assistant_context_t* hass, cJSON* json) {
+    cJSON* id_item = cJSON_GetObjectItem(json, "id");
+    cJSON* success_item = cJSON_GetObjectItem(json, "success");
+    cJSON* result_item = cJSON_GetObjectItem(json, "result");
+    if (!cJSON_IsNumber(id_item) || !cJSON_IsBool(success_item)) {
+        return;
+    }
+
+    uint16_t response_id = static_cast<uint16_t>(id_item->valueint);
+    bool success = cJSON_IsTrue(success_item);
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    const bool command_result = command_scheduler_on_result(&hass->commands, response_id, success);
+    xSemaphoreGive(hass->mutex);
+    const bool echo_result = hass_handle_command_echo_result(hass, response_id, success, result_item);
+    if (command_result || echo_result) {
+        if (!success) {
+            const char* message = get_optional_string(cJSON_GetObjectItem(json, "error"), "message", nullptr);
+            ESP_LOGW(TAG, "Command %u failed: %s", response_id, message ? message : "unknown error");
+        }
+        // The entity may have a newer value waiting for this result
+        xTaskNotifyGive(hass->task);
+        return;
+    }
+
+    if (hass_handle_energy_statistic_result(hass, response_id, success, result_item) ||
+        hass_handle_registry_check_result(hass, response_id, success, result_item) ||
+        hass_handle_registry_delta_result(hass, response_id, success, result_item) ||
+        hass_handle_silent_refresh_result(hass, response_id, success, result_item)) {
+        return;
+    }
+
+    uint16_t weather_forecast_request_id = 0;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    weather_forecast_request_id = hass->weather_forecast_request_id;
+    const bool forecast_subscription = response_id == hass->weather_forecast_subscription_id;
+    if (forecast_subscription && !success) {
+        hass->weather_forecast_subscription_id = 0;
+        hass->weather_forecast_polling = true;
+    }
+    xSemaphoreGive(hass->mutex);
+
+    if (forecast_subscription) {
+        if (!success) {
+            ESP_LOGW(TAG, "weather/subscribe_forecast unavailable, polling get_forecasts instead");
+            hass_cmd_request_weather_forecast(hass);
+        }
+        return;
+    }
+
+    if (response_id == weather_forecast_request_id) {
+        xSemaphoreTake(hass->mutex, portMAX_DELAY);
+        hass->weather_forecast_requested = false;
+        hass->weather_forecast_request_id = 0;
+        xSemaphoreGive(hass->mutex);
+        if (!success) {
+            ESP_LOGW(TAG, "Weather forecast request failed");
+        } else {
+            hass_parse_weather_forecast_result(hass, result_item);
+        }
+        xTaskNotifyGive(hass->task); // the silent refresh waits for the forecast too
+        return;
+    }
+
+    bool inputs_ready = true;
+    const uint8_t discovery_request = hass_discovery_request_for_id(hass, response_id, &inputs_ready);
+    if (discovery_request == DiscoveryRequestKinds) {
+        return;
+    }
+    if (!inputs_ready) {
+        hass_defer_discovery_request(hass, discovery_request, response_id);
+        return;
+    }
+    if (success) {
+        if (discovery_request == DiscoveryEnergyPrefs) {
+            hass_parse_energy_preferences_result(hass, result_item);
+        } else {
+            hass_parse_registry_result(hass, static_cast<RegistryRequest>(discovery_request + 1), result_item);
+        }
+    }
+    hass_complete_discovery_request(hass, discovery_request, success);
+}
+
+void hass_handle_server_payload(home_assistant_context_t* hass, cJSON* json) {
+    cJSON* type_item = cJSON_GetObjectItem(json, "type");
+    if (!cJSON_IsString(type_item) || type_item->valuestring == nullptr) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Received Home Assistant message of type %s", type_item->valuestring);
+    if (strcmp(type_item->valuestring, "auth_required") == 0) {
+        ESP_LOGI(TAG, "Logging in to home assistant...");
+        hass_cmd_authenticate(hass);
+    } else if (strcmp(type_item->valuestring, "auth_invalid") == 0) {
+        ESP_LOGI(TAG, "Updating state to InvalidCredentials");
+        hass_update_state(hass, ConnState::InvalidCredentials);
+    } else if (strcmp(type_item->valuestring, "auth_ok") == 0) {
+        ESP_LOGI(TAG, "Authentication successful, loading rooms and entities");
+        if (HASS_COALESCE_MESSAGES) {
+            hass_cmd_supported_features(hass);
+        }
+        if (HASS_SILENT_REFRESH_MINIMAL && power_is_silent_boot()) {
+            hass_begin_silent_refresh(hass);
+        } else {
+            hass_begin_session(hass);
+        }
+    } else if (strcmp(type_item->valuestring, "result") == 0) {
+        hass_handle_result(hass, json);
+    } else if (strcmp(type_item->valuestring, "event") == 0) {
+        cJSON* event = cJSON_GetObjectItem(json, "event");
+        cJSON* id_item = cJSON_GetObjectItem(json, "id");
+        if (cJSON_IsNumber(id_item) && cJSON_IsObject(event) &&
+            (hass_handle_forecast_event(hass, id_item->valueint, event) || hass_handle_registry_delta_event(hass, id_item->valueint, event))) {
+            return;
+        }
+        const char* event_type = cJSON_IsObject(event) ? get_optional_string(event, "event_type", nullptr) : nullptr;
+        if (event_type && hass_is_registry_event(event_type)) {
+            hass_handle_registry_event(hass, event_type, cJSON_GetObjectItem(event, "data"));
+        }
+    } else {
+        ESP_LOGI(TAG, "Ignoring HASS event type %s", type_item->valuestring);
+    }
+}
+
+static void hass_registry_stream_on_field(void* ctx, const char* key, const char* value, bool is_string) {
+    home_assistant_context_t* hass = static_cast<home_assistant_context_t*>(ctx);
+    if (strcmp(key, "id") == 0 && !is_string) {
+        hass->registry_stream_response_id = static_cast<uint16_t>(atoi(value));
+        if (hass_registry_request_for_id(hass, hass->registry_stream_response_id) == RegistryRequestNone) {
+            hass->registry_stream_candidate = false;
         }
+    } else if (strcmp(key, "type") == 0 && (!is_string || strcmp(value, "result") != 0)) {
+        hass->registry_stream_candidate = false;
+    }
+}
+
+static bool hass_registry_stream_on_array(void* ctx, uint8_t depth, const char* key) {
+    home_assistant_context_t* hass = static_cast<home_assistant_context_t*>(ctx);
+    if (!hass->registry_stream_candidate) {
+        return false;
+    }
+
+    // HA sends "id" ahead of "result"; without it we cannot tell which listing this is
+    bool inputs_ready = true;
+    const RegistryRequest request = hass_registry_request_for_id(hass, hass->registry_stream_response_id, &inputs_ready);
+    bool split = depth == 1 && strcmp(key, "result") == 0;
+    if (request == RegistryRequestEntity) {
+        // list_for_display nests the rows: { entity_categories: {...}, entities: [...] }
+        split = split || (depth == 2 && strcmp(key, "entities") == 0);
+    }
+    if (request == RegistryRequestNone || !split) {
+        return false;
+    }
+
+    hass->registry_stream_request = request;
+    hass->registry_stream_early = !inputs_ready;
+    hass->registry_stream_started_at = xTaskGetTickCount();
+    return true;
+}
+
+static void hass_registry_stream_on_item(void* ctx, const char* json, size_t len) {
+    home_assistant_context_t* hass = static_cast<home_assistant_context_t*>(ctx);
+    if (hass->registry_stream_early) {
+        return;
+    }
+    cJSON* item = cJSON_ParseWithLength(json, len);
+    if (!item) {
+        ESP_LOGW(TAG, "Skipping malformed %s registry item", hass_registry_name(static_cast<RegistryRequest>(hass->registry_stream_request)));
+        return;
+    }
+    hass_parse_registry_item(hass, static_cast<RegistryRequest>(hass->registry_stream_request), item);
+    cJSON_Delete(item);
+}
+
+static void hass_finish_registry_stream(home_assistant_context_t* hass, size_t payload_len) {
+    const RegistryRequest request = static_cast<RegistryRequest>(hass->registry_stream_request);
+    const JsonStream* stream = &hass->registry_stream;
+    hass->registry_stream_request = RegistryRequestNone;
+
+    ESP_LOGI(TAG, "Streamed %s registry: %u items (%u oversized), largest %u bytes, %u bytes total in %lu ms", hass_registry_name(request),
+             stream->items, stream->dropped_items, static_cast<unsigned>(stream->largest_item), static_cast<unsigned>(payload_len),
+             static_cast<unsigned long>((xTaskGetTickCount() - hass->registry_stream_started_at) * portTICK_PERIOD_MS));
+    if (stream->error) {
+        ESP_LOGW(TAG, "Malformed %s registry payload, listing may be incomplete", hass_registry_name(request));
+    }
+
+    // Discovery may have been reset by a reconnect while the listing streamed in
+    if (hass_registry_request_for_id(hass, hass->registry_stream_response_id) != request) {
+        return;
+    }
+    if (hass->registry_stream_early) {
+        hass_defer_discovery_request(hass, request - 1, hass->registry_stream_response_id);
+        return;
+    }
+    hass_complete_discovery_request(hass, request - 1, true);
+}
+
+static void hass_dispatch_text(home_assistant_context_t* hass, const char* json, size_t len) {
+    if (hass_decode_entity_event(hass, json, len)) {
+        return;
+    }
+    cJSON* root = cJSON_ParseWithLength(json, len);
+    if (!root) {
+        ESP_LOGE(TAG, "JSON parsing failed");
+        return;
+    }
+    hass_handle_server_payload(hass, root);
+    cJSON_Delete(root);
+}
+
+static void hass_registry_stream_begin(home_assistant_context_t* hass) {
+    hass->registry_stream_candidate = hass->registry_item_buffer != nullptr;
+    hass->registry_stream_request = RegistryRequestNone;
+    hass->registry_stream_response_id = 0;
+}
+
+static void hass_registry_stream_on_message_start(void* ctx) {
+    hass_registry_stream_begin(static_cast<home_assistant_context_t*>(ctx));
+}
+
+// Each message of a coalesced frame, as soon as it closes
+static void hass_registry_stream_on_message_end(void* ctx, const char* json, size_t len) {
+    home_assistant_context_t* hass = static_cast<home_assistant_context_t*>(ctx);
+    if (hass->registry_stream_request != RegistryRequestNone) {
+        hass_finish_registry_stream(hass, len);
+    } else if (json == nullptr) {
+        ESP_LOGE(TAG, "Coalesced message of %u bytes does not fit the JSON buffer, dropping it", static_cast<unsigned>(len));
+    } else {
+        hass_dispatch_text(hass, json, len);
     }
 }
 
-void hass_start_discovery(home_assistant_context_t* hass) {
-    ESP_LOGI(TAG, "Starting room entity discovery");
-    hass_reset_discovery_state(hass);
-    power_wifi_sleep_hold(true); // registry payloads drain internal heap; keep the PHY enabled until the first state sync lands
-    store_begin_room_sync(hass->store);
-    hass_set_pending_discovery_command(hass, DiscoveryCommandRequestFloorRegistry);
+static bool hass_is_coalesced_frame(const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != ' ' && data[i] != '\t' && data[i] != '\n' && data[i] != '\r') {
+            return data[i] == '[';
+        }
+    }
+    return false;
 }
 
-void hass_handle_result(home_assistant_context_t* hass, cJSON* json) {
-    cJSON* id_item = cJSON_GetObjectItem(json, "id");
-    cJSON* success_item = cJSON_GetObjectItem(json, "success");
-    cJSON* result_item = cJSON_GetObjectItem(json, "result");
-    if (!cJSON_IsNumber(id_item) || !cJSON_IsBool(success_item)) {
+// Registry listings are split into items while they stream in, so their size
+// no longer matters; everything else is buffered whole and parsed once the
+// last fragment lands. Coalesced frames always go through the stream, which
+// cuts the batch into its messages.
+static void hass_receive_text(home_assistant_context_t* hass, const esp_websocket_event_data_t* data) {
+    hass->rx_bytes = hass->rx_bytes + data->data_len;
+    if (data->payload_offset == 0) {
+        json_stream_reset(&hass->registry_stream);
+        hass_registry_stream_begin(hass);
+        hass->rx_coalesced = hass_is_coalesced_frame(data->data_ptr, data->data_len);
+    }
+
+    if (hass->rx_coalesced) {
+        if (data->data_len > 0 && !json_stream_feed(&hass->registry_stream, data->data_ptr, data->data_len) &&
+            data->payload_offset + data->data_len >= data->payload_len) {
+            ESP_LOGE(TAG, "Malformed coalesced frame, later messages in it were dropped");
+        }
+        if (hass->registry_stream_request != RegistryRequestNone) {
+            hass_extend_discovery_deadline(hass, hass->registry_stream_response_id);
+        }
         return;
     }
 
-    uint16_t response_id = static_cast<uint16_t>(id_item->valueint);
-    bool success = cJSON_IsTrue(success_item);
-
-    uint16_t floor_request_id = 0;
-    uint16_t area_request_id = 0;
-    uint16_t device_request_id = 0;
-    uint16_t entity_request_id = 0;
-    uint16_t weather_forecast_request_id = 0;
-    uint16_t energy_prefs_request_id = 0;
-    xSemaphoreTake(hass->mutex, portMAX_DELAY);
-    floor_request_id = hass->floor_registry_request_id;
-    area_request_id = hass->area_registry_request_id;
-    device_request_id = hass->device_registry_request_id;
-    entity_request_id = hass->entity_registry_request_id;
-    weather_forecast_request_id = hass->weather_forecast_request_id;
-    energy_prefs_request_id = hass->energy_prefs_request_id;
-    xSemaphoreGive(hass->mutex);
+    if (hass->registry_stream_candidate && data->data_len > 0 &&
+        !json_stream_feed(&hass->registry_stream, data->data_ptr, data->data_len) &&
+        hass->registry_stream_request == RegistryRequestNone) {
+        hass->registry_stream_candidate = false;
+    }
 
-    if (response_id == weather_forecast_request_id) {
-        xSemaphoreTake(hass->mutex, portMAX_DELAY);
-        hass->weather_forecast_requested = false;
-        hass->weather_forecast_request_id = 0;
-        xSemaphoreGive(hass->mutex);
-        if (!success) {
-            ESP_LOGW(TAG, "Weather forecast request failed");
-        } else {
-            hass_parse_weather_forecast_result(hass, result_item);
+    const bool message_complete = data->payload_offset + data->data_len >= data->payload_len;
+    if (hass->registry_stream_request != RegistryRequestNone) {
+        hass_extend_discovery_deadline(hass, hass->registry_stream_response_id);
+        if (message_complete) {
+            hass_finish_registry_stream(hass, data->payload_len);
         }
         return;
     }
 
-    if (response_id == energy_prefs_request_id) {
-        if (!success) {
-            ESP_LOGW(TAG, "Energy preferences request failed, keeping configured standby entities");
-        } else {
-            hass_parse_energy_preferences_result(hass, result_item);
+    // Nearly every state change arrives in one frame: parse it where it lies
+    if (data->payload_offset == 0 && data->data_len == data->payload_len) {
+        if (data->data_len > 0) {
+            hass_dispatch_text(hass, data->data_ptr, data->data_len);
         }
-        hass_set_pending_discovery_command(hass, DiscoveryCommandSubscribeEntities);
         return;
     }
 
-    if (response_id == floor_request_id) {
-        if (!success) {
-            ESP_LOGW(TAG, "Floor registry request failed, using only 'Other Areas'");
-        } else {
-            hass_parse_floor_registry(hass, result_item);
-        }
-        hass_set_pending_discovery_command(hass, DiscoveryCommandRequestAreaRegistry);
+    // json_buffer belongs to the parser task, so no lock is needed
+    if (data->payload_offset == 0) {
+        hass->json_buffer_len = 0;
+        hass->dropping_oversized_payload = false;
+    }
+    if (hass->dropping_oversized_payload) {
         return;
     }
 
-    if (response_id == area_request_id) {
-        if (!success) {
-            ESP_LOGE(TAG, "Area registry request failed");
-            hass_update_state(hass, ConnState::ConnectionError);
-            return;
-        }
-        hass_parse_area_registry(hass, result_item);
-        hass_set_pending_discovery_command(hass, DiscoveryCommandRequestDeviceRegistry);
+    const size_t chunk_end = data->payload_offset + data->data_len;
+    if (hass->json_buffer == nullptr || chunk_end > hass->json_buffer_cap) {
+        ESP_LOGE(TAG, "JSON buffer overflow, discarding message payload_len=%d", data->payload_len);
+        hass->dropping_oversized_payload = true;
+        hass->json_buffer_len = 0;
         return;
     }
 
-    if (response_id == device_request_id) {
-        if (!success) {
-            ESP_LOGE(TAG, "Device registry request failed");
-            hass_update_state(hass, ConnState::ConnectionError);
-            return;
-        }
-        hass_parse_device_registry(hass, result_item);
-        hass_set_pending_discovery_command(hass, DiscoveryCommandRequestEntityRegistry);
-        return;
+    memcpy(hass->json_buffer + data->payload_offset, data->data_ptr, data->data_len);
+    if (chunk_end > hass->json_buffer_len) {
+        hass->json_buffer_len = chunk_end;
     }
+    if (hass->json_buffer_len > 0 && hass->json_buffer_len == static_cast<size_t>(data->payload_len)) {
+        hass_dispatch_text(hass, hass->json_buffer, hass->json_buffer_len);
+    }
+}
 
-    if (response_id == entity_request_id) {
-        if (!success) {
-            ESP_LOGE(TAG, "Entity registry request failed");
+// One text frame chunk as queued for the parser task; the data follows
+struct RxChunk {
+    uint32_t generation;
+    uint32_t queued_ms;
+    int payload_len;
+    int payload_offset;
+    int data_len;
+};
+
+static HassRxStats g_rx_stats = {};
+static RingbufHandle_t g_rx_ring = nullptr;
+
+void home_assistant_rx_stats(HassRxStats* out) {
+    *out = g_rx_stats;
+    out->ring_used = g_rx_ring ? HASS_RX_RING_LEN - xRingbufferGetCurFreeSize(g_rx_ring) : 0;
+}
+
+// Stale frames still queued from the previous connection are skipped
+static void hass_start_rx_generation(home_assistant_context_t* hass) {
+    hass->rx_generation = hass->rx_generation + 1;
+}
+
+// Websocket task: copy the chunk out and get back to the socket
+static void hass_queue_text(home_assistant_context_t* hass, const esp_websocket_event_data_t* data) {
+    const size_t len = sizeof(RxChunk) + data->data_len;
+    if (len > xRingbufferGetMaxItemSize(hass->rx_ring)) {
+        ESP_LOGE(TAG, "Frame chunk of %d bytes does not fit the receive ring, dropping it", data->data_len);
+        return;
+    }
+    if (hass->rx_overflowed) {
+        return;
+    }
+    void* slot = nullptr;
+    if (xRingbufferSendAcquire(hass->rx_ring, &slot, len, 0) != pdTRUE) {
+        g_rx_stats.ring_full++;
+        ESP_LOGW(TAG, "Receive ring full, waiting for the parser");
+        // Bounded: we hold the client lock here, and the parser may be waiting
+        // for it to send. A lost chunk breaks the stream, so resync from scratch.
+        if (xRingbufferSendAcquire(hass->rx_ring, &slot, len, pdMS_TO_TICKS(HASS_RX_RING_FULL_WAIT_MS)) != pdTRUE) {
+            g_rx_stats.ring_overflows++;
+            ESP_LOGE(TAG, "Parser stuck for %lu ms, dropping the connection", static_cast<unsigned long>(HASS_RX_RING_FULL_WAIT_MS));
+            hass->rx_overflowed = true;
+            hass_start_rx_generation(hass);
             hass_update_state(hass, ConnState::ConnectionError);
+            if (hass->store->home_assistant_task) {
+                xTaskNotifyGive(hass->store->home_assistant_task);
+            }
             return;
         }
+    }
 
-        hass_parse_entity_registry(hass, result_item);
-        hass_refresh_entities_from_store(hass);
-        store_finish_room_sync(hass->store);
-        hass_update_device_room(hass); // room indices may have shifted
-        xSemaphoreTake(hass->mutex, portMAX_DELAY);
-        const uint8_t entity_count = hass->entity_count;
-        xSemaphoreGive(hass->mutex);
-        if (entity_count == 0) {
-            ESP_LOGW(TAG, "No light/climate/cover entities discovered for mapped rooms");
-        }
-        hass_set_pending_discovery_command(hass, DiscoveryCommandRequestEnergyPrefs);
-        return;
+    RxChunk* chunk = static_cast<RxChunk*>(slot);
+    chunk->generation = hass->rx_generation;
+    chunk->queued_ms = hass_now_ms();
+    chunk->payload_len = data->payload_len;
+    chunk->payload_offset = data->payload_offset;
+    chunk->data_len = data->data_len;
+    if (data->data_len > 0) {
+        memcpy(chunk + 1, data->data_ptr, data->data_len);
     }
-}
+    xRingbufferSendComplete(hass->rx_ring, slot);
 
-void hass_handle_server_payload(home_assistant_context_t* hass, cJSON* json) {
-    cJSON* type_item = cJSON_GetObjectItem(json, "type");
-    if (!cJSON_IsString(type_item) || type_item->valuestring == nullptr) {
-        return;
+    const uint32_t used = HASS_RX_RING_LEN - xRingbufferGetCurFreeSize(hass->rx_ring);
+    if (used > g_rx_stats.ring_peak) {
+        g_rx_stats.ring_peak = used;
     }
+}
 
-    ESP_LOGI(TAG, "Received Home Assistant message of type %s", type_item->valuestring);
-    if (strcmp(type_item->valuestring, "auth_required") == 0) {
-        ESP_LOGI(TAG, "Logging in to home assistant...");
-        hass_cmd_authenticate(hass);
-    } else if (strcmp(type_item->valuestring, "auth_invalid") == 0) {
-        ESP_LOGI(TAG, "Updating state to InvalidCredentials");
-        hass_update_state(hass, ConnState::InvalidCredentials);
-    } else if (strcmp(type_item->valuestring, "auth_ok") == 0) {
-        ESP_LOGI(TAG, "Authentication successful, loading rooms and entities");
-        hass_start_discovery(hass);
-    } else if (strcmp(type_item->valuestring, "result") == 0) {
-        hass_handle_result(hass, json);
-    } else if (strcmp(type_item->valuestring, "event") == 0) {
-        cJSON* event = cJSON_GetObjectItem(json, "event");
-        if (cJSON_IsObject(event)) {
-            hass_handle_entity_update(hass, event);
+static void hass_parser_task(void* arg) {
+    home_assistant_context_t* hass = static_cast<home_assistant_context_t*>(arg);
+    while (true) {
+        size_t len = 0;
+        RxChunk* chunk = static_cast<RxChunk*>(xRingbufferReceive(hass->rx_ring, &len, portMAX_DELAY));
+        if (chunk == nullptr) {
+            continue;
         }
-        power_wifi_sleep_hold(false); // the first event is the full state sync — discovery burst is over
-    } else {
-        ESP_LOGI(TAG, "Ignoring HASS event type %s", type_item->valuestring);
+        if (chunk->generation == hass->rx_generation) {
+            esp_websocket_event_data_t data = {};
+            data.op_code = 1;
+            data.data_ptr = reinterpret_cast<const char*>(chunk + 1);
+            data.data_len = chunk->data_len;
+            data.payload_len = chunk->payload_len;
+            data.payload_offset = chunk->payload_offset;
+            hass_receive_text(hass, &data);
+
+            if (chunk->payload_offset + chunk->data_len >= chunk->payload_len) {
+                const uint32_t latency_ms = hass_now_ms() - chunk->queued_ms;
+                g_rx_stats.messages++;
+                g_rx_stats.dispatch_last_ms = latency_ms;
+                if (latency_ms > g_rx_stats.dispatch_max_ms) {
+                    g_rx_stats.dispatch_max_ms = latency_ms;
+                }
+            }
+        }
+        vRingbufferReturnItem(hass->rx_ring, chunk);
+    }
+}
+
+// Kept in RTC memory so the next connect, even after deep sleep, can resume it
+static void hass_keep_tls_session(home_assistant_context_t* hass) {
+    uint8_t* session = static_cast<uint8_t*>(heap_caps_malloc(HASS_TLS_SESSION_MAX_LEN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (!session) {
+        session = static_cast<uint8_t*>(malloc(HASS_TLS_SESSION_MAX_LEN));
+    }
+    size_t len = 0;
+    bool resumed = false;
+    if (session && esp_websocket_client_get_tls_session(hass->client, session, HASS_TLS_SESSION_MAX_LEN, &len, &resumed) == ESP_OK) {
+        tls_session_cache_save(fnv1a_str(hass->endpoints[hass->endpoint_idx]), session, len);
     }
+    free(session);
 }
 
 static void hass_ws_event_handler(void* handler_args, esp_event_base_t base, int32_t event_id, void* event_data) {
@@ -1916,58 +4118,28 @@ static void hass_ws_event_handler(void* handler_args, esp_event_base_t base, int
     switch (event_id) {
     case WEBSOCKET_EVENT_CONNECTED:
         ESP_LOGI(TAG, "Received WEBSOCKET_EVENT_CONNECTED");
+        hass_start_rx_generation(hass);
+        hass->rx_overflowed = false;
+        if (HASS_TLS_SESSION_RESUMPTION) {
+            hass_keep_tls_session(hass);
+        }
         break;
     case WEBSOCKET_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "Received WEBSOCKET_EVENT_DISCONNECTED");
+        hass_start_rx_generation(hass);
         hass_update_state(hass, ConnState::ConnectionError);
         break;
     case WEBSOCKET_EVENT_ERROR:
         ESP_LOGI(TAG, "Received WEBSOCKET_EVENT_ERROR");
+        hass_start_rx_generation(hass);
         hass_update_state(hass, ConnState::ConnectionError);
         break;
     case WEBSOCKET_EVENT_DATA:
         if (data->op_code == 0 || data->op_code == 1) {
-            xSemaphoreTake(hass->mutex, portMAX_DELAY);
-
-            if (data->payload_offset == 0) {
-                hass->json_buffer_len = 0;
-                hass->dropping_oversized_payload = false;
-            }
-
-            if (hass->dropping_oversized_payload) {
-                xSemaphoreGive(hass->mutex);
-                return;
-            }
-
-            const size_t chunk_end = data->payload_offset + data->data_len;
-            if (hass->json_buffer == nullptr || chunk_end > hass->json_buffer_cap) {
-                ESP_LOGE(TAG, "JSON buffer overflow, discarding message payload_len=%d", data->payload_len);
-                hass->dropping_oversized_payload = true;
-                hass->json_buffer_len = 0;
-                xSemaphoreGive(hass->mutex);
-                return;
-            }
-
-            memcpy(hass->json_buffer + data->payload_offset, data->data_ptr, data->data_len);
-            if (chunk_end > hass->json_buffer_len) {
-                hass->json_buffer_len = chunk_end;
-            }
-
-            cJSON* json = nullptr;
-            if (hass->json_buffer_len == data->payload_len && hass->json_buffer_len > 0) {
-                json = cJSON_ParseWithLength(hass->json_buffer, hass->json_buffer_len);
-                if (!json) {
-                    ESP_LOGE(TAG, "JSON parsing failed");
-                }
-            }
-            xSemaphoreGive(hass->mutex);
-
-            if (json) {
-                hass_handle_server_payload(hass, json);
-                cJSON_Delete(json);
-            }
+            hass_queue_text(hass, data);
         } else if (data->op_code == 8) {
             ESP_LOGI(TAG, "Received Connection Close frame");
+            hass_start_rx_generation(hass);
             hass_update_state(hass, ConnState::ConnectionError);
         }
         break;
@@ -1980,30 +4152,52 @@ static void hass_ws_event_handler(void* handler_args, esp_event_base_t base, int
     }
 }
 
-static void hass_send_call_service(home_assistant_context_t* hass, const char* domain, const char* service, cJSON* service_data) {
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "id", hass_generate_event_id(hass));
-    cJSON_AddStringToObject(root, "type", "call_service");
-    cJSON_AddStringToObject(root, "domain", domain);
-    cJSON_AddStringToObject(root, "service", service);
-    cJSON_AddItemToObject(root, "service_data", service_data);
+// Optional service_data member next to entity_id: a string when `text` is set, a number otherwise
+struct ServiceArg {
+    const char* key;
+    const char* text;
+    float number;
+};
 
-    char* request = cJSON_PrintUnformatted(root);
-    ESP_LOGI(TAG, "Sending %s", request);
-    esp_websocket_client_send_text(hass->client, request, strlen(request), portMAX_DELAY);
-    cJSON_free(request);
-    cJSON_Delete(root);
+static void hass_send_call_service(home_assistant_context_t* hass, const Command* cmd, const char* domain, const char* service,
+                                   const char* entity_id, const ServiceArg* arg = nullptr) {
+    JsonWriter writer;
+    const uint16_t message_id = hass_begin_request(hass, &writer);
+    int16_t evicted_idx = -1;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    command_scheduler_on_sent(&hass->commands, static_cast<uint8_t>(cmd->type), cmd->entity_idx, message_id, hass_now_ms());
+    if (cmd->entity_idx < MAX_ENTITIES) {
+        evicted_idx = hass_track_command_echo(hass, cmd->entity_idx, message_id);
+    }
+    xSemaphoreGive(hass->mutex);
+    if (evicted_idx >= 0) {
+        store_release_target(hass->store, static_cast<uint8_t>(evicted_idx));
+    }
+
+    json_writer_string(&writer, "type", "call_service");
+    json_writer_string(&writer, "domain", domain);
+    json_writer_string(&writer, "service", service);
+    json_writer_begin_object(&writer, "service_data");
+    json_writer_string(&writer, "entity_id", entity_id);
+    if (arg) {
+        json_writer_literal_key(&writer, arg->key);
+        if (arg->text) {
+            json_writer_escaped(&writer, arg->text);
+        } else {
+            json_writer_number_value(&writer, arg->number);
+        }
+    }
+    json_writer_close(&writer, '}');
+    hass_send_message(hass, &writer, service);
 }
 
-static void hass_refresh_standby_battery_soc(home_assistant_context_t* hass) {
+static void hass_refresh_standby_battery_soc(home_assistant_context_t* hass, const Command* cmd) {
     if (!has_entity_id(hass->standby_energy_battery_soc_entity_id)) {
         ESP_LOGW(TAG, "Standby battery SoC entity is not configured/discovered");
         return;
     }
 
-    cJSON* service_data = cJSON_CreateObject();
-    cJSON_AddStringToObject(service_data, "entity_id", hass->standby_energy_battery_soc_entity_id);
-    hass_send_call_service(hass, "homeassistant", "update_entity", service_data);
+    hass_send_call_service(hass, cmd, "homeassistant", "update_entity", hass->standby_energy_battery_soc_entity_id);
 }
 
 static const char* climate_mode_service_value(ClimateMode mode) {
@@ -2019,21 +4213,13 @@ static const char* climate_mode_service_value(ClimateMode mode) {
 }
 
 void hass_send_command(home_assistant_context_t* hass, Command* cmd) {
-    if (cmd->entity_idx < MAX_ENTITIES) {
-        xSemaphoreTake(hass->mutex, portMAX_DELAY);
-        hass->last_command_sent_at_ms[cmd->entity_idx] = xTaskGetTickCount();
-        xSemaphoreGive(hass->mutex);
-    }
-
     switch (cmd->type) {
     case CommandType::SetLightBrightnessPercentage: {
-        cJSON* service_data = cJSON_CreateObject();
-        cJSON_AddStringToObject(service_data, "entity_id", cmd->entity_id);
         if (cmd->value == 0) {
-            hass_send_call_service(hass, "light", "turn_off", service_data);
+            hass_send_call_service(hass, cmd, "light", "turn_off", cmd->entity_id);
         } else {
-            cJSON_AddNumberToObject(service_data, "brightness_pct", cmd->value);
-            hass_send_call_service(hass, "light", "turn_on", service_data);
+            const ServiceArg brightness = {"brightness_pct", nullptr, static_cast<float>(cmd->value)};
+            hass_send_call_service(hass, cmd, "light", "turn_on", cmd->entity_id, &brightness);
         }
         break;
     }
@@ -2041,53 +4227,36 @@ void hass_send_command(home_assistant_context_t* hass, Command* cmd) {
         ClimateMode mode = climate_unpack_mode(cmd->value);
         float target_c = climate_steps_to_celsius(climate_unpack_temp_steps(cmd->value));
 
-        cJSON* mode_service_data = cJSON_CreateObject();
-        cJSON_AddStringToObject(mode_service_data, "entity_id", cmd->entity_id);
-        cJSON_AddStringToObject(mode_service_data, "hvac_mode", climate_mode_service_value(mode));
-        hass_send_call_service(hass, "climate", "set_hvac_mode", mode_service_data);
+        const ServiceArg hvac_mode = {"hvac_mode", climate_mode_service_value(mode), 0};
+        hass_send_call_service(hass, cmd, "climate", "set_hvac_mode", cmd->entity_id, &hvac_mode);
 
         if (mode != ClimateMode::Off) {
-            cJSON* temp_service_data = cJSON_CreateObject();
-            cJSON_AddStringToObject(temp_service_data, "entity_id", cmd->entity_id);
-            cJSON_AddNumberToObject(temp_service_data, "temperature", target_c);
-            hass_send_call_service(hass, "climate", "set_temperature", temp_service_data);
+            const ServiceArg temperature = {"temperature", nullptr, target_c};
+            hass_send_call_service(hass, cmd, "climate", "set_temperature", cmd->entity_id, &temperature);
         }
         break;
     }
     case CommandType::SetCoverOpenClose: {
-        cJSON* service_data = cJSON_CreateObject();
-        cJSON_AddStringToObject(service_data, "entity_id", cmd->entity_id);
         const char* service = cmd->value == 0 ? "close_cover" : (cmd->value == 2 ? "stop_cover" : "open_cover");
-        hass_send_call_service(hass, "cover", service, service_data);
+        hass_send_call_service(hass, cmd, "cover", service, cmd->entity_id);
         break;
     }
-    case CommandType::ValveOpenClose: {
-        cJSON* service_data = cJSON_CreateObject();
-        cJSON_AddStringToObject(service_data, "entity_id", cmd->entity_id);
-        hass_send_call_service(hass, "valve", cmd->value == 0 ? "close_valve" : "open_valve", service_data);
+    case CommandType::ValveOpenClose:
+        hass_send_call_service(hass, cmd, "valve", cmd->value == 0 ? "close_valve" : "open_valve", cmd->entity_id);
         break;
-    }
     case CommandType::SetFanSpeedPercentage: {
-        cJSON* service_data = cJSON_CreateObject();
-        cJSON_AddStringToObject(service_data, "entity_id", cmd->entity_id);
-        cJSON_AddNumberToObject(service_data, "percentage", cmd->value);
-        hass_send_call_service(hass, "fan", "set_percentage", service_data);
+        const ServiceArg percentage = {"percentage", nullptr, static_cast<float>(cmd->value)};
+        hass_send_call_service(hass, cmd, "fan", "set_percentage", cmd->entity_id, &percentage);
         break;
     }
-    case CommandType::SwitchOnOff: {
-        cJSON* service_data = cJSON_CreateObject();
-        cJSON_AddStringToObject(service_data, "entity_id", cmd->entity_id);
-        hass_send_call_service(hass, "switch", cmd->value == 0 ? "turn_off" : "turn_on", service_data);
+    case CommandType::SwitchOnOff:
+        hass_send_call_service(hass, cmd, "switch", cmd->value == 0 ? "turn_off" : "turn_on", cmd->entity_id);
         break;
-    }
-    case CommandType::AutomationOnOff: {
-        cJSON* service_data = cJSON_CreateObject();
-        cJSON_AddStringToObject(service_data, "entity_id", cmd->entity_id);
-        hass_send_call_service(hass, "automation", cmd->value == 0 ? "turn_off" : "turn_on", service_data);
+    case CommandType::AutomationOnOff:
+        hass_send_call_service(hass, cmd, "automation", cmd->value == 0 ? "turn_off" : "turn_on", cmd->entity_id);
         break;
-    }
     case CommandType::RefreshStandbyBatterySoc:
-        hass_refresh_standby_battery_soc(hass);
+        hass_refresh_standby_battery_soc(hass, cmd);
         break;
     default:
         ESP_LOGI(TAG, "Service type not supported");
@@ -2095,6 +4264,317 @@ void hass_send_command(home_assistant_context_t* hass, Command* cmd) {
     }
 }
 
+static const char* hass_bulk_domain(CommandType type) {
+    switch (type) {
+    case CommandType::SetLightBrightnessPercentage:
+        return "light";
+    case CommandType::SwitchOnOff:
+        return "switch";
+    default:
+        return nullptr;
+    }
+}
+
+// Room-wide on/off: the pending bulk commands of one domain and direction go
+// out as a single call_service with an entity_id list. Returns how long the
+// entities still held back (result outstanding, no token) have to wait.
+static uint32_t hass_send_bulk_command(home_assistant_context_t* hass, CommandType type, bool on) {
+    const char* domain = hass_bulk_domain(type);
+    if (!domain) {
+        return HASS_TASK_IDLE_WAIT_MS;
+    }
+    uint32_t wait_ms = HASS_TASK_IDLE_WAIT_MS;
+    uint8_t entity_idxs[MAX_ENTITIES];
+    uint8_t values[MAX_ENTITIES];
+    const char* entity_ids[MAX_ENTITIES];
+    uint8_t count = 0;
+    uint16_t cursor = 0;
+    Command command;
+    while (count < MAX_ENTITIES && store_get_pending_command(hass->store, &cursor, &command)) {
+        if (!command.bulk || command.type != type || (command.value != 0) != on) {
+            continue;
+        }
+        xSemaphoreTake(hass->mutex, portMAX_DELAY);
+        const uint32_t command_wait_ms =
+            command_scheduler_wait_ms(&hass->commands, static_cast<uint8_t>(command.type), command.entity_idx, hass_now_ms());
+        xSemaphoreGive(hass->mutex);
+        if (command_wait_ms > 0) {
+            if (command_wait_ms < wait_ms) {
+                wait_ms = command_wait_ms;
+            }
+            continue;
+        }
+        entity_idxs[count] = command.entity_idx;
+        values[count] = command.value;
+        entity_ids[count] = command.entity_id;
+        count++;
+    }
+    if (count == 0) {
+        return wait_ms;
+    }
+
+    JsonWriter writer;
+    const uint16_t message_id = hass_begin_request(hass, &writer);
+    uint8_t evicted[MAX_ENTITIES];
+    uint8_t evicted_count = 0;
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    command_scheduler_on_sent_group(&hass->commands, static_cast<uint8_t>(type), entity_idxs, count, message_id, hass_now_ms());
+    for (uint8_t idx = 0; idx < count; idx++) {
+        const int16_t evicted_idx = hass_track_command_echo(hass, entity_idxs[idx], message_id);
+        if (evicted_idx >= 0) {
+            evicted[evicted_count++] = static_cast<uint8_t>(evicted_idx);
+        }
+    }
+    xSemaphoreGive(hass->mutex);
+    for (uint8_t idx = 0; idx < evicted_count; idx++) {
+        store_release_target(hass->store, evicted[idx]);
+    }
+
+    const char* service = on ? "turn_on" : "turn_off";
+    json_writer_string(&writer, "type", "call_service");
+    json_writer_string(&writer, "domain", domain);
+    json_writer_string(&writer, "service", service);
+    json_writer_begin_object(&writer, "service_data");
+    json_writer_begin_array(&writer, "entity_id");
+    for (uint8_t idx = 0; idx < count; idx++) {
+        json_writer_array_string(&writer, entity_ids[idx]);
+    }
+    json_writer_close(&writer, ']');
+    json_writer_close(&writer, '}');
+    hass_send_message(hass, &writer, service);
+    ESP_LOGI(TAG, "%s.%s for %u entities in one call", domain, service, count);
+
+    for (uint8_t idx = 0; idx < count; idx++) {
+        const Command sent = {.type = type, .entity_id = entity_ids[idx], .entity_idx = entity_idxs[idx], .value = values[idx], .bulk = true};
+        store_ack_pending_command(hass->store, &sent);
+    }
+    return wait_ms;
+}
+
+// Sends every pending command its domain and entity allow right now and
+// returns how long the task may sleep before a held-back one becomes due
+static uint32_t hass_drain_commands(home_assistant_context_t* hass) {
+    uint32_t wait_ms = HASS_TASK_IDLE_WAIT_MS;
+    uint16_t cursor = 0;
+    Command command;
+    bool bulk_sent[COMMAND_SCHEDULER_BUCKETS][2] = {};
+
+    xSemaphoreTake(hass->mutex, portMAX_DELAY);
+    command_scheduler_expire(&hass->commands, hass_now_ms());
+    xSemaphoreGive(hass->mutex);
+    hass_expire_command_echoes(hass);
+
+    while (store_get_pending_command(hass->store, &cursor, &command)) {
+        const uint8_t bucket = static_cast<uint8_t>(command.type);
+        if (command.bulk && bucket < COMMAND_SCHEDULER_BUCKETS) {
+            const bool on = command.value != 0;
+            if (!bulk_sent[bucket][on]) {
+                bulk_sent[bucket][on] = true;
+                const uint32_t bulk_wait_ms = hass_send_bulk_command(hass, command.type, on);
+                if (bulk_wait_ms < wait_ms) {
+                    wait_ms = bulk_wait_ms;
+                }
+            }
+            continue;
+        }
+        xSemaphoreTake(hass->mutex, portMAX_DELAY);
+        const uint32_t command_wait_ms =
+            command_scheduler_wait_ms(&hass->commands, bucket, command.entity_idx, hass_now_ms());
+        xSemaphoreGive(hass->mutex);
+        if (command_wait_ms > 0) {
+            // Left pending: a newer value replaces it until it can go
+            if (command_wait_ms < wait_ms) {
+                wait_ms = command_wait_ms;
+            }
+            continue;
+        }
+        hass_send_command(hass, &command);
+        store_ack_pending_command(hass->store, &command);
+    }
+    return wait_ms;
+}
+
+// The endpoint that last came up, so wake boots connect there without probing
+// (RTC RAM survives deep sleep and software resets)
+static constexpr uint32_t ENDPOINT_MAGIC = 0x48415350; // "HASP"
+RTC_NOINIT_ATTR static uint32_t g_rtc_endpoint_magic;
+RTC_NOINIT_ATTR static uint32_t g_rtc_endpoint_hash;
+
+// False when no endpoint was remembered
+static bool hass_init_endpoints(home_assistant_context_t* hass) {
+    hass->endpoints[hass->endpoint_count++] = hass->config->home_assistant_url;
+    for (int idx = 0; idx < MAX_HOME_ASSISTANT_FALLBACK_URLS; idx++) {
+        const char* url = hass->config->home_assistant_fallback_urls[idx];
+        if (url != nullptr && url[0] != '\0') {
+            hass->endpoints[hass->endpoint_count++] = url;
+        }
+    }
+    if (g_rtc_endpoint_magic != ENDPOINT_MAGIC) {
+        return false;
+    }
+    for (uint8_t idx = 0; idx < hass->endpoint_count; idx++) {
+        if (fnv1a_str(hass->endpoints[idx]) == g_rtc_endpoint_hash) {
+            hass->endpoint_idx = idx;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void hass_remember_endpoint(home_assistant_context_t* hass) {
+    hass->endpoint_failed[hass->endpoint_idx] = false;
+    const uint32_t hash = fnv1a_str(hass->endpoints[hass->endpoint_idx]);
+    if (g_rtc_endpoint_magic != ENDPOINT_MAGIC || g_rtc_endpoint_hash != hash) {
+        g_rtc_endpoint_hash = hash;
+        g_rtc_endpoint_magic = ENDPOINT_MAGIC;
+    }
+}
+
+// Host and port of a ws:// or wss:// URL
+static bool hass_parse_endpoint(const char* url, char* host, size_t host_cap, char* port, size_t port_cap) {
+    const char* rest = nullptr;
+    if (strncmp(url, "wss://", 6) == 0) {
+        rest = url + 6;
+        copy_string(port, port_cap, "443");
+    } else if (strncmp(url, "ws://", 5) == 0) {
+        rest = url + 5;
+        copy_string(port, port_cap, "80");
+    } else {
+        return false;
+    }
+    const size_t authority_len = strcspn(rest, "/?");
+    const char* colon = static_cast<const char*>(memchr(rest, ':', authority_len));
+    const size_t host_len = colon ? static_cast<size_t>(colon - rest) : authority_len;
+    if (host_len == 0 || host_len >= host_cap) {
+        return false;
+    }
+    memcpy(host, rest, host_len);
+    host[host_len] = '\0';
+    if (colon) {
+        const size_t port_len = authority_len - host_len - 1;
+        if (port_len == 0 || port_len >= port_cap) {
+            return false;
+        }
+        memcpy(port, colon + 1, port_len);
+        port[port_len] = '\0';
+    }
+    return true;
+}
+
+// TCP handshake time to the endpoint, UINT32_MAX when it does not answer in time
+static uint32_t hass_probe_endpoint(const char* url) {
+    char host[128];
+    char port[8];
+    if (!hass_parse_endpoint(url, host, sizeof(host), port, sizeof(port))) {
+        ESP_LOGW(TAG, "Cannot probe endpoint %s", url);
+        return UINT32_MAX;
+    }
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* address = nullptr;
+    if (getaddrinfo(host, port, &hints, &address) != 0 || address == nullptr) {
+        return UINT32_MAX;
+    }
+    const int sock = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (sock < 0) {
+        freeaddrinfo(address);
+        return UINT32_MAX;
+    }
+
+    uint32_t rtt_ms = UINT32_MAX;
+    const uint32_t started_ms = hass_now_ms();
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    if (connect(sock, address->ai_addr, address->ai_addrlen) == 0 || errno == EINPROGRESS) {
+        fd_set writable;
+        FD_ZERO(&writable);
+        FD_SET(sock, &writable);
+        timeval timeout = {
+            .tv_sec = static_cast<time_t>(HASS_ENDPOINT_PROBE_TIMEOUT_MS / 1000),
+            .tv_usec = static_cast<suseconds_t>((HASS_ENDPOINT_PROBE_TIMEOUT_MS % 1000) * 1000),
+        };
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        if (select(sock + 1, nullptr, &writable, nullptr, &timeout) == 1 &&
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &error_len) == 0 && error == 0) {
+            rtt_ms = hass_now_ms() - started_ms;
+        }
+    }
+    close(sock);
+    freeaddrinfo(address);
+    return rtt_ms;
+}
+
+static esp_websocket_client_handle_t hass_create_client(home_assistant_context_t* hass, const char* url) {
+    const esp_websocket_client_config_t client_config = {
+        .uri = url,
+        .disable_auto_reconnect = true,
+        .cert_pem = hass->config->root_ca,
+        .enable_tls_session_resumption = HASS_TLS_SESSION_RESUMPTION && hass->config->root_ca && strncmp(url, "wss://", 6) == 0,
+    };
+    esp_websocket_client_handle_t client = esp_websocket_client_init(&client_config);
+    esp_websocket_register_events(client, WEBSOCKET_EVENT_ANY, hass_ws_event_handler, static_cast<void*>(hass));
+
+    // A session from before deep sleep; later reconnects reuse the client's own
+    if (client && client_config.enable_tls_session_resumption) {
+        uint8_t* session = static_cast<uint8_t*>(heap_caps_malloc(HASS_TLS_SESSION_MAX_LEN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+        if (!session) {
+            session = static_cast<uint8_t*>(malloc(HASS_TLS_SESSION_MAX_LEN));
+        }
+        const size_t len = tls_session_cache_load(fnv1a_str(url), session, session ? HASS_TLS_SESSION_MAX_LEN : 0);
+        if (len > 0 && esp_websocket_client_set_tls_session(client, session, len) == ESP_OK) {
+            ESP_LOGI(TAG, "Offering the kept TLS session (%u bytes)", static_cast<unsigned>(len));
+        }
+        free(session);
+    }
+    return client;
+}
+
+// Probes every endpoint and returns the fastest healthy one: one that answers
+// and whose last connect did not fail. Without any answer the next endpoint in
+// order gets its turn.
+static uint8_t hass_select_endpoint(home_assistant_context_t* hass) {
+    if (hass->endpoint_count < 2) {
+        return hass->endpoint_idx;
+    }
+    uint8_t best = UINT8_MAX;
+    uint32_t best_rtt_ms = UINT32_MAX;
+    bool best_failed = true;
+    for (uint8_t idx = 0; idx < hass->endpoint_count; idx++) {
+        const uint32_t rtt_ms = hass_probe_endpoint(hass->endpoints[idx]);
+        if (rtt_ms == UINT32_MAX) {
+            ESP_LOGI(TAG, "Endpoint %s: no answer", hass->endpoints[idx]);
+            continue;
+        }
+        ESP_LOGI(TAG, "Endpoint %s: %lu ms%s", hass->endpoints[idx], static_cast<unsigned long>(rtt_ms),
+                 hass->endpoint_failed[idx] ? " (last connect failed)" : "");
+        const bool failed = hass->endpoint_failed[idx];
+        if (best == UINT8_MAX || (best_failed && !failed) || (failed == best_failed && rtt_ms < best_rtt_ms)) {
+            best = idx;
+            best_rtt_ms = rtt_ms;
+            best_failed = failed;
+        }
+    }
+    if (best == UINT8_MAX) {
+        best = static_cast<uint8_t>((hass->endpoint_idx + 1) % hass->endpoint_count);
+    }
+    return best;
+}
+
+// The client must be closed
+static void hass_switch_endpoint(home_assistant_context_t* hass, uint8_t endpoint_idx) {
+    if (endpoint_idx == hass->endpoint_idx) {
+        return;
+    }
+    ESP_LOGI(TAG, "Switching to endpoint %s", hass->endpoints[endpoint_idx]);
+    // Senders use the client under send_mutex
+    xSemaphoreTake(hass->send_mutex, portMAX_DELAY);
+    esp_websocket_client_destroy(hass->client);
+    hass->client = hass_create_client(hass, hass->endpoints[endpoint_idx]);
+    hass->endpoint_idx = endpoint_idx;
+    xSemaphoreGive(hass->send_mutex);
+}
+
 void home_assistant_task(void* arg) {
     HomeAssistantTaskArgs* ctx = static_cast<HomeAssistantTaskArgs*>(arg);
     EntityStore* store = ctx->store;
@@ -2103,16 +4583,10 @@ void home_assistant_task(void* arg) {
     store_wait_for_wifi_up(store);
     ESP_LOGI(TAG, "Wifi is up, connecting...");
 
-    esp_websocket_client_config_t client_config = {
-        .uri = ctx->config->home_assistant_url,
-        .disable_auto_reconnect = true,
-        .cert_pem = ctx->config->root_ca,
-    };
-
     home_assistant_context_t* hass = new home_assistant_context_t{};
     hass->store = store;
     hass->config = ctx->config;
-    hass->client = esp_websocket_client_init(&client_config);
+    const bool endpoint_remembered = hass_init_endpoints(hass);
     hass->mutex = xSemaphoreCreateMutex();
     hass->task = xTaskGetCurrentTaskHandle();
     hass->json_buffer_cap = HASS_MAX_JSON_BUFFER;
@@ -2126,17 +4600,66 @@ void home_assistant_task(void* arg) {
         hass_update_state(hass, ConnState::ConnectionError);
         vTaskDelete(nullptr);
     }
+    hass->send_mutex = xSemaphoreCreateMutex();
+    hass->send_buffer = static_cast<char*>(heap_caps_malloc(HASS_SEND_BUFFER_LEN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (hass->send_buffer == nullptr) {
+        hass->send_buffer = static_cast<char*>(malloc(HASS_SEND_BUFFER_LEN));
+    }
+    if (hass->send_buffer == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate send buffer, cannot start Home Assistant client");
+        hass_update_state(hass, ConnState::ConnectionError);
+        vTaskDelete(nullptr);
+    }
+    hass->registry_item_buffer = static_cast<char*>(heap_caps_malloc(HASS_MAX_REGISTRY_ITEM_LEN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (hass->registry_item_buffer == nullptr) {
+        ESP_LOGW(TAG, "Failed to allocate registry item buffer, registries will be buffered whole");
+    }
+    const JsonStreamHandlers registry_stream_handlers = {
+        .on_field = hass_registry_stream_on_field,
+        .on_array = hass_registry_stream_on_array,
+        .on_item = hass_registry_stream_on_item,
+        .on_message_start = hass_registry_stream_on_message_start,
+        .on_message_end = hass_registry_stream_on_message_end,
+        .ctx = hass,
+    };
+    json_stream_init(&hass->registry_stream, &registry_stream_handlers, hass->registry_item_buffer, HASS_MAX_REGISTRY_ITEM_LEN,
+                     hass->json_buffer, hass->json_buffer_cap);
     hass->event_id = 1;
+    command_scheduler_init(&hass->commands, hass_now_ms());
+    hass->discovery_cache_fingerprint = hass_discovery_cache_fingerprint(hass->config);
     hass_reset_discovery_state(hass);
 
-    esp_websocket_register_events(hass->client, WEBSOCKET_EVENT_ANY, hass_ws_event_handler, static_cast<void*>(hass));
+    uint8_t* rx_ring_storage = static_cast<uint8_t*>(heap_caps_malloc(HASS_RX_RING_LEN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (rx_ring_storage == nullptr) {
+        rx_ring_storage = static_cast<uint8_t*>(malloc(HASS_RX_RING_LEN));
+    }
+    StaticRingbuffer_t* rx_ring_struct = static_cast<StaticRingbuffer_t*>(malloc(sizeof(StaticRingbuffer_t)));
+    if (rx_ring_storage == nullptr || rx_ring_struct == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate receive ring, cannot start Home Assistant client");
+        hass_update_state(hass, ConnState::ConnectionError);
+        vTaskDelete(nullptr);
+    }
+    hass->rx_ring = xRingbufferCreateStatic(HASS_RX_RING_LEN, RINGBUF_TYPE_NOSPLIT, rx_ring_storage, rx_ring_struct);
+    g_rx_ring = hass->rx_ring;
+    xTaskCreatePinnedToCore(hass_parser_task, "hass_parser", HASS_PARSER_TASK_STACK, hass, HASS_PARSER_TASK_PRIORITY, nullptr,
+                            HASS_PARSER_TASK_CORE);
+
+    // Wake boots go straight to the endpoint that last came up
+    if (!endpoint_remembered) {
+        hass->endpoint_idx = hass_select_endpoint(hass);
+    }
+    hass->client = hass_create_client(hass, hass->endpoints[hass->endpoint_idx]);
+    ESP_LOGI(TAG, "Connecting to %s", hass->endpoints[hass->endpoint_idx]);
+    hass->connect_started_at = xTaskGetTickCount();
     esp_err_t err = esp_websocket_client_start(hass->client);
     ESP_LOGI(TAG, "esp_websocket_client_start returned: %s", esp_err_to_name(err));
 
-    Command command;
     bool previous_connect_failed = false;
+    bool endpoint_proven = false;
+    uint32_t wait_ms = HASS_TASK_IDLE_WAIT_MS;
     while (1) {
-        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+        wait_ms = HASS_TASK_IDLE_WAIT_MS;
 
         xSemaphoreTake(hass->mutex, portMAX_DELAY);
         ConnState state = hass->state;
@@ -2151,15 +4674,28 @@ void home_assistant_task(void* arg) {
             store_wait_for_wifi_up(store);
 
             if (previous_connect_failed) {
+                hass->endpoint_failed[hass->endpoint_idx] = true;
                 ESP_LOGI(TAG, "Waiting 10 seconds");
                 vTaskDelay(pdMS_TO_TICKS(HASS_RECONNECT_DELAY_MS));
             }
             previous_connect_failed = true;
+            endpoint_proven = false;
+            hass_switch_endpoint(hass, hass_select_endpoint(hass));
 
             ESP_LOGI(TAG, "Attempting to reconnect to home assistant");
             xSemaphoreTake(hass->mutex, portMAX_DELAY);
             hass->state = ConnState::Initializing;
             hass->event_id = 1;
+            hass->entities_subscription_id = 0;
+            hass->weather_forecast_subscription_id = 0;
+            hass->weather_forecast_polling = false;
+            hass->registry_events_subscribed = false;
+            hass->registry_changed = false;
+            hass->silent_refresh = false;
+            hass->silent_prefs_request_id = 0;
+            hass->wake_room_pending = false;
+            hass->connect_started_at = xTaskGetTickCount();
+            command_scheduler_clear_in_flight(&hass->commands);
             xSemaphoreGive(hass->mutex);
             hass_reset_discovery_state(hass);
             store_flush_pending_commands(hass->store);
@@ -2167,28 +4703,78 @@ void home_assistant_task(void* arg) {
             err = esp_websocket_client_start(hass->client);
             ESP_LOGI(TAG, "esp_websocket_client_start returned %s", esp_err_to_name(err));
         } else {
-            hass_dispatch_discovery_command(hass);
+            wait_ms = hass_run_discovery(hass);
+            hass_poll_silent_refresh(hass);
         }
 
         if (state == ConnState::Up) {
+            if (!endpoint_proven) {
+                hass_remember_endpoint(hass);
+                endpoint_proven = true;
+            }
             previous_connect_failed = false;
-            const uint32_t now_ms = static_cast<uint32_t>(xTaskGetTickCount() * portTICK_PERIOD_MS);
+            const uint32_t now_ms = hass_now_ms();
             const bool standby_active = store_is_standby_active(store);
             bool weather_forecast_requested = false;
             uint32_t last_weather_forecast_request_ms = 0;
             xSemaphoreTake(hass->mutex, portMAX_DELAY);
+            const bool weather_forecast_polling = hass->weather_forecast_polling;
             weather_forecast_requested = hass->weather_forecast_requested;
             last_weather_forecast_request_ms = hass->last_weather_forecast_request_ms;
             xSemaphoreGive(hass->mutex);
-            if (standby_active && !weather_forecast_requested &&
+            if (weather_forecast_polling && standby_active && !weather_forecast_requested &&
                 (last_weather_forecast_request_ms == 0 ||
                  static_cast<uint32_t>(now_ms - last_weather_forecast_request_ms) >= STANDBY_REFRESH_INTERVAL_MS)) {
                 hass_cmd_request_weather_forecast(hass);
             }
-            while (store_get_pending_command(store, &command)) {
-                hass_send_command(hass, &command);
-                store_ack_pending_command(store, &command);
-                vTaskDelay(pdMS_TO_TICKS(HASS_TASK_SEND_DELAY_MS));
+            xSemaphoreTake(hass->mutex, portMAX_DELAY);
+            const bool energy_stats_due = HASS_STANDBY_ENERGY_FROM_STATISTICS &&
+                                          static_cast<uint32_t>(now_ms - hass->last_energy_stats_request_ms) >= STANDBY_REFRESH_INTERVAL_MS;
+            xSemaphoreGive(hass->mutex);
+            if (standby_active && energy_stats_due) {
+                hass_cmd_request_energy_statistics(hass);
+            }
+            bool rediscover = false;
+            xSemaphoreTake(hass->mutex, portMAX_DELAY);
+            if (hass->registry_changed && xTaskGetTickCount() - hass->registry_changed_at >= pdMS_TO_TICKS(HASS_REGISTRY_CHANGE_SETTLE_MS)) {
+                hass->registry_changed = false;
+                rediscover = true;
+            }
+            xSemaphoreGive(hass->mutex);
+            if (rediscover) {
+                ESP_LOGI(TAG, "Registry settled, rediscovering rooms and entities");
+                hass_rediscover(hass);
+            }
+            bool resubscribe = false;
+            uint16_t replaced_subscription_id = 0;
+            xSemaphoreTake(hass->mutex, portMAX_DELAY);
+            const bool discovery_idle = hass_discovery_idle_locked(hass);
+            if (discovery_idle && hass->entities_resubscribe_pending) {
+                hass->entities_resubscribe_pending = false;
+                replaced_subscription_id = hass->entities_subscription_id;
+                resubscribe = true;
+            }
+            const bool save_deltas = discovery_idle && hass->discovery_cache_dirty &&
+                                     xTaskGetTickCount() - hass->registry_delta_at >= pdMS_TO_TICKS(HASS_REGISTRY_CHANGE_SETTLE_MS);
+            xSemaphoreGive(hass->mutex);
+            if (resubscribe && HASS_SCOPED_SUBSCRIPTIONS) {
+                hass_rebuild_dispatch_index(hass);
+                hass_drop_room_subscriptions(hass); // the open room resubscribes with its new widgets below
+            } else if (resubscribe) {
+                if (replaced_subscription_id != 0) {
+                    hass_cmd_unsubscribe(hass, replaced_subscription_id);
+                }
+                hass_cmd_subscribe_entities(hass);
+            }
+            if (discovery_idle) {
+                hass_sync_room_subscriptions(hass);
+            }
+            if (save_deltas) {
+                hass_save_discovery_cache(hass);
+            }
+            const uint32_t command_wait_ms = hass_drain_commands(hass);
+            if (command_wait_ms < wait_ms) {
+                wait_ms = command_wait_ms;
             }
         }
     }
@@ -8,4 +8,16 @@ struct HomeAssistantTaskArgs {
     Configuration* config;
 };
 
-void home_assistant_task(void* arg);
\ No newline at end of file
+// Receive path counters for the harness
+struct HassRxStats {
+    uint32_t ring_used;  // bytes queued for the parser task now
+    uint32_t ring_peak;  // most bytes ever queued
+    uint32_t ring_full;  // times the websocket task had to wait for room
+    uint32_t ring_overflows; // times it gave up waiting and dropped the connection
+    uint32_t messages;   // whole text messages handled
+    uint32_t dispatch_last_ms; // last message: received to handled
+    uint32_t dispatch_max_ms;
+};
+
+void home_assistant_task(void* arg);
+void home_assistant_rx_stats(HassRxStats* out);
\ No newline at end of file
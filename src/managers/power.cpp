@@ -27,6 +27,7 @@ RTC_NOINIT_ATTR static uint32_t g_rtc_standby_hash;
 static PowerBootMode g_boot_mode = PowerBootMode::Normal;
 static FASTEPD* g_epaper = nullptr;
 static bool g_silent_boot = false;
+static volatile bool g_silent_data_ready = false;
 static bool g_standby_sleep = true;
 static bool g_sleep_guard_tripped = false;
 static const char* volatile g_sleep_inhibit = "boot";
@@ -232,6 +233,10 @@ bool power_is_silent_boot() {
     return g_silent_boot;
 }
 
+void power_silent_refresh_data_ready() {
+    g_silent_data_ready = true;
+}
+
 void power_mark_boot_healthy() {
     if (!g_sleep_guard_tripped) {
         g_wake_boot_streak = 0;
@@ -281,7 +286,7 @@ static void power_silent_refresh_poll(EntityStore* store) {
         if (store_open_standby(store, millis())) {
             ESP_LOGI(TAG, "silent refresh: standby resumed, waiting for data");
         }
-    } else if (refreshed_at == 0 && store_standby_data_fresh(store)) {
+    } else if (refreshed_at == 0 && (g_silent_data_ready || (!HASS_SILENT_REFRESH_MINIMAL && store_standby_data_fresh(store)))) {
         refreshed_at = millis();
         ESP_LOGI(TAG, "silent refresh: data landed, lingering %lums for publish/redraw", static_cast<unsigned long>(SILENT_REFRESH_LINGER_MS));
     }
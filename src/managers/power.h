@@ -30,6 +30,7 @@ void power_set_standby_sleep(bool enabled); // runtime kill switch
 bool power_standby_sleep_enabled();
 const char* power_sleep_inhibit(); // why we are not sleeping right now ("none" = would sleep)
 bool power_is_silent_boot();       // UI suppresses all drawing while true
+void power_silent_refresh_data_ready(); // the standby data of a silent refresh is complete
 void power_force_standby_sleep(EntityStore* store, uint32_t timer_s); // sleep now, gates bypassed (settings tile, console)
 void power_mark_boot_healthy();    // clears the wake boot-loop guard streak
 
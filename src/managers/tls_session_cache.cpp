@@ -0,0 +1,52 @@
+#include "managers/tls_session_cache.h"
+#include "constants.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "fnv1a.h"
+#include <cstring>
+
+static const char* TAG = "tls_session_cache";
+
+static constexpr uint32_t SESSION_MAGIC = 0x544c5331; // "TLS1"
+
+// Not NVS: the session is rewritten on every full handshake and NVS space is
+// taken by the discovery cache
+RTC_NOINIT_ATTR static uint32_t g_rtc_session_magic;
+RTC_NOINIT_ATTR static uint32_t g_rtc_session_endpoint;
+RTC_NOINIT_ATTR static uint32_t g_rtc_session_checksum;
+RTC_NOINIT_ATTR static uint32_t g_rtc_session_len;
+RTC_NOINIT_ATTR static uint8_t g_rtc_session_data[HASS_TLS_SESSION_MAX_LEN];
+
+void tls_session_cache_save(uint32_t endpoint_hash, const uint8_t* data, size_t len) {
+    if (!data || len == 0 || len > sizeof(g_rtc_session_data)) {
+        ESP_LOGW(TAG, "Not keeping TLS session: %u bytes (limit %u)", static_cast<unsigned>(len),
+                 static_cast<unsigned>(sizeof(g_rtc_session_data)));
+        tls_session_cache_invalidate();
+        return;
+    }
+    g_rtc_session_magic = 0;
+    memcpy(g_rtc_session_data, data, len);
+    g_rtc_session_len = len;
+    g_rtc_session_endpoint = endpoint_hash;
+    g_rtc_session_checksum = fnv1a_update(FNV1A_OFFSET, data, len);
+    g_rtc_session_magic = SESSION_MAGIC;
+}
+
+size_t tls_session_cache_load(uint32_t endpoint_hash, uint8_t* out, size_t cap) {
+    if (!out || g_rtc_session_magic != SESSION_MAGIC || g_rtc_session_endpoint != endpoint_hash) {
+        return 0;
+    }
+    const size_t len = g_rtc_session_len;
+    if (len == 0 || len > sizeof(g_rtc_session_data) || len > cap ||
+        fnv1a_update(FNV1A_OFFSET, g_rtc_session_data, len) != g_rtc_session_checksum) {
+        ESP_LOGW(TAG, "Kept TLS session is corrupt");
+        tls_session_cache_invalidate();
+        return 0;
+    }
+    memcpy(out, g_rtc_session_data, len);
+    return len;
+}
+
+void tls_session_cache_invalidate() {
+    g_rtc_session_magic = 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// TLS session of the last handshake, kept in RTC memory so a wake from deep
+// sleep can resume it instead of doing a full handshake. Power loss clears it.
+// Sessions belong to one endpoint, identified by the caller's hash of its URL.
+
+void tls_session_cache_save(uint32_t endpoint_hash, const uint8_t* data, size_t len);
+// Session length, or 0 when none was saved for this endpoint
+size_t tls_session_cache_load(uint32_t endpoint_hash, uint8_t* out, size_t cap);
+void tls_session_cache_invalidate();
@@ -153,6 +153,20 @@ static bool is_back_button_touched(const TouchEvent* touch_event) {
            touch_event->y >= ROOM_CONTROLS_BACK_Y && touch_event->y < ROOM_CONTROLS_BACK_Y + ROOM_CONTROLS_BACK_H;
 }
 
+// -1 none, 0 all off, 1 all on
+static int8_t room_bulk_button_touched(const TouchEvent* touch_event) {
+    if (touch_event->y < ROOM_CONTROLS_BACK_Y || touch_event->y >= ROOM_CONTROLS_BACK_Y + ROOM_CONTROLS_BACK_H) {
+        return -1;
+    }
+    if (touch_event->x >= ROOM_CONTROLS_BULK_OFF_X && touch_event->x < ROOM_CONTROLS_BULK_OFF_X + ROOM_CONTROLS_BULK_W) {
+        return 0;
+    }
+    if (touch_event->x >= ROOM_CONTROLS_BULK_ON_X && touch_event->x < ROOM_CONTROLS_BULK_ON_X + ROOM_CONTROLS_BULK_W) {
+        return 1;
+    }
+    return -1;
+}
+
 static bool is_home_settings_button_touched(const TouchEvent* touch_event) {
     return touch_event->x >= HOME_SETTINGS_BUTTON_X && touch_event->x < HOME_SETTINGS_BUTTON_X + HOME_SETTINGS_BUTTON_W &&
            touch_event->y >= HOME_SETTINGS_BUTTON_Y && touch_event->y < HOME_SETTINGS_BUTTON_Y + HOME_SETTINGS_BUTTON_H;
@@ -441,6 +455,9 @@ void touch_task(void* arg) {
     bool touching = false;
     bool swallow_touch_release = false;
     int active_widget = -1;
+    bool live_drag = false;      // active_widget follows the finger, see SLIDER_LIVE_DRAG
+    uint8_t live_drag_value = 0; // last value queued during the drag
+    uint32_t live_drag_ms = 0;
     uint32_t last_touch_ms = 0;
     uint32_t standby_touch_ignore_until_ms = 0;
     uint8_t widget_original_value = 0;
@@ -700,6 +717,7 @@ void touch_task(void* arg) {
                 touch_end = touch_event;
                 touching = true;
                 swallow_touch_release = false;
+                live_drag = false;
 
                 if (is_back_button_touched(&touch_event)) {
                     ESP_LOGI(TAG, "Back to room list");
@@ -708,6 +726,15 @@ void touch_task(void* arg) {
                     continue;
                 }
 
+                // Buttons only drawn when the room has something to switch
+                const int8_t bulk = room_bulk_button_touched(&touch_event);
+                if (bulk >= 0) {
+                    ESP_LOGI(TAG, "Room all %s", bulk == 1 ? "on" : "off");
+                    store_send_room_command(store, ui_state->selected_room, bulk == 1);
+                    swallow_touch_release = true;
+                    continue;
+                }
+
                 for (size_t widget_idx = 0; widget_idx < screen->widget_count; widget_idx++) {
                     if (screen->widgets[widget_idx]->isTouching(&touch_event)) {
                         ESP_LOGI(TAG, "Starting touch on widget %d", widget_idx);
@@ -715,9 +742,25 @@ void touch_task(void* arg) {
                         break;
                     }
                 }
+                live_drag = SLIDER_LIVE_DRAG && active_widget != -1 && screen->widgets[active_widget]->tracksDrag();
+                if (live_drag) {
+                    live_drag_value = ui_state->widget_values[active_widget];
+                    live_drag_ms = now_ms;
+                }
             } else {
                 touch_end.x = ti.x[0];
                 touch_end.y = ti.y[0];
+
+                // Latest wins: the store overwrites a value not sent yet
+                if (live_drag && active_widget != -1 && now_ms - live_drag_ms >= SLIDER_LIVE_DRAG_INTERVAL_MS) {
+                    const uint8_t value = screen->widgets[active_widget]->getValueFromTouch(&touch_end, live_drag_value);
+                    const uint8_t step = value > live_drag_value ? value - live_drag_value : live_drag_value - value;
+                    if (step >= SLIDER_LIVE_DRAG_MIN_STEP) {
+                        store_send_command(store, screen->entity_ids[active_widget], value);
+                        live_drag_value = value;
+                        live_drag_ms = now_ms;
+                    }
+                }
             }
         } else {
             if (touching) {
@@ -870,13 +913,15 @@ void touch_task(void* arg) {
                 }
 
                 if (ui_state->mode == UiMode::RoomControls && millis() - last_touch_ms > TOUCH_RELEASE_TIMEOUT_MS) {
-                    int8_t page_delta = list_swipe_delta(&touch_start, &touch_end);
+                    // A slider drag owns its gesture, however far it went sideways
+                    int8_t page_delta = live_drag ? 0 : list_swipe_delta(&touch_start, &touch_end);
                     if (page_delta != 0) {
                         if (store_shift_room_controls_page(store, page_delta)) {
                             ESP_LOGI(TAG, "Swiped room controls to page delta %d", page_delta);
                         }
                     } else if (active_widget != -1) {
-                        widget_original_value = ui_state->widget_values[active_widget];
+                        // The final value goes out unless the drag already queued it
+                        widget_original_value = live_drag ? live_drag_value : ui_state->widget_values[active_widget];
                         widget_current_value = screen->widgets[active_widget]->getValueFromTouch(&touch_end, widget_original_value);
                         if (widget_current_value != widget_original_value) {
                             store_send_command(store, screen->entity_ids[active_widget], widget_current_value);
@@ -886,6 +931,7 @@ void touch_task(void* arg) {
                     ESP_LOGI(TAG, "End of touch");
                     touching = false;
                     active_widget = -1;
+                    live_drag = false;
                     continue;
                 }
 
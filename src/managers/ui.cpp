@@ -1524,7 +1524,26 @@ bool ui_build_room_controls(Screen* screen,
     return screen->widget_count > 0 || snapshot->entity_count == 0;
 }
 
-void ui_draw_room_controls_header(FASTEPD* epaper, const char* room_name, uint8_t room_controls_page, uint8_t room_controls_page_count, bool truncated) {
+static bool ui_room_has_bulk_actions(const RoomControlsSnapshot* snapshot) {
+    for (uint8_t idx = 0; idx < snapshot->entity_count; idx++) {
+        if (store_supports_bulk_command(snapshot->entity_types[idx])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void ui_draw_bulk_button(FASTEPD* epaper, int16_t x, const char* label) {
+    epaper->fillRoundRect(x, ROOM_CONTROLS_BACK_Y, ROOM_CONTROLS_BULK_W, ROOM_CONTROLS_BACK_H, 14, ui_white(epaper));
+    epaper->drawRoundRect(x, ROOM_CONTROLS_BACK_Y, ROOM_CONTROLS_BULK_W, ROOM_CONTROLS_BACK_H, 14, BBEP_BLACK);
+    int16_t text_w, text_h, text_ascent;
+    measure_line(epaper, label, &text_w, &text_h, &text_ascent);
+    draw_text_at(epaper, x + (ROOM_CONTROLS_BULK_W - text_w) / 2, ROOM_CONTROLS_BACK_Y + (ROOM_CONTROLS_BACK_H - text_h) / 2 + text_ascent,
+                 label, true);
+}
+
+void ui_draw_room_controls_header(FASTEPD* epaper, const char* room_name, uint8_t room_controls_page, uint8_t room_controls_page_count, bool truncated,
+                                  bool bulk_actions) {
     epaper->setFont(Montserrat_Regular_20);
     epaper->setTextColor(BBEP_BLACK);
 
@@ -1537,12 +1556,18 @@ void ui_draw_room_controls_header(FASTEPD* epaper, const char* room_name, uint8_
     char room_label[MAX_ROOM_NAME_LEN];
     strncpy(room_label, room_name ? room_name : "", sizeof(room_label) - 1);
     room_label[sizeof(room_label) - 1] = '\0';
-    truncate_with_ellipsis(epaper, room_label, sizeof(room_label), DISPLAY_WIDTH - (ROOM_CONTROLS_BACK_X + ROOM_CONTROLS_BACK_W + 32) - 8);
+    const int16_t right_edge = bulk_actions ? ROOM_CONTROLS_BULK_OFF_X - ROOM_CONTROLS_BULK_GAP : DISPLAY_WIDTH - ROOM_CONTROLS_ITEM_X;
+    truncate_with_ellipsis(epaper, room_label, sizeof(room_label), right_edge - (ROOM_CONTROLS_BACK_X + ROOM_CONTROLS_BACK_W + 32) - 8);
     draw_text_at(epaper, ROOM_CONTROLS_BACK_X + ROOM_CONTROLS_BACK_W + 32, ROOM_CONTROLS_BACK_Y + 30, room_label, true);
 
     epaper->setFont(Montserrat_Regular_16);
     draw_text_at(epaper, ROOM_CONTROLS_BACK_X + ROOM_CONTROLS_BACK_W + 32, ROOM_CONTROLS_BACK_Y + 56, "Controls", true);
 
+    if (bulk_actions) {
+        ui_draw_bulk_button(epaper, ROOM_CONTROLS_BULK_OFF_X, "All off");
+        ui_draw_bulk_button(epaper, ROOM_CONTROLS_BULK_ON_X, "All on");
+    }
+
     if (room_controls_page_count > 1) {
         char page_text[20];
         snprintf(page_text, sizeof(page_text), "Page %u/%u", static_cast<unsigned>(room_controls_page + 1),
@@ -1556,7 +1581,7 @@ void ui_draw_room_controls_header(FASTEPD* epaper, const char* room_name, uint8_
         constexpr int16_t pad_y = 9;
         const int16_t badge_w = text_w + 2 * pad_x + 1; // +1 for the reinforce double-strike
         const int16_t badge_h = text_h + 2 * pad_y;
-        const int16_t badge_x = DISPLAY_WIDTH - ROOM_CONTROLS_ITEM_X - badge_w;
+        const int16_t badge_x = right_edge - badge_w;
         const int16_t badge_y = (ROOM_CONTROLS_HEADER_HEIGHT - badge_h) / 2;
 
         epaper->fillRoundRect(badge_x, badge_y, badge_w, badge_h, 12, ui_band(epaper));
@@ -1615,6 +1640,7 @@ void ui_task(void* arg) {
     static WifiSettingsSnapshot wifi_settings_snapshot;
     static WifiPasswordSnapshot wifi_password_snapshot;
     bool room_controls_truncated = false;
+    bool room_controls_bulk = false;
     uint8_t room_controls_page_count = 1;
 
     memset(&floor_list_snapshot, 0, sizeof(floor_list_snapshot));
@@ -1676,6 +1702,7 @@ void ui_task(void* arg) {
                 if (store_get_room_controls_snapshot(ctx->store, current_state.selected_room, &room_controls_snapshot)) {
                     ui_build_room_controls(ctx->screen, &room_controls_snapshot, current_state.room_controls_page, &room_controls_page_count,
                                            &room_controls_truncated);
+                    room_controls_bulk = ui_room_has_bulk_actions(&room_controls_snapshot);
                     store_update_ui_state(ctx->store, ctx->screen, &current_state);
                 } else {
                     current_state.mode = UiMode::GenericError;
@@ -1760,14 +1787,14 @@ void ui_task(void* arg) {
                 ctx->epaper->setMode(BB_MODE_4BPP);
                 ctx->epaper->fillScreen(ui_white(ctx->epaper));
                 ui_draw_room_controls_header(ctx->epaper, room_controls_snapshot.room_name, current_state.room_controls_page,
-                                             room_controls_page_count, room_controls_truncated);
+                                             room_controls_page_count, room_controls_truncated, room_controls_bulk);
                 ui_room_controls_draw_widgets(&current_state, BitDepth::BD_4BPP, ctx->screen, ctx->epaper);
                 ctx->epaper->fullUpdate(CLEAR_FAST, true);
 
                 ctx->epaper->setMode(BB_MODE_1BPP);
                 ctx->epaper->fillScreen(ui_white(ctx->epaper));
                 ui_draw_room_controls_header(ctx->epaper, room_controls_snapshot.room_name, current_state.room_controls_page,
-                                             room_controls_page_count, room_controls_truncated);
+                                             room_controls_page_count, room_controls_truncated, room_controls_bulk);
                 ui_room_controls_draw_widgets(&current_state, BitDepth::BD_1BPP, ctx->screen, ctx->epaper);
                 ctx->epaper->backupPlane();
                 display_is_dirty = false;
@@ -1812,14 +1839,14 @@ void ui_task(void* arg) {
             ctx->epaper->setMode(BB_MODE_4BPP);
             ctx->epaper->fillScreen(ui_white(ctx->epaper));
             ui_draw_room_controls_header(ctx->epaper, room_controls_snapshot.room_name, displayed_state.room_controls_page,
-                                         room_controls_page_count, room_controls_truncated);
+                                         room_controls_page_count, room_controls_truncated, room_controls_bulk);
             ui_room_controls_draw_widgets(&displayed_state, BitDepth::BD_4BPP, ctx->screen, ctx->epaper);
             ctx->epaper->fullUpdate(CLEAR_FAST, true);
 
             ctx->epaper->setMode(BB_MODE_1BPP);
             ctx->epaper->fillScreen(ui_white(ctx->epaper));
             ui_draw_room_controls_header(ctx->epaper, room_controls_snapshot.room_name, displayed_state.room_controls_page,
-                                         room_controls_page_count, room_controls_truncated);
+                                         room_controls_page_count, room_controls_truncated, room_controls_bulk);
             ui_room_controls_draw_widgets(&displayed_state, BitDepth::BD_1BPP, ctx->screen, ctx->epaper);
             ctx->epaper->backupPlane();
 
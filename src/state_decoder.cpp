@@ -0,0 +1,398 @@
+#include "state_decoder.h"
+
+#include <cstdlib>
+#include <cstring>
+
+struct StateCursor {
+    const char* pos;
+    const char* end;
+    bool error;
+};
+
+static const char* const kStateNumberKeys[StateNumberCount] = {
+    "temperature", "target_temp_low", "brightness", "percentage", "off_brightness",
+};
+
+static bool state_is_delimiter(char c) {
+    return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void state_skip_ws(StateCursor* c) {
+    while (c->pos < c->end && (*c->pos == ' ' || *c->pos == '\t' || *c->pos == '\n' || *c->pos == '\r')) {
+        c->pos++;
+    }
+}
+
+static bool state_peek(StateCursor* c, char expected) {
+    state_skip_ws(c);
+    return c->pos < c->end && *c->pos == expected;
+}
+
+static bool state_consume(StateCursor* c, char expected) {
+    if (!state_peek(c, expected)) {
+        c->error = true;
+        return false;
+    }
+    c->pos++;
+    return true;
+}
+
+// Unescapes into `out` (NUL-terminated, cut at `cap`); `out` may be nullptr to skip
+static bool state_read_string(StateCursor* c, char* out, size_t cap, bool* truncated) {
+    if (!state_consume(c, '"')) {
+        return false;
+    }
+    size_t len = 0;
+    bool cut = false;
+    while (c->pos < c->end) {
+        char ch = *c->pos++;
+        if (ch == '"') {
+            if (out && cap > 0) {
+                out[len] = '\0';
+            }
+            if (truncated) {
+                *truncated = cut;
+            }
+            return true;
+        }
+        if (ch == '\\') {
+            if (c->pos >= c->end) {
+                break;
+            }
+            ch = *c->pos++;
+            switch (ch) {
+            case 'n':
+                ch = '\n';
+                break;
+            case 't':
+                ch = '\t';
+                break;
+            case 'r':
+                ch = '\r';
+                break;
+            case 'b':
+                ch = '\b';
+                break;
+            case 'f':
+                ch = '\f';
+                break;
+            case 'u':
+                // None of the fields kept here carry non-ASCII text
+                if (c->end - c->pos < 4) {
+                    c->pos = c->end;
+                    continue;
+                }
+                c->pos += 4;
+                ch = '?';
+                break;
+            default:
+                break; // \" \\ \/
+            }
+        }
+        if (out) {
+            if (len + 1 < cap) {
+                out[len++] = ch;
+            } else {
+                cut = true;
+            }
+        }
+    }
+    c->error = true;
+    return false;
+}
+
+static bool state_skip_value(StateCursor* c) {
+    state_skip_ws(c);
+    if (c->pos >= c->end) {
+        c->error = true;
+        return false;
+    }
+    if (*c->pos == '"') {
+        return state_read_string(c, nullptr, 0, nullptr);
+    }
+    if (*c->pos != '{' && *c->pos != '[') {
+        while (c->pos < c->end && !state_is_delimiter(*c->pos)) {
+            c->pos++;
+        }
+        return true;
+    }
+
+    uint16_t depth = 0;
+    while (c->pos < c->end) {
+        const char ch = *c->pos;
+        if (ch == '"') {
+            if (!state_read_string(c, nullptr, 0, nullptr)) {
+                return false;
+            }
+            continue;
+        }
+        c->pos++;
+        if (ch == '{' || ch == '[') {
+            depth++;
+        } else if ((ch == '}' || ch == ']') && --depth == 0) {
+            return true;
+        }
+    }
+    c->error = true;
+    return false;
+}
+
+// Moves to the next member of an object and reads its key. Start with
+// *first = true; returns false once the object closes or the text is malformed.
+static bool state_next_member(StateCursor* c, bool* first, char* key, size_t key_cap, bool* key_truncated) {
+    if (*first) {
+        *first = false;
+        if (!state_consume(c, '{')) {
+            return false;
+        }
+    } else if (!state_peek(c, '}') && !state_consume(c, ',')) {
+        return false;
+    }
+    if (state_peek(c, '}')) {
+        c->pos++;
+        return false;
+    }
+    return state_read_string(c, key, key_cap, key_truncated) && state_consume(c, ':');
+}
+
+// Plain text of a scalar token (number, true, null)
+static size_t state_read_token(StateCursor* c, char* out, size_t cap) {
+    state_skip_ws(c);
+    const char* start = c->pos;
+    while (c->pos < c->end && !state_is_delimiter(*c->pos)) {
+        c->pos++;
+    }
+    const size_t len = static_cast<size_t>(c->pos - start);
+    if (len == 0 || len >= cap) {
+        return 0;
+    }
+    memcpy(out, start, len);
+    out[len] = '\0';
+    return len;
+}
+
+static bool state_read_number(StateCursor* c, float* out) {
+    char text[32];
+    const size_t len = state_read_token(c, text, sizeof(text));
+    if (len == 0 || (text[0] != '-' && (text[0] < '0' || text[0] > '9'))) {
+        return false;
+    }
+    char* end = nullptr;
+    *out = strtof(text, &end);
+    return end == text + len;
+}
+
+static void state_read_hvac_modes(StateCursor* c, DecodedState* out) {
+    if (!state_peek(c, '[')) {
+        state_skip_value(c);
+        return;
+    }
+    c->pos++;
+    out->has_hvac_modes = true;
+    if (state_peek(c, ']')) {
+        c->pos++;
+        return;
+    }
+    while (!c->error) {
+        if (state_peek(c, '"')) {
+            char mode[16];
+            bool truncated = false;
+            if (state_read_string(c, mode, sizeof(mode), &truncated) && !truncated) {
+                if (strcmp(mode, "off") == 0) {
+                    out->hvac_modes |= StateHvacOff;
+                } else if (strcmp(mode, "heat") == 0 || strcmp(mode, "heating") == 0) {
+                    out->hvac_modes |= StateHvacHeat;
+                } else if (strcmp(mode, "cool") == 0 || strcmp(mode, "cooling") == 0) {
+                    out->hvac_modes |= StateHvacCool;
+                } else if (strcmp(mode, "heat_cool") == 0) {
+                    out->hvac_modes |= StateHvacHeat | StateHvacCool;
+                }
+            }
+        } else {
+            state_skip_value(c);
+        }
+        if (state_peek(c, ',')) {
+            c->pos++;
+            continue;
+        }
+        state_consume(c, ']');
+        return;
+    }
+}
+
+static void state_read_attributes(StateCursor* c, DecodedState* out) {
+    if (!state_peek(c, '{')) {
+        state_skip_value(c);
+        return;
+    }
+    out->has_attributes = true;
+
+    bool first = true;
+    char key[24];
+    bool truncated = false;
+    while (state_next_member(c, &first, key, sizeof(key), &truncated)) {
+        if (truncated) {
+            state_skip_value(c);
+            continue;
+        }
+        if (strcmp(key, "hvac_modes") == 0) {
+            state_read_hvac_modes(c, out);
+            continue;
+        }
+        uint8_t number = 0;
+        while (number < StateNumberCount && strcmp(key, kStateNumberKeys[number]) != 0) {
+            number++;
+        }
+        if (number == StateNumberCount || state_peek(c, '"') || state_peek(c, '{') || state_peek(c, '[')) {
+            state_skip_value(c);
+        } else if (state_read_number(c, &out->numbers[number])) {
+            out->numbers_valid |= 1 << number;
+        }
+    }
+}
+
+static void state_read_context(StateCursor* c, DecodedState* out) {
+    if (state_peek(c, '"')) {
+        state_read_string(c, out->context_id, sizeof(out->context_id), nullptr);
+        return;
+    }
+    if (!state_peek(c, '{')) {
+        state_skip_value(c);
+        return;
+    }
+    // Contexts carrying a user id are sent as an object
+    bool first = true;
+    char key[8];
+    bool truncated = false;
+    while (state_next_member(c, &first, key, sizeof(key), &truncated)) {
+        if (!truncated && strcmp(key, "id") == 0 && state_peek(c, '"')) {
+            state_read_string(c, out->context_id, sizeof(out->context_id), nullptr);
+        } else {
+            state_skip_value(c);
+        }
+    }
+}
+
+static void state_decode_state(StateCursor* c, DecodedState* out) {
+    *out = {};
+    state_skip_ws(c);
+    out->json = c->pos;
+    if (!state_peek(c, '{')) {
+        state_skip_value(c);
+        out->json_len = static_cast<size_t>(c->pos - out->json);
+        return;
+    }
+
+    bool first = true;
+    char key[4];
+    bool truncated = false;
+    while (state_next_member(c, &first, key, sizeof(key), &truncated)) {
+        if (truncated) {
+            state_skip_value(c);
+        } else if (strcmp(key, "s") == 0) {
+            out->has_state = true;
+            if (state_peek(c, '"')) {
+                state_read_string(c, out->state, sizeof(out->state), nullptr);
+            } else if (state_peek(c, '{') || state_peek(c, '[')) {
+                state_skip_value(c);
+            } else if (state_read_token(c, out->state, sizeof(out->state)) == 0 || strcmp(out->state, "null") == 0) {
+                out->state[0] = '\0';
+            }
+        } else if (strcmp(key, "a") == 0) {
+            state_read_attributes(c, out);
+        } else if (strcmp(key, "c") == 0) {
+            state_read_context(c, out);
+        } else {
+            state_skip_value(c);
+        }
+    }
+    out->json_len = static_cast<size_t>(c->pos - out->json);
+}
+
+// {id: state} for "a", {id: {"+": state, "-": {...}}} for "c"
+static void state_decode_entities(StateCursor* c, const StateDecoderHandlers* handlers, bool changes) {
+    bool first = true;
+    char entity_id[STATE_DECODER_MAX_ID_LEN];
+    bool truncated = false;
+    DecodedState state;
+    while (state_next_member(c, &first, entity_id, sizeof(entity_id), &truncated)) {
+        if (truncated || (handlers->want && !handlers->want(handlers->ctx, entity_id))) {
+            state_skip_value(c);
+            continue;
+        }
+        if (!changes) {
+            state_decode_state(c, &state);
+            if (!c->error) {
+                handlers->on_state(handlers->ctx, entity_id, &state);
+            }
+            continue;
+        }
+
+        bool change_first = true;
+        char change_key[4];
+        bool change_truncated = false;
+        while (state_next_member(c, &change_first, change_key, sizeof(change_key), &change_truncated)) {
+            if (!change_truncated && strcmp(change_key, "+") == 0) {
+                state_decode_state(c, &state);
+                if (!c->error) {
+                    handlers->on_state(handlers->ctx, entity_id, &state);
+                }
+            } else {
+                state_skip_value(c); // removed attributes are not tracked
+            }
+        }
+    }
+}
+
+static bool state_decode_event(StateCursor* c, const StateDecoderHandlers* handlers) {
+    bool first = true;
+    char key[4];
+    bool truncated = false;
+    bool seen = false;
+    while (state_next_member(c, &first, key, sizeof(key), &truncated)) {
+        if (!truncated && (strcmp(key, "a") == 0 || strcmp(key, "c") == 0)) {
+            seen = true;
+            state_decode_entities(c, handlers, key[0] == 'c');
+        } else if (!truncated && strcmp(key, "r") == 0) {
+            seen = true;
+            state_skip_value(c);
+        } else if (!seen) {
+            return false; // registry and other events lead with their own members
+        } else {
+            state_skip_value(c);
+        }
+    }
+    return seen;
+}
+
+StateDecodeResult state_decoder_decode(const char* json, size_t len, const StateDecoderHandlers* handlers) {
+    StateCursor c = {json, json + len, false};
+    bool first = true;
+    char key[8];
+    bool truncated = false;
+    bool is_event = false;
+    bool decoded = false;
+    while (state_next_member(&c, &first, key, sizeof(key), &truncated)) {
+        if (!truncated && strcmp(key, "type") == 0) {
+            char type[8];
+            bool type_truncated = false;
+            if (!state_peek(&c, '"') || !state_read_string(&c, type, sizeof(type), &type_truncated) || type_truncated ||
+                strcmp(type, "event") != 0) {
+                return StateDecodeResult::NotStates;
+            }
+            is_event = true;
+        } else if (!truncated && strcmp(key, "event") == 0) {
+            // HA sends "type" first; anything else goes the generic way
+            if (!is_event || !state_decode_event(&c, handlers)) {
+                return StateDecodeResult::NotStates;
+            }
+            decoded = true;
+        } else {
+            state_skip_value(&c);
+        }
+    }
+    if (!decoded) {
+        return StateDecodeResult::NotStates;
+    }
+    return c.error ? StateDecodeResult::Malformed : StateDecodeResult::Decoded;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Decoder for subscribe_entities events: {"a":{id:state}} with the initial
+// states and {"c":{id:{"+":state}}} with changes, where a compressed state is
+// {"s":..., "a":{attributes}, "c":context, ...}. It walks the text in place,
+// keeps only the handful of fields the client reads and skips everything else
+// (effect lists, color modes, ...) without building a tree or allocating.
+
+constexpr size_t STATE_DECODER_MAX_ID_LEN = 128;
+constexpr size_t STATE_DECODER_MAX_STATE_LEN = 48;
+constexpr size_t STATE_DECODER_MAX_CONTEXT_LEN = 40;
+
+enum StateNumber : uint8_t {
+    StateNumberTemperature = 0,
+    StateNumberTargetTempLow = 1,
+    StateNumberBrightness = 2,
+    StateNumberPercentage = 3,
+    StateNumberOffBrightness = 4,
+    StateNumberCount = 5,
+};
+
+enum StateHvacMode : uint8_t {
+    StateHvacOff = 1 << 0,
+    StateHvacHeat = 1 << 1, // "heat" / "heating", also set by "heat_cool"
+    StateHvacCool = 1 << 2, // "cool" / "cooling", also set by "heat_cool"
+};
+
+struct DecodedState {
+    bool has_state;
+    char state[STATE_DECODER_MAX_STATE_LEN];
+    bool has_attributes;
+    uint8_t numbers_valid; // bit per StateNumber; only JSON numbers count
+    float numbers[StateNumberCount];
+    bool has_hvac_modes;
+    uint8_t hvac_modes; // StateHvacMode bits
+    char context_id[STATE_DECODER_MAX_CONTEXT_LEN]; // empty when absent
+    // The state object as sent, for the rare consumer that needs more
+    const char* json;
+    size_t json_len;
+};
+
+struct StateDecoderHandlers {
+    // Return false to skip the entity without decoding its state
+    bool (*want)(void* ctx, const char* entity_id);
+    void (*on_state)(void* ctx, const char* entity_id, const DecodedState* state);
+    void* ctx;
+};
+
+enum class StateDecodeResult : uint8_t {
+    NotStates, // some other message; nothing was reported
+    Decoded,
+    Malformed, // states up to the error were reported
+};
+
+StateDecodeResult state_decoder_decode(const char* json, size_t len, const StateDecoderHandlers* handlers);
@@ -309,24 +309,151 @@ void store_set_hass_state(EntityStore* store, ConnState state) {
     }
 }
 
+// Caller holds store->mutex
+static void entity_set_reported_locked(HomeAssistantEntity& entity, uint8_t value) {
+    entity.reported_value = value;
+    if (value != 0) {
+        entity.last_on_value = value;
+    }
+}
+
 void store_update_value(EntityStore* store, uint8_t entity_idx, uint8_t value) {
     xSemaphoreTake(store->mutex, portMAX_DELAY);
     HomeAssistantEntity& entity = store->entities[entity_idx];
     uint8_t previous_value = entity.current_value;
-    entity.current_value = value;
+    entity_set_reported_locked(entity, value);
+    if (!entity.target_active) {
+        entity.current_value = value;
+    }
+    const bool changed = entity.current_value != previous_value;
+    xSemaphoreGive(store->mutex);
+
+    if (changed) {
+        notify_ui(store);
+    }
+}
+
+void store_confirm_value(EntityStore* store, uint8_t entity_idx, uint8_t value, bool settled) {
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    HomeAssistantEntity& entity = store->entities[entity_idx];
+    uint8_t previous_value = entity.current_value;
+    entity_set_reported_locked(entity, value);
+    // A newer target queued meanwhile stays on screen until it is confirmed too
+    if (settled && !entity.command_pending) {
+        entity.target_active = false;
+        entity.current_value = value;
+    }
+    const bool changed = entity.current_value != previous_value;
     xSemaphoreGive(store->mutex);
 
-    if (previous_value != value) {
+    if (changed) {
         notify_ui(store);
     }
 }
 
+void store_release_target(EntityStore* store, uint8_t entity_idx) {
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    HomeAssistantEntity& entity = store->entities[entity_idx];
+    uint8_t previous_value = entity.current_value;
+    if (!entity.command_pending) {
+        entity.target_active = false;
+        entity.current_value = entity.reported_value;
+    }
+    const bool changed = entity.current_value != previous_value;
+    xSemaphoreGive(store->mutex);
+
+    if (changed) {
+        notify_ui(store);
+    }
+}
+
+uint8_t store_get_entity_kinds(EntityStore* store, StoreEntityKind* kinds, uint8_t capacity) {
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    const uint8_t count = store->entity_count < capacity ? store->entity_count : capacity;
+    for (uint8_t entity_idx = 0; entity_idx < count; entity_idx++) {
+        const HomeAssistantEntity& entity = store->entities[entity_idx];
+        kinds[entity_idx] = {
+            .command_type = entity.command_type,
+            .climate_mode_mask = entity.climate_mode_mask,
+            .climate_hvac_modes_known = entity.climate_hvac_modes_known,
+            .climate_is_ac = entity.climate_is_ac,
+        };
+    }
+    xSemaphoreGive(store->mutex);
+    return count;
+}
+
+// Caller holds store->mutex. Only room controls show entity values, so this
+// marks the entities of the room being shown.
+static void mark_on_screen_locked(const EntityStore* store, bool* on_screen) {
+    memset(on_screen, 0, sizeof(bool) * MAX_ENTITIES);
+    if (store->settings_mode != SettingsMode::None || store->standby_active || store->selected_room < 0 ||
+        store->selected_room >= static_cast<int8_t>(store->room_count)) {
+        return;
+    }
+    const Room& room = store->rooms[store->selected_room];
+    for (uint8_t idx = 0; idx < room.entity_count; idx++) {
+        if (room.entity_ids[idx] < MAX_ENTITIES) {
+            on_screen[room.entity_ids[idx]] = true;
+        }
+    }
+}
+
+uint8_t store_update_values_batch(EntityStore* store, const StoreValueUpdate* updates, size_t count) {
+    uint8_t shown_changes = 0;
+    bool rooms_changed = false;
+    bool on_screen[MAX_ENTITIES];
+
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    mark_on_screen_locked(store, on_screen);
+    for (size_t idx = 0; idx < count; idx++) {
+        const StoreValueUpdate& update = updates[idx];
+        if (update.entity_idx >= store->entity_count) {
+            continue;
+        }
+        HomeAssistantEntity& entity = store->entities[update.entity_idx];
+        const uint8_t previous_value = entity.current_value;
+        entity_set_reported_locked(entity, update.value);
+        if (update.source == StoreValueSource::Reported) {
+            if (!entity.target_active) {
+                entity.current_value = update.value;
+            }
+        } else if (update.source == StoreValueSource::ConfirmedSettled && !entity.command_pending) {
+            entity.target_active = false;
+            entity.current_value = update.value;
+        }
+
+        if (update.climate_visibility &&
+            (entity.climate_mode_mask != update.climate_mode_mask || entity.climate_hvac_modes_known != update.climate_hvac_modes_known ||
+             entity.climate_is_ac != update.climate_is_ac)) {
+            entity.climate_mode_mask = update.climate_mode_mask;
+            entity.climate_hvac_modes_known = update.climate_hvac_modes_known;
+            entity.climate_is_ac = update.climate_is_ac;
+            rooms_changed = true;
+        }
+        if (entity.current_value != previous_value && on_screen[update.entity_idx]) {
+            shown_changes++;
+        }
+    }
+    if (rooms_changed) {
+        store->rooms_revision++;
+    }
+    xSemaphoreGive(store->mutex);
+
+    if (shown_changes > 0 || rooms_changed) {
+        notify_ui(store);
+    }
+    return shown_changes;
+}
+
 void store_send_command(EntityStore* store, uint8_t entity_idx, uint8_t value) {
     xSemaphoreTake(store->mutex, portMAX_DELAY);
     HomeAssistantEntity& entity = store->entities[entity_idx];
     entity.current_value = value;
     entity.command_value = value;
     entity.command_pending = true;
+    entity.command_bulk = false;
+    entity.target_active = true;
     xSemaphoreGive(store->mutex);
 
     ESP_LOGI(TAG, "Sending command to update entity %s to value %d", store->entities[entity_idx].entity_id, value);
@@ -337,6 +464,46 @@ void store_send_command(EntityStore* store, uint8_t entity_idx, uint8_t value) {
     notify_ui(store);
 }
 
+bool store_supports_bulk_command(CommandType type) {
+    return type == CommandType::SetLightBrightnessPercentage || type == CommandType::SwitchOnOff;
+}
+
+bool store_send_room_command(EntityStore* store, int8_t room_idx, bool on) {
+    uint8_t switched = 0;
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    if (room_idx >= 0 && room_idx < static_cast<int8_t>(store->room_count)) {
+        const Room& room = store->rooms[room_idx];
+        for (uint8_t idx = 0; idx < room.entity_count; idx++) {
+            HomeAssistantEntity& entity = store->entities[room.entity_ids[idx]];
+            if (!store_supports_bulk_command(entity.command_type) || (entity.current_value != 0) == on) {
+                continue;
+            }
+            // turn_on restores the light's previous brightness: show the last one
+            // reported, or keep showing the light off until its echo says
+            const uint8_t value = !on ? 0 : (entity.command_type == CommandType::SwitchOnOff ? 1 : entity.last_on_value);
+            entity.command_value = on ? 1 : 0; // a bulk call only carries the direction
+            entity.command_pending = true;
+            entity.command_bulk = true;
+            if (!on || value != 0) {
+                entity.current_value = value;
+                entity.target_active = true;
+            }
+            switched++;
+        }
+    }
+    xSemaphoreGive(store->mutex);
+
+    if (switched == 0) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Switching %u entities of room %d %s", switched, room_idx, on ? "on" : "off");
+    if (store->home_assistant_task) {
+        xTaskNotifyGive(store->home_assistant_task);
+    }
+    notify_ui(store);
+    return true;
+}
+
 void store_request_standby_battery_soc_refresh(EntityStore* store) {
     xSemaphoreTake(store->mutex, portMAX_DELAY);
     store->standby_refresh_battery_soc_pending = true;
@@ -349,30 +516,38 @@ void store_request_standby_battery_soc_refresh(EntityStore* store) {
     }
 }
 
-bool store_get_pending_command(EntityStore* store, Command* command) {
+bool store_get_pending_command(EntityStore* store, uint16_t* cursor, Command* command) {
     xSemaphoreTake(store->mutex, portMAX_DELAY);
 
-    if (store->standby_refresh_battery_soc_pending) {
-        command->entity_id = nullptr;
-        command->entity_idx = UINT8_MAX;
-        command->type = CommandType::RefreshStandbyBatterySoc;
-        command->value = 0;
-        xSemaphoreGive(store->mutex);
-        return true;
+    // Cursor 0 is the battery refresh, cursor n + 1 is entity n
+    if (*cursor == 0) {
+        *cursor = 1;
+        if (store->standby_refresh_battery_soc_pending) {
+            command->entity_id = nullptr;
+            command->entity_idx = UINT8_MAX;
+            command->type = CommandType::RefreshStandbyBatterySoc;
+            command->value = 0;
+            command->bulk = false;
+            xSemaphoreGive(store->mutex);
+            return true;
+        }
     }
 
-    for (uint8_t entity_idx = 0; entity_idx < store->entity_count; ++entity_idx) {
+    for (uint16_t entity_idx = *cursor - 1; entity_idx < store->entity_count; ++entity_idx) {
         HomeAssistantEntity& entity = store->entities[entity_idx];
         if (entity.command_pending) {
             command->entity_id = entity.entity_id;
-            command->entity_idx = entity_idx;
+            command->entity_idx = static_cast<uint8_t>(entity_idx);
             command->type = entity.command_type;
             command->value = entity.command_value;
+            command->bulk = entity.command_bulk;
+            *cursor = entity_idx + 2;
             xSemaphoreGive(store->mutex);
             return true;
         }
     }
 
+    *cursor = store->entity_count + 1;
     xSemaphoreGive(store->mutex);
     return false;
 }
@@ -394,6 +569,7 @@ void store_ack_pending_command(EntityStore* store, const Command* command) {
     HomeAssistantEntity& entity = store->entities[command->entity_idx];
     if (entity.command_value == command->value) {
         entity.command_pending = false;
+        entity.command_bulk = false;
     }
 
     xSemaphoreGive(store->mutex);
@@ -415,8 +591,8 @@ void store_begin_room_sync(EntityStore* store) {
     notify_ui(store);
 }
 
-void store_finish_room_sync(EntityStore* store) {
-    xSemaphoreTake(store->mutex, portMAX_DELAY);
+// Pulls the selection and list pages back inside what the rooms now hold
+static void clamp_navigation_locked(EntityStore* store) {
     uint8_t floor_pages = list_page_count(store->floor_count);
     if (store->floor_list_page >= floor_pages) {
         store->floor_list_page = floor_pages - 1;
@@ -450,7 +626,11 @@ void store_finish_room_sync(EntityStore* store) {
     } else {
         store->room_controls_page = 0;
     }
+}
 
+void store_finish_room_sync(EntityStore* store) {
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    clamp_navigation_locked(store);
     store->rooms_loaded = true;
     store->rooms_revision++;
     xSemaphoreGive(store->mutex);
@@ -514,7 +694,7 @@ int16_t store_find_room(EntityStore* store, const char* room_name) {
     return result;
 }
 
-int8_t store_add_entity_to_room(EntityStore* store, uint8_t room_idx, EntityConfig entity, const char* display_name) {
+static int8_t add_entity_to_room(EntityStore* store, uint8_t room_idx, EntityConfig entity, const char* display_name, bool trim_name) {
     xSemaphoreTake(store->mutex, portMAX_DELAY);
 
     if (room_idx >= store->room_count) {
@@ -533,7 +713,9 @@ int8_t store_add_entity_to_room(EntityStore* store, uint8_t room_idx, EntityConf
         HomeAssistantEntity& new_entity = store->entities[entity_idx];
         memset(&new_entity, 0, sizeof(HomeAssistantEntity));
         copy_string(new_entity.entity_id, sizeof(new_entity.entity_id), entity.entity_id);
-        if (display_name && display_name[0]) {
+        if (display_name && display_name[0] && !trim_name) {
+            copy_string(new_entity.display_name, sizeof(new_entity.display_name), display_name);
+        } else if (display_name && display_name[0]) {
             char trimmed_name[MAX_ENTITY_NAME_LEN];
             trim_entity_name_for_room(display_name, room_name, trimmed_name, sizeof(trimmed_name));
             copy_string(new_entity.display_name, sizeof(new_entity.display_name), trimmed_name);
@@ -546,7 +728,10 @@ int8_t store_add_entity_to_room(EntityStore* store, uint8_t room_idx, EntityConf
             new_entity.climate_hvac_modes_known = false;
             new_entity.climate_is_ac = false;
             new_entity.current_value = climate_pack_value(ClimateMode::Off, climate_celsius_to_steps(20.0f));
+            new_entity.reported_value = new_entity.current_value;
         }
+    } else if (display_name && display_name[0] && !trim_name) {
+        copy_string(store->entities[entity_idx].display_name, sizeof(store->entities[entity_idx].display_name), display_name);
     } else if (display_name && display_name[0]) {
         char trimmed_name[MAX_ENTITY_NAME_LEN];
         trim_entity_name_for_room(display_name, room_name, trimmed_name, sizeof(trimmed_name));
@@ -571,6 +756,153 @@ int8_t store_add_entity_to_room(EntityStore* store, uint8_t room_idx, EntityConf
     return static_cast<int8_t>(entity_idx);
 }
 
+int8_t store_add_entity_to_room(EntityStore* store, uint8_t room_idx, EntityConfig entity, const char* display_name) {
+    return add_entity_to_room(store, room_idx, entity, display_name, true);
+}
+
+int8_t store_restore_entity_to_room(EntityStore* store, uint8_t room_idx, EntityConfig entity, const char* display_name) {
+    return add_entity_to_room(store, room_idx, entity, display_name, false);
+}
+
+bool store_update_floor(EntityStore* store, uint8_t floor_idx, const char* floor_name, const char* icon_name) {
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    if (floor_idx >= store->floor_count) {
+        xSemaphoreGive(store->mutex);
+        return false;
+    }
+
+    Floor updated = {};
+    copy_string(updated.name, sizeof(updated.name), floor_name);
+    copy_string(updated.icon, sizeof(updated.icon), icon_name);
+    Floor& floor = store->floors[floor_idx];
+    const bool changed = strcmp(floor.name, updated.name) != 0 || strcmp(floor.icon, updated.icon) != 0;
+    if (changed) {
+        floor = updated;
+        store->rooms_revision++;
+    }
+    xSemaphoreGive(store->mutex);
+    if (changed) {
+        notify_ui(store);
+    }
+    return changed;
+}
+
+bool store_update_room(EntityStore* store, uint8_t room_idx, const char* room_name, const char* icon_name, int8_t floor_idx) {
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    if (room_idx >= store->room_count || floor_idx < 0 || floor_idx >= static_cast<int8_t>(store->floor_count)) {
+        xSemaphoreGive(store->mutex);
+        return false;
+    }
+
+    char name[MAX_ROOM_NAME_LEN];
+    char icon[MAX_ICON_NAME_LEN];
+    copy_string(name, sizeof(name), room_name);
+    copy_string(icon, sizeof(icon), icon_name);
+    Room& room = store->rooms[room_idx];
+    const bool changed = strcmp(room.name, name) != 0 || strcmp(room.icon, icon) != 0 || room.floor_idx != floor_idx;
+    if (changed) {
+        memcpy(room.name, name, sizeof(room.name));
+        memcpy(room.icon, icon, sizeof(room.icon));
+        room.floor_idx = floor_idx;
+        clamp_navigation_locked(store);
+        store->rooms_revision++;
+    }
+    xSemaphoreGive(store->mutex);
+    if (changed) {
+        notify_ui(store);
+    }
+    return changed;
+}
+
+int16_t store_place_entity(EntityStore* store, int8_t room_idx, EntityConfig entity, const char* display_name, bool* added) {
+    if (added) {
+        *added = false;
+    }
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    if (room_idx >= static_cast<int8_t>(store->room_count)) {
+        xSemaphoreGive(store->mutex);
+        return -1;
+    }
+
+    bool changed = false;
+    int16_t entity_idx = find_entity_index(store, entity.entity_id);
+    if (entity_idx < 0 && room_idx >= 0) {
+        if (store->entity_count >= MAX_ENTITIES) {
+            xSemaphoreGive(store->mutex);
+            return -1;
+        }
+        // Indices are shared with the client and the command queue, so
+        // entities are only ever appended; hidden ones just leave their rooms
+        entity_idx = store->entity_count++;
+        HomeAssistantEntity& new_entity = store->entities[entity_idx];
+        memset(&new_entity, 0, sizeof(HomeAssistantEntity));
+        copy_string(new_entity.entity_id, sizeof(new_entity.entity_id), entity.entity_id);
+        new_entity.command_type = entity.command_type;
+        if (new_entity.command_type == CommandType::SetClimateModeAndTemperature) {
+            new_entity.climate_mode_mask = CLIMATE_MODE_MASK_DEFAULT;
+            new_entity.current_value = climate_pack_value(ClimateMode::Off, climate_celsius_to_steps(20.0f));
+            new_entity.reported_value = new_entity.current_value;
+        }
+        changed = true;
+        if (added) {
+            *added = true;
+        }
+    }
+    if (entity_idx < 0) {
+        xSemaphoreGive(store->mutex);
+        return -1;
+    }
+
+    for (uint8_t idx = 0; idx < store->room_count; idx++) {
+        if (static_cast<int8_t>(idx) == room_idx) {
+            continue;
+        }
+        Room& room = store->rooms[idx];
+        for (uint8_t slot = 0; slot < room.entity_count; slot++) {
+            if (room.entity_ids[slot] == entity_idx) {
+                memmove(&room.entity_ids[slot], &room.entity_ids[slot + 1], room.entity_count - slot - 1);
+                room.entity_count--;
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    if (room_idx >= 0) {
+        Room& room = store->rooms[room_idx];
+        HomeAssistantEntity& target = store->entities[entity_idx];
+        char name[MAX_ENTITY_NAME_LEN];
+        if (display_name && display_name[0]) {
+            trim_entity_name_for_room(display_name, room.name, name, sizeof(name));
+        } else {
+            fallback_entity_name(entity.entity_id, name, sizeof(name));
+        }
+        if (strcmp(target.display_name, name) != 0) {
+            copy_string(target.display_name, sizeof(target.display_name), name);
+            changed = true;
+        }
+
+        bool present = false;
+        for (uint8_t slot = 0; slot < room.entity_count && !present; slot++) {
+            present = room.entity_ids[slot] == entity_idx;
+        }
+        if (!present && room.entity_count < MAX_ENTITIES) {
+            room.entity_ids[room.entity_count++] = static_cast<uint8_t>(entity_idx);
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        clamp_navigation_locked(store);
+        store->rooms_revision++;
+    }
+    xSemaphoreGive(store->mutex);
+    if (changed) {
+        notify_ui(store);
+    }
+    return room_idx >= 0 ? entity_idx : -1;
+}
+
 bool store_select_room(EntityStore* store, int8_t room_idx) {
     xSemaphoreTake(store->mutex, portMAX_DELAY);
 
@@ -597,9 +929,31 @@ bool store_select_room(EntityStore* store, int8_t room_idx) {
     store->rooms_revision++;
     xSemaphoreGive(store->mutex);
     notify_ui(store);
+    if (store->home_assistant_task) {
+        xTaskNotifyGive(store->home_assistant_task); // scoped subscriptions follow the open room
+    }
     return true;
 }
 
+int8_t store_get_open_room(EntityStore* store) {
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    const int8_t room_idx = store->standby_active ? -1 : store->selected_room;
+    xSemaphoreGive(store->mutex);
+    return room_idx;
+}
+
+uint8_t store_get_room_entities(EntityStore* store, int8_t room_idx, uint8_t* entity_idxs, uint8_t capacity) {
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    uint8_t count = 0;
+    if (room_idx >= 0 && room_idx < static_cast<int8_t>(store->room_count)) {
+        const Room& room = store->rooms[room_idx];
+        count = room.entity_count < capacity ? room.entity_count : capacity;
+        memcpy(entity_idxs, room.entity_ids, count);
+    }
+    xSemaphoreGive(store->mutex);
+    return count;
+}
+
 bool store_select_floor(EntityStore* store, int8_t floor_idx) {
     xSemaphoreTake(store->mutex, portMAX_DELAY);
 
@@ -1697,7 +2051,10 @@ void store_flush_pending_commands(EntityStore* store) {
     xSemaphoreTake(store->mutex, portMAX_DELAY);
     store->standby_refresh_battery_soc_pending = false;
     for (uint8_t entity_idx = 0; entity_idx < store->entity_count; ++entity_idx) {
-        store->entities[entity_idx].command_pending = false;
+        HomeAssistantEntity& entity = store->entities[entity_idx];
+        entity.command_pending = false;
+        entity.target_active = false;
+        entity.current_value = entity.reported_value;
     }
     xSemaphoreGive(store->mutex);
 }
@@ -1721,6 +2078,7 @@ EntityRef store_add_entity(EntityStore* store, EntityConfig entity) {
         new_entity.climate_hvac_modes_known = false;
         new_entity.climate_is_ac = false;
         new_entity.current_value = climate_pack_value(ClimateMode::Off, climate_celsius_to_steps(20.0f));
+        new_entity.reported_value = new_entity.current_value;
     }
 
     xSemaphoreGive(store->mutex);
@@ -27,9 +27,13 @@ struct HomeAssistantEntity {
     uint8_t climate_mode_mask;
     bool climate_hvac_modes_known;
     bool climate_is_ac;
-    uint8_t current_value;
-    uint8_t command_value;
-    bool command_pending;
+    uint8_t current_value;  // what the UI shows: the target while one is outstanding, else reported_value
+    uint8_t reported_value; // last value Home Assistant reported
+    uint8_t last_on_value;  // last non-zero reported_value, 0 until the entity was seen on
+    uint8_t command_value;  // target requested from the UI
+    bool command_pending;   // target not sent yet
+    bool command_bulk;      // from a room-wide on/off: a plain turn_on/turn_off, grouped per domain
+    bool target_active;     // target not confirmed by Home Assistant yet
 };
 
 struct EntityConfig {
@@ -256,6 +260,31 @@ struct Command {
     const char* entity_id;
     uint8_t entity_idx;
     uint8_t value;
+    bool bulk; // see HomeAssistantEntity::command_bulk
+};
+
+// What decoding a state update needs to know about an entity
+struct StoreEntityKind {
+    CommandType command_type;
+    uint8_t climate_mode_mask;
+    bool climate_hvac_modes_known;
+    bool climate_is_ac;
+};
+
+enum class StoreValueSource : uint8_t {
+    Reported,         // as store_update_value
+    Confirmed,        // as store_confirm_value, other calls still outstanding
+    ConfirmedSettled, // as store_confirm_value for our last outstanding call
+};
+
+struct StoreValueUpdate {
+    uint8_t entity_idx;
+    uint8_t value;
+    StoreValueSource source;
+    bool climate_visibility; // the climate_* fields below are set
+    uint8_t climate_mode_mask;
+    bool climate_hvac_modes_known;
+    bool climate_is_ac;
 };
 
 constexpr EventBits_t BIT_WIFI_UP = (1 << 0);
@@ -263,9 +292,26 @@ constexpr EventBits_t BIT_WIFI_UP = (1 << 0);
 void store_init(EntityStore* store);
 void store_set_wifi_state(EntityStore* store, ConnState state);
 void store_set_hass_state(EntityStore* store, ConnState state);
+// State reported by Home Assistant; shown unless a target is outstanding
 void store_update_value(EntityStore* store, uint8_t entity_idx, uint8_t value);
+// Home Assistant applied one of our commands; `settled` when no other call is still outstanding
+void store_confirm_value(EntityStore* store, uint8_t entity_idx, uint8_t value, bool settled);
+// Our command failed or its echo never came: show the reported value again
+void store_release_target(EntityStore* store, uint8_t entity_idx);
+// Returns how many of the first `capacity` entities were copied
+uint8_t store_get_entity_kinds(EntityStore* store, StoreEntityKind* kinds, uint8_t capacity);
+// Applies a burst of state updates under one lock and wakes the UI once, only
+// when a value in the room on screen or the rooms themselves changed. Returns
+// how many shown values changed.
+uint8_t store_update_values_batch(EntityStore* store, const StoreValueUpdate* updates, size_t count);
 void store_send_command(EntityStore* store, uint8_t entity_idx, uint8_t value);
-bool store_get_pending_command(EntityStore* store, Command* command);
+// Lights and switches follow the room controls' all on / all off
+bool store_supports_bulk_command(CommandType type);
+// Switches every such entity of the room that is not already there, under one
+// lock and one redraw. False when there was nothing to switch.
+bool store_send_room_command(EntityStore* store, int8_t room_idx, bool on);
+// Walks pending commands in entity order; start with *cursor = 0
+bool store_get_pending_command(EntityStore* store, uint16_t* cursor, Command* command);
 void store_ack_pending_command(EntityStore* store, const Command* command);
 void store_begin_room_sync(EntityStore* store);
 void store_finish_room_sync(EntityStore* store);
@@ -273,8 +319,21 @@ int8_t store_add_floor(EntityStore* store, const char* floor_name, const char* i
 int8_t store_add_room(EntityStore* store, const char* room_name, const char* icon_name, int8_t floor_idx);
 int16_t store_find_room(EntityStore* store, const char* room_name);
 int8_t store_add_entity_to_room(EntityStore* store, uint8_t room_idx, EntityConfig entity, const char* display_name);
+// Discovery cache replay: the cached display name was already trimmed for its room
+int8_t store_restore_entity_to_room(EntityStore* store, uint8_t room_idx, EntityConfig entity, const char* display_name);
+// Registry deltas applied in place of a full room sync; each redraws only when
+// something visible changed. The update calls return whether it did.
+bool store_update_floor(EntityStore* store, uint8_t floor_idx, const char* floor_name, const char* icon_name);
+bool store_update_room(EntityStore* store, uint8_t room_idx, const char* room_name, const char* icon_name, int8_t floor_idx);
+// Shows the entity in `room_idx` only, appending it when new (*added), or in
+// no room when `room_idx` is -1. Returns its index, -1 when hidden or full.
+int16_t store_place_entity(EntityStore* store, int8_t room_idx, EntityConfig entity, const char* display_name, bool* added);
 bool store_select_floor(EntityStore* store, int8_t floor_idx);
 bool store_select_room(EntityStore* store, int8_t room_idx);
+// Room whose controls are on screen, -1 on the lists and in standby
+int8_t store_get_open_room(EntityStore* store);
+// Returns how many of the room's entity indices were copied
+uint8_t store_get_room_entities(EntityStore* store, int8_t room_idx, uint8_t* entity_idxs, uint8_t capacity);
 bool store_go_home(EntityStore* store);
 bool store_wake_from_standby(EntityStore* store);
 bool store_shift_floor_list_page(EntityStore* store, int8_t delta);
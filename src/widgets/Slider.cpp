@@ -200,6 +200,10 @@ bool Slider::isTouching(const TouchEvent* touch_event) const {
            touch_event->y < hit_rect_.y + hit_rect_.h;
 }
 
+bool Slider::tracksDrag() const {
+    return true;
+}
+
 uint8_t Slider::getValueFromTouch(const TouchEvent* touch_event, uint8_t original_value) const {
     const int touch_x = static_cast<int>(touch_event->x);
 
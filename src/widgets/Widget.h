@@ -27,4 +27,6 @@ public:
     virtual Rect partialDraw(FASTEPD* display, BitDepth depth, uint8_t from, uint8_t to) = 0;
     virtual bool isTouching(const TouchEvent* touch_event) const = 0;
     virtual uint8_t getValueFromTouch(const TouchEvent* touch_event, uint8_t original_value) const = 0;
+    // Whether the value follows the finger during a drag rather than being set on release
+    virtual bool tracksDrag() const { return false; }
 };
\ No newline at end of file
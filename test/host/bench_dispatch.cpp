@@ -0,0 +1,160 @@
+// subscribe_entities dispatch: a 500-entity initial state event resolved key by
+// key, the old way (strcmp against every room entity id, then against every
+// standby and energy-series id) against one hash lookup per key.
+//
+// The dispatch index itself is private to home_assistant.cpp; IdMap uses the
+// same scheme (FNV-1a, linear probing, load under 3/4) and at 172 ids ends up
+// with the same 256 slots, so it stands in for it here.
+
+#include "host_check.h"
+#include "esp_heap_caps.h"
+#include "id_table.h"
+
+#include <string>
+#include <vector>
+
+static constexpr int EVENT_ENTITIES = 500;
+static constexpr int WIDGET_IDS = 128; // MAX_ENTITIES, the most a room layout subscribes to
+static constexpr int SERIES_COUNT = 5;
+static constexpr int SERIES_IDS = 8;   // MAX_STANDBY_ENERGY_SERIES_ENTITIES
+static constexpr int SINGLE_IDS = 4;   // device area, weather, battery SoC, house usage
+
+struct Tracked {
+    std::vector<std::string> widgets;
+    std::string singles[SINGLE_IDS];
+    std::string series[SERIES_COUNT][SERIES_IDS];
+};
+
+struct Event {
+    std::vector<std::string> keys;
+    Tracked tracked;
+};
+
+static Event generate_event() {
+    static const char* const kDomains[] = {"light", "switch", "sensor", "binary_sensor", "climate", "cover", "media_player", "fan"};
+    Event event;
+    for (int idx = 0; idx < EVENT_ENTITIES; idx++) {
+        event.keys.push_back(std::string(kDomains[idx % 8]) + ".device_" + std::to_string(idx) + "_entity");
+    }
+    // Spread the tracked ids over the event with a stride coprime to its size
+    int pick = 0;
+    auto next = [&] { return event.keys[(pick++ * 3) % EVENT_ENTITIES]; };
+    for (int idx = 0; idx < WIDGET_IDS; idx++) {
+        event.tracked.widgets.push_back(next());
+    }
+    for (std::string& id : event.tracked.singles) {
+        id = next();
+    }
+    for (auto& series : event.tracked.series) {
+        for (std::string& id : series) {
+            id = next();
+        }
+    }
+    return event;
+}
+
+struct Resolved {
+    long long widgets = 0; // sum of matched widget indices + 1
+    long long roles = 0;   // sum of matched standby slots + 1
+    int locks = 0;         // hass->mutex acquisitions
+};
+
+// hass_match_entity followed by hass_parse_standby_entity_update, as before the index
+static void resolve_linear(const Event& event, Resolved* out) {
+    const Tracked& tracked = event.tracked;
+    for (const std::string& key : event.keys) {
+        const char* id = key.c_str();
+        out->locks++;
+        for (int idx = 0; idx < WIDGET_IDS; idx++) {
+            if (strcmp(id, tracked.widgets[idx].c_str()) == 0) {
+                out->widgets += idx + 1;
+                break;
+            }
+        }
+        out->locks++;
+        for (int idx = 0; idx < SINGLE_IDS; idx++) {
+            if (strcmp(id, tracked.singles[idx].c_str()) == 0) {
+                out->roles += idx + 1;
+            }
+        }
+        for (int series = 0; series < SERIES_COUNT; series++) {
+            for (int idx = 0; idx < SERIES_IDS; idx++) {
+                if (strcmp(id, tracked.series[series][idx].c_str()) == 0) {
+                    out->roles += SINGLE_IDS + series * SERIES_IDS + idx + 1;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Values >= 0 are widget indices, the standby slots are stored as -(slot + 1)
+static void build_index(const Tracked& tracked, IdMap* map, IdArena* arena) {
+    for (int idx = 0; idx < WIDGET_IDS; idx++) {
+        id_map_put(map, arena, tracked.widgets[idx].c_str(), static_cast<int16_t>(idx));
+    }
+    for (int idx = 0; idx < SINGLE_IDS; idx++) {
+        id_map_put(map, arena, tracked.singles[idx].c_str(), static_cast<int16_t>(-(idx + 1)));
+    }
+    for (int series = 0; series < SERIES_COUNT; series++) {
+        for (int idx = 0; idx < SERIES_IDS; idx++) {
+            id_map_put(map, arena, tracked.series[series][idx].c_str(), static_cast<int16_t>(-(SINGLE_IDS + series * SERIES_IDS + idx + 1)));
+        }
+    }
+}
+
+static void resolve_indexed(const Event& event, const IdMap* map, Resolved* out) {
+    for (const std::string& key : event.keys) {
+        out->locks++;
+        int16_t value = 0;
+        if (!id_map_get(map, key.c_str(), &value)) {
+            continue;
+        }
+        if (value >= 0) {
+            out->widgets += value + 1;
+        } else {
+            out->roles += -value;
+        }
+    }
+}
+
+int main() {
+    const Event event = generate_event();
+    IdArena arena = {};
+    IdMap map = {};
+    build_index(event.tracked, &map, &arena);
+
+    Resolved linear;
+    Resolved indexed;
+    resolve_linear(event, &linear);
+    resolve_indexed(event, &map, &indexed);
+    if (linear.widgets != indexed.widgets || linear.roles != indexed.roles) {
+        fprintf(stderr, "paths disagree: widgets %lld vs %lld, roles %lld vs %lld\n", linear.widgets, indexed.widgets,
+                linear.roles, indexed.roles);
+        return EXIT_FAILURE;
+    }
+
+    const int runs = 7;
+    const int iterations = 2000;
+    const double linear_ns = host_bench_ns(runs, iterations, [&] {
+        Resolved resolved;
+        resolve_linear(event, &resolved);
+        asm volatile("" : : "r"(resolved.widgets) : "memory");
+    });
+    const double indexed_ns = host_bench_ns(runs, iterations, [&] {
+        Resolved resolved;
+        resolve_indexed(event, &map, &resolved);
+        asm volatile("" : : "r"(resolved.widgets) : "memory");
+    });
+
+    const int tracked = WIDGET_IDS + SINGLE_IDS + SERIES_COUNT * SERIES_IDS;
+    printf("dispatch: %d-entity initial state event, %d tracked ids, %u index slots\n", EVENT_ENTITIES, tracked, map.cap);
+    printf("  linear:  %8.2f us per event, %6.1f ns per entity, %d mutex takes\n", linear_ns / 1e3, linear_ns / EVENT_ENTITIES,
+           linear.locks);
+    printf("  indexed: %8.2f us per event, %6.1f ns per entity, %d mutex takes\n", indexed_ns / 1e3, indexed_ns / EVENT_ENTITIES,
+           indexed.locks);
+
+    id_arena_reset(&arena);
+    heap_caps_free(map.slots);
+    return EXIT_SUCCESS;
+}
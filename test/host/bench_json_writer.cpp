@@ -0,0 +1,141 @@
+// Outgoing messages: JsonWriter into a fixed buffer against building a cJSON
+// tree and printing it with cJSON_PrintUnformatted, as the requests were sent
+// before. Reports time per message and, for cJSON, heap allocated per message.
+//
+// Two messages: a call_service command and a subscribe_entities request for a
+// full room layout plus the standby ids.
+
+#include "host_check.h"
+#include "json_writer.h"
+
+#include <string>
+#include <vector>
+
+#if HOST_HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+static constexpr size_t SEND_BUFFER_LEN = 1024 * 16; // HASS_SEND_BUFFER_LEN
+static constexpr int SUBSCRIBED_IDS = 128 + 44;      // room widgets plus standby and energy-series ids
+
+static std::vector<std::string> make_entity_ids() {
+    std::vector<std::string> ids;
+    for (int idx = 0; idx < SUBSCRIBED_IDS; idx++) {
+        ids.push_back("light.living_room_ceiling_" + std::to_string(idx));
+    }
+    return ids;
+}
+
+static size_t write_call_service(char* buffer, uint16_t id) {
+    JsonWriter writer;
+    json_writer_init(&writer, buffer, SEND_BUFFER_LEN);
+    json_writer_open(&writer, '{');
+    json_writer_number(&writer, "id", id);
+    json_writer_string(&writer, "type", "call_service");
+    json_writer_string(&writer, "domain", "light");
+    json_writer_string(&writer, "service", "turn_on");
+    json_writer_begin_object(&writer, "service_data");
+    json_writer_string(&writer, "entity_id", "light.living_room_ceiling");
+    json_writer_literal_key(&writer, "brightness_pct");
+    json_writer_number_value(&writer, 64);
+    json_writer_close(&writer, '}');
+    json_writer_close(&writer, '}');
+    return json_writer_finish(&writer) ? writer.len : 0;
+}
+
+static size_t write_subscribe(char* buffer, uint16_t id, const std::vector<std::string>& entity_ids) {
+    JsonWriter writer;
+    json_writer_init(&writer, buffer, SEND_BUFFER_LEN);
+    json_writer_open(&writer, '{');
+    json_writer_number(&writer, "id", id);
+    json_writer_string(&writer, "type", "subscribe_entities");
+    json_writer_begin_array(&writer, "entity_ids");
+    for (const std::string& entity_id : entity_ids) {
+        json_writer_array_string(&writer, entity_id.c_str());
+    }
+    json_writer_close(&writer, ']');
+    json_writer_close(&writer, '}');
+    return json_writer_finish(&writer) ? writer.len : 0;
+}
+
+#if HOST_HAVE_CJSON
+static size_t heap_allocated = 0;
+
+static void* counting_malloc(size_t len) {
+    heap_allocated += len;
+    return malloc(len);
+}
+
+static std::string print_and_free(cJSON* root) {
+    char* json = cJSON_PrintUnformatted(root);
+    std::string text = json ? json : "";
+    cJSON_free(json);
+    cJSON_Delete(root);
+    return text;
+}
+
+static cJSON* build_call_service(uint16_t id) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "id", id);
+    cJSON_AddStringToObject(root, "type", "call_service");
+    cJSON_AddStringToObject(root, "domain", "light");
+    cJSON_AddStringToObject(root, "service", "turn_on");
+    cJSON* data = cJSON_AddObjectToObject(root, "service_data");
+    cJSON_AddStringToObject(data, "entity_id", "light.living_room_ceiling");
+    cJSON_AddNumberToObject(data, "brightness_pct", 64);
+    return root;
+}
+
+static cJSON* build_subscribe(uint16_t id, const std::vector<std::string>& entity_ids) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "id", id);
+    cJSON_AddStringToObject(root, "type", "subscribe_entities");
+    cJSON* ids = cJSON_AddArrayToObject(root, "entity_ids");
+    for (const std::string& entity_id : entity_ids) {
+        cJSON_AddItemToArray(ids, cJSON_CreateString(entity_id.c_str()));
+    }
+    return root;
+}
+#endif
+
+template <typename Write, typename Build>
+static void bench(const char* name, char* buffer, int iterations, Write&& write, Build&& build) {
+    size_t len = 0;
+    const double writer_ns = host_bench_ns(5, iterations, [&] { len = write(); });
+    printf("%s: %zu bytes\n", name, len);
+    printf("  JsonWriter: %8.2f us, no heap\n", writer_ns / 1e3);
+#if HOST_HAVE_CJSON
+    std::string printed;
+    const double cjson_ns = host_bench_ns(5, iterations, [&] { printed = print_and_free(build()); });
+    if (printed != std::string(buffer, len)) {
+        fprintf(stderr, "  output differs:\n    %s\n    %.*s\n", printed.c_str(), static_cast<int>(len), buffer);
+    }
+    heap_allocated = 0;
+    print_and_free(build());
+    printf("  cJSON:      %8.2f us, %zu bytes allocated\n", cjson_ns / 1e3, heap_allocated);
+#else
+    (void)buffer;
+    (void)build;
+#endif
+}
+
+int main() {
+#if HOST_HAVE_CJSON
+    cJSON_Hooks hooks = {counting_malloc, free};
+    cJSON_InitHooks(&hooks);
+#define BUILD(expr) [&] { return expr; }
+#else
+#define BUILD(expr) [] { return nullptr; }
+#endif
+    std::vector<char> buffer(SEND_BUFFER_LEN);
+    const std::vector<std::string> entity_ids = make_entity_ids();
+
+    bench("call_service", buffer.data(), 200000, [&] { return write_call_service(buffer.data(), 42); },
+          BUILD(build_call_service(42)));
+    bench("subscribe_entities", buffer.data(), 20000, [&] { return write_subscribe(buffer.data(), 7, entity_ids); },
+          BUILD(build_subscribe(7, entity_ids)));
+#if !HOST_HAVE_CJSON
+    printf("  cJSON not found: set CJSON_DIR for the cJSON baseline\n");
+#endif
+    return EXIT_SUCCESS;
+}
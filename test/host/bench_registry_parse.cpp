@@ -0,0 +1,194 @@
+// Registry listing: streamed item by item (json_stream + a cJSON parse per
+// row, as hass_registry_stream_on_item does) against the old path that
+// buffered the whole message and parsed it as one cJSON tree. Reports parse
+// time and peak heap of each.
+//
+//   bench_registry_parse [payload.json]
+//
+// Without a file it generates an entity registry listing (list_for_display
+// shape). Rows are fed in websocket-sized chunks.
+
+#include "host_check.h"
+#include "json_stream.h"
+
+#include <string>
+#include <vector>
+
+#if HOST_HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+static constexpr size_t CHUNK_LEN = 1024;                // esp_websocket_client's default rx buffer
+static constexpr size_t ITEM_BUFFER_LEN = 1024 * 16;     // HASS_MAX_REGISTRY_ITEM_LEN
+static constexpr int GENERATED_ENTITIES = 2000;
+
+static std::string generate_listing(int count) {
+    static const char* const kDomains[] = {"light", "switch", "sensor", "binary_sensor", "climate", "cover", "automation", "fan"};
+    std::string json = R"({"id":9,"type":"result","success":true,"result":{"entity_categories":{"0":"config","1":"diagnostic"},"entities":[)";
+    char row[512];
+    for (int idx = 0; idx < count; idx++) {
+        const char* domain = kDomains[idx % 8];
+        snprintf(row, sizeof(row),
+                 R"(%s{"ei":"%s.device_%04d_entity","di":"0f3c5e%026d","ai":"area_%02d","en":"Device %d %s","pl":"zha",)"
+                 R"("tk":"%s_%d","lb":[],"ec":%s,"hb":%s,"hn":true,"ic":"mdi:home-%d"})",
+                 idx ? "," : "", domain, idx, idx / 4, idx % 40, idx, domain, domain, idx, idx % 11 == 0 ? "1" : "null",
+                 idx % 17 == 0 ? "true" : "false", idx % 30);
+        json += row;
+    }
+    json += "]}}";
+    return json;
+}
+
+static std::string read_file(const char* path) {
+    std::string data;
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return data;
+    }
+    char buffer[65536];
+    size_t len = 0;
+    while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, len);
+    }
+    fclose(file);
+    return data;
+}
+
+#if HOST_HAVE_CJSON
+// Heap accounting for cJSON, the only allocator on either path
+static size_t heap_now = 0;
+static size_t heap_peak = 0;
+
+static void* counting_malloc(size_t len) {
+    size_t* block = static_cast<size_t*>(malloc(len + sizeof(size_t)));
+    if (!block) {
+        return nullptr;
+    }
+    *block = len;
+    heap_now += len;
+    if (heap_now > heap_peak) {
+        heap_peak = heap_now;
+    }
+    return block + 1;
+}
+
+static void counting_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    size_t* block = static_cast<size_t*>(ptr) - 1;
+    heap_now -= *block;
+    free(block);
+}
+
+// Touches what the discovery callbacks read, so the tree walk is not optimized out
+static size_t walk_row(const cJSON* row) {
+    size_t seen = 0;
+    for (const cJSON* field = row ? row->child : nullptr; field; field = field->next) {
+        seen += cJSON_IsString(field) ? strlen(field->valuestring) : 1;
+    }
+    return seen;
+}
+#endif
+
+struct StreamRun {
+    size_t rows = 0;
+    size_t seen = 0;
+};
+
+static bool on_array(void*, uint8_t depth, const char* key) {
+    return (depth == 1 && strcmp(key, "result") == 0) || (depth == 2 && strcmp(key, "entities") == 0);
+}
+
+static void on_item(void* ctx, const char* json, size_t len) {
+    StreamRun* run = static_cast<StreamRun*>(ctx);
+    run->rows++;
+#if HOST_HAVE_CJSON
+    cJSON* row = cJSON_ParseWithLength(json, len);
+    run->seen += walk_row(row);
+    cJSON_Delete(row);
+#else
+    (void)json;
+    run->seen += len;
+#endif
+}
+
+static StreamRun run_streaming(const std::string& payload, char* item_buffer) {
+    StreamRun run;
+    const JsonStreamHandlers handlers = {
+        .on_field = nullptr,
+        .on_array = on_array,
+        .on_item = on_item,
+        .on_message_start = nullptr,
+        .on_message_end = nullptr,
+        .ctx = &run,
+    };
+    JsonStream stream;
+    json_stream_init(&stream, &handlers, item_buffer, ITEM_BUFFER_LEN, nullptr, 0);
+    for (size_t offset = 0; offset < payload.size(); offset += CHUNK_LEN) {
+        const size_t len = payload.size() - offset < CHUNK_LEN ? payload.size() - offset : CHUNK_LEN;
+        json_stream_feed(&stream, payload.data() + offset, len);
+    }
+    return run;
+}
+
+#if HOST_HAVE_CJSON
+static size_t run_buffered(const std::string& payload, char* json_buffer) {
+    for (size_t offset = 0; offset < payload.size(); offset += CHUNK_LEN) {
+        const size_t len = payload.size() - offset < CHUNK_LEN ? payload.size() - offset : CHUNK_LEN;
+        memcpy(json_buffer + offset, payload.data() + offset, len);
+    }
+    cJSON* root = cJSON_ParseWithLength(json_buffer, payload.size());
+    const cJSON* result = cJSON_GetObjectItem(root, "result");
+    const cJSON* rows = cJSON_IsObject(result) ? cJSON_GetObjectItem(result, "entities") : result;
+    size_t seen = 0;
+    const cJSON* row = nullptr;
+    cJSON_ArrayForEach(row, rows) {
+        seen += walk_row(row);
+    }
+    cJSON_Delete(root);
+    return seen;
+}
+#endif
+
+int main(int argc, char** argv) {
+    const std::string payload = argc > 1 ? read_file(argv[1]) : generate_listing(GENERATED_ENTITIES);
+    if (payload.empty()) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    std::vector<char> item_buffer(ITEM_BUFFER_LEN);
+    const int runs = 5;
+    const int iterations = payload.size() > (1u << 20) ? 2 : 10;
+
+    StreamRun rows;
+    const double stream_ns = host_bench_ns(runs, iterations, [&] { rows = run_streaming(payload, item_buffer.data()); });
+    printf("registry listing: %zu bytes, %zu rows, %zu-byte chunks\n", payload.size(), rows.rows, CHUNK_LEN);
+
+#if HOST_HAVE_CJSON
+    cJSON_Hooks hooks = {counting_malloc, counting_free};
+    cJSON_InitHooks(&hooks);
+
+    heap_peak = heap_now = 0;
+    run_streaming(payload, item_buffer.data());
+    const size_t stream_peak = ITEM_BUFFER_LEN + heap_peak;
+
+    std::vector<char> json_buffer(payload.size());
+    size_t seen = 0;
+    const double buffered_ns = host_bench_ns(runs, iterations, [&] { seen = run_buffered(payload, json_buffer.data()); });
+    heap_peak = heap_now = 0;
+    run_buffered(payload, json_buffer.data());
+    const size_t buffered_peak = payload.size() + heap_peak;
+    if (seen != rows.seen) {
+        fprintf(stderr, "paths disagree: %zu vs %zu\n", rows.seen, seen);
+        return EXIT_FAILURE;
+    }
+
+    printf("  streamed: %8.2f ms, peak heap %7zu bytes (item buffer + largest row tree)\n", stream_ns / 1e6, stream_peak);
+    printf("  buffered: %8.2f ms, peak heap %7zu bytes (message buffer + whole tree)\n", buffered_ns / 1e6, buffered_peak);
+#else
+    printf("  scan only: %8.2f ms, item buffer %zu bytes\n", stream_ns / 1e6, ITEM_BUFFER_LEN);
+    printf("  cJSON not found: set CJSON_DIR for the per-row parse and the buffered baseline\n");
+#endif
+    return EXIT_SUCCESS;
+}
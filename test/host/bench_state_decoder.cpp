@@ -0,0 +1,221 @@
+// subscribe_entities decoding: state_decoder against a cJSON parse of the
+// whole message followed by the same field lookups the old handler did.
+// Reports time per message and, for cJSON, peak heap.
+//
+// Two messages: a 500-entity initial state event and a single-entity change.
+
+#include "host_check.h"
+#include "state_decoder.h"
+
+#include <string>
+
+#if HOST_HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+static constexpr int INITIAL_ENTITIES = 500;
+
+// Roughly what HA sends: lights and climates carry long attribute lists the client never reads
+static std::string generate_state(int idx) {
+    char state[640];
+    switch (idx % 5) {
+    case 0:
+        snprintf(state, sizeof(state),
+                 R"({"s":"on","a":{"min_color_temp_kelvin":2000,"max_color_temp_kelvin":6535,"effect_list":["off","colorloop","random"],)"
+                 R"("supported_color_modes":["color_temp","xy"],"color_mode":"xy","brightness":%d,"hs_color":[30.1,70.4],)"
+                 R"("rgb_color":[255,167,76],"xy_color":[0.52,0.38],"effect":"off","friendly_name":"Light %d","supported_features":44},)"
+                 R"("c":"01HX%022d","lc":1700000000.%d})",
+                 idx % 256, idx, idx, idx);
+        break;
+    case 1:
+        snprintf(state, sizeof(state),
+                 R"({"s":"heat","a":{"hvac_modes":["off","heat","cool","heat_cool"],"min_temp":7,"max_temp":35,"target_temp_step":0.5,)"
+                 R"("current_temperature":20.%d,"temperature":21.5,"target_temp_high":null,"target_temp_low":null,)"
+                 R"("hvac_action":"heating","preset_modes":["eco","comfort","away"],"preset_mode":"comfort",)"
+                 R"("friendly_name":"Thermostat %d","supported_features":401},"c":{"id":"01HX%022d","parent_id":null,"user_id":null},"lc":1700000000})",
+                 idx % 10, idx, idx);
+        break;
+    case 2:
+        snprintf(state, sizeof(state),
+                 R"({"s":"%d.%d","a":{"state_class":"measurement","unit_of_measurement":"W","device_class":"power",)"
+                 R"("friendly_name":"Power %d"},"c":"01HX%022d","lc":1700000000})",
+                 idx * 3, idx % 10, idx, idx);
+        break;
+    case 3:
+        snprintf(state, sizeof(state),
+                 R"({"s":"off","a":{"percentage":%d,"percentage_step":1.0,"preset_modes":null,"friendly_name":"Fan %d",)"
+                 R"("supported_features":49},"c":"01HX%022d","lc":1700000000})",
+                 idx % 100, idx, idx);
+        break;
+    default:
+        snprintf(state, sizeof(state), R"({"s":"off","a":{"friendly_name":"Switch %d","icon":"mdi:power-socket-eu"},"c":"01HX%022d","lc":1700000000})",
+                 idx, idx);
+        break;
+    }
+    return state;
+}
+
+static std::string generate_initial() {
+    static const char* const kDomains[] = {"light", "climate", "sensor", "fan", "switch"};
+    std::string json = R"({"id":12,"type":"event","event":{"a":{)";
+    for (int idx = 0; idx < INITIAL_ENTITIES; idx++) {
+        json += (idx ? ",\"" : "\"") + std::string(kDomains[idx % 5]) + ".device_" + std::to_string(idx) + "\":" + generate_state(idx);
+    }
+    json += "}}}";
+    return json;
+}
+
+static const std::string kChange =
+    R"({"id":12,"type":"event","event":{"c":{"light.device_0":{"+":{"s":"on","a":{"brightness":200,"color_mode":"xy",)"
+    R"("xy_color":[0.5,0.4]},"c":"01HXCHANGE00000000000000","lc":1700000100.5}}}}})";
+
+// Folds what the widget parsers read, so neither path can be optimized out
+struct Digest {
+    size_t states = 0;
+    size_t state_bytes = 0;
+    double numbers = 0;
+    unsigned hvac = 0;
+    size_t context_bytes = 0;
+};
+
+static void on_state(void* ctx, const char*, const DecodedState* state) {
+    Digest* digest = static_cast<Digest*>(ctx);
+    digest->states++;
+    digest->state_bytes += strlen(state->state);
+    for (uint8_t number = 0; number < StateNumberCount; number++) {
+        if (state->numbers_valid & (1 << number)) {
+            digest->numbers += state->numbers[number];
+        }
+    }
+    digest->hvac += state->hvac_modes;
+    digest->context_bytes += strlen(state->context_id);
+}
+
+static Digest run_decoder(const std::string& json) {
+    Digest digest;
+    const StateDecoderHandlers handlers = {.want = nullptr, .on_state = on_state, .ctx = &digest};
+    state_decoder_decode(json.data(), json.size(), &handlers);
+    return digest;
+}
+
+#if HOST_HAVE_CJSON
+static size_t heap_now = 0;
+static size_t heap_peak = 0;
+
+static void* counting_malloc(size_t len) {
+    size_t* block = static_cast<size_t*>(malloc(len + sizeof(size_t)));
+    if (!block) {
+        return nullptr;
+    }
+    *block = len;
+    heap_now += len;
+    if (heap_now > heap_peak) {
+        heap_peak = heap_now;
+    }
+    return block + 1;
+}
+
+static void counting_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    size_t* block = static_cast<size_t*>(ptr) - 1;
+    heap_now -= *block;
+    free(block);
+}
+
+static const char* const kNumberKeys[StateNumberCount] = {"temperature", "target_temp_low", "brightness", "percentage", "off_brightness"};
+
+static void cjson_read_state(const cJSON* item, Digest* digest) {
+    digest->states++;
+    const cJSON* state = cJSON_GetObjectItem(item, "s");
+    if (cJSON_IsString(state)) {
+        digest->state_bytes += strlen(state->valuestring) < STATE_DECODER_MAX_STATE_LEN ? strlen(state->valuestring) : STATE_DECODER_MAX_STATE_LEN - 1;
+    } else if (cJSON_IsNumber(state)) {
+        char text[32];
+        digest->state_bytes += snprintf(text, sizeof(text), "%g", state->valuedouble);
+    }
+    const cJSON* attributes = cJSON_GetObjectItem(item, "a");
+    if (cJSON_IsObject(attributes)) {
+        for (const char* key : kNumberKeys) {
+            const cJSON* number = cJSON_GetObjectItem(attributes, key);
+            if (cJSON_IsNumber(number)) {
+                digest->numbers += static_cast<float>(number->valuedouble);
+            }
+        }
+        const cJSON* modes = cJSON_GetObjectItem(attributes, "hvac_modes");
+        const cJSON* mode = nullptr;
+        cJSON_ArrayForEach(mode, modes) {
+            if (!cJSON_IsString(mode)) {
+                continue;
+            }
+            if (strcmp(mode->valuestring, "off") == 0) {
+                digest->hvac += StateHvacOff;
+            } else if (strcmp(mode->valuestring, "heat") == 0) {
+                digest->hvac += StateHvacHeat;
+            } else if (strcmp(mode->valuestring, "cool") == 0) {
+                digest->hvac += StateHvacCool;
+            } else if (strcmp(mode->valuestring, "heat_cool") == 0) {
+                digest->hvac += StateHvacHeat | StateHvacCool;
+            }
+        }
+    }
+    const cJSON* context = cJSON_GetObjectItem(item, "c");
+    if (cJSON_IsObject(context)) {
+        context = cJSON_GetObjectItem(context, "id");
+    }
+    if (cJSON_IsString(context)) {
+        digest->context_bytes += strlen(context->valuestring);
+    }
+}
+
+static Digest run_cjson(const std::string& json) {
+    Digest digest;
+    cJSON* root = cJSON_ParseWithLength(json.data(), json.size());
+    const cJSON* event = cJSON_GetObjectItem(root, "event");
+    const cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(event, "a")) {
+        cjson_read_state(item, &digest);
+    }
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(event, "c")) {
+        const cJSON* plus = cJSON_GetObjectItem(item, "+");
+        if (cJSON_IsObject(plus)) {
+            cjson_read_state(plus, &digest);
+        }
+    }
+    cJSON_Delete(root);
+    return digest;
+}
+#endif
+
+static void bench(const char* name, const std::string& json, int iterations) {
+    Digest decoded;
+    const double decoder_ns = host_bench_ns(5, iterations, [&] { decoded = run_decoder(json); });
+    printf("%s: %zu bytes, states: %zu\n", name, json.size(), decoded.states);
+    printf("  state_decoder: %9.2f us, no heap\n", decoder_ns / 1e3);
+
+#if HOST_HAVE_CJSON
+    Digest parsed;
+    const double cjson_ns = host_bench_ns(5, iterations, [&] { parsed = run_cjson(json); });
+    heap_peak = heap_now = 0;
+    run_cjson(json);
+    if (parsed.states != decoded.states || parsed.numbers != decoded.numbers || parsed.hvac != decoded.hvac ||
+        parsed.context_bytes != decoded.context_bytes) {
+        fprintf(stderr, "  paths disagree on %s\n", name);
+    }
+    printf("  cJSON:         %9.2f us, peak heap %zu bytes\n", cjson_ns / 1e3, heap_peak);
+#endif
+}
+
+int main() {
+#if HOST_HAVE_CJSON
+    cJSON_Hooks hooks = {counting_malloc, counting_free};
+    cJSON_InitHooks(&hooks);
+#endif
+    bench("initial states", generate_initial(), 50);
+    bench("single change", kChange, 20000);
+#if !HOST_HAVE_CJSON
+    printf("  cJSON not found: set CJSON_DIR for the cJSON baseline\n");
+#endif
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+// Widget states from a subscribe_entities event applied to the store one
+// entity at a time (store_update_value per entity, as before) against one
+// store_update_values_batch call. Counts store mutex takes and UI task
+// wakeups, and times both.
+//
+// Only the store side is modelled: the hass->mutex takes the old per-entity
+// path also made in home_assistant.cpp are not part of this count.
+
+#include "host_check.h"
+#include "host_freertos.h"
+#include "store.h"
+
+#include <string>
+#include <vector>
+
+static constexpr uint8_t ROOMS = MAX_ENTITIES / MAX_WIDGETS_PER_SCREEN;
+
+static EntityStore store;
+static int ui_task_handle;
+
+static void setup_store() {
+    store_init(&store);
+    const int8_t floor_idx = store_add_floor(&store, "Ground", "home");
+    for (uint8_t room = 0; room < ROOMS; room++) {
+        const int8_t room_idx = store_add_room(&store, ("Room " + std::to_string(room)).c_str(), "sofa", floor_idx);
+        for (size_t widget = 0; widget < MAX_WIDGETS_PER_SCREEN; widget++) {
+            const std::string entity_id = "light.room_" + std::to_string(room) + "_" + std::to_string(widget);
+            store_add_entity_to_room(&store, room_idx, EntityConfig{entity_id.c_str(), CommandType::SetLightBrightnessPercentage},
+                                     entity_id.c_str());
+        }
+    }
+    store.selected_room = 0;
+    store.ui_task = &ui_task_handle;
+}
+
+static void apply_single(const std::vector<StoreValueUpdate>& updates) {
+    for (const StoreValueUpdate& update : updates) {
+        store_update_value(&store, update.entity_idx, update.value);
+    }
+}
+
+static void apply_batch(const std::vector<StoreValueUpdate>& updates) {
+    store_update_values_batch(&store, updates.data(), updates.size());
+}
+
+// Every entity in the event changes value, as on the initial state burst
+static std::vector<StoreValueUpdate> make_updates(size_t count, uint8_t value) {
+    std::vector<StoreValueUpdate> updates(count);
+    for (size_t idx = 0; idx < count; idx++) {
+        updates[idx] = {};
+        updates[idx].entity_idx = static_cast<uint8_t>(idx);
+        updates[idx].value = value;
+        updates[idx].source = StoreValueSource::Reported;
+    }
+    return updates;
+}
+
+template <typename Apply>
+static HostFreertosCounts count_calls(Apply&& apply, size_t count) {
+    apply(make_updates(count, 1)); // settle from whatever the last run left
+    apply(make_updates(count, 0));
+    host_freertos_counts = {};
+    apply(make_updates(count, 1));
+    return host_freertos_counts;
+}
+
+static void bench(const char* name, size_t count) {
+    const HostFreertosCounts single = count_calls(apply_single, count);
+    const HostFreertosCounts batch = count_calls(apply_batch, count);
+
+    const std::vector<StoreValueUpdate> on = make_updates(count, 1);
+    const std::vector<StoreValueUpdate> off = make_updates(count, 0);
+    bool flip = false;
+    const double single_ns = host_bench_ns(5, 20000, [&] { apply_single((flip = !flip) ? on : off); });
+    const double batch_ns = host_bench_ns(5, 20000, [&] { apply_batch((flip = !flip) ? on : off); });
+
+    printf("%s: %zu widget states, %u on the selected room\n", name, count,
+           static_cast<unsigned>(count < MAX_WIDGETS_PER_SCREEN ? count : MAX_WIDGETS_PER_SCREEN));
+    printf("  per entity: %4u mutex takes, %4u UI wakeups, %7.2f us\n", single.semaphore_takes, single.task_notifies, single_ns / 1e3);
+    printf("  batched:    %4u mutex takes, %4u UI wakeups, %7.2f us\n", batch.semaphore_takes, batch.task_notifies, batch_ns / 1e3);
+}
+
+int main() {
+    setup_store();
+    if (store.entity_count != MAX_ENTITIES) {
+        fprintf(stderr, "store holds %u entities, expected %zu\n", store.entity_count, MAX_ENTITIES);
+        return EXIT_FAILURE;
+    }
+    bench("initial states", MAX_ENTITIES);
+    bench("change event", 4);
+    return EXIT_SUCCESS;
+}
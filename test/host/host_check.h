@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Just enough of a test framework for the host builds: a failed CHECK prints
+// where and keeps going, host_check_exit() turns the count into the status.
+
+static int host_check_failures = 0;
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            host_check_failures++;                                               \
+        }                                                                        \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                  \
+    do {                                                                                            \
+        const long long check_actual = static_cast<long long>(actual);                              \
+        const long long check_expected = static_cast<long long>(expected);                          \
+        if (check_actual != check_expected) {                                                       \
+            std::fprintf(stderr, "%s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__, #actual, \
+                         check_actual, check_expected);                                            \
+            host_check_failures++;                                                                  \
+        }                                                                                           \
+    } while (0)
+
+#define CHECK_STR(actual, expected)                                                                       \
+    do {                                                                                                  \
+        const char* check_actual = (actual);                                                              \
+        const char* check_expected = (expected);                                                          \
+        if (!check_actual || std::strcmp(check_actual, check_expected) != 0) {                            \
+            std::fprintf(stderr, "%s:%d: %s == \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual,  \
+                         check_actual ? check_actual : "(null)", check_expected);                        \
+            host_check_failures++;                                                                        \
+        }                                                                                                 \
+    } while (0)
+
+static inline int host_check_exit(const char* name) {
+    if (host_check_failures == 0) {
+        std::printf("%s: ok\n", name);
+        return EXIT_SUCCESS;
+    }
+    std::printf("%s: %d failed\n", name, host_check_failures);
+    return EXIT_FAILURE;
+}
+
+// Best of `runs` timings of `iterations` calls, in nanoseconds per call
+template <typename Fn>
+static double host_bench_ns(int runs, int iterations, Fn&& fn) {
+    double best = 0;
+    for (int run = 0; run < runs; run++) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int idx = 0; idx < iterations; idx++) {
+            fn();
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        const double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Host stand-in: the panel ids boards.h selects and the type widgets draw on
+
+#define BB_PANEL_EPDIY_V7 1
+#define BB_PANEL_M5PAPERS3 2
+
+class FASTEPD;
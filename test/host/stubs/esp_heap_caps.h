@@ -0,0 +1,18 @@
+#pragma once
+
+// Host stand-in: every capability is plain malloc
+
+#include <cstddef>
+#include <cstdlib>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+static inline void* heap_caps_malloc(size_t len, unsigned) {
+    return malloc(len);
+}
+
+static inline void heap_caps_free(void* ptr) {
+    free(ptr);
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void esp_system_abort(const char* details);
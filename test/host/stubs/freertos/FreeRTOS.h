@@ -0,0 +1,21 @@
+#pragma once
+
+// Host stand-in for the FreeRTOS pieces the store and the scheduler use. The
+// functions live in host_freertos.cpp, which counts the calls the benchmarks
+// care about (see host_freertos.h).
+
+#include <cstddef>
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef void* TaskHandle_t;
+typedef void* SemaphoreHandle_t;
+typedef void* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+#define portMAX_DELAY 0xffffffffu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTRUE 1
+#define pdFALSE 0
@@ -0,0 +1,65 @@
+#include "host_freertos.h"
+
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+// Single-threaded: mutexes never block and notifications are only counted
+
+HostFreertosCounts host_freertos_counts = {};
+int64_t host_time_us = 0;
+
+static int host_handle; // any non-null handle will do
+
+void esp_system_abort(const char* details) {
+    fprintf(stderr, "abort: %s\n", details);
+    abort();
+}
+
+int64_t esp_timer_get_time() {
+    return host_time_us;
+}
+
+TickType_t xTaskGetTickCount() {
+    return static_cast<TickType_t>(host_time_us / 1000 / portTICK_PERIOD_MS);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t) {
+    host_freertos_counts.task_notifies++;
+    return pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return &host_handle;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) {
+    host_freertos_counts.semaphore_takes++;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t) {
+    return pdTRUE;
+}
+
+EventGroupHandle_t xEventGroupCreate() {
+    return &host_handle;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t, EventBits_t bits) {
+    host_freertos_counts.event_group_sets++;
+    return bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t, EventBits_t) {
+    return 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t, EventBits_t bits, BaseType_t, BaseType_t, TickType_t) {
+    return bits;
+}
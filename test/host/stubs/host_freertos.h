@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// Calls counted by the host FreeRTOS stand-in; reset them between runs
+struct HostFreertosCounts {
+    uint32_t semaphore_takes;
+    uint32_t task_notifies;
+    uint32_t event_group_sets;
+};
+
+extern HostFreertosCounts host_freertos_counts;
+// Clock behind esp_timer_get_time and xTaskGetTickCount, advanced by hand
+extern int64_t host_time_us;
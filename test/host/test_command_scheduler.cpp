@@ -0,0 +1,156 @@
+#include "host_check.h"
+#include "constants.h"
+#include "managers/command_scheduler.h"
+
+static constexpr uint8_t LIGHTS = 0;
+static constexpr uint8_t CLIMATE = 1;
+
+// Independent entities go out back-to-back up to the burst, then at the refill rate
+static void test_burst_and_refill() {
+    CommandScheduler scheduler;
+    command_scheduler_init(&scheduler, 0);
+    const int burst = static_cast<int>(HASS_COMMAND_BURST);
+    for (int entity = 0; entity < burst; entity++) {
+        CHECK_EQ(command_scheduler_wait_ms(&scheduler, LIGHTS, entity, 0), 0);
+        command_scheduler_on_sent(&scheduler, LIGHTS, entity, 100 + entity, 0);
+    }
+    const uint32_t wait_ms = command_scheduler_wait_ms(&scheduler, LIGHTS, burst, 0);
+    CHECK_EQ(wait_ms, static_cast<uint32_t>(1000.0f / HASS_COMMAND_RATE_INITIAL) + 1);
+    CHECK(command_scheduler_wait_ms(&scheduler, LIGHTS, burst, wait_ms - 2) > 0);
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, LIGHTS, burst, wait_ms), 0);
+
+    // Other domains have their own bucket
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, CLIMATE, 50, 0), 0);
+    // Out-of-range buckets are not paced
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, COMMAND_SCHEDULER_BUCKETS, 51, 0), 0);
+
+    // An idle bucket refills to the burst, not beyond
+    command_scheduler_clear_in_flight(&scheduler);
+    for (int entity = 0; entity < burst; entity++) {
+        CHECK_EQ(command_scheduler_wait_ms(&scheduler, LIGHTS, entity, 60000), 0);
+        command_scheduler_on_sent(&scheduler, LIGHTS, entity, 200 + entity, 60000);
+    }
+    CHECK(command_scheduler_wait_ms(&scheduler, LIGHTS, burst, 60000) > 0);
+}
+
+// One command per entity awaits its result; the next value waits for it
+static void test_one_in_flight_per_entity() {
+    CommandScheduler scheduler;
+    command_scheduler_init(&scheduler, 1000);
+    command_scheduler_on_sent(&scheduler, LIGHTS, 7, 10, 1000);
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, LIGHTS, 7, 1000), HASS_COMMAND_RESULT_TIMEOUT_MS);
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, LIGHTS, 7, 3000), HASS_COMMAND_RESULT_TIMEOUT_MS - 2000);
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, LIGHTS, 8, 1000), 0);
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, LIGHTS, COMMAND_SCHEDULER_NO_ENTITY, 1000), 0);
+
+    CHECK(command_scheduler_on_result(&scheduler, 10, true));
+    CHECK_EQ(scheduler.in_flight_count, 0);
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, LIGHTS, 7, 3000), 0);
+    CHECK(!command_scheduler_on_result(&scheduler, 10, true)); // already answered
+    CHECK(!command_scheduler_on_result(&scheduler, 99, false));
+}
+
+// Additive increase on success, halving on failure, within the limits
+static void test_rate_adapts() {
+    CommandScheduler scheduler;
+    command_scheduler_init(&scheduler, 0);
+    uint16_t message_id = 1;
+    for (int round = 0; round < 40; round++) {
+        command_scheduler_on_sent(&scheduler, LIGHTS, 1, message_id, 0);
+        command_scheduler_on_result(&scheduler, message_id++, true);
+    }
+    CHECK(scheduler.buckets[LIGHTS].rate == HASS_COMMAND_RATE_MAX);
+
+    command_scheduler_on_sent(&scheduler, LIGHTS, 1, message_id, 0);
+    command_scheduler_on_result(&scheduler, message_id++, false);
+    CHECK(scheduler.buckets[LIGHTS].rate == HASS_COMMAND_RATE_MAX / 2);
+
+    for (int round = 0; round < 10; round++) {
+        command_scheduler_on_sent(&scheduler, LIGHTS, 1, message_id, 0);
+        command_scheduler_on_result(&scheduler, message_id++, false);
+    }
+    CHECK(scheduler.buckets[LIGHTS].rate == HASS_COMMAND_RATE_MIN);
+    CHECK(scheduler.buckets[CLIMATE].rate == HASS_COMMAND_RATE_INITIAL);
+
+    // A slowed domain spaces its commands out
+    const uint32_t wait_ms = command_scheduler_wait_ms(&scheduler, LIGHTS, 2, 0);
+    CHECK(wait_ms > static_cast<uint32_t>(1000.0f / HASS_COMMAND_RATE_INITIAL));
+}
+
+// A room-wide call costs one token and adapts its bucket once
+static void test_group_call() {
+    CommandScheduler scheduler;
+    command_scheduler_init(&scheduler, 0);
+    const uint8_t entities[] = {3, 4, 5, 6, 7, 8};
+    command_scheduler_on_sent_group(&scheduler, LIGHTS, entities, sizeof(entities), 20, 0);
+    CHECK_EQ(scheduler.in_flight_count, sizeof(entities));
+    CHECK(scheduler.buckets[LIGHTS].tokens == HASS_COMMAND_BURST - 1);
+    for (uint8_t entity : entities) {
+        CHECK(command_scheduler_wait_ms(&scheduler, LIGHTS, entity, 0) > 0);
+    }
+
+    CHECK(command_scheduler_on_result(&scheduler, 20, true));
+    CHECK_EQ(scheduler.in_flight_count, 0);
+    CHECK(scheduler.buckets[LIGHTS].rate == HASS_COMMAND_RATE_INITIAL + 1);
+}
+
+// Lost results count as one failure per message and free the entities
+static void test_expire() {
+    CommandScheduler scheduler;
+    command_scheduler_init(&scheduler, 0);
+    const uint8_t entities[] = {1, 2, 3};
+    command_scheduler_on_sent_group(&scheduler, LIGHTS, entities, sizeof(entities), 30, 0);
+    command_scheduler_on_sent(&scheduler, CLIMATE, 9, 31, 2000);
+
+    CHECK_EQ(command_scheduler_expire(&scheduler, HASS_COMMAND_RESULT_TIMEOUT_MS - 1), 0);
+    CHECK_EQ(command_scheduler_expire(&scheduler, HASS_COMMAND_RESULT_TIMEOUT_MS), 3);
+    CHECK_EQ(scheduler.in_flight_count, 1);
+    CHECK(scheduler.buckets[LIGHTS].rate == HASS_COMMAND_RATE_INITIAL / 2);
+    CHECK(scheduler.buckets[CLIMATE].rate == HASS_COMMAND_RATE_INITIAL);
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, LIGHTS, 1, HASS_COMMAND_RESULT_TIMEOUT_MS), 0);
+    CHECK(!command_scheduler_on_result(&scheduler, 30, true)); // a late answer is ignored
+    CHECK(command_scheduler_on_result(&scheduler, 31, true));
+}
+
+// A full in-flight table holds everything back until the oldest result is due
+static void test_in_flight_limit() {
+    CommandScheduler scheduler;
+    command_scheduler_init(&scheduler, 0);
+    for (uint8_t entity = 0; entity < COMMAND_SCHEDULER_MAX_IN_FLIGHT; entity++) {
+        command_scheduler_on_sent(&scheduler, entity % COMMAND_SCHEDULER_BUCKETS, entity, entity, entity * 10);
+    }
+    CHECK_EQ(scheduler.in_flight_count, COMMAND_SCHEDULER_MAX_IN_FLIGHT);
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, 7, 100, 1000), HASS_COMMAND_RESULT_TIMEOUT_MS - 1000);
+
+    // Group members past the limit are not tracked
+    const uint8_t more[] = {101, 102};
+    command_scheduler_on_sent_group(&scheduler, LIGHTS, more, sizeof(more), 500, 1000);
+    CHECK_EQ(scheduler.in_flight_count, COMMAND_SCHEDULER_MAX_IN_FLIGHT);
+
+    command_scheduler_clear_in_flight(&scheduler);
+    CHECK_EQ(scheduler.in_flight_count, 0);
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, 7, 100, 1000), 0);
+}
+
+// The millisecond clock wraps after 49 days
+static void test_clock_wrap() {
+    const uint32_t start = UINT32_MAX - 100;
+    CommandScheduler scheduler;
+    command_scheduler_init(&scheduler, start);
+    command_scheduler_on_sent(&scheduler, LIGHTS, 1, 40, start);
+    CHECK_EQ(command_scheduler_wait_ms(&scheduler, LIGHTS, 1, start + 1000), HASS_COMMAND_RESULT_TIMEOUT_MS - 1000);
+    CHECK_EQ(command_scheduler_expire(&scheduler, start + 1000), 0);
+    CHECK_EQ(command_scheduler_expire(&scheduler, start + HASS_COMMAND_RESULT_TIMEOUT_MS), 1);
+    CHECK(scheduler.buckets[LIGHTS].tokens <= HASS_COMMAND_BURST);
+}
+
+int main() {
+    test_burst_and_refill();
+    test_one_in_flight_per_entity();
+    test_rate_adapts();
+    test_group_call();
+    test_expire();
+    test_in_flight_limit();
+    test_clock_wrap();
+    return host_check_exit("command_scheduler");
+}
@@ -0,0 +1,120 @@
+#include "host_check.h"
+#include "esp_heap_caps.h"
+#include "id_table.h"
+
+#include <string>
+
+static void test_put_get() {
+    IdArena arena = {};
+    IdMap map = {};
+    int16_t value = 0;
+    CHECK(!id_map_get(&map, "kitchen", &value)); // nothing allocated yet
+    CHECK(id_map_put(&map, &arena, "kitchen", 3));
+    CHECK(id_map_put(&map, &arena, "living_room", 7));
+    CHECK(id_map_get(&map, "kitchen", &value));
+    CHECK_EQ(value, 3);
+    CHECK(id_map_get(&map, "living_room", &value));
+    CHECK_EQ(value, 7);
+    CHECK(!id_map_get(&map, "kitche", &value));
+    CHECK(!id_map_get(&map, nullptr, &value));
+    CHECK(!id_map_put(&map, &arena, nullptr, 1));
+    CHECK_EQ(map.count, 2);
+
+    // Overwriting keeps the count and does not intern again
+    const size_t bytes = arena.bytes;
+    CHECK(id_map_put(&map, &arena, "kitchen", -1));
+    CHECK(id_map_get(&map, "kitchen", &value));
+    CHECK_EQ(value, -1);
+    CHECK_EQ(map.count, 2);
+    CHECK_EQ(arena.bytes, bytes);
+
+    // The key is copied: the caller's buffer can change afterwards
+    char key[16] = "hall";
+    CHECK(id_map_put(&map, &arena, key, 9));
+    strcpy(key, "attic");
+    CHECK(id_map_get(&map, "hall", &value));
+    CHECK_EQ(value, 9);
+    CHECK(!id_map_get(&map, "attic", &value));
+
+    id_arena_reset(&arena);
+    heap_caps_free(map.slots);
+}
+
+// Thousands of device ids, past the old 512 cap: the map grows and keeps every entry
+static void test_grow() {
+    IdArena arena = {};
+    IdMap map = {};
+    const int count = 5000;
+    for (int idx = 0; idx < count; idx++) {
+        const std::string id = "0f3c5e" + std::to_string(idx * 7919);
+        CHECK(id_map_put(&map, &arena, id.c_str(), static_cast<int16_t>(idx)));
+    }
+    CHECK_EQ(map.count, count);
+    CHECK(map.cap >= count * 4 / 3);
+    CHECK_EQ(map.cap & (map.cap - 1), 0);
+    for (int idx = 0; idx < count; idx++) {
+        const std::string id = "0f3c5e" + std::to_string(idx * 7919);
+        int16_t value = -1;
+        if (!id_map_get(&map, id.c_str(), &value) || value != idx) {
+            std::fprintf(stderr, "lost %s after growing\n", id.c_str());
+            host_check_failures++;
+            break;
+        }
+    }
+    id_arena_reset(&arena);
+    heap_caps_free(map.slots);
+}
+
+static void test_clear_keeps_slots() {
+    IdArena arena = {};
+    IdMap map = {};
+    for (int idx = 0; idx < 40; idx++) {
+        CHECK(id_map_put(&map, &arena, ("area_" + std::to_string(idx)).c_str(), static_cast<int16_t>(idx)));
+    }
+    const IdMapSlot* slots = map.slots;
+    const uint16_t cap = map.cap;
+    id_map_clear(&map);
+    id_arena_reset(&arena);
+    int16_t value = 0;
+    CHECK_EQ(map.count, 0);
+    CHECK(!id_map_get(&map, "area_1", &value));
+    CHECK(map.slots == slots);
+    CHECK_EQ(map.cap, cap);
+
+    // Refilled for the next discovery without reallocating
+    CHECK(id_map_put(&map, &arena, "area_1", 5));
+    CHECK(id_map_get(&map, "area_1", &value));
+    CHECK_EQ(value, 5);
+    CHECK(map.slots == slots);
+    id_arena_reset(&arena);
+    heap_caps_free(map.slots);
+}
+
+static void test_arena() {
+    IdArena arena = {};
+    CHECK(id_arena_intern(&arena, nullptr) == nullptr);
+    const char* first = id_arena_intern(&arena, "floor_ground");
+    CHECK_STR(first, "floor_ground");
+    CHECK_EQ(arena.bytes, strlen("floor_ground") + 1);
+
+    // Strings stay put when later ones need a new block, including one larger than a block
+    const std::string large(5000, 'x');
+    const char* big = id_arena_intern(&arena, large.c_str());
+    for (int idx = 0; idx < 500; idx++) {
+        CHECK(id_arena_intern(&arena, ("sensor.energy_" + std::to_string(idx)).c_str()) != nullptr);
+    }
+    CHECK_STR(first, "floor_ground");
+    CHECK(big != nullptr && large == big);
+
+    id_arena_reset(&arena);
+    CHECK(arena.blocks == nullptr);
+    CHECK_EQ(arena.bytes, 0);
+}
+
+int main() {
+    test_put_get();
+    test_grow();
+    test_clear_keeps_slots();
+    test_arena();
+    return host_check_exit("id_table");
+}
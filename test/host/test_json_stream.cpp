@@ -0,0 +1,186 @@
+#include "host_check.h"
+#include "json_stream.h"
+
+#include <string>
+#include <vector>
+
+// Records every callback so a run can be compared with another one
+struct Recorder {
+    const char* split_key = "result";
+    uint8_t split_depth = 1;
+    std::vector<std::string> fields;
+    std::vector<std::string> items;
+    std::vector<std::string> messages; // "<whole json>" or "split:<len>"
+    int message_starts = 0;
+};
+
+static void on_field(void* ctx, const char* key, const char* value, bool is_string) {
+    static_cast<Recorder*>(ctx)->fields.push_back(std::string(key) + (is_string ? "=\"" : "=") + value);
+}
+
+static bool on_array(void* ctx, uint8_t depth, const char* key) {
+    const Recorder* recorder = static_cast<Recorder*>(ctx);
+    return depth == recorder->split_depth && strcmp(key, recorder->split_key) == 0;
+}
+
+static void on_item(void* ctx, const char* json, size_t len) {
+    static_cast<Recorder*>(ctx)->items.emplace_back(json, len);
+}
+
+static void on_message_start(void* ctx) {
+    static_cast<Recorder*>(ctx)->message_starts++;
+}
+
+static void on_message_end(void* ctx, const char* json, size_t len) {
+    Recorder* recorder = static_cast<Recorder*>(ctx);
+    recorder->messages.push_back(json ? std::string(json, len) : "split:" + std::to_string(len));
+}
+
+struct Harness {
+    Recorder recorder;
+    JsonStream stream;
+    char item_buffer[256];
+    char message_buffer[512];
+
+    explicit Harness(size_t item_cap = sizeof(item_buffer)) {
+        const JsonStreamHandlers handlers = {
+            .on_field = on_field,
+            .on_array = on_array,
+            .on_item = on_item,
+            .on_message_start = on_message_start,
+            .on_message_end = on_message_end,
+            .ctx = &recorder,
+        };
+        json_stream_init(&stream, &handlers, item_buffer, item_cap, message_buffer, sizeof(message_buffer));
+    }
+
+    bool feed(const std::string& text) {
+        return json_stream_feed(&stream, text.data(), text.size());
+    }
+};
+
+static const std::string kRegistryResult =
+    R"({"id":12,"type":"result","success":true,"result":[)"
+    R"({"area_id":"kitchen","name":"Kitchen","floor_id":null,"aliases":["cuisine","k]"]},)"
+    R"({"area_id":"living","name":"Living \"room\" {big}","floor_id":"ground"},)"
+    R"( { "area_id" : "hall" , "labels" : [ [1,2], {"a":[]} ] } ]})";
+
+static void test_split_array() {
+    Harness harness;
+    CHECK(harness.feed(kRegistryResult));
+    const Recorder& r = harness.recorder;
+    CHECK_EQ(r.items.size(), 3);
+    CHECK_STR(r.items[0].c_str(), R"({"area_id":"kitchen","name":"Kitchen","floor_id":null,"aliases":["cuisine","k]"]})");
+    CHECK_STR(r.items[1].c_str(), R"({"area_id":"living","name":"Living \"room\" {big}","floor_id":"ground"})");
+    CHECK_STR(r.items[2].c_str(), R"({ "area_id" : "hall" , "labels" : [ [1,2], {"a":[]} ] })");
+    CHECK_EQ(r.fields.size(), 3);
+    CHECK_STR(r.fields[0].c_str(), "id=12");
+    CHECK_STR(r.fields[1].c_str(), "type=\"result");
+    CHECK_STR(r.fields[2].c_str(), "success=true");
+    CHECK_EQ(harness.stream.items, 3);
+    CHECK_EQ(harness.stream.dropped_items, 0);
+    CHECK_EQ(harness.stream.depth, 0);
+}
+
+// list_for_display nests the rows one level down: {"result":{"entities":[...]}}
+static void test_nested_split_array() {
+    Harness harness;
+    harness.recorder.split_key = "entities";
+    harness.recorder.split_depth = 2;
+    CHECK(harness.feed(R"({"id":3,"type":"result","success":true,"result":{"entity_categories":{"0":"config"},)"
+                       R"("entities":[{"ei":"light.a","ai":"kitchen"},{"ei":"switch.b","hb":true}]}})"));
+    const Recorder& r = harness.recorder;
+    CHECK_EQ(r.items.size(), 2);
+    CHECK_STR(r.items[0].c_str(), R"({"ei":"light.a","ai":"kitchen"})");
+    CHECK_STR(r.items[1].c_str(), R"({"ei":"switch.b","hb":true})");
+    // Scalars below the top level are not fields
+    CHECK_EQ(r.fields.size(), 3);
+}
+
+// Every way of cutting the message in two, and byte by byte, gives the same callbacks
+static void test_fragment_boundaries() {
+    Harness whole;
+    whole.feed(kRegistryResult);
+
+    for (size_t cut = 1; cut < kRegistryResult.size(); cut++) {
+        Harness split;
+        CHECK(split.feed(kRegistryResult.substr(0, cut)));
+        CHECK(split.feed(kRegistryResult.substr(cut)));
+        if (split.recorder.items != whole.recorder.items || split.recorder.fields != whole.recorder.fields) {
+            std::fprintf(stderr, "fragment boundary at byte %zu changed the result\n", cut);
+            host_check_failures++;
+        }
+    }
+
+    Harness bytes;
+    for (char c : kRegistryResult) {
+        CHECK(bytes.feed(std::string(1, c)));
+    }
+    CHECK(bytes.recorder.items == whole.recorder.items);
+    CHECK(bytes.recorder.fields == whole.recorder.fields);
+}
+
+// A coalesced frame is an array of messages: each is scanned on its own and
+// handed over whole, unless it was split
+static void test_coalesced_batch() {
+    const std::string event = R"({"id":4,"type":"event","event":{"a":{"light.a":{"s":"on"}}}})";
+    const std::string batch = "[" + event + "," + kRegistryResult + R"(,{"id":13,"type":"result","success":false}])";
+
+    Harness harness;
+    CHECK(harness.feed(batch));
+    const Recorder& r = harness.recorder;
+    CHECK_EQ(r.message_starts, 3);
+    CHECK_EQ(r.messages.size(), 3);
+    CHECK_STR(r.messages[0].c_str(), event.c_str());
+    CHECK_STR(r.messages[1].c_str(), ("split:" + std::to_string(kRegistryResult.size())).c_str());
+    CHECK_STR(r.messages[2].c_str(), R"({"id":13,"type":"result","success":false})");
+    CHECK_EQ(r.items.size(), 3);
+    // Fields of each message, in order
+    CHECK_EQ(r.fields.size(), 8);
+    CHECK_STR(r.fields[0].c_str(), "id=4");
+    CHECK_STR(r.fields[2].c_str(), "id=12");
+    CHECK_STR(r.fields[5].c_str(), "id=13");
+    CHECK_STR(r.fields[7].c_str(), "success=false");
+
+    // The same batch cut at every byte
+    for (size_t cut = 1; cut < batch.size(); cut++) {
+        Harness split;
+        split.feed(batch.substr(0, cut));
+        split.feed(batch.substr(cut));
+        if (split.recorder.messages != r.messages || split.recorder.items != r.items || split.recorder.fields != r.fields) {
+            std::fprintf(stderr, "batch boundary at byte %zu changed the result\n", cut);
+            host_check_failures++;
+        }
+    }
+}
+
+// An element larger than the item buffer is dropped; the others still arrive
+static void test_item_overflow() {
+    Harness harness(16);
+    CHECK(harness.feed(R"({"id":2,"result":[{"a":"longer than sixteen bytes"},{"a":1},[2,3]]})"));
+    CHECK_EQ(harness.recorder.items.size(), 2);
+    CHECK_EQ(harness.stream.dropped_items, 1);
+    CHECK_STR(harness.recorder.items[0].c_str(), R"({"a":1})");
+    CHECK_STR(harness.recorder.items[1].c_str(), "[2,3]");
+    CHECK_EQ(harness.stream.largest_item, 7);
+}
+
+static void test_reset_and_malformed() {
+    Harness harness;
+    CHECK(!harness.feed(R"({"id":1}})"));
+    CHECK(!harness.feed("{}")); // stays failed until reset
+    json_stream_reset(&harness.stream);
+    harness.recorder = Recorder{};
+    CHECK(harness.feed(kRegistryResult));
+    CHECK_EQ(harness.recorder.items.size(), 3);
+}
+
+int main() {
+    test_split_array();
+    test_nested_split_array();
+    test_fragment_boundaries();
+    test_coalesced_batch();
+    test_item_overflow();
+    test_reset_and_malformed();
+    return host_check_exit("json_stream");
+}
@@ -0,0 +1,154 @@
+#include "host_check.h"
+#include "json_writer.h"
+
+#include <cmath>
+#include <string>
+
+// The shape hass_send_call_service writes
+static void test_call_service() {
+    char buffer[256];
+    JsonWriter writer;
+    json_writer_init(&writer, buffer, sizeof(buffer));
+    json_writer_open(&writer, '{');
+    json_writer_number(&writer, "id", 42);
+    json_writer_string(&writer, "type", "call_service");
+    json_writer_string(&writer, "domain", "light");
+    json_writer_string(&writer, "service", "turn_on");
+    json_writer_begin_object(&writer, "service_data");
+    json_writer_string(&writer, "entity_id", "light.kitchen");
+    json_writer_literal_key(&writer, "brightness_pct");
+    json_writer_number_value(&writer, 75);
+    json_writer_close(&writer, '}');
+    json_writer_close(&writer, '}');
+    CHECK_STR(json_writer_finish(&writer), R"({"id":42,"type":"call_service","domain":"light","service":"turn_on",)"
+                                           R"("service_data":{"entity_id":"light.kitchen","brightness_pct":75}})");
+    CHECK_EQ(writer.len, strlen(buffer));
+}
+
+static void test_nesting() {
+    char buffer[256];
+    JsonWriter writer;
+    json_writer_init(&writer, buffer, sizeof(buffer));
+    json_writer_open(&writer, '{');
+    json_writer_begin_array(&writer, "entity_ids");
+    json_writer_array_string(&writer, "light.a");
+    json_writer_array_string(&writer, "switch.b");
+    json_writer_close(&writer, ']');
+    json_writer_begin_array(&writer, "empty");
+    json_writer_close(&writer, ']');
+    json_writer_begin_object(&writer, "nested");
+    json_writer_begin_array(&writer, "rows");
+    json_writer_separator(&writer);
+    json_writer_open(&writer, '{');
+    json_writer_bool(&writer, "on", true);
+    json_writer_close(&writer, '}');
+    json_writer_separator(&writer);
+    json_writer_open(&writer, '{');
+    json_writer_bool(&writer, "on", false);
+    json_writer_close(&writer, '}');
+    json_writer_close(&writer, ']');
+    json_writer_close(&writer, '}');
+    json_writer_number(&writer, "after", 1);
+    json_writer_close(&writer, '}');
+    CHECK_STR(json_writer_finish(&writer),
+              R"({"entity_ids":["light.a","switch.b"],"empty":[],"nested":{"rows":[{"on":true},{"on":false}]},"after":1})");
+}
+
+// Results stay valid until the next call, long enough for CHECK_STR
+static const char* escaped(const char* text) {
+    static char buffer[128];
+    JsonWriter writer;
+    json_writer_init(&writer, buffer, sizeof(buffer));
+    json_writer_escaped(&writer, text);
+    const char* json = json_writer_finish(&writer);
+    return json ? json : "(overflow)";
+}
+
+static void test_escaping() {
+    CHECK_STR(escaped("plain"), R"("plain")");
+    CHECK_STR(escaped(""), R"("")");
+    CHECK_STR(escaped(nullptr), R"("")");
+    CHECK_STR(escaped(R"(say "hi" \o/)"), R"("say \"hi\" \\o/")");
+    CHECK_STR(escaped("tab\there\nline\x01\x1f"), R"("tab\u0009here\u000aline\u0001\u001f")");
+    CHECK_STR(escaped("café ☀"), "\"café ☀\""); // UTF-8 passes through
+    CHECK_STR(escaped("\""), R"("\"")");
+}
+
+static const char* number(double value) {
+    static char buffer[64];
+    JsonWriter writer;
+    json_writer_init(&writer, buffer, sizeof(buffer));
+    json_writer_number_value(&writer, value);
+    const char* json = json_writer_finish(&writer);
+    return json ? json : "(overflow)";
+}
+
+static void test_numbers() {
+    CHECK_STR(number(0), "0");
+    CHECK_STR(number(-0.0), "0");
+    CHECK_STR(number(65535), "65535");
+    CHECK_STR(number(-40), "-40");
+    CHECK_STR(number(21.5), "21.5");
+    CHECK_STR(number(0.1f), "0.1"); // float arguments do not leak their binary noise
+    CHECK_STR(number(1700000000123.0), "1700000000123");
+    CHECK_STR(number(1e20), "1e+20");
+    CHECK_STR(number(NAN), "null");
+    CHECK_STR(number(INFINITY), "null");
+}
+
+static void test_overflow() {
+    const char* expected = R"({"type":"ping"})";
+    const size_t len = strlen(expected);
+    std::string buffer(len + 1, '\0');
+
+    // Exactly fits, terminator included
+    JsonWriter writer;
+    json_writer_init(&writer, &buffer[0], len + 1);
+    json_writer_open(&writer, '{');
+    json_writer_string(&writer, "type", "ping");
+    json_writer_close(&writer, '}');
+    CHECK_STR(json_writer_finish(&writer), expected);
+
+    // One byte short: nothing usable comes out, and later writes stay refused
+    json_writer_init(&writer, &buffer[0], len);
+    json_writer_open(&writer, '{');
+    json_writer_string(&writer, "type", "ping");
+    json_writer_close(&writer, '}');
+    CHECK(writer.overflow);
+    CHECK(json_writer_finish(&writer) == nullptr);
+    CHECK(writer.len < len);
+
+    // No send buffer (allocation failed at boot)
+    json_writer_init(&writer, nullptr, 0);
+    json_writer_open(&writer, '{');
+    json_writer_close(&writer, '}');
+    CHECK(json_writer_finish(&writer) == nullptr);
+}
+
+static void test_unbalanced_and_depth() {
+    char buffer[64];
+    JsonWriter writer;
+    json_writer_init(&writer, buffer, sizeof(buffer));
+    json_writer_open(&writer, '{');
+    json_writer_begin_object(&writer, "a");
+    json_writer_close(&writer, '}');
+    CHECK(json_writer_finish(&writer) == nullptr); // still inside the outer object
+
+    json_writer_init(&writer, buffer, sizeof(buffer));
+    for (uint8_t level = 0; level + 1 < JSON_WRITER_MAX_DEPTH; level++) {
+        json_writer_open(&writer, '[');
+    }
+    CHECK(!writer.overflow);
+    json_writer_open(&writer, '[');
+    CHECK(writer.overflow);
+}
+
+int main() {
+    test_call_service();
+    test_nesting();
+    test_escaping();
+    test_numbers();
+    test_overflow();
+    test_unbalanced_and_depth();
+    return host_check_exit("json_writer");
+}
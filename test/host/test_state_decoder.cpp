@@ -0,0 +1,170 @@
+#include "host_check.h"
+#include "state_decoder.h"
+
+#include <string>
+#include <vector>
+
+struct Seen {
+    std::string entity_id;
+    DecodedState state;
+    std::string json;
+};
+
+struct Collector {
+    std::vector<Seen> states;
+    std::vector<std::string> asked;
+    const char* skip = nullptr; // entity the want callback turns down
+};
+
+static bool want(void* ctx, const char* entity_id) {
+    Collector* collector = static_cast<Collector*>(ctx);
+    collector->asked.push_back(entity_id);
+    return !collector->skip || strcmp(entity_id, collector->skip) != 0;
+}
+
+static void on_state(void* ctx, const char* entity_id, const DecodedState* state) {
+    static_cast<Collector*>(ctx)->states.push_back({entity_id, *state, std::string(state->json, state->json_len)});
+}
+
+static StateDecodeResult decode(const std::string& json, Collector* collector) {
+    const StateDecoderHandlers handlers = {.want = want, .on_state = on_state, .ctx = collector};
+    return state_decoder_decode(json.data(), json.size(), &handlers);
+}
+
+static bool has_number(const DecodedState& state, StateNumber number) {
+    return (state.numbers_valid & (1 << number)) != 0;
+}
+
+static void test_initial_states() {
+    const std::string light = R"({"s":"on","a":{"effect_list":["rainbow","{x}"],"brightness":128,"friendly_name":"Kitchen \"main\"",)"
+                              R"("rgb_color":[255,0,0]},"c":"01HXKITCHEN","lc":1700000000.25})";
+    const std::string json = R"({"id":5,"type":"event","event":{"a":{"light.kitchen":)" + light +
+                             R"(,"climate.hall":{"s":"heat","a":{"temperature":21.5,"target_temp_low":null,)"
+                             R"("hvac_modes":["off","heat_cool","auto"]},"c":{"id":"01HXHALL","parent_id":null,"user_id":"u1"}},)"
+                             R"("sensor.outside":{"s":-3.5,"a":{}}}}})";
+    Collector collector;
+    CHECK(decode(json, &collector) == StateDecodeResult::Decoded);
+    CHECK_EQ(collector.states.size(), 3);
+    if (collector.states.size() != 3) {
+        return;
+    }
+
+    const Seen& kitchen = collector.states[0];
+    CHECK_STR(kitchen.entity_id.c_str(), "light.kitchen");
+    CHECK(kitchen.state.has_state);
+    CHECK_STR(kitchen.state.state, "on");
+    CHECK(kitchen.state.has_attributes);
+    CHECK_EQ(kitchen.state.numbers_valid, 1 << StateNumberBrightness);
+    CHECK_EQ(kitchen.state.numbers[StateNumberBrightness], 128);
+    CHECK(!kitchen.state.has_hvac_modes);
+    CHECK_STR(kitchen.state.context_id, "01HXKITCHEN");
+    CHECK_STR(kitchen.json.c_str(), light.c_str());
+
+    const Seen& hall = collector.states[1];
+    CHECK_STR(hall.state.state, "heat");
+    CHECK(has_number(hall.state, StateNumberTemperature));
+    CHECK(hall.state.numbers[StateNumberTemperature] == 21.5f);
+    CHECK(!has_number(hall.state, StateNumberTargetTempLow)); // null is not a number
+    CHECK(hall.state.has_hvac_modes);
+    CHECK_EQ(hall.state.hvac_modes, StateHvacOff | StateHvacHeat | StateHvacCool);
+    CHECK_STR(hall.state.context_id, "01HXHALL"); // object form
+
+    const Seen& outside = collector.states[2];
+    CHECK_STR(outside.state.state, "-3.5"); // unquoted states arrive as text
+    CHECK(outside.state.has_attributes);
+    CHECK_EQ(outside.state.numbers_valid, 0);
+    CHECK_STR(outside.state.context_id, "");
+}
+
+static void test_change_event() {
+    const std::string json = R"({"type":"event","event":{"c":{"light.kitchen":{"+":{"s":"off","c":"01HXOFF","lc":1.5},)"
+                             R"("-":{"a":["brightness","color_mode"]}},"fan.bedroom":{"+":{"a":{"percentage":"50","off_brightness":0}}},)"
+                             R"("cover.blind":{"-":{"a":["current_position"]}}}},"id":7})";
+    Collector collector;
+    CHECK(decode(json, &collector) == StateDecodeResult::Decoded);
+    CHECK_EQ(collector.states.size(), 2); // removals alone report nothing
+    if (collector.states.size() != 2) {
+        return;
+    }
+    const DecodedState& kitchen = collector.states[0].state;
+    CHECK(kitchen.has_state);
+    CHECK_STR(kitchen.state, "off");
+    CHECK(!kitchen.has_attributes);
+    CHECK_STR(kitchen.context_id, "01HXOFF");
+
+    // Attribute-only change: no state, and a quoted number does not count
+    const DecodedState& fan = collector.states[1].state;
+    CHECK(!fan.has_state);
+    CHECK(fan.has_attributes);
+    CHECK_EQ(fan.numbers_valid, 1 << StateNumberOffBrightness);
+    CHECK_EQ(fan.numbers[StateNumberOffBrightness], 0);
+}
+
+static void test_state_text() {
+    const std::string long_state(80, 'x');
+    const std::string json = R"({"type":"event","event":{"a":{"sensor.a":{"s":"line\nbreak \"quoted\""},"sensor.b":{"s":null},)"
+                             R"("sensor.c":{"s":")" + long_state + R"("},"sensor.d":{"s":"caf\u00e9"},"sensor.e":{"s":"café"}}}})";
+    Collector collector;
+    CHECK(decode(json, &collector) == StateDecodeResult::Decoded);
+    CHECK_EQ(collector.states.size(), 5);
+    if (collector.states.size() != 5) {
+        return;
+    }
+    CHECK_STR(collector.states[0].state.state, "line\nbreak \"quoted\"");
+    CHECK(collector.states[1].state.has_state);
+    CHECK_STR(collector.states[1].state.state, "");
+    CHECK_EQ(strlen(collector.states[2].state.state), STATE_DECODER_MAX_STATE_LEN - 1);
+    CHECK_STR(collector.states[3].state.state, "caf?"); // \u escapes are not decoded
+    CHECK_STR(collector.states[4].state.state, "café"); // raw UTF-8 passes through
+}
+
+// Turned-down and overlong ids are skipped whole, whatever their state holds
+static void test_want_filter() {
+    const std::string long_id = "sensor." + std::string(STATE_DECODER_MAX_ID_LEN, 'z');
+    const std::string json = R"({"type":"event","event":{"a":{"weather.home":{"s":"sunny","a":{"forecast":[{"t":"}{]["}]}},)"
+                             R"(")" + long_id + R"(":{"s":"1"},"switch.tv":{"s":"on"}}}})";
+    Collector collector;
+    collector.skip = "weather.home";
+    CHECK(decode(json, &collector) == StateDecodeResult::Decoded);
+    CHECK_EQ(collector.asked.size(), 2); // the overlong id never reaches want
+    CHECK_EQ(collector.states.size(), 1);
+    if (collector.states.size() == 1) {
+        CHECK_STR(collector.states[0].entity_id.c_str(), "switch.tv");
+    }
+}
+
+static void test_not_states() {
+    Collector collector;
+    CHECK(decode(R"({"id":3,"type":"result","success":true,"result":null})", &collector) == StateDecodeResult::NotStates);
+    CHECK(decode(R"({"id":4,"type":"event","event":{"event_type":"entity_registry_updated","data":{"action":"create"}}})",
+                 &collector) == StateDecodeResult::NotStates);
+    CHECK(decode(R"({"type":"auth_ok","ha_version":"2025.1.0"})", &collector) == StateDecodeResult::NotStates);
+    // "event" before "type" goes the generic way
+    CHECK(decode(R"({"event":{"a":{"light.x":{"s":"on"}}},"type":"event"})", &collector) == StateDecodeResult::NotStates);
+    CHECK(decode("", &collector) == StateDecodeResult::NotStates);
+    CHECK_EQ(collector.states.size(), 0);
+}
+
+static void test_malformed() {
+    const std::string json = R"({"type":"event","event":{"a":{"light.a":{"s":"on"},"light.b":{"s":"off","a":{"brightness":)";
+    Collector collector;
+    CHECK(decode(json, &collector) == StateDecodeResult::Malformed);
+    CHECK_EQ(collector.states.size(), 1); // states before the cut are kept
+    if (collector.states.size() == 1) {
+        CHECK_STR(collector.states[0].entity_id.c_str(), "light.a");
+    }
+
+    Collector broken;
+    CHECK(decode(R"({"type":"event","event":{"a":{"light.a" {"s":"on"}}}})", &broken) == StateDecodeResult::Malformed);
+    CHECK_EQ(broken.states.size(), 0);
+}
+
+int main() {
+    test_initial_states();
+    test_change_event();
+    test_state_text();
+    test_want_filter();
+    test_not_states();
+    test_malformed();
+    return host_check_exit("state_decoder");
+}